@@ -26,10 +26,16 @@
 #include <osgEarth/TileSource>
 #include <osgEarth/TileHandler>
 #include <osgEarth/TileVisitor>
+#include <osgEarth/CacheEstimator>
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ElevationLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/Progress>
 #include <osg/ArgumentParser>
 #include <osg/Timer>
+#include <osgDB/Registry>
+#include <OpenThreads/Atomic>
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
@@ -49,20 +55,51 @@ int usage(char** argv)
         << "\n    --min-level [int]                   : minimum level of detail"
         << "\n    --max-level [int]                   : maximum level of detail"
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
+        << "\n    --compress [processor]              : block-compress image tiles with an image processor (e.g. fastdxt)"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
+        << "\n    --threads [n]                       : number of threads to use"
+        << "\n    --journal [file]                    : record progress in a journal and resume from it if present"
+        << "\n    --order [depth|z|hilbert]           : tile traversal order; z and hilbert visit each level along a space-filling curve"
+        << "\n    --estimate                          : sample tiles from the input and print the estimated output size and time, then exit"
+        << "\n    --samples [n]                       : most tiles to sample per level with --estimate (default 100)"
+        << "\n    --confidence [c]                    : confidence level of the estimate (default 0.95)"
+        << "\n    --working-set [tiles]               : approximate number of tiles per chunk of a z or hilbert traversal"
         << std::endl;
 
     return 0;
 }
 
 
+// Block-compresses an image on the CPU if the user asked for it.
+// Returns a compressed copy, or the original image.
+osg::Image* compressImage(osg::Image* image, const std::string& processor)
+{
+    osg::Texture::InternalFormatMode mode;
+    if ( processor.empty() || !ImageUtils::computeCPUCompressionMode(image, mode) )
+        return image;
+
+    osg::Image* copy = ImageUtils::cloneImage(image);
+    ImageUtils::compressImage(copy, mode, processor);
+    return copy;
+}
+
+
+// How many image tiles were copied as-is, and how many had to be re-encoded.
+struct TileCounts
+{
+    OpenThreads::Atomic copied;
+    OpenThreads::Atomic encoded;
+};
+
+
 // TileHandler that copies images from one tilesource to another.
 struct TileSourceToTileSource : public TileHandler
 {
-    TileSourceToTileSource(TileSource* source, TileSource* dest, bool heightFields)
-        : _source(source), _dest(dest), _heightFields(heightFields)
+    TileSourceToTileSource(TileSource* source, TileSource* dest, bool heightFields, const std::string& compression, TileCounts& counts)
+        : _source(source), _dest(dest), _heightFields(heightFields), _compression(compression), _counts(counts)
     {
-        //nop
+        // the plugin that encodes the output, to recognize tiles already in its format
+        _destRW = osgDB::Registry::instance()->getReaderWriterForExtension( dest->getExtension() );
     }
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
@@ -78,7 +115,18 @@ struct TileSourceToTileSource : public TileHandler
         {
             osg::ref_ptr<osg::Image> image = _source->createImage(key);
             if ( image.valid() )
+            {
+                // the output stores the bytes the image was read from when they
+                // are already in its format and we aren't compressing:
+                std::string payload;
+                if ( _compression.empty() && ImageUtils::getEncodedPayload(image.get(), _destRW.get(), payload) )
+                    ++_counts.copied;
+                else
+                    ++_counts.encoded;
+
+                image = compressImage(image.get(), _compression);
                 ok = _dest->storeImage(key, image.get(), 0L);
+            }
         }
         return ok;
     }
@@ -91,6 +139,9 @@ struct TileSourceToTileSource : public TileHandler
     TileSource* _source;
     TileSource* _dest;
     bool        _heightFields;
+    std::string _compression;
+    TileCounts& _counts;
+    osg::ref_ptr<osgDB::ReaderWriter> _destRW;
 };
 
 
@@ -99,8 +150,8 @@ struct TileSourceToTileSource : public TileHandler
 // necessary to translate from one Profile/SRS to another.
 struct ImageLayerToTileSource : public TileHandler
 {
-    ImageLayerToTileSource(ImageLayer* source, TileSource* dest)
-        : _source(source), _dest(dest)
+    ImageLayerToTileSource(ImageLayer* source, TileSource* dest, const std::string& compression, TileCounts& counts)
+        : _source(source), _dest(dest), _compression(compression), _counts(counts)
     {
         //nop
     }
@@ -110,7 +161,12 @@ struct ImageLayerToTileSource : public TileHandler
         bool ok = false;
         GeoImage image = _source->createImage(key);
         if (image.valid())
-            ok = _dest->storeImage(key, image.getImage(), 0L);
+        {
+            // reprojected, so always re-encoded
+            ++_counts.encoded;
+            osg::ref_ptr<osg::Image> final = compressImage(image.getImage(), _compression);
+            ok = _dest->storeImage(key, final.get(), 0L);
+        }
 
         return ok;
     }
@@ -122,6 +178,8 @@ struct ImageLayerToTileSource : public TileHandler
 
     osg::ref_ptr<ImageLayer> _source;
     TileSource*              _dest;
+    std::string              _compression;
+    TileCounts&              _counts;
 };
 
 
@@ -172,6 +230,7 @@ struct ProgressReporter : public osgEarth::ProgressCallback
             << std::setprecision(1) << "\r"
             << (int)current << "/" << (int)total
             << " (" << percentage << "%)"
+            << (msg.empty() ? "" : " ") << msg
             << "                        "
             << std::flush;
 
@@ -211,7 +270,16 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --profile [profile]   : reproject to the target profile, e.g. "wgs84"
  *      --min-level [int]     : min level of detail to copy
  *      --max-level [int]     : max level of detail to copy
- *      --threads [n]         : threads to use (may crash. Careful.)
+ *      --threads [n]         : threads to use
+ *      --journal [file]      : progress journal; rerunning with the same file
+ *                              resumes an interrupted conversion
+ *      --order [name]        : traversal order: depth (default), z or hilbert
+ *      --working-set [tiles] : tiles per chunk of a z or hilbert traversal
+ *      --estimate            : sample the input and print the estimated output
+ *                              size and time, without converting anything
+ *      --compress [name]     : block-compress image tiles with the named image
+ *                              processor (e.g. fastdxt). The output driver must
+ *                              be able to store compressed images (e.g. format dds)
  *
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *
@@ -247,6 +315,15 @@ main(int argc, char** argv)
         dbo->setOptionString( str );
     }
 
+    // precompress image tiles?
+    std::string compression;
+    args.read("--compress", compression);
+
+    // ask the input to keep the bytes it reads, so tiles already in the
+    // output's format can be copied as-is; unless we're going to compress
+    // the images anyway:
+    ImageUtils::storeKeepEncodedPayloads( dbo.get(), compression.empty() );
+
     TileSourceOptions inOptions(inConf);
     osg::ref_ptr<TileSource> input = TileSourceFactory::create(inOptions);
     if ( !input.valid() )
@@ -349,11 +426,17 @@ main(int argc, char** argv)
         visitor = new TileVisitor();
     }
 
+    // what --estimate samples: the same reads the conversion will do
+    osg::ref_ptr<TileSampler> sampler;
+
+    TileCounts counts;
+
     // If the profiles are identical, just use a tile copier.
     if ( isSameProfile )
     {
         OE_NOTICE << LC << "Profiles match - initiating simple tile copy" << std::endl;
-        visitor->setTileHandler( new TileSourceToTileSource(input.get(), output.get(), heightFields) );
+        visitor->setTileHandler( new TileSourceToTileSource(input.get(), output.get(), heightFields, compression, counts) );
+        sampler = new TileSourceSampler(input.get(), heightFields);
     }
     else
     {
@@ -374,6 +457,7 @@ main(int argc, char** argv)
                 return -1;
             }
             visitor->setTileHandler( new ElevationLayerToTileSource(layer, output.get()) );
+            sampler = new TerrainLayerSampler(layer);
         }
         else
         {
@@ -389,7 +473,8 @@ main(int argc, char** argv)
                 OE_WARN << LC << "Input profile is not valid" << std::endl;
                 return -1;
             }
-            visitor->setTileHandler( new ImageLayerToTileSource(layer, output.get()) );
+            visitor->setTileHandler( new ImageLayerToTileSource(layer, output.get(), compression, counts) );
+            sampler = new TerrainLayerSampler(layer);
         }
     }
 
@@ -434,6 +519,79 @@ main(int argc, char** argv)
         visitor->addExtent( extent );
     }
 
+    // resume from (and keep) a progress journal?
+    std::string journalFile;
+    if ( args.read("--journal", journalFile) )
+    {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(journalFile);
+        if ( !journal->open() )
+            return -1;
+        visitor->setJournal( journal.get() );
+    }
+
+    // traversal order: keeps consecutive reads and writes close together
+    std::string order;
+    if ( args.read("--order", order) )
+    {
+        if ( order == "z" )
+            visitor->setTraversalOrder( TileVisitor::ORDER_Z );
+        else if ( order == "hilbert" )
+            visitor->setTraversalOrder( TileVisitor::ORDER_HILBERT );
+    }
+
+    unsigned int workingSet = 0;
+    if ( args.read("--working-set", workingSet) )
+        visitor->setWorkingSetSize( workingSet );
+
+    // measure a sample of tiles and extrapolate instead of converting?
+    if ( args.read("--estimate") )
+    {
+        CacheEstimator est;
+        est.setProfile( outputProfile.get() );
+        est.setMinLevel( visitor->getMinLevel() );
+        est.setMaxLevel( visitor->getMaxLevel() );
+        for(unsigned i=0; i<visitor->getExtents().size(); ++i)
+            est.addExtent( visitor->getExtents()[i].transform(outputProfile->getSRS()) );
+
+        unsigned samples = 0;
+        if ( args.read("--samples", samples) )
+            est.setMaxSamplesPerLevel( samples );
+
+        double confidence = 0.0;
+        if ( args.read("--confidence", confidence) )
+            est.setConfidence( confidence );
+
+        // size the tiles in the output's format when it names one
+        if ( outConf.hasValue("format") )
+            sampler->setFormat( outConf.value("format") );
+
+        std::cout << "Sampling..." << std::endl;
+        osg::ref_ptr<ProgressReporter> progress = new ProgressReporter();
+        if ( !est.sample(sampler.get(), progress.get()) )
+            return -1;
+
+        const std::vector<CacheEstimator::LevelEstimate>& levels = est.getLevelEstimates();
+        for(unsigned lod = est.getMinLevel(); lod < levels.size(); ++lod)
+        {
+            std::cout << "    Level " << lod << ": " << levels[lod].numTiles << " tiles, "
+                << levels[lod].numSampled << " sampled, "
+                << (int)(levels[lod].emptyRatio.value*100.0) << "% empty, "
+                << prettyPrintSize(levels[lod].sizeInMB.value) << ", "
+                << prettyPrintTime(levels[lod].timeInSeconds.value) << std::endl;
+        }
+
+        CacheEstimator::Interval size = est.getSizeInMBInterval();
+        CacheEstimator::Interval time = est.getTotalTimeInSecondsInterval();
+        std::cout
+            << "Tiles = " << est.getNumTiles() << std::endl
+            << "Size  = " << prettyPrintSize(size.value)
+            << " (" << prettyPrintSize(size.low) << " - " << prettyPrintSize(size.high) << ")" << std::endl
+            << "Time  = " << prettyPrintTime(time.value)
+            << " (" << prettyPrintTime(time.low) << " - " << prettyPrintTime(time.high) << ")"
+            << " on one thread, at " << (int)(est.getConfidence()*100.0 + 0.5) << "% confidence" << std::endl;
+        return 0;
+    }
+
     // Ready!!!
     std::cout << "Working..." << std::endl;
 
@@ -452,5 +610,24 @@ main(int argc, char** argv)
         << osg::Timer::instance()->delta_s(t0, t1)
         << " seconds." << std::endl;
 
+    if ( !heightFields )
+    {
+        std::cout
+            << "Tiles copied as-is = " << (unsigned)counts.copied
+            << ", re-encoded = " << (unsigned)counts.encoded << std::endl;
+    }
+
+    std::vector<TileVisitor::LevelStats> stats;
+    visitor->getLevelStats(stats);
+    for(unsigned lod=0; lod<stats.size(); ++lod)
+    {
+        if ( stats[lod].processed > 0 )
+        {
+            std::cout
+                << "Level " << lod << ": " << stats[lod].processed << " tiles, "
+                << stats[lod].tilesPerSecond() << " tiles/s" << std::endl;
+        }
+    }
+
     return 0;
 }
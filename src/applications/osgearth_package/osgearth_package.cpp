@@ -74,7 +74,12 @@ usage( const std::string& msg = "" )
         << "            [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "            [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "            [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
+        << "            [--journal <folder>]            ; Keep a progress journal per layer in this folder and resume from it if present" << std::endl
+        << "            [--order <depth|z|hilbert>]     ; Tile traversal order (default=depth). z and hilbert visit each level along a space-filling curve" << std::endl
+        << "            [--working-set <tiles>]         ; Approximate number of tiles per chunk of a z or hilbert traversal (default=4096)" << std::endl
         << "            [--alpha-mask]                  ; Mask out imagery that isn't in the provided extents." << std::endl
+        << "            [--compress <processor>]        ; Block-compress image tiles with an image processor (e.g. fastdxt); use with --ext dds" << std::endl
+        << "            [--no-dedup]                    ; Write every tile out in full, instead of hard-linking tiles identical to one already written" << std::endl
         << std::endl
         << "            [--verbose]                     ; Displays progress of the operation" << std::endl;
 
@@ -140,6 +145,15 @@ makeTMS( osg::ArgumentParser& args )
 
     bool verbose = args.read("--verbose");
 
+    std::string journalFolder;
+    args.read("--journal", journalFolder);
+
+    std::string order;
+    args.read("--order", order);
+
+    unsigned int workingSet = 0;
+    args.read("--working-set", workingSet);
+
     unsigned int batchSize = 0;
     args.read("--batchsize", batchSize);
 
@@ -200,6 +214,9 @@ makeTMS( osg::ArgumentParser& args )
     if( args.read( "--overwrite" ) )
         overwrite = true;
 
+    // whether to hard-link identical tiles
+    bool deduplicate = !args.read( "--no-dedup" );
+
     // write out an earth file
     std::string outEarth;
     args.read( "--out-earth", outEarth );
@@ -220,6 +237,10 @@ makeTMS( osg::ArgumentParser& args )
     //TODO:  Single color
     bool continueSingleColor = args.read( "--continue-single-color" );
 
+    // precompress image tiles
+    std::string compressionMethod;
+    args.read( "--compress", compressionMethod );
+
     // elevation pixel depth
     unsigned elevationPixelDepth = 32;
     args.read( "--elevation-pixel-depth", elevationPixelDepth );
@@ -314,6 +335,13 @@ makeTMS( osg::ArgumentParser& args )
     visitor->setMinLevel( minLevel );
     visitor->setMaxLevel( maxLevel );        
 
+    if ( order == "z" )
+        visitor->setTraversalOrder( TileVisitor::ORDER_Z );
+    else if ( order == "hilbert" )
+        visitor->setTraversalOrder( TileVisitor::ORDER_HILBERT );
+    if ( workingSet > 0 )
+        visitor->setWorkingSetSize( workingSet );
+
 
     for (unsigned int i = 0; i < bounds.size(); i++)
     {
@@ -333,6 +361,9 @@ makeTMS( osg::ArgumentParser& args )
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
     packager.setApplyAlphaMask(applyAlphaMask);
+    packager.setCompressionMethod(compressionMethod);
+    packager.setJournalFolder(journalFolder);
+    packager.setDeduplicate(deduplicate);
 
 
     // new map for an output earth file if necessary.
@@ -465,6 +496,17 @@ makeTMS( osg::ArgumentParser& args )
 
     }
 
+    if (verbose)
+    {
+        OE_NOTICE << LC << "Image tiles copied as-is: " << packager.getNumTilesCopied()
+            << ", re-encoded: " << packager.getNumTilesEncoded() << std::endl;
+    }
+
+    if (verbose && deduplicate)
+    {
+        OE_NOTICE << LC << "Identical tiles saved " << prettyPrintSize( (double)packager.getDeduplicator().getBytesSaved() / 1048576.0 ) << std::endl;
+    }
+
     // Write out an earth file if it was requested
     // Finally, write an earth file if requested:
     if( outMap.valid() )
@@ -202,7 +202,7 @@ void ExportDialog::updateEstimate()
     // Adjust everything by the # of layers
     unsigned int numLayers = terrainLayers.size(); //_mapNode->getMap()->getNumImageLayers() + _mapNode->getMap()->getNumElevationLayers();
     totalSeconds *= (double)numLayers;
-    unsigned int numTiles = est.getNumTiles() * numLayers;
+    unsigned long long numTiles = est.getNumTiles() * numLayers;
     double sizeMB = est.getSizeInMB() * (double)numLayers;
 
     std::string timeString = prettyPrintTime(totalSeconds);
@@ -50,6 +50,7 @@ using namespace osgEarth::Drivers;
 int list( osg::ArgumentParser& args );
 int seed( osg::ArgumentParser& args );
 int purge( osg::ArgumentParser& args );
+int compact( osg::ArgumentParser& args );
 int usage( const std::string& msg );
 int message( const std::string& msg );
 
@@ -65,6 +66,8 @@ int
         return list( args );
     else if ( args.read( "--purge" ) )
         return purge( args );        
+    else if ( args.read( "--compact" ) )
+        return compact( args );
     else
     return usage("");
 }
@@ -85,6 +88,9 @@ int
         << std::endl
         << "    --seed file.earth                   ; Seeds the cache in a .earth file"  << std::endl
         << "        [--estimate]                    ; Print out an estimation of the number of tiles, disk space and time it will take to perform this seed operation" << std::endl
+        << "        [--sample]                      ; With --estimate, measure a random sample of tiles from each layer instead of assuming a size and time per tile" << std::endl
+        << "        [--samples n]                   ; Most tiles to sample per level (default=100)" << std::endl
+        << "        [--confidence c]                ; Confidence level of the sampled estimate (default=0.95)" << std::endl
         << "        [--min-level level]             ; Lowest LOD level to seed (default=0)" << std::endl
         << "        [--max-level level]             ; Highest LOD level to seed (defaut=highest available)" << std::endl
         << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to seed (in map coordinates; default=entire map)" << std::endl
@@ -92,9 +98,15 @@ int
         << "        [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "        [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "        [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
+        << "        [--journal folder]              ; Keep a progress journal per layer in this folder and resume from it if present" << std::endl
+        << "        [--order depth|z|hilbert]       ; Tile traversal order (default=depth). z and hilbert visit each level along a space-filling curve" << std::endl
+        << "        [--working-set tiles]           ; Approximate number of tiles per chunk of a z or hilbert traversal (default=4096)" << std::endl
         << "        [--verbose]                     ; Displays progress of the seed operation" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
+        << std::endl
+        << "    --compact file.earth|folder         ; Stores identical tiles once, in the layer caches of a .earth file or in a folder" << std::endl
+        << "                                        ; of tiles (e.g. a TMS package), and reports the space reclaimed" << std::endl
         << std::endl;
 
     return -1;
@@ -109,6 +121,43 @@ int message( const std::string& msg )
     return 0;
 }
 
+void printLevelStats( const TileVisitor* visitor )
+{
+    std::vector< TileVisitor::LevelStats > stats;
+    visitor->getLevelStats( stats );
+    for (unsigned int lod = 0; lod < stats.size(); ++lod)
+    {
+        if (stats[lod].processed > 0)
+        {
+            std::cout << "    Level " << lod << ": " << stats[lod].processed << " tiles, "
+                << stats[lod].tilesPerSecond() << " tiles/s" << std::endl;
+        }
+    }
+}
+
+void printSampledEstimate( const CacheEstimator& est )
+{
+    const std::vector< CacheEstimator::LevelEstimate >& levels = est.getLevelEstimates();
+    for (unsigned int lod = est.getMinLevel(); lod < levels.size(); ++lod)
+    {
+        const CacheEstimator::LevelEstimate& level = levels[lod];
+        std::cout << "    Level " << lod << ": " << level.numTiles << " tiles, "
+            << level.numSampled << " sampled, "
+            << (int)(level.emptyRatio.value*100.0) << "% empty, "
+            << osgEarth::prettyPrintSize( level.sizeInMB.value ) << ", "
+            << osgEarth::prettyPrintTime( level.timeInSeconds.value ) << std::endl;
+    }
+
+    CacheEstimator::Interval size = est.getSizeInMBInterval();
+    CacheEstimator::Interval time = est.getTotalTimeInSecondsInterval();
+    std::cout
+        << "Size on disk:          " << osgEarth::prettyPrintSize( size.value )
+        << " (" << osgEarth::prettyPrintSize( size.low ) << " - " << osgEarth::prettyPrintSize( size.high ) << ")" << std::endl
+        << "Total time:            " << osgEarth::prettyPrintTime( time.value )
+        << " (" << osgEarth::prettyPrintTime( time.low ) << " - " << osgEarth::prettyPrintTime( time.high ) << ")" << std::endl
+        << "Confidence:            " << (int)(est.getConfidence()*100.0 + 0.5) << "%, single thread" << std::endl;
+}
+
 int
 seed( osg::ArgumentParser& args )
 {    
@@ -125,6 +174,14 @@ seed( osg::ArgumentParser& args )
     while (args.read("--max-level", maxLevel));
 
     bool estimate = args.read("--estimate");        
+
+    bool sample = args.read("--sample");
+
+    unsigned int samplesPerLevel = 0;
+    args.read("--samples", samplesPerLevel);
+
+    double confidence = 0.0;
+    args.read("--confidence", confidence);
     
 
     std::vector< Bounds > bounds;
@@ -142,6 +199,15 @@ seed( osg::ArgumentParser& args )
 
     bool verbose = args.read("--verbose");
 
+    std::string journalFolder;
+    args.read("--journal", journalFolder);
+
+    std::string order;
+    args.read("--order", order);
+
+    unsigned int workingSet = 0;
+    args.read("--working-set", workingSet);
+
     unsigned int batchSize = 0;
     args.read("--batchsize", batchSize);
 
@@ -212,7 +278,44 @@ seed( osg::ArgumentParser& args )
             est.addExtent( extent );
         } 
 
-        unsigned int numTiles = est.getNumTiles();
+        unsigned long long numTiles = est.getNumTiles();
+
+        if (sample)
+        {
+            if ( samplesPerLevel > 0 )
+                est.setMaxSamplesPerLevel( samplesPerLevel );
+            if ( confidence > 0.0 )
+                est.setConfidence( confidence );
+
+            // Sample the layers that would be seeded.
+            TerrainLayerVector layers;
+            if (imageLayerIndex >= 0)
+                layers.push_back( mapNode->getMap()->getLayerAt<ImageLayer>( imageLayerIndex ) );
+            else if (elevationLayerIndex >= 0)
+                layers.push_back( mapNode->getMap()->getLayerAt<ElevationLayer>( elevationLayerIndex ) );
+            else
+                mapNode->getMap()->getLayers( layers );
+
+            osg::ref_ptr< ProgressCallback > sampleProgress = verbose ? new ConsoleProgressCallback() : 0L;
+            for (unsigned int i = 0; i < layers.size(); ++i)
+            {
+                if ( !layers[i].valid() )
+                    continue;
+
+                std::cout << "Sampling layer " << layers[i]->getName() << std::endl;
+                osg::ref_ptr< TileSampler > sampler = new TerrainLayerSampler( layers[i].get() );
+                if ( !est.sample( sampler.get(), sampleProgress.get() ) )
+                    return 1;
+
+                std::cout << "Cache Estimation for " << layers[i]->getName() << std::endl
+                    << "---------------- " << std::endl
+                    << "Total number of tiles: " << numTiles << std::endl;
+                printSampledEstimate( est );
+                std::cout << std::endl;
+            }
+            return 0;
+        }
+
         double size = est.getSizeInMB();
         double time = est.getTotalTimeInSeconds();
         std::cout << "Cache Estimation " << std::endl
@@ -299,6 +402,13 @@ seed( osg::ArgumentParser& args )
     if ( maxLevel >= 0 )
         visitor->setMaxLevel( maxLevel );        
 
+    if ( order == "z" )
+        visitor->setTraversalOrder( TileVisitor::ORDER_Z );
+    else if ( order == "hilbert" )
+        visitor->setTraversalOrder( TileVisitor::ORDER_HILBERT );
+    if ( workingSet > 0 )
+        visitor->setWorkingSetSize( workingSet );
+
 
     for (unsigned int i = 0; i < bounds.size(); i++)
     {
@@ -311,6 +421,7 @@ seed( osg::ArgumentParser& args )
     // Initialize the seeder
     CacheSeed seeder;
     seeder.setVisitor(visitor.get());
+    seeder.setJournalFolder(journalFolder);
 
     osgEarth::Map* map = mapNode->getMap();
 
@@ -327,6 +438,7 @@ seed( osg::ArgumentParser& args )
             if (verbose)
             {
                 OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+                printLevelStats( visitor.get() );
             }    
         }
         else
@@ -349,6 +461,7 @@ seed( osg::ArgumentParser& args )
             if (verbose)
             {
                 OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+                printLevelStats( visitor.get() );
             }    
         }
         else
@@ -374,6 +487,7 @@ seed( osg::ArgumentParser& args )
             if (verbose)
             {
                 OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
+                printLevelStats( visitor.get() );
             }                
         }
 
@@ -589,4 +703,72 @@ purge( osg::ArgumentParser& args )
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+int
+compact( osg::ArgumentParser& args )
+{
+    // a folder of tiles, such as a TMS package: link identical files together.
+    if ( args.argc() > 1 && osgDB::fileType(args[1]) == osgDB::DIRECTORY )
+    {
+        std::string folder = args[1];
+
+        CollectFilesVisitor v;
+        v.traverse( folder );
+
+        FileDeduplicator dedup;
+        for( std::vector<std::string>::const_iterator i = v.filenames.begin(); i != v.filenames.end(); ++i )
+        {
+            dedup.add( *i );
+        }
+
+        std::cout
+            << "Compacted " << v.filenames.size() << " files in " << folder << "; reclaimed "
+            << prettyPrintSize( (double)dedup.getBytesSaved() / 1048576.0 ) << std::endl;
+
+        return 0;
+    }
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    Map* map = mapNode->getMap();
+
+    if ( !map->getCache() )
+        return message( "Earth file does not contain a cache." );
+
+    TerrainLayerVector layers;
+    map->getLayers( layers );
+
+    unsigned long long total = 0ull;
+    for( TerrainLayerVector::iterator i = layers.begin(); i != layers.end(); ++i )
+    {
+        TerrainLayer* layer = i->get();
+
+        CacheSettings* cacheSettings = layer->getCacheSettings();
+        CacheBin* bin = cacheSettings ? cacheSettings->getCacheBin() : 0L;
+        if ( !bin )
+        {
+            std::cout << "Layer \"" << layer->getName() << "\": no cache" << std::endl;
+            continue;
+        }
+
+        // share identical records, then let the cache release the space.
+        unsigned long long bytes = bin->deduplicate();
+        bin->compact();
+        total += bytes;
+
+        std::cout
+            << "Layer \"" << layer->getName() << "\": reclaimed "
+            << prettyPrintSize( (double)bytes / 1048576.0 ) << std::endl;
+    }
+
+    std::cout << "Total reclaimed: " << prettyPrintSize( (double)total / 1048576.0 ) << std::endl;
+
+    return 0;
+}
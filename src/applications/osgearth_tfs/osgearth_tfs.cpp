@@ -57,6 +57,7 @@ usage( const std::string& msg )
         << "    --crop             ; Crops features instead of doing a centroid check.  Features can be added to multiple tiles when cropping is enabled" << std::endl
         << "    --dest-srs         ; The destination SRS string in any format osgEarth can understand (wkt, proj4, epsg).  If none is specified the source data SRS will be used" << std::endl
         << "    --bounds minx miny maxx maxy ; The bounding box to use as Level 0.  Feature extent will be used by default" << std::endl
+        << "    --format           ; The tile format, json (default) or pbf (mapnik vector tiles)" << std::endl
         << std::endl;
 
     return -1;
@@ -111,6 +112,9 @@ int main(int argc, char** argv)
     std::string destSRS;
     while(arguments.read("--dest-srs", destSRS));
 
+    std::string format = "json";
+    while(arguments.read("--format", format));
+
     std::string grid;
     float gridSizeMeters = -1.0f;
     while (arguments.read("--grid", grid));
@@ -224,6 +228,7 @@ int main(int argc, char** argv)
         << "  OrderBy=" << queryOrderBy << std::endl
         << "  Method= " << method << std::endl
         << "  DestSRS= " << destSRS << std::endl
+        << "  Format= " << format << std::endl
         << std::endl;
 
     //buildTFS( features.get(), firstLevel, maxLevel, maxFeatures, destination, layer, description, query, cropMethod);
@@ -235,6 +240,7 @@ int main(int argc, char** argv)
     packager.setMethod( cropMethod );    
     packager.setDestSRS( destSRS );
     packager.setLod0Extent(ext);
+    packager.setFormat( format );
 
     packager.package( features, destination, layer, description );
     osg::Timer_t endTime = osg::Timer::instance()->tick();
@@ -321,6 +321,77 @@ CacheBin::writeNode(const std::string&    key,
 }
 
 
+#define PAYLOAD_MIME_TYPE "payload_mime_type"
+
+// marks a record holding the bytes of a StringObject
+#define STRING_MIME_TYPE "application/x-osgearth-string"
+
+bool
+CacheBin::getEncodedPayload(const osg::Object*    object,
+                            std::string&          data,
+                            Config&               metadata)
+{
+    const StringObject* str = dynamic_cast<const StringObject*>(object);
+    if ( str )
+    {
+        data = str->getString();
+        metadata.set( PAYLOAD_MIME_TYPE, STRING_MIME_TYPE );
+        return true;
+    }
+
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    std::string mimeType;
+    if ( !image || !ImageUtils::getEncodedPayload(image, data, mimeType) )
+        return false;
+
+    metadata.set( PAYLOAD_MIME_TYPE, mimeType );
+    return true;
+}
+
+bool
+CacheBin::isEncodedPayload(const Config& metadata)
+{
+    return metadata.hasValue( PAYLOAD_MIME_TYPE );
+}
+
+osg::Object*
+CacheBin::readEncodedPayload(const std::string&    data,
+                             const Config&         metadata,
+                             const osgDB::Options* dbo)
+{
+    std::string mimeType = metadata.value(PAYLOAD_MIME_TYPE);
+    if ( mimeType == STRING_MIME_TYPE )
+        return new StringObject( data );
+
+    osg::Image* image = ImageUtils::readEncodedPayload( data, mimeType, dbo );
+
+    // keep the bytes with the image so it can be copied on without re-encoding
+    if ( image )
+        ImageUtils::setEncodedPayload( image, data, mimeType );
+
+    return image;
+}
+
+// no serialized object or image format starts with a NUL byte
+#define BLOB_REFERENCE_PREFIX std::string("\0oeblob:", 8)
+
+std::string
+CacheBin::makeBlobReference(const std::string& hash)
+{
+    return BLOB_REFERENCE_PREFIX + hash;
+}
+
+bool
+CacheBin::getBlobReference(const std::string& value, std::string& hash)
+{
+    const std::string prefix = BLOB_REFERENCE_PREFIX;
+    if ( value.size() != prefix.size() + 64 || value.compare(0, prefix.size(), prefix) != 0 )
+        return false;
+
+    hash = value.substr( prefix.size() );
+    return true;
+}
+
 #undef  LC
 #define LC "[ReadImageFromCachePseudoLoader] "
 
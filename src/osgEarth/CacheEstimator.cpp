@@ -19,13 +19,190 @@
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/Registry>
 #include <osgEarth/TileKey>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/TileSource>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/Random>
+#include <osgEarth/StringUtils>
+#include <osgDB/Registry>
+#include <osg/Timer>
+#include <cmath>
+#include <set>
+#include <sstream>
+
+#define LC "[CacheEstimator] "
 
 using namespace osgEarth;
 
+//...................................................................
+
+unsigned
+TileSampler::getEncodedSize(const osg::Object* object, const std::string& format)
+{
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+    if ( !image && !hf )
+        return 0u;
+
+    // The caches store an image's original payload verbatim when there is one.
+    std::string data, mimeType;
+    if ( format.empty() && image && ImageUtils::getEncodedPayload(image, data, mimeType) )
+        return data.size();
+
+    osg::ref_ptr<osgDB::Options> options = Registry::instance()->cloneOrCreateOptions();
+    osgDB::ReaderWriter* rw = 0L;
+    if ( format.empty() )
+    {
+        rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+        options->setPluginStringData("Compressor", "zlib");
+    }
+    else
+    {
+        rw = osgDB::Registry::instance()->getReaderWriterForExtension(format);
+    }
+
+    if ( !rw )
+    {
+        OE_WARN << LC << "No plugin to encode \"" << (format.empty() ? "osgb" : format) << "\"" << std::endl;
+        return 0u;
+    }
+
+    std::stringstream buf;
+    osgDB::ReaderWriter::WriteResult r;
+    if ( image )
+    {
+        r = rw->writeImage(*image, buf, options.get());
+    }
+    else if ( format.empty() )
+    {
+        r = rw->writeObject(*hf, buf, options.get());
+    }
+    else
+    {
+        // image formats store heightfields as 32-bit float images
+        ImageToHeightFieldConverter conv;
+        osg::ref_ptr<osg::Image> hfImage = conv.convert(hf, 32);
+        if ( hfImage.valid() )
+            r = rw->writeImage(*hfImage.get(), buf, options.get());
+    }
+
+    return r.success() ? (unsigned)buf.str().size() : 0u;
+}
+
+//...................................................................
+
+TerrainLayerSampler::TerrainLayerSampler(TerrainLayer* layer) :
+_layer( layer )
+{
+    //nop
+}
+
+bool
+TerrainLayerSampler::hasData(const TileKey& key) const
+{
+    TileSource* ts = _layer->getTileSource();
+    return ts ? ts->hasData(key) : true;
+}
+
+bool
+TerrainLayerSampler::sample(const TileKey& key, unsigned& bytes, ProgressCallback* progress)
+{
+    if ( ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(_layer.get()) )
+    {
+        GeoImage image = imageLayer->createImage(key, progress);
+        if ( image.valid() )
+        {
+            bytes = getEncodedSize(image.getImage(), _format);
+            return true;
+        }
+    }
+    else if ( ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(_layer.get()) )
+    {
+        GeoHeightField hf = elevationLayer->createHeightField(key, progress);
+        if ( hf.valid() )
+        {
+            bytes = getEncodedSize(hf.getHeightField(), _format);
+            return true;
+        }
+    }
+    return false;
+}
+
+//...................................................................
+
+TileSourceSampler::TileSourceSampler(TileSource* source, bool heightFields) :
+_source( source ),
+_heightFields( heightFields )
+{
+    //nop
+}
+
+bool
+TileSourceSampler::hasData(const TileKey& key) const
+{
+    return _source->hasData(key);
+}
+
+bool
+TileSourceSampler::sample(const TileKey& key, unsigned& bytes, ProgressCallback* progress)
+{
+    osg::ref_ptr<osg::Object> tile;
+    if ( _heightFields )
+        tile = _source->createHeightField(key, 0L, progress);
+    else
+        tile = _source->createImage(key, 0L, progress);
+
+    if ( !tile.valid() )
+        return false;
+
+    bytes = getEncodedSize(tile.get(), _format);
+    return true;
+}
+
+//...................................................................
+
+namespace
+{
+    // Two-sided normal quantile for a confidence level
+    // (Abramowitz and Stegun 26.2.23, error < 4.5e-4)
+    double zScore(double confidence)
+    {
+        double p = 0.5*(1.0 - confidence);
+        double t = sqrt(-2.0*log(p));
+        return t - (2.515517 + 0.802853*t + 0.010328*t*t) /
+                   (1.0 + 1.432788*t + 0.189269*t*t + 0.001308*t*t*t);
+    }
+
+    // Mean and sample variance of a list of values
+    void meanAndVariance(const std::vector<double>& values, double& mean, double& variance)
+    {
+        mean = 0.0;
+        variance = 0.0;
+        if ( values.empty() )
+            return;
+        for(unsigned i=0; i<values.size(); ++i)
+            mean += values[i];
+        mean /= (double)values.size();
+        if ( values.size() < 2 )
+            return;
+        for(unsigned i=0; i<values.size(); ++i)
+            variance += (values[i]-mean)*(values[i]-mean);
+        variance /= (double)(values.size()-1);
+    }
+}
+
 CacheEstimator::CacheEstimator():
 _minLevel (0),
 _maxLevel (12),
-_profile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() )
+_profile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() ),
+_confidence( 0.95 ),
+_marginOfError( 0.1 ),
+_maxSamplesPerLevel( 100 ),
+_seed( 1 ),
+_sizeVariance( 0.0 ),
+_timeVariance( 0.0 )
 {    
     // By default we can give them a somewhat worse case estimate since it's going to be next to impossible to know what the real size of the data is going to be due to the fact that it's 
     // dependant on the dataset itself as well as compression.  So lets just default to about 130 kb per tile to start with.
@@ -43,38 +220,61 @@ CacheEstimator::addExtent( const GeoExtent& value)
     _extents.push_back( value );
 }
 
-unsigned int
-CacheEstimator::getNumTiles() const
+void
+CacheEstimator::setConfidence( double confidence )
 {
-    unsigned int total = 0;
+    _confidence = osg::clampBetween( confidence, 0.5, 0.999 );
+}
 
-    for (unsigned int level = _minLevel; level <= _maxLevel; level++)
-    {
-        double coverageRatio = 0.0;
+void
+CacheEstimator::getTileRanges( unsigned int level, std::vector<TileRange>& out ) const
+{
+    out.clear();
 
-        if (_extents.empty())
+    if (_extents.empty())
+    {
+        TileRange range;
+        range.x0 = range.y0 = 0;
+        _profile->getNumTiles( level, range.wide, range.high );
+        out.push_back( range );
+    }
+    else
+    {
+        for (std::vector< GeoExtent >::const_iterator itr = _extents.begin(); itr != _extents.end(); ++itr)
         {
-            unsigned int wide, high;
-            _profile->getNumTiles( level, wide, high );
-            total += (wide * high);
+            const GeoExtent& extent = *itr;
+
+            TileKey ll = _profile->createTileKey(extent.xMin(), extent.yMin(), level);
+            TileKey ur = _profile->createTileKey(extent.xMax(), extent.yMax(), level);
+
+            if (!ll.valid() || !ur.valid()) continue;
+
+            int tilesWide = ur.getTileX() - ll.getTileX() + 1;
+            int tilesHigh = ll.getTileY() - ur.getTileY() + 1;
+            if (tilesWide <= 0 || tilesHigh <= 0) continue;
+
+            TileRange range;
+            range.x0 = ll.getTileX();
+            range.y0 = ur.getTileY();
+            range.wide = tilesWide;
+            range.high = tilesHigh;
+            out.push_back( range );
         }
-        else
+    }
+}
+
+unsigned long long
+CacheEstimator::getNumTiles() const
+{
+    unsigned long long total = 0ull;
+    std::vector<TileRange> ranges;
+
+    for (unsigned int level = _minLevel; level <= _maxLevel; level++)
+    {
+        getTileRanges( level, ranges );
+        for (unsigned int i = 0; i < ranges.size(); ++i)
         {
-            for (std::vector< GeoExtent >::const_iterator itr = _extents.begin(); itr != _extents.end(); ++itr)
-            {
-                const GeoExtent& extent = *itr;
-                double boundsArea = extent.area();
-
-                TileKey ll = _profile->createTileKey(extent.xMin(), extent.yMin(), level);
-                TileKey ur = _profile->createTileKey(extent.xMax(), extent.yMax(), level);
-
-                if (!ll.valid() || !ur.valid()) continue;
-                
-                int tilesWide = ur.getTileX() - ll.getTileX() + 1;
-                int tilesHigh = ll.getTileY() - ur.getTileY() + 1;
-                int tilesAtLevel = tilesWide * tilesHigh;                
-                total += tilesAtLevel;
-            }
+            total += (unsigned long long)ranges[i].wide * ranges[i].high;
         }
     }
     return total;
@@ -82,13 +282,175 @@ CacheEstimator::getNumTiles() const
 
 double CacheEstimator::getSizeInMB() const
 {
-    return getNumTiles() * _sizeInMBPerTile;
+    return isSampled() ? getSizeInMBInterval().value : (double)getNumTiles() * _sizeInMBPerTile;
 }
 
 double CacheEstimator::getTotalTimeInSeconds() const
 {
-    return getNumTiles() * _timeInSecondsPerTile;
+    return isSampled() ? getTotalTimeInSecondsInterval().value : (double)getNumTiles() * _timeInSecondsPerTile;
+}
+
+CacheEstimator::Interval
+CacheEstimator::makeInterval( double total, double variance ) const
+{
+    double e = zScore( _confidence ) * sqrt( variance );
+    Interval result;
+    result.value = total;
+    result.low   = osg::maximum( total - e, 0.0 );
+    result.high  = total + e;
+    return result;
+}
+
+CacheEstimator::Interval
+CacheEstimator::getSizeInMBInterval() const
+{
+    if (!isSampled())
+    {
+        return makeInterval( getSizeInMB(), 0.0 );
+    }
+
+    double total = 0.0;
+    for (unsigned int i = 0; i < _levels.size(); ++i)
+    {
+        total += _levels[i].sizeInMB.value;
+    }
+    return makeInterval( total, _sizeVariance );
+}
+
+CacheEstimator::Interval
+CacheEstimator::getTotalTimeInSecondsInterval() const
+{
+    if (!isSampled())
+    {
+        return makeInterval( getTotalTimeInSeconds(), 0.0 );
+    }
+
+    double total = 0.0;
+    for (unsigned int i = 0; i < _levels.size(); ++i)
+    {
+        total += _levels[i].timeInSeconds.value;
+    }
+    return makeInterval( total, _timeVariance );
 }
 
+bool
+CacheEstimator::sample( TileSampler* sampler, ProgressCallback* progress )
+{
+    _levels.clear();
+    _sizeVariance = 0.0;
+    _timeVariance = 0.0;
 
+    if (!sampler || !_profile.valid() || _minLevel > _maxLevel)
+    {
+        return false;
+    }
 
+    // Tiles needed per level to pin the empty-tile ratio down to the margin
+    // of error; the finite population correction shrinks it on small levels.
+    double z = zScore( _confidence );
+    double margin = osg::maximum( _marginOfError, 0.001 );
+    double n0 = z*z*0.25 / (margin*margin);
+
+    std::vector<LevelEstimate> levels( _maxLevel+1 );
+    std::vector< std::vector<TileRange> > ranges( _maxLevel+1 );
+    unsigned int totalSamples = 0;
+    for (unsigned int level = _minLevel; level <= _maxLevel; ++level)
+    {
+        getTileRanges( level, ranges[level] );
+        unsigned long long count = 0ull;
+        for (unsigned int i = 0; i < ranges[level].size(); ++i)
+        {
+            count += (unsigned long long)ranges[level][i].wide * ranges[level][i].high;
+        }
+
+        levels[level].numTiles = count;
+        double numTiles = (double)count;
+        if (count > 0ull)
+        {
+            double n = ceil( n0 / (1.0 + (n0 - 1.0)/numTiles) );
+            levels[level].numSampled = (unsigned int)osg::minimum( osg::minimum( n, numTiles ), (double)_maxSamplesPerLevel );
+        }
+        totalSamples += levels[level].numSampled;
+    }
+
+    Random prng( _seed );
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    unsigned int done = 0;
+
+    for (unsigned int level = _minLevel; level <= _maxLevel; ++level)
+    {
+        LevelEstimate& est = levels[level];
+        if (est.numSampled == 0)
+            continue;
+
+        // Choose distinct tiles uniformly from the extents.
+        std::set<unsigned long long> picks;
+        while (picks.size() < est.numSampled)
+        {
+            unsigned long long index = (unsigned long long)( prng.next() * (double)est.numTiles );
+            picks.insert( osg::minimum( index, est.numTiles - 1ull ) );
+        }
+
+        std::vector<double> empty, bytes, seconds;
+        for (std::set<unsigned long long>::const_iterator p = picks.begin(); p != picks.end(); ++p)
+        {
+            if (progress && progress->isCanceled())
+            {
+                return false;
+            }
+
+            unsigned long long index = *p;
+            unsigned int r = 0;
+            while (index >= (unsigned long long)ranges[level][r].wide * ranges[level][r].high)
+            {
+                index -= (unsigned long long)ranges[level][r].wide * ranges[level][r].high;
+                ++r;
+            }
+            const TileRange& range = ranges[level][r];
+            TileKey key( level, range.x0 + (unsigned int)(index % range.wide), range.y0 + (unsigned int)(index / range.wide), _profile.get() );
+
+            unsigned int tileBytes = 0;
+            osg::Timer_t t0 = osg::Timer::instance()->tick();
+            bool ok = sampler->hasData( key ) && sampler->sample( key, tileBytes, progress );
+            double t = osg::Timer::instance()->delta_s( t0, osg::Timer::instance()->tick() );
+
+            empty.push_back( ok ? 0.0 : 1.0 );
+            bytes.push_back( ok ? (double)tileBytes : 0.0 );
+            seconds.push_back( t );
+            if (!ok)
+                ++est.numEmpty;
+
+            if (progress)
+            {
+                ++done;
+                double elapsed = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+                progress->reportProgress( done, totalSamples, Stringify() << "level " << level << ", " << prettyPrintTime(elapsed) );
+            }
+        }
+
+        // Extrapolate the sample means to the level, with the variance of a
+        // simple random sample drawn without replacement.
+        double N = (double)est.numTiles, n = (double)est.numSampled;
+        double fpc = N > 1.0 ? (N - n) / N : 0.0;
+        double mean, variance;
+
+        meanAndVariance( empty, mean, variance );
+        est.emptyRatio = makeInterval( mean, fpc * variance / n );
+        est.emptyRatio.high = osg::minimum( est.emptyRatio.high, 1.0 );
+
+        const double toMB = 1.0 / (1024.0*1024.0);
+        meanAndVariance( bytes, mean, variance );
+        est.sizeInMB = makeInterval( N * mean * toMB, N * N * fpc * variance / n * toMB * toMB );
+        _sizeVariance += N * N * fpc * variance / n * toMB * toMB;
+
+        meanAndVariance( seconds, mean, variance );
+        est.timeInSeconds = makeInterval( N * mean, N * N * fpc * variance / n );
+        _timeVariance += N * N * fpc * variance / n;
+
+        OE_INFO << LC << "Level " << level << ": " << est.numSampled << " of " << est.numTiles << " tiles sampled, "
+            << est.numEmpty << " empty" << std::endl;
+    }
+
+    _levels.swap( levels );
+    return true;
+}
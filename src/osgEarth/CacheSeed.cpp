@@ -126,6 +126,16 @@ void CacheSeed::setVisitor(TileVisitor* visitor)
 
 void CacheSeed::run( TerrainLayer* layer, const Map* map )
 {
+    osg::ref_ptr<TileJournal> journal;
+    if ( !_journalFolder.empty() )
+    {
+        journal = new TileJournal( TileJournal::getPathForLayer(_journalFolder, layer) );
+        if ( !journal->open() )
+            journal = 0L;
+    }
+
+    _visitor->setJournal( journal.get() );
     _visitor->setTileHandler( new CacheTileHandler( layer, map ) );
     _visitor->run( map->getProfile() );
+    _visitor->setJournal( 0L );
 }
\ No newline at end of file
@@ -266,7 +266,8 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
         }
 
         // Make it from the source:
-        result = source->createHeightField( key, getOrCreatePreCacheOp(), progress );
+        ReadResult r = source->readHeightField( key, getOrCreatePreCacheOp(), progress );
+        result = r.release<osg::HeightField>();
    
         // If the result is good, we how have a heightfield but it's vertical values
         // are still relative to the tile source's vertical datum. Convert them.
@@ -283,13 +284,14 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
         }
         
         // Blacklist the tile if it is the same projection as the source and
-        // we can't get it and it wasn't cancelled
+        // we can't get it and it wasn't cancelled. Only keep it across sessions
+        // if the source said outright that the tile does not exist.
         if (result == 0L)
         {
             if ( progress == 0L ||
                  ( !progress->isCanceled() && !progress->needsRetry() ) )
             {
-                source->getBlacklist()->add( key );
+                source->getBlacklist()->add( key, r.code() == ReadResult::RESULT_NOT_FOUND );
             }
         }
     }
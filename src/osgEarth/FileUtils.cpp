@@ -30,9 +30,11 @@
 
 #ifdef WIN32
 #  include <windows.h>
+#  include <io.h>
 #else
 #  include <stdio.h>
 #  include <stdlib.h>
+#  include <unistd.h>
 #endif
 
 #include <sys/types.h>
@@ -48,6 +50,7 @@
 
 #include <list>
 #include <sstream>
+#include <fstream>
 
 // currently this impl is for _all_ platforms, except as defined.
 // the mac version will change soon to reflect the path scheme under osx, but
@@ -438,6 +441,150 @@ osgEarth::getLastModifiedTime(const std::string& path)
 }
 
 
+
+bool
+osgEarth::linkFile(const std::string& existing, const std::string& link)
+{
+#ifdef WIN32
+    return CreateHardLinkA( link.c_str(), existing.c_str(), NULL ) != 0;
+#else
+    return ::link( existing.c_str(), link.c_str() ) == 0;
+#endif
+}
+
+
+unsigned
+osgEarth::getLinkCount(const std::string& path)
+{
+#ifdef WIN32
+    HANDLE h = CreateFileA( path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( h == INVALID_HANDLE_VALUE )
+        return 0u;
+    BY_HANDLE_FILE_INFORMATION info;
+    unsigned count = GetFileInformationByHandle( h, &info ) ? (unsigned)info.nNumberOfLinks : 0u;
+    CloseHandle( h );
+    return count;
+#else
+    struct stat buf;
+    if ( stat(path.c_str(), &buf) == 0 )
+        return (unsigned)buf.st_nlink;
+    else
+        return 0u;
+#endif
+}
+
+
+/**************************************************/
+FileDeduplicator::FileDeduplicator() :
+_minSize( 128u ),
+_saved  ( 0ull )
+{
+}
+
+bool
+FileDeduplicator::write(const std::string& path, const std::string& data)
+{
+    // never write through a name that may share its data with other files
+    ::unlink( path.c_str() );
+    forget( path );
+
+    std::string hash;
+    if ( data.size() >= _minSize )
+    {
+        hash = contentHash( data );
+
+        Threading::ScopedMutexLock lock( _mutex );
+        std::map<std::string, std::string>::const_iterator i = _paths.find( hash );
+        if ( i != _paths.end() && linkFile(i->second, path) )
+        {
+            _saved += data.size();
+            return true;
+        }
+    }
+
+    std::ofstream out( path.c_str(), std::ios::out | std::ios::binary );
+    if ( !out.is_open() )
+        return false;
+    out.write( data.data(), data.size() );
+    out.close();
+    if ( out.fail() )
+        return false;
+
+    if ( !hash.empty() )
+    {
+        // the first file with this content (or the one that replaces it
+        // after it was removed) is what later copies link to.
+        Threading::ScopedMutexLock lock( _mutex );
+        _paths[hash] = path;
+        _hashes[path] = hash;
+    }
+    return true;
+}
+
+void
+FileDeduplicator::forget(const std::string& path)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    std::map<std::string, std::string>::iterator i = _hashes.find( path );
+    if ( i != _hashes.end() )
+    {
+        _paths.erase( i->second );
+        _hashes.erase( i );
+    }
+}
+
+unsigned long long
+FileDeduplicator::add(const std::string& path)
+{
+    std::ifstream in( path.c_str(), std::ios::in | std::ios::binary );
+    if ( !in.is_open() )
+        return 0ull;
+    std::stringstream buf;
+    buf << in.rdbuf();
+    in.close();
+
+    std::string data = buf.str();
+    if ( data.size() < _minSize )
+        return 0ull;
+
+    std::string hash = contentHash( data );
+    forget( path );
+
+    Threading::ScopedMutexLock lock( _mutex );
+    std::map<std::string, std::string>::const_iterator i = _paths.find( hash );
+    if ( i == _paths.end() )
+    {
+        _paths[hash] = path;
+        _hashes[path] = hash;
+        return 0ull;
+    }
+
+    // the file's own data is only freed if this was its last name.
+    unsigned long long reclaimed = getLinkCount(path) == 1u ? (unsigned long long)data.size() : 0ull;
+
+    // link under a temporary name first so the file is never missing.
+    std::string temp = path + ".dedup";
+    if ( !linkFile(i->second, temp) )
+        return 0ull;
+
+#ifdef WIN32
+    ::unlink( path.c_str() );
+#endif
+    bool renamed = ::rename(temp.c_str(), path.c_str()) == 0;
+
+    // renaming onto another name of the same data does nothing
+    if ( osgDB::fileExists(temp) )
+        ::unlink( temp.c_str() );
+
+    if ( !renamed )
+        return 0ull;
+
+    _saved += reclaimed;
+    return reclaimed;
+}
+
+
 /**************************************************/
 DirectoryVisitor::DirectoryVisitor()
 {
@@ -22,17 +22,21 @@
 #include <osgEarth/Progress>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/ThreadingUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
 #include <osg/Notify>
 #include <osg/Timer>
+#include <osg/Math>
 #include <string.h>
 #include <sstream>
 #include <fstream>
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <deque>
 #include <curl/curl.h>
 
 // Whether to use WinInet instead of cURL - CMAKE option
@@ -125,12 +129,12 @@ namespace osgEarth
 
         void writeHeader(const char* ptr, size_t realsize)
         {
-            std::string header(ptr);
-            StringTokenizer tok(":");
-            StringVector tized;
-            tok.tokenize(header, tized);
-            if ( tized.size() >= 2 )
-                _headers[tized[0]] = tized[1];
+            // split on the first colon only; values like dates and quoted
+            // entity tags must come through intact.
+            std::string header(ptr, realsize);
+            std::string::size_type colon = header.find(':');
+            if ( colon != std::string::npos && colon > 0 )
+                _headers[trim(header.substr(0, colon))] = trim(header.substr(colon+1));
         }
 
         std::ostream* _stream;
@@ -182,6 +186,21 @@ static int CurlProgressCallback(void *clientp,double dltotal,double dlnow,double
 
 /****************************************************************************/
 
+HTTPHostMetrics::HTTPHostMetrics() :
+inFlight      ( 0u ),
+queued        ( 0u ),
+completed     ( 0u ),
+newConnections( 0u ),
+reuseRatio    ( 0.0 ),
+latencyP50    ( 0.0 ),
+latencyP90    ( 0.0 ),
+latencyP99    ( 0.0 )
+{
+    //nop
+}
+
+/****************************************************************************/
+
 HTTPRequest::HTTPRequest( const std::string& url )
 : _url( url )
 {
@@ -245,6 +264,11 @@ void HTTPRequest::setLastModified( const DateTime &lastModified)
     addHeader("If-Modified-Since", lastModified.asRFC1123());
 }
 
+void HTTPRequest::setETag( const std::string& etag )
+{
+    addHeader("If-None-Match", etag);
+}
+
 
 std::string
 HTTPRequest::getURL() const
@@ -358,10 +382,374 @@ HTTPResponse::getHeadersAsConfig() const
 #define USER_AGENT "osgearth" QUOTE(OSGEARTH_MAJOR_VERSION) "." QUOTE(OSGEARTH_MINOR_VERSION)
 
 
+namespace
+{
+    // Number of recent transfer times kept per host for the latency percentiles
+    const unsigned MAX_LATENCY_SAMPLES = 256;
+
+    /**
+     * Gets the "scheme://host:port" key used to group transfers by host.
+     */
+    std::string getHostKey(const std::string& url)
+    {
+        std::string::size_type p = url.find("://");
+        std::string scheme = p != std::string::npos ? toLower(url.substr(0, p)) : "http";
+        std::string::size_type start = p != std::string::npos ? p+3 : 0;
+        std::string::size_type end = url.find_first_of("/?#", start);
+        std::string authority = url.substr(start, end != std::string::npos ? end-start : std::string::npos);
+
+        // strip any user info:
+        std::string::size_type at = authority.find_last_of('@');
+        if ( at != std::string::npos )
+            authority = authority.substr(at+1);
+
+        std::string::size_type colon = authority.find_last_of(':');
+        if ( colon == std::string::npos || authority.find(']', colon) != std::string::npos )
+            authority += scheme == "https" ? ":443" : ":80";
+
+        return scheme + "://" + toLower(authority);
+    }
+
+    /**
+     * One pending or active transfer. Lives on the stack of the thread that
+     * called TransferEngine::perform, which blocks until the transfer is done.
+     */
+    struct Transfer
+    {
+        Transfer(CURL* handle, ProgressCallback* progress) :
+            _handle(handle), _progress(progress), _result(CURLE_OK) { }
+
+        CURL*             _handle;
+        ProgressCallback* _progress;
+        CURLcode          _result;
+        Threading::Event  _done;
+    };
+
+    /**
+     * Per-host queue and statistics.
+     */
+    struct HostState
+    {
+        HostState() : _inFlight(0u), _completed(0u), _newConnections(0u), _nextSample(0u) { }
+
+        void addLatency(double t)
+        {
+            if ( _latencies.size() < MAX_LATENCY_SAMPLES )
+                _latencies.push_back(t);
+            else
+                _latencies[_nextSample] = t;
+            _nextSample = (_nextSample+1) % MAX_LATENCY_SAMPLES;
+        }
+
+        std::deque<Transfer*> _queue;
+        unsigned              _inFlight;
+        unsigned              _completed;
+        unsigned              _newConnections;
+        std::vector<double>   _latencies;
+        unsigned              _nextSample;
+    };
+
+    /**
+     * Runs all HTTP transfers on a single curl "multi" handle serviced by
+     * one I/O thread. The multi handle owns a connection pool shared by every
+     * calling thread, and multiplexes concurrent requests over HTTP/2 where
+     * the server allows it. Callers still see a blocking API: perform() hands
+     * over a fully configured easy handle and waits for it to finish.
+     */
+    class TransferEngine : public OpenThreads::Thread
+    {
+    public:
+        TransferEngine() :
+            _multi(0L),
+            _maxPerHost(8u),
+            _maxPerHostChanged(false),
+            _done(false)
+        {
+            const char* maxEnv = ::getenv("OSGEARTH_HTTP_MAX_CONNECTIONS_PER_HOST");
+            if ( maxEnv )
+                _maxPerHost = osg::maximum(1u, as<unsigned>(std::string(maxEnv), 8u));
+        }
+
+        virtual ~TransferEngine()
+        {
+            // last resort; HTTPClient::globalShutdown should have done this.
+            stop();
+        }
+
+        /** Stops the I/O thread and releases the multi handle and its connections. */
+        void stop()
+        {
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                if ( !_multi || _done )
+                    return;
+                _done = true;
+            }
+
+            wake();
+            join();
+
+            Threading::ScopedMutexLock lock(_mutex);
+            curl_multi_cleanup(_multi);
+            _multi = 0L;
+            _done = false;
+        }
+
+        /** Runs a configured easy handle to completion and returns the curl result. */
+        CURLcode perform(CURL* handle, const std::string& host, ProgressCallback* progress)
+        {
+            Transfer transfer(handle, progress);
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+
+                // shutting down; nobody would service the queue.
+                if ( _done )
+                    return CURLE_ABORTED_BY_CALLBACK;
+
+                if ( !_multi )
+                    startImpl();
+                _hosts[host]._queue.push_back(&transfer);
+            }
+            wake();
+            while( !transfer._done.wait(1000u) ) { }
+            return transfer._result;
+        }
+
+        unsigned getMaxPerHost() const
+        {
+            return _maxPerHost;
+        }
+
+        void setMaxPerHost(unsigned value)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _maxPerHost = osg::maximum(1u, value);
+            _maxPerHostChanged = true;
+        }
+
+        void getMetrics(HTTPHostMetricsMap& out)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            for(std::map<std::string, HostState>::const_iterator i = _hosts.begin(); i != _hosts.end(); ++i)
+            {
+                const HostState& state = i->second;
+                HTTPHostMetrics& m = out[i->first];
+                m.inFlight = state._inFlight;
+                m.queued = state._queue.size();
+                m.completed = state._completed;
+                m.newConnections = state._newConnections;
+                m.reuseRatio = state._completed > 0u ?
+                    (double)(state._completed - osg::minimum(state._completed, state._newConnections)) / (double)state._completed :
+                    0.0;
+
+                if ( !state._latencies.empty() )
+                {
+                    std::vector<double> sorted(state._latencies);
+                    std::sort(sorted.begin(), sorted.end());
+                    unsigned last = sorted.size()-1;
+                    m.latencyP50 = sorted[(unsigned)(0.50*last + 0.5)];
+                    m.latencyP90 = sorted[(unsigned)(0.90*last + 0.5)];
+                    m.latencyP99 = sorted[(unsigned)(0.99*last + 0.5)];
+                }
+            }
+        }
+
+    public: // OpenThreads::Thread
+
+        void run()
+        {
+            while( !_done )
+            {
+                admit();
+
+                int running = 0;
+                curl_multi_perform(_multi, &running);
+
+                int remaining = 0;
+                while( CURLMsg* msg = curl_multi_info_read(_multi, &remaining) )
+                {
+                    if ( msg->msg == CURLMSG_DONE )
+                    {
+                        CURL* handle = msg->easy_handle;
+                        CURLcode result = msg->data.result;
+                        curl_multi_remove_handle(_multi, handle);
+                        complete(handle, result);
+                    }
+                }
+
+                if ( _active.empty() )
+                {
+                    // idle; sleep until perform() has something for us.
+                    _wake.wait(100u);
+                    _wake.reset();
+                }
+                else
+                {
+#if LIBCURL_VERSION_NUM >= 0x074400
+                    curl_multi_poll(_multi, 0L, 0u, 100, 0L);
+#else
+                    // no way to interrupt the wait on older curl, so keep it short
+                    curl_multi_wait(_multi, 0L, 0u, 10, 0L);
+#endif
+                }
+            }
+
+            // release anyone still waiting.
+            for(std::map<CURL*, Transfer*>::iterator i = _active.begin(); i != _active.end(); ++i)
+            {
+                curl_multi_remove_handle(_multi, i->first);
+                i->second->_result = CURLE_ABORTED_BY_CALLBACK;
+                i->second->_done.set();
+            }
+            _active.clear();
+
+            Threading::ScopedMutexLock lock(_mutex);
+            for(std::map<std::string, HostState>::iterator h = _hosts.begin(); h != _hosts.end(); ++h)
+            {
+                while( !h->second._queue.empty() )
+                {
+                    Transfer* t = h->second._queue.front();
+                    h->second._queue.pop_front();
+                    t->_result = CURLE_ABORTED_BY_CALLBACK;
+                    t->_done.set();
+                }
+            }
+        }
+
+    private:
+
+        // call with _mutex locked.
+        void startImpl()
+        {
+            _multi = curl_multi_init();
+#if LIBCURL_VERSION_NUM >= 0x072b00
+            curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071e00
+            curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)_maxPerHost);
+            _maxPerHostChanged = false;
+#endif
+            curl_multi_setopt(_multi, CURLMOPT_MAXCONNECTS, 64L);
+            start();
+        }
+
+        void wake()
+        {
+            _wake.set();
+#if LIBCURL_VERSION_NUM >= 0x074400
+            if ( _multi )
+                curl_multi_wakeup(_multi);
+#endif
+        }
+
+        // Moves queued transfers onto the multi handle as per-host slots open up.
+        void admit()
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+            if ( _maxPerHostChanged )
+            {
+                curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)_maxPerHost);
+                _maxPerHostChanged = false;
+            }
+#endif
+
+            for(std::map<std::string, HostState>::iterator h = _hosts.begin(); h != _hosts.end(); ++h)
+            {
+                HostState& state = h->second;
+
+                // curl only polls the progress function of active transfers,
+                // so check the queued ones for cancelation here.
+                for(std::deque<Transfer*>::iterator q = state._queue.begin(); q != state._queue.end(); )
+                {
+                    Transfer* t = *q;
+                    if ( t->_progress && t->_progress->isCanceled() )
+                    {
+                        q = state._queue.erase(q);
+                        t->_result = CURLE_ABORTED_BY_CALLBACK;
+                        t->_done.set();
+                    }
+                    else ++q;
+                }
+
+                while( state._inFlight < _maxPerHost && !state._queue.empty() )
+                {
+                    Transfer* t = state._queue.front();
+                    state._queue.pop_front();
+
+                    CURLMcode code = curl_multi_add_handle(_multi, t->_handle);
+                    if ( code != CURLM_OK )
+                    {
+                        OE_WARN << LC << "Failed to start transfer to " << h->first << ": " << curl_multi_strerror(code) << std::endl;
+                        t->_result = CURLE_FAILED_INIT;
+                        t->_done.set();
+                    }
+                    else
+                    {
+                        _active[t->_handle] = t;
+                        _hostOf[t->_handle] = h->first;
+                        state._inFlight++;
+                    }
+                }
+            }
+        }
+
+        void complete(CURL* handle, CURLcode result)
+        {
+            std::map<CURL*, Transfer*>::iterator i = _active.find(handle);
+            if ( i == _active.end() )
+                return;
+
+            Transfer* t = i->second;
+            _active.erase(i);
+
+            long numConnects = 0L;
+            curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &numConnects);
+            double totalTime = 0.0;
+            curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &totalTime);
+
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                std::map<CURL*, std::string>::iterator h = _hostOf.find(handle);
+                if ( h != _hostOf.end() )
+                {
+                    HostState& state = _hosts[h->second];
+                    state._inFlight--;
+                    state._completed++;
+                    if ( numConnects > 0L )
+                        state._newConnections++;
+                    state.addLatency(totalTime);
+                    _hostOf.erase(h);
+                }
+            }
+
+            // the transfer lives on the caller's stack; don't touch it after this.
+            t->_result = result;
+            t->_done.set();
+        }
+
+        CURLM*                             _multi;
+        Threading::Mutex                   _mutex;
+        Threading::Event                   _wake;
+        std::map<std::string, HostState>   _hosts;
+        std::map<CURL*, Transfer*>         _active;   // I/O thread only
+        std::map<CURL*, std::string>       _hostOf;
+        unsigned                           _maxPerHost;
+        bool                               _maxPerHostChanged;
+        volatile bool                      _done;
+    };
+}
+
 namespace
 {
     // TODO: consider moving this stuff into the osgEarth::Registry;
     // don't like it here in the global scope
+    // shared transfer engine; declared ahead of the per-thread clients so
+    // that it outlives their curl handles during static destruction
+    static TransferEngine              s_transferEngine;
+    static bool                        s_useTransferEngine = true;
+
     // per-thread client map (must be global scope)
     static PerThread<HTTPClient>       s_clientPerThread;
 
@@ -437,6 +825,12 @@ HTTPClient::initializeImpl()
         _simResponseCode = 503L; // SERVICE UNAVAILABLE
     }
 
+    // Falls back on one blocking transfer per thread (for testing)
+    if ( ::getenv("OSGEARTH_HTTP_DISABLE_MULTI") )
+    {
+        s_useTransferEngine = false;
+    }
+
     // Dumps out HTTP request/response info
     if ( ::getenv("OSGEARTH_HTTP_DEBUG") )
     {
@@ -459,6 +853,19 @@ HTTPClient::initializeImpl()
     // Note that you must have curl built against zlib to support gzip or deflate encoding.
     curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "");
 
+    // With the shared transfer engine, negotiate HTTP/2 over TLS and prefer
+    // waiting for a multiplexed stream on an existing connection over opening
+    // a new one. The blocking fallback has nothing to multiplex with.
+    if ( s_useTransferEngine )
+    {
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        curl_easy_setopt( _curl_handle, CURLOPT_PIPEWAIT, 1L );
+#endif
+    }
+
     osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
     if (curlConfigHandler.valid()) {
         curlConfigHandler->onInitialize(_curl_handle);
@@ -545,12 +952,33 @@ void HTTPClient::setCurlConfighandler(CurlConfigHandler* handler)
     s_curlConfigHandler = handler;
 }
 
+unsigned HTTPClient::getMaxConnectionsPerHost()
+{
+    return s_transferEngine.getMaxPerHost();
+}
+
+void HTTPClient::setMaxConnectionsPerHost( unsigned value )
+{
+    s_transferEngine.setMaxPerHost( value );
+}
+
+void HTTPClient::getHostMetrics( HTTPHostMetricsMap& out )
+{
+    s_transferEngine.getMetrics( out );
+}
+
 void
 HTTPClient::globalInit()
 {
     curl_global_init(CURL_GLOBAL_ALL);
 }
 
+void
+HTTPClient::globalShutdown()
+{
+    s_transferEngine.stop();
+}
+
 void
 HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
 {
@@ -1171,7 +1599,10 @@ HTTPClient::doGet(const HTTPRequest&    request,
             curlConfigHandler->onGet(_curl_handle);
         }
 
-        res = curl_easy_perform(_curl_handle);
+        if ( s_useTransferEngine )
+            res = s_transferEngine.perform( _curl_handle, getHostKey(url), progress );
+        else
+            res = curl_easy_perform( _curl_handle );
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
         curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
 
@@ -1417,7 +1848,19 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
             osgDB::ReaderWriter::ReadResult rr = reader->readImage(response.getPartStream(0), options);
             if ( rr.validImage() )
             {
-                result = ReadResult(rr.takeImage());
+                osg::Image* image = rr.takeImage();
+
+                // Keep the encoded bytes with the image so a cache can store
+                // them as-is, provided the read options ask for them and they can
+                // be decoded again by mime type.
+                const std::string& mimeType = response.getMimeType();
+                if ( ImageUtils::getKeepEncodedPayloads(options) &&
+                     !mimeType.empty() && osgDB::Registry::instance()->getReaderWriterForMimeType(mimeType) )
+                {
+                    ImageUtils::setEncodedPayload( image, response.getPartAsString(0), mimeType );
+                }
+
+                result = ReadResult(image);
             }
             else
             {
@@ -85,6 +85,7 @@ ImageLayerOptions::setDefaults()
     _minRange.init( 0.0 );
     _maxRange.init( FLT_MAX );
     _featherPixels.init( false );
+    _bakeColorFilters.init( false );
     _minFilter.init( osg::Texture::LINEAR_MIPMAP_LINEAR );
     _magFilter.init( osg::Texture::LINEAR );
     _texcomp.init( osg::Texture::USE_IMAGE_DATA_FORMAT ); // none
@@ -109,6 +110,7 @@ ImageLayerOptions::fromConfig(const Config& conf)
     conf.getIfSet( "shared",         _shared );
     conf.getIfSet( "coverage",       _coverage );
     conf.getIfSet( "feather_pixels", _featherPixels);
+    conf.getIfSet( "bake_color_filters", _bakeColorFilters );
 
     if ( conf.hasValue( "transparent_color" ) )
         _transparentColor = stringToColor( conf.value( "transparent_color" ), osg::Vec4ub(0,0,0,0));
@@ -155,6 +157,7 @@ ImageLayerOptions::getConfig(bool isolate) const
     conf.updateIfSet( "shared",         _shared );
     conf.updateIfSet( "coverage",       _coverage );
     conf.updateIfSet( "feather_pixels", _featherPixels );
+    conf.updateIfSet( "bake_color_filters", _bakeColorFilters );
 
     if (_transparentColor.isSet())
         conf.update("transparent_color", colorToString( _transparentColor.value()));
@@ -218,6 +221,25 @@ namespace
             return equiv;
         }
     };
+
+    // True if the options ask for CPU color filtering and every filter in
+    // the chain can actually run on the CPU.
+    bool canBakeColorFilters(const ImageLayerOptions& options)
+    {
+        if ( options.bakeColorFilters() != true || options.colorFilters().empty() )
+            return false;
+
+        for(ColorFilterChain::const_iterator i = options.colorFilters().begin(); i != options.colorFilters().end(); ++i)
+        {
+            if ( !i->valid() || !i->get()->supportsCPU() )
+                return false;
+        }
+        return true;
+    }
+
+    // Number of pixels processed per span in the fused pixel pass. Small
+    // enough to stay in L1 across the whole filter chain.
+    const unsigned SPAN_SIZE = 256u;
 }
 
 //------------------------------------------------------------------------
@@ -234,6 +256,13 @@ ImageLayerTileProcessor::init(const ImageLayerOptions& options,
 {
     _options = options;
     _layerInTargetProfile = layerInTargetProfile;
+    _bakeColorFilters = canBakeColorFilters( options );
+
+    if ( options.bakeColorFilters() == true && !_bakeColorFilters && !options.colorFilters().empty() )
+    {
+        OE_WARN << "[ImageLayer] Cannot bake color filters for layer \"" << options.name().get()
+            << "\" because one or more filters have no CPU implementation" << std::endl;
+    }
 
     //if ( _layerInTargetProfile )
     //    OE_DEBUG << LC << "Good, the layer and map have the same profile." << std::endl;
@@ -270,16 +299,33 @@ ImageLayerTileProcessor::process( osg::ref_ptr<osg::Image>& image ) const
 
     // If this is a compressed image, uncompress it IF the image is not already in the
     // target profile...because if it's not in the target profile, we will have to do
-    // some mosaicing...and we can't mosaic a compressed image.
-    if (!_layerInTargetProfile &&
+    // some mosaicing...and we can't mosaic a compressed image. Baking color filters
+    // also requires access to the raw pixels.
+    if ((!_layerInTargetProfile || _bakeColorFilters) &&
         ImageUtils::isCompressed(image.get()) &&
         ImageUtils::canConvert(image.get(), GL_RGBA, GL_UNSIGNED_BYTE) )
     {
         image = ImageUtils::convertToRGBA8( image.get() );
     }
 
+    if ( _bakeColorFilters )
+    {
+        // Filters can introduce color (e.g., HSL on a grayscale image) and
+        // chroma keys introduce alpha, so work in RGBA.
+        if ( image->getPixelFormat() != GL_RGBA || !ImageUtils::PixelWriter::supports(image.get()) )
+        {
+            if ( !ImageUtils::canConvert(image.get(), GL_RGBA, GL_UNSIGNED_BYTE) )
+                return;
+            image = ImageUtils::convertToRGBA8( image.get() );
+        }
+
+        // One pass over the pixels applies the transparent color and the
+        // entire filter chain.
+        applyPixelPass( image.get() );
+    }
+
     // Apply a transparent color mask if one is specified
-    if ( _options.transparentColor().isSet() )
+    else if ( _options.transparentColor().isSet() )
     {
         if ( !ImageUtils::hasAlphaChannel(image.get()) && ImageUtils::canConvert(image.get(), GL_RGBA, GL_UNSIGNED_BYTE) )
         {
@@ -291,7 +337,97 @@ ImageLayerTileProcessor::process( osg::ref_ptr<osg::Image>& image ) const
         ImageUtils::PixelVisitor<ApplyChromaKey> applyChroma;
         applyChroma._chromaKey = _chromaKey;
         applyChroma.accept( image.get() );
+        image->dirty();
     }    
+
+    // Process images with full alpha to properly support MP blending. This
+    // runs before the tile is cached, and on tiles a source produces besides
+    // the one requested (e.g. metatile siblings).
+    if ( _options.featherPixels() == true )
+    {
+        ImageUtils::featherAlphaRegions( image.get() );
+    }
+}
+
+void
+ImageLayerTileProcessor::applyPixelPass( osg::Image* image ) const
+{
+    const ColorFilterChain& filters = _options.colorFilters();
+    const bool chromaKey = _options.transparentColor().isSet();
+    const float eps = 0.01f; // as in ImageUtils::areRGBEquivalent
+
+    // Fast path for RGBA8: unpack straight from the row bytes.
+    const bool rgba8 = image->getDataType() == GL_UNSIGNED_BYTE;
+
+    ImageUtils::PixelReader read( image );
+    ImageUtils::PixelWriter write( image );
+
+    osg::Vec4f span[SPAN_SIZE];
+
+    for(int r=0; r<image->r(); ++r)
+    {
+        for(int t=0; t<image->t(); ++t)
+        {
+            unsigned char* row = rgba8 ? image->data(0, t, r) : 0L;
+
+            for(int s0=0; s0<image->s(); s0 += SPAN_SIZE)
+            {
+                const unsigned count = osg::minimum( (unsigned)(image->s() - s0), SPAN_SIZE );
+                float* f = span[0].ptr();
+
+                // load:
+                if ( rgba8 )
+                {
+                    const unsigned char* in = row + 4*s0;
+                    for(unsigned i=0; i<4*count; ++i)
+                        f[i] = (float)in[i] * (1.0f/255.0f);
+                }
+                else
+                {
+                    for(unsigned i=0; i<count; ++i)
+                        span[i] = read(s0+(int)i, t, r);
+                }
+
+                // transparent color:
+                if ( chromaKey )
+                {
+                    for(unsigned i=0; i<count; ++i, f += 4)
+                    {
+                        bool equiv =
+                            fabs(f[0] - _chromaKey.r()) < eps &&
+                            fabs(f[1] - _chromaKey.g()) < eps &&
+                            fabs(f[2] - _chromaKey.b()) < eps;
+                        f[3] = equiv ? 0.0f : f[3];
+                    }
+                }
+
+                // filter chain, in order:
+                for(ColorFilterChain::const_iterator j = filters.begin(); j != filters.end(); ++j)
+                {
+                    j->get()->applyToSpan( span, count );
+                }
+
+                // store:
+                if ( rgba8 )
+                {
+                    const float* g = span[0].ptr();
+                    unsigned char* out = row + 4*s0;
+                    for(unsigned i=0; i<4*count; ++i)
+                    {
+                        float v = g[i] * 255.0f + 0.5f;
+                        out[i] = (unsigned char)(v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v);
+                    }
+                }
+                else
+                {
+                    for(unsigned i=0; i<count; ++i)
+                        write(span[i], s0+(int)i, t, r);
+                }
+            }
+        }
+    }
+
+    image->dirty();
 }
 
 //------------------------------------------------------------------------
@@ -363,7 +499,16 @@ ImageLayer::open()
         setTileSourceExpected(false);
     }
 
-    return TerrainLayer::open();
+    // the tile source copies the read options when it opens, and with them
+    // this setting, which tells its readers whether to keep encoded bytes.
+    _keepEncodedPayloadsSetting = ImageUtils::storeKeepEncodedPayloads(_readOptions.get(), _keepEncodedPayloads);
+
+    const Status& status = TerrainLayer::open();
+
+    // now that the cache is set up:
+    updateKeepEncodedPayloadsSetting();
+
+    return status;
 }
 
 void
@@ -373,6 +518,8 @@ ImageLayer::init()
 
     // image layers render as a terrain texture.
     setRenderType(RENDERTYPE_TILE);
+
+    _keepEncodedPayloads = false;
 }
 
 Config
@@ -445,10 +592,46 @@ ImageLayer::isCoverage() const
     return options().coverage().get();
 }
 
+void
+ImageLayer::setKeepEncodedPayloads(bool value)
+{
+    _keepEncodedPayloads = value;
+    updateKeepEncodedPayloadsSetting();
+}
+
+void
+ImageLayer::updateKeepEncodedPayloadsSetting()
+{
+    // Readers keep the encoded bytes with the image only when they will be
+    // used: by the cache write in createImageInKeyProfile or by a caller that
+    // wants them.
+    if ( _keepEncodedPayloadsSetting.valid() )
+    {
+        CacheSettings* cacheSettings = getCacheSettings();
+        bool cacheWrites =
+            cacheSettings &&
+            cacheSettings->isCacheEnabled() &&
+            cacheSettings->cachePolicy()->isCacheWriteable();
+
+        _keepEncodedPayloadsSetting->setValue( _keepEncodedPayloads || cacheWrites );
+    }
+}
+
+bool
+ImageLayer::getKeepEncodedPayloads() const
+{
+    return _keepEncodedPayloads;
+}
+
 void
 ImageLayer::addColorFilter( ColorFilter* filter )
 {
     options().colorFilters().push_back( filter );
+
+    // the pre-cache operation holds its own copy of the chain, and decides
+    // from it whether to bake the filters.
+    _preCacheOp = 0L;
+
     fireCallback( &ImageLayerCallback::onColorFiltersChanged );
 }
 
@@ -460,6 +643,7 @@ ImageLayer::removeColorFilter( ColorFilter* filter )
     if ( i != filters.end() )
     {
         filters.erase( i );
+        _preCacheOp = 0L;
         fireCallback( &ImageLayerCallback::onColorFiltersChanged );
     }
 }
@@ -470,6 +654,17 @@ ImageLayer::getColorFilters() const
     return options().colorFilters();
 }
 
+bool
+ImageLayer::getColorFiltersBaked() const
+{
+    // ask the processor that does the baking, so the shaders never skip a
+    // filter the tiles did not get.
+    ImageLayerPreCacheOperation* op = static_cast<ImageLayerPreCacheOperation*>(
+        const_cast<ImageLayer*>(this)->getOrCreatePreCacheOp() );
+
+    return op->_processor.bakesColorFilters();
+}
+
 void
 ImageLayer::setTargetProfileHint( const Profile* profile )
 {
@@ -589,6 +784,13 @@ ImageLayer::createImageInNativeProfile(const TileKey&    key,
 }
 
 
+std::string
+ImageLayer::getCacheKey(const TileKey& key)
+{
+    // the cache key combines the Key and the horizontal profile.
+    return Stringify() << key.str() << "_" << key.getProfile()->getHorizSignature();
+}
+
 GeoImage
 ImageLayer::createImageInKeyProfile(const TileKey&    key, 
                                     ProgressCallback* progress)
@@ -611,8 +813,7 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
     OE_DEBUG << LC << "create image for \"" << key.str() << "\", ext= "
         << key.getExtent().toString() << std::endl;
 
-    // the cache key combines the Key and the horizontal profile.
-    std::string cacheKey = Stringify() << key.str() << "_" << key.getProfile()->getHorizSignature();
+    std::string cacheKey = getCacheKey(key);
     const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
     
     // Check the layer L2 cache first
@@ -662,6 +863,8 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
         {
             cachedImage = r.releaseImage();
             ImageUtils::fixInternalFormat( cachedImage.get() );            
+            if ( !_keepEncodedPayloads )
+                ImageUtils::removeEncodedPayload( cachedImage.get() );
             bool expired = policy.isExpired(r.lastModifiedTime());
             if (!expired)
             {
@@ -705,13 +908,6 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
         ImageUtils::fixInternalFormat( result.getImage() );
     }
 
-    // memory cache first:
-    if ( result.valid() && _memCache.valid() )
-    {
-        CacheBin* bin = _memCache->getOrCreateDefaultBin();
-        bin->write(cacheKey, result.getImage(), 0L);
-    }
-
     // If we got a result, the cache is valid and we are caching in the map profile,
     // write to the map cache.
     if (result.valid()  &&
@@ -726,6 +922,20 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
         cacheBin->write(cacheKey, result.getImage(), 0L);
     }
 
+    // The cache has had its chance to store the source's encoded bytes
+    // verbatim; don't carry them around any longer unless asked to.
+    if ( result.valid() && !_keepEncodedPayloads )
+    {
+        ImageUtils::removeEncodedPayload( result.getImage() );
+    }
+
+    // memory cache:
+    if ( result.valid() && _memCache.valid() )
+    {
+        CacheBin* bin = _memCache->getOrCreateDefaultBin();
+        bin->write(cacheKey, result.getImage(), 0L);
+    }
+
     if ( result.valid() )
     {
         OE_DEBUG << LC << key.str() << " result OK" << std::endl;
@@ -777,24 +987,20 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
     }
 
     // create an image from the tile source.
-    osg::ref_ptr<osg::Image> result = source->createImage( key, op.get(), progress );   
+    // (the operation takes care of feathering, if enabled)
+    ReadResult r = source->readImage( key, op.get(), progress );
+    osg::ref_ptr<osg::Image> result = r.releaseImage();
 
-    // Process images with full alpha to properly support MP blending.    
-    if (result.valid() && 
-        options().featherPixels() == true)
-    {
-        ImageUtils::featherAlphaRegions( result.get() );
-    }    
-    
     // If image creation failed (but was not intentionally canceled and 
     // didn't time out or end for any other recoverable reason), then
-    // blacklist this tile for future requests.
+    // blacklist this tile for future requests. Only keep it across sessions
+    // if the source said outright that the tile does not exist.
     if (result == 0L)
     {
         if ( progress == 0L ||
              ( !progress->isCanceled() && !progress->needsRetry() ) )
         {
-            source->getBlacklist()->add( key );
+            source->getBlacklist()->add( key, r.code() == ReadResult::RESULT_NOT_FOUND );
         }
     }
 
@@ -802,6 +1008,37 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 }
 
 
+bool
+ImageLayer::readEncodedImage(const TileKey&    key,
+                             std::string&      out_data,
+                             std::string&      out_mimeType,
+                             ProgressCallback* progress)
+{
+    if ( !getEnabled() || !isKeyInRange(key) )
+        return false;
+
+    TileSource* source = getTileSource();
+    if ( !source || !getProfile() || !key.getProfile()->isHorizEquivalentTo(getProfile()) )
+        return false;
+
+    // anything the pre-cache operation would do to the pixels rules it out:
+    if ( options().transparentColor().isSet() ||
+         (options().noDataImageFilename().isSet() && !options().noDataImageFilename()->empty()) ||
+         options().featherPixels() == true ||
+         getColorFiltersBaked() )
+    {
+        return false;
+    }
+
+    if ( getCacheSettings()->cachePolicy()->isCacheOnly() )
+        return false;
+
+    if ( source->getBlacklist()->contains(key) || !source->hasData(key) )
+        return false;
+
+    return source->readEncodedImage( key, out_data, out_mimeType, progress );
+}
+
 GeoImage
 ImageLayer::assembleImage(const TileKey& key, ProgressCallback* progress)
 {
@@ -1012,37 +1249,26 @@ ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
     else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 1))
     {
         osg::Timer_t start = osg::Timer::instance()->tick();
-        osgDB::ImageProcessor* imageProcessor = osgDB::Registry::instance()->getImageProcessorForExtension("fastdxt");
-        if (imageProcessor)
+        osg::Image *image = tex->getImage(0);
+
+        // nothing to do for tiles that were stored precompressed
+        if (!image || ImageUtils::isCompressed(image))
+            return;
+
+        // RGB uses DXT1, RGBA uses DXT5, single-channel data uses BC4
+        osg::Texture::InternalFormatMode mode;
+        if (!ImageUtils::computeCPUCompressionMode(image, mode))
         {
-            osg::Texture::InternalFormatMode mode;
-            // RGB uses DXT1
-            if (tex->getImage(0)->getPixelFormat() == GL_RGB)
-            {
-                mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
-            }
-            // RGBA uses DXT5
-            else if (tex->getImage(0)->getPixelFormat() == GL_RGBA)
-            {         
-                mode = osg::Texture::USE_S3TC_DXT5_COMPRESSION;
-            }
-            else
-            {
-                OE_INFO << "FastDXT only works on GL_RGBA or GL_RGB images" << std::endl;
-                return;
-            }
+            OE_INFO << "FastDXT only works on 8-bit RGBA, RGB or red images" << std::endl;
+            return;
+        }
 
-            osg::Image *image = tex->getImage(0);
-            imageProcessor->compress(*image, mode, false, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
+        if (ImageUtils::compressImage(image, mode, "fastdxt"))
+        {
             osg::Timer_t end = osg::Timer::instance()->tick();
-            image->dirty();
             tex->setImage(0, image);
             OE_INFO << "Compress took " << osg::Timer::instance()->delta_m(start, end) << std::endl;        
         }
-        else
-        {
-            OE_WARN << "Failed to get ImageProcessor fastdxt" << std::endl;
-        }
 
     }
     else if ( options().textureCompression().isSet() )
@@ -23,14 +23,22 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/Random>
 #include <osgEarth/GeoCommon>
+#include <osgEarth/StringUtils>
 #include <osg/Notify>
 #include <osg/Texture>
 #include <osg/ImageSequence>
 #include <osg/Timer>
 #include <osg/ValueObject>
 #include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
 #include <string.h>
 #include <memory.h>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define OE_IMAGEUTILS_SSE2
+#    include <emmintrin.h>
+#endif
 
 #define LC "[ImageUtils] "
 
@@ -44,6 +52,49 @@
 #endif
 
 
+namespace osgEarth
+{
+    /**
+     * Encoded bytes an image was decoded from, along with enough of the
+     * image's state at the time to tell whether they still match it.
+     */
+    class EncodedImagePayload : public osg::Object
+    {
+    public:
+        EncodedImagePayload() :
+            _modifiedCount(0u), _s(0), _t(0), _r(0),
+            _pixelFormat(0), _dataType(0), _internalFormat(0) { }
+
+        EncodedImagePayload(const EncodedImagePayload& rhs, const osg::CopyOp& copyop =osg::CopyOp::SHALLOW_COPY) :
+            osg::Object(rhs, copyop),
+            _data(rhs._data), _mimeType(rhs._mimeType), _modifiedCount(rhs._modifiedCount),
+            _s(rhs._s), _t(rhs._t), _r(rhs._r),
+            _pixelFormat(rhs._pixelFormat), _dataType(rhs._dataType), _internalFormat(rhs._internalFormat) { }
+
+        META_Object(osgEarth, EncodedImagePayload);
+
+        std::string _data;
+        std::string _mimeType;
+        unsigned    _modifiedCount;
+        int         _s, _t, _r;
+        GLenum      _pixelFormat;
+        GLenum      _dataType;
+        GLint       _internalFormat;
+    };
+}
+
+// Serializer without properties, so an image still carrying a payload can be
+// written to osgb; the payload comes back empty and is ignored.
+REGISTER_OBJECT_WRAPPER(EncodedImagePayload,
+                        new osgEarth::EncodedImagePayload,
+                        osgEarth::EncodedImagePayload,
+                        "osg::Object osgEarth::EncodedImagePayload")
+{
+    //nop
+}
+
+#define ENCODED_PAYLOAD_NAME "osgEarth.EncodedPayload"
+
 using namespace osgEarth;
 
 
@@ -65,6 +116,145 @@ ImageUtils::cloneImage( const osg::Image* input )
     return clone;
 }
 
+void
+ImageUtils::setEncodedPayload(osg::Image* image, const std::string& data, const std::string& mimeType)
+{
+    if ( !image || data.empty() || mimeType.empty() )
+        return;
+
+    removeEncodedPayload( image );
+
+    EncodedImagePayload* payload = new EncodedImagePayload();
+    payload->setName( ENCODED_PAYLOAD_NAME );
+    payload->_data           = data;
+    payload->_mimeType       = mimeType;
+    payload->_modifiedCount  = image->getModifiedCount();
+    payload->_s              = image->s();
+    payload->_t              = image->t();
+    payload->_r              = image->r();
+    payload->_pixelFormat    = image->getPixelFormat();
+    payload->_dataType       = image->getDataType();
+    payload->_internalFormat = image->getInternalTextureFormat();
+    image->getOrCreateUserDataContainer()->addUserObject( payload );
+}
+
+bool
+ImageUtils::getEncodedPayload(const osg::Image* image, std::string& data, std::string& mimeType)
+{
+    if ( !image )
+        return false;
+
+    // Any other user data (like the un-normalized marker) would not survive
+    // a round trip through the encoded bytes.
+    const osg::UserDataContainer* udc = image->getUserDataContainer();
+    if ( !udc || udc->getNumUserObjects() != 1u || udc->getUserData() != 0L )
+        return false;
+
+    const EncodedImagePayload* payload = dynamic_cast<const EncodedImagePayload*>( udc->getUserObject(0u) );
+    if ( !payload || payload->_data.empty() )
+        return false;
+
+    if (payload->_modifiedCount != image->getModifiedCount() ||
+        payload->_s             != image->s()                ||
+        payload->_t             != image->t()                ||
+        payload->_r             != image->r()                ||
+        payload->_pixelFormat   != image->getPixelFormat()   ||
+        payload->_dataType      != image->getDataType() )
+    {
+        return false;
+    }
+
+    // fixInternalFormat() is re-applied to anything read back from a cache,
+    // so that is the only internal format change allowed.
+    GLint internalFormat = image->getInternalTextureFormat();
+    if ( internalFormat != payload->_internalFormat )
+    {
+        bool fixed =
+            image->getDataType() == GL_UNSIGNED_BYTE &&
+            ((image->getPixelFormat() == GL_RGB  && internalFormat == GL_RGB8_INTERNAL) ||
+             (image->getPixelFormat() == GL_RGBA && internalFormat == GL_RGB8A_INTERNAL));
+        if ( !fixed )
+            return false;
+    }
+
+    data     = payload->_data;
+    mimeType = payload->_mimeType;
+    return true;
+}
+
+bool
+ImageUtils::getEncodedPayload(const osg::Image* image, const osgDB::ReaderWriter* rw, std::string& data)
+{
+    std::string mimeType;
+    if ( !rw || !getEncodedPayload(image, data, mimeType) )
+        return false;
+
+    // strip any parameters, as in "image/png; charset=binary"
+    std::string type = trim( mimeType.substr(0, mimeType.find(';')) );
+    if ( osgDB::Registry::instance()->getReaderWriterForMimeType(type) != rw )
+    {
+        data.clear();
+        return false;
+    }
+    return true;
+}
+
+void
+ImageUtils::removeEncodedPayload(osg::Image* image)
+{
+    osg::UserDataContainer* udc = image ? image->getUserDataContainer() : 0L;
+    if ( udc )
+    {
+        unsigned i = udc->getUserObjectIndex( ENCODED_PAYLOAD_NAME );
+        if ( i < udc->getNumUserObjects() )
+            udc->removeUserObject( i );
+    }
+}
+
+#define KEEP_ENCODED_PAYLOADS_NAME "osgEarth.KeepEncodedPayloads"
+
+osg::BoolValueObject*
+ImageUtils::storeKeepEncodedPayloads(osgDB::Options* options, bool value)
+{
+    if ( !options )
+        return 0L;
+
+    // replace rather than update, since a setting already there may be
+    // shared with the options this copy was made from.
+    osg::UserDataContainer* udc = options->getOrCreateUserDataContainer();
+    unsigned i = udc->getUserObjectIndex( KEEP_ENCODED_PAYLOADS_NAME );
+    if ( i < udc->getNumUserObjects() )
+        udc->removeUserObject( i );
+
+    osg::BoolValueObject* setting = new osg::BoolValueObject( KEEP_ENCODED_PAYLOADS_NAME, value );
+    udc->addUserObject( setting );
+    return setting;
+}
+
+bool
+ImageUtils::getKeepEncodedPayloads(const osgDB::Options* options)
+{
+    const osg::UserDataContainer* udc = options ? options->getUserDataContainer() : 0L;
+    const osg::BoolValueObject* setting = udc ?
+        dynamic_cast<const osg::BoolValueObject*>(udc->getUserObject(KEEP_ENCODED_PAYLOADS_NAME)) : 0L;
+    return setting && setting->getValue();
+}
+
+osg::Image*
+ImageUtils::readEncodedPayload(const std::string& data, const std::string& mimeType, const osgDB::Options* options)
+{
+    // strip any parameters, as in "image/png; charset=binary"
+    std::string type = trim( mimeType.substr(0, mimeType.find(';')) );
+
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForMimeType( type );
+    if ( !rw )
+        return 0L;
+
+    std::istringstream in( data );
+    osgDB::ReaderWriter::ReadResult rr = rw->readImage( in, options );
+    return rr.validImage() ? rr.takeImage() : 0L;
+}
+
 void
 ImageUtils::fixInternalFormat( osg::Image* image )
 {
@@ -145,6 +335,7 @@ ImageUtils::copyAsSubImage(const osg::Image* src, osg::Image* dst, int dst_start
         }
     }
 
+    dst->dirty();
     return true;
 }  
 
@@ -731,6 +922,7 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
     mixer._destHasAlpha = hasAlphaChannel(dest); //dest->getPixelSizeInBits() == 32;
 
     mixer.accept( src, dest );  
+    dest->dirty();
 
     return true;
 }
@@ -868,25 +1060,346 @@ ImageUtils::createEmptyImage(unsigned int s, unsigned int t)
     return empty;
 }
 
-bool
-ImageUtils::isEmptyImage(const osg::Image* image, float alphaThreshold)
+namespace
 {
-    if ( !hasAlphaChannel(image) || !PixelReader::supports(image) )
-        return false;
+    // Properties that a single scan over an image can prove or disprove.
+    enum ScanFlags
+    {
+        SCAN_EMPTY        = 1 << 0,  // all alpha values <= the empty threshold
+        SCAN_SINGLE_COLOR = 1 << 1,  // all pixels equal the first one within tolerance
+        SCAN_OPAQUE       = 1 << 2   // no alpha value below the opaque threshold
+    };
 
-    PixelReader read(image);
-    for(unsigned r=0; r<(unsigned)image->r(); ++r)
+    // Memory layout of an image that the span scanners can read directly,
+    // without going through a PixelReader.
+    struct SpanLayout
+    {
+        unsigned lanes;     // components per pixel
+        int      alphaLane; // component holding alpha, or -1 if none
+    };
+
+    bool getSpanLayout(const osg::Image* image, SpanLayout& out)
+    {
+        switch(image->getPixelFormat())
+        {
+        case GL_RGBA:
+        case GL_BGRA:            out.lanes = 4; out.alphaLane =  3; return true;
+        case GL_RGB:
+        case GL_BGR:             out.lanes = 3; out.alphaLane = -1; return true;
+        case GL_LUMINANCE_ALPHA: out.lanes = 2; out.alphaLane =  1; return true;
+        case GL_ALPHA:           out.lanes = 1; out.alphaLane =  0; return true;
+        case GL_LUMINANCE:
+        case GL_RED:             out.lanes = 1; out.alphaLane = -1; return true;
+        default:                 return false;
+        }
+    }
+
+    /**
+     * Compares rows of normalized 8-bit data against a reference row
+     * (the first pixel repeated) and an alpha lane mask, 16 lanes at a time
+     * when SSE2 is available. Tolerances are the float thresholds of the
+     * PixelReader path expressed in 0..255 units.
+     */
+    struct ByteSpans
     {
-        for(unsigned t=0; t<(unsigned)image->t(); ++t) 
+        typedef unsigned char value_type;
+
+        ByteSpans(const osg::Image* image, const SpanLayout& layout, float colorThreshold, float emptyThreshold, float opaqueThreshold)
+        {
+            const unsigned len = image->s() * layout.lanes;
+            _ref.resize(len);
+            _alpha.resize(len, 0);
+            const unsigned char* first = image->data(0, 0, 0);
+            for(unsigned i=0; i<len; ++i)
+            {
+                _ref[i] = first[i % layout.lanes];
+                if ( (int)(i % layout.lanes) == layout.alphaLane )
+                    _alpha[i] = 0xFF;
+            }
+
+            // |a-b|/255 > threshold  <=>  |a-b| > floor(threshold*255) for integer a,b
+            _colorTol = (unsigned char)osg::clampBetween(colorThreshold*255.0f, 0.0f, 255.0f);
+            _emptyTol = (unsigned char)osg::clampBetween(emptyThreshold*255.0f, 0.0f, 255.0f);
+            _opaqueMin = (unsigned)osg::clampBetween(ceilf(opaqueThreshold*255.0f), 0.0f, 256.0f);
+        }
+
+        // True if any lane differs from the reference row by more than the color tolerance.
+        bool differs(const unsigned char* row, unsigned len) const
+        {
+            unsigned i = 0;
+#ifdef OE_IMAGEUTILS_SSE2
+            const __m128i tol  = _mm_set1_epi8((char)_colorTol);
+            const __m128i zero = _mm_setzero_si128();
+            for( ; i+16 <= len; i += 16 )
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(&_ref[i]));
+                __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                if ( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(d, tol), zero)) != 0xFFFF )
+                    return true;
+            }
+#endif
+            for( ; i<len; ++i )
+            {
+                int d = (int)row[i] - (int)_ref[i];
+                if ( d > (int)_colorTol || -d > (int)_colorTol )
+                    return true;
+            }
+            return false;
+        }
+
+        // True if any alpha lane is above the empty tolerance.
+        bool alphaAbove(const unsigned char* row, unsigned len) const
+        {
+            unsigned i = 0;
+#ifdef OE_IMAGEUTILS_SSE2
+            const __m128i tol  = _mm_set1_epi8((char)_emptyTol);
+            const __m128i zero = _mm_setzero_si128();
+            for( ; i+16 <= len; i += 16 )
+            {
+                __m128i a = _mm_and_si128(
+                    _mm_loadu_si128((const __m128i*)(row + i)),
+                    _mm_loadu_si128((const __m128i*)(&_alpha[i])));
+                if ( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(a, tol), zero)) != 0xFFFF )
+                    return true;
+            }
+#endif
+            for( ; i<len; ++i )
+            {
+                if ( _alpha[i] && row[i] > _emptyTol )
+                    return true;
+            }
+            return false;
+        }
+
+        // True if any alpha lane is below the opaque minimum.
+        bool alphaBelow(const unsigned char* row, unsigned len) const
         {
-            for(unsigned s=0; s<(unsigned)image->s(); ++s)
+            if ( _opaqueMin == 0 )
+                return false;
+
+            unsigned i = 0;
+#ifdef OE_IMAGEUTILS_SSE2
+            if ( _opaqueMin <= 255 )
+            {
+                const __m128i lim  = _mm_set1_epi8((char)_opaqueMin);
+                const __m128i ones = _mm_set1_epi8((char)0xFF);
+                const __m128i zero = _mm_setzero_si128();
+                for( ; i+16 <= len; i += 16 )
+                {
+                    // force non-alpha lanes to 0xFF so they never count as transparent:
+                    __m128i a = _mm_or_si128(
+                        _mm_loadu_si128((const __m128i*)(row + i)),
+                        _mm_andnot_si128(_mm_loadu_si128((const __m128i*)(&_alpha[i])), ones));
+                    if ( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(lim, a), zero)) != 0xFFFF )
+                        return true;
+                }
+            }
+#endif
+            for( ; i<len; ++i )
             {
-                osg::Vec4 color = read(s, t, r);
-                if ( color.a() > alphaThreshold )
-                    return false;
+                if ( _alpha[i] && (unsigned)row[i] < _opaqueMin )
+                    return true;
             }
+            return false;
         }
+
+        std::vector<unsigned char> _ref;
+        std::vector<unsigned char> _alpha;
+        unsigned char _colorTol;
+        unsigned char _emptyTol;
+        unsigned      _opaqueMin;
+    };
+
+    /**
+     * Same as ByteSpans, for GL_FLOAT data. Float data is never normalized
+     * so the thresholds apply to the raw values.
+     */
+    struct FloatSpans
+    {
+        typedef float value_type;
+
+        FloatSpans(const osg::Image* image, const SpanLayout& layout, float colorThreshold, float emptyThreshold, float opaqueThreshold) :
+            _lanes    ( layout.lanes ),
+            _alphaLane( layout.alphaLane ),
+            _colorTol ( colorThreshold ),
+            _emptyTol ( emptyThreshold ),
+            _opaqueMin( opaqueThreshold )
+        {
+            const unsigned len = image->s() * layout.lanes;
+            _ref.resize(len);
+            const float* first = reinterpret_cast<const float*>(image->data(0, 0, 0));
+            for(unsigned i=0; i<len; ++i)
+                _ref[i] = first[i % layout.lanes];
+        }
+
+        bool differs(const float* row, unsigned len) const
+        {
+            unsigned i = 0;
+#ifdef OE_IMAGEUTILS_SSE2
+            const __m128 tol  = _mm_set1_ps(_colorTol);
+            const __m128 sign = _mm_set1_ps(-0.0f);
+            for( ; i+4 <= len; i += 4 )
+            {
+                __m128 d = _mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(row + i), _mm_loadu_ps(&_ref[i])));
+                if ( _mm_movemask_ps(_mm_cmpgt_ps(d, tol)) != 0 )
+                    return true;
+            }
+#endif
+            for( ; i<len; ++i )
+            {
+                if ( fabs(row[i] - _ref[i]) > _colorTol )
+                    return true;
+            }
+            return false;
+        }
+
+        bool alphaAbove(const float* row, unsigned len) const
+        {
+            for(unsigned i=_alphaLane; i<len; i += _lanes)
+                if ( row[i] > _emptyTol )
+                    return true;
+            return false;
+        }
+
+        bool alphaBelow(const float* row, unsigned len) const
+        {
+            for(unsigned i=_alphaLane; i<len; i += _lanes)
+                if ( row[i] < _opaqueMin )
+                    return true;
+            return false;
+        }
+
+        std::vector<float> _ref;
+        unsigned _lanes;
+        int      _alphaLane;
+        float    _colorTol;
+        float    _emptyTol;
+        float    _opaqueMin;
+    };
+
+    // Scans an image row by row, clearing each flag as soon as a row disproves it
+    // and returning as soon as no flags remain.
+    template<typename SPANS>
+    unsigned scanSpans(const osg::Image* image, const SPANS& spans, unsigned lanes, unsigned flags)
+    {
+        typedef typename SPANS::value_type T;
+        const unsigned len = image->s() * lanes;
+
+        for(int r=0; r<image->r() && flags != 0; ++r)
+        {
+            for(int t=0; t<image->t() && flags != 0; ++t)
+            {
+                const T* row = reinterpret_cast<const T*>(image->data(0, t, r));
+
+                if ( (flags & SCAN_EMPTY) && spans.alphaAbove(row, len) )
+                    flags &= ~SCAN_EMPTY;
+
+                if ( (flags & SCAN_SINGLE_COLOR) && spans.differs(row, len) )
+                    flags &= ~SCAN_SINGLE_COLOR;
+
+                if ( (flags & SCAN_OPAQUE) && spans.alphaBelow(row, len) )
+                    flags &= ~SCAN_OPAQUE;
+            }
+        }
+        return flags;
+    }
+
+    // Scans with a PixelReader; used for formats the span scanners don't handle.
+    unsigned scanPixels(const osg::Image* image, float colorThreshold, float emptyThreshold, float opaqueThreshold, unsigned flags)
+    {
+        ImageUtils::PixelReader read(image);
+        const osg::Vec4 ref = read(0, 0, 0);
+
+        for(int r=0; r<image->r() && flags != 0; ++r)
+        {
+            for(int t=0; t<image->t() && flags != 0; ++t)
+            {
+                for(int s=0; s<image->s() && flags != 0; ++s)
+                {
+                    osg::Vec4 color = read(s, t, r);
+
+                    if ( (flags & SCAN_EMPTY) && color.a() > emptyThreshold )
+                        flags &= ~SCAN_EMPTY;
+
+                    if ( (flags & SCAN_OPAQUE) && color.a() < opaqueThreshold )
+                        flags &= ~SCAN_OPAQUE;
+
+                    if ( (flags & SCAN_SINGLE_COLOR) && (
+                        fabs(color.r()-ref.r()) > colorThreshold ||
+                        fabs(color.g()-ref.g()) > colorThreshold ||
+                        fabs(color.b()-ref.b()) > colorThreshold ||
+                        fabs(color.a()-ref.a()) > colorThreshold) )
+                    {
+                        flags &= ~SCAN_SINGLE_COLOR;
+                    }
+                }
+            }
+        }
+        return flags;
+    }
+
+    // Tests the requested flags against an image, picking the fastest scanner
+    // for its format. Flags that don't apply to the format (the alpha tests on
+    // an image without alpha) must be resolved by the caller beforehand.
+    unsigned scanImage(const osg::Image* image, float colorThreshold, float emptyThreshold, float opaqueThreshold, unsigned flags)
+    {
+        if ( flags == 0 || image->s() <= 0 || image->t() <= 0 || image->r() <= 0 )
+            return flags;
+
+        SpanLayout layout;
+        if ( getSpanLayout(image, layout) )
+        {
+            if ( image->getDataType() == GL_UNSIGNED_BYTE && ImageUtils::isNormalized(image) )
+            {
+                ByteSpans spans(image, layout, colorThreshold, emptyThreshold, opaqueThreshold);
+                return scanSpans(image, spans, layout.lanes, flags);
+            }
+            else if ( image->getDataType() == GL_FLOAT )
+            {
+                FloatSpans spans(image, layout, colorThreshold, emptyThreshold, opaqueThreshold);
+                return scanSpans(image, spans, layout.lanes, flags);
+            }
+        }
+
+        return scanPixels(image, colorThreshold, emptyThreshold, opaqueThreshold, flags);
     }
+}
+
+bool
+ImageUtils::isEmptyImage(const osg::Image* image, float alphaThreshold)
+{
+    if ( !hasAlphaChannel(image) || !PixelReader::supports(image) )
+        return false;
+
+    return scanImage(image, 0.0f, alphaThreshold, 0.0f, SCAN_EMPTY) == SCAN_EMPTY;
+}
+
+bool
+ImageUtils::classifyImage(const osg::Image* image, ImageClassification& out, float threshold, unsigned what)
+{
+    out = ImageClassification();
+    out.hasAlpha = hasAlphaChannel(image);
+
+    if ( !PixelReader::supports(image) )
+        return false;
+
+    // without an alpha channel an image is never "empty" and always opaque.
+    unsigned flags = 0u;
+    if ( what & CLASSIFY_SINGLE_COLOR )
+        flags |= SCAN_SINGLE_COLOR;
+    if ( out.hasAlpha && (what & CLASSIFY_EMPTY) )
+        flags |= SCAN_EMPTY;
+    if ( out.hasAlpha && (what & CLASSIFY_OPAQUE) )
+        flags |= SCAN_OPAQUE;
+
+    if ( flags != 0u )
+        flags = scanImage(image, threshold, threshold, 1.0f, flags);
+
+    out.empty       = (flags & SCAN_EMPTY) != 0;
+    out.singleColor = (flags & SCAN_SINGLE_COLOR) != 0;
+    if ( what & CLASSIFY_OPAQUE )
+        out.opaque  = out.hasAlpha ? (flags & SCAN_OPAQUE) != 0 : true;
     return true;
 }
 
@@ -1021,32 +1534,7 @@ ImageUtils::isSingleColorImage(const osg::Image* image, float threshold)
     if ( !PixelReader::supports(image) )
         return false;
 
-    PixelReader read(image);
-
-    osg::Vec4 referenceColor = read(0, 0, 0);
-    float refR = referenceColor.r();
-    float refG = referenceColor.g();
-    float refB = referenceColor.b();
-    float refA = referenceColor.a();
-
-    for(unsigned r=0; r<(unsigned)image->r(); ++r)
-    {
-        for(unsigned t=0; t<(unsigned)image->t(); ++t) 
-        {
-            for(unsigned s=0; s<(unsigned)image->s(); ++s)
-            {
-                osg::Vec4 color = read(s, t, r);
-                if (   (fabs(color.r()-refR) > threshold)
-                    || (fabs(color.g()-refG) > threshold)
-                    || (fabs(color.b()-refB) > threshold)
-                    || (fabs(color.a()-refA) > threshold) )
-                {
-                    return false;
-                }
-            }
-        }
-    }
-    return true;
+    return scanImage(image, threshold, 0.0f, 0.0f, SCAN_SINGLE_COLOR) == SCAN_SINGLE_COLOR;
 }
 
 bool
@@ -1093,6 +1581,16 @@ ImageUtils::computeTextureCompressionMode(const osg::Image*                 imag
             return true;
         }
     }
+    else if (image->getPixelFormat() == GL_RED && image->getPixelSizeInBits() == 8)
+    {
+        // Single-channel data only. (RGTC has no luminance form; a luminance
+        // image would sample as red-only.)
+        if (caps.supportsTextureCompression(osg::Texture::USE_RGTC1_COMPRESSION))
+        {
+            out_mode = osg::Texture::USE_RGTC1_COMPRESSION;
+            return true;
+        }
+    }
 
 #else // OSG_GLES2_AVAILABLE
 
@@ -1117,6 +1615,51 @@ ImageUtils::computeTextureCompressionMode(const osg::Image*                 imag
     return false;
 }
 
+bool
+ImageUtils::computeCPUCompressionMode(const osg::Image*                 image,
+                                      osg::Texture::InternalFormatMode& out_mode)
+{
+    if (!image || isCompressed(image) || image->getDataType() != GL_UNSIGNED_BYTE)
+        return false;
+
+    switch(image->getPixelFormat())
+    {
+    case GL_RGB:
+        out_mode = osg::Texture::USE_S3TC_DXT1_COMPRESSION;
+        return true;
+    case GL_RGBA:
+        out_mode = osg::Texture::USE_S3TC_DXT5_COMPRESSION;
+        return true;
+    case GL_RED:
+        // luminance images are left alone, since RGTC would sample them as red-only
+        out_mode = osg::Texture::USE_RGTC1_COMPRESSION;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool
+ImageUtils::compressImage(osg::Image*                      image,
+                          osg::Texture::InternalFormatMode mode,
+                          const std::string&               processor)
+{
+    if (!image || isCompressed(image))
+        return false;
+
+    osgDB::ImageProcessor* ip = osgDB::Registry::instance()->getImageProcessorForExtension(processor);
+    if (!ip)
+    {
+        OE_WARN << LC << "Failed to load the \"" << processor << "\" image processor" << std::endl;
+        return false;
+    }
+
+    ip->compress(*image, mode, false, true, osgDB::ImageProcessor::USE_CPU, osgDB::ImageProcessor::FASTEST);
+    image->dirty();
+
+    return isCompressed(image);
+}
+
 bool 
 ImageUtils::replaceNoDataValues(osg::Image*       target,
                                 const Bounds&     targetBounds,
@@ -1157,6 +1700,7 @@ ImageUtils::replaceNoDataValues(osg::Image*       target,
         }
     }
 
+    target->dirty();
     return true;
 }
 
@@ -1263,16 +1807,8 @@ ImageUtils::areEquivalent(const osg::Image *lhs, const osg::Image *rhs)
         (lhs->getPacking() == rhs->getPacking()) &&
         (lhs->getImageSizeInBytes() == rhs->getImageSizeInBytes()))
     {
-        unsigned int size = lhs->getImageSizeInBytes();
-        const unsigned char* ptr1 = lhs->data();
-        const unsigned char* ptr2 = rhs->data();
-        for (unsigned int i = 0; i < size; ++i)
-        {
-            if ( *ptr1++ != *ptr2++ )
-                return false;
-        }
-
-        return true;
+        // memcmp is vectorized by the C runtime and exits on the first mismatch.
+        return ::memcmp(lhs->data(), rhs->data(), lhs->getImageSizeInBytes()) == 0;
     }
 
     return false;
@@ -1299,14 +1835,7 @@ ImageUtils::hasTransparency(const osg::Image* image, float threshold)
     if ( !image || !hasAlphaChannel(image) || !PixelReader::supports(image) )
         return false;
 
-    PixelReader read(image);
-    for( int r=0; r<image->r(); ++r)
-        for( int t=0; t<image->t(); ++t )
-            for( int s=0; s<image->s(); ++s )
-                if ( read(s, t, r).a() < threshold )
-                    return true;
-
-    return false;
+    return scanImage(image, 0.0f, 0.0f, threshold, SCAN_OPAQUE) == 0;
 }
 
 
@@ -1382,6 +1911,7 @@ ImageUtils::featherAlphaRegions(osg::Image* image, float maxAlpha)
         }
     }
 
+    image->dirty();
     return true;
 }
 
@@ -1402,6 +1932,7 @@ ImageUtils::convertToPremultipliedAlpha(osg::Image* image)
             }
         }
     }
+    image->dirty();
     return true;
 }
 
@@ -114,7 +114,22 @@ namespace
             return key;
         }
 
-        MemCacheLRU _lru;
+        Config readMetadata()
+        {
+            Threading::ScopedMutexLock lock( _metadataMutex );
+            return _metadata;
+        }
+
+        bool writeMetadata( const Config& meta )
+        {
+            Threading::ScopedMutexLock lock( _metadataMutex );
+            _metadata = meta;
+            return true;
+        }
+
+        MemCacheLRU      _lru;
+        Config           _metadata;
+        Threading::Mutex _metadataMutex;
     };
     
 
@@ -0,0 +1,314 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/MetaTiler>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/Progress>
+#include <osgEarth/StringUtils>
+#include <string.h>
+
+#define LC "[MetaTiler] "
+
+// how often a thread waiting on another's metatile checks for cancelation
+#define WAIT_SLICE_MS 50u
+
+using namespace osgEarth;
+
+namespace
+{
+    // Copies a tileSize x tileSize block out of a metatile image.
+    osg::Image* copySubImage(const osg::Image* src, unsigned s0, unsigned t0, unsigned size)
+    {
+        osg::Image* tile = new osg::Image();
+        tile->allocateImage(size, size, 1, src->getPixelFormat(), src->getDataType(), src->getPacking());
+        tile->setInternalTextureFormat(src->getInternalTextureFormat());
+
+        const unsigned pixelBytes = src->getPixelSizeInBits() / 8;
+        for(unsigned t = 0; t < size; ++t)
+        {
+            memcpy(tile->data(0, t), src->data(s0, t0 + t), size * pixelBytes);
+        }
+        return tile;
+    }
+}
+
+//------------------------------------------------------------------------
+
+MetaTiler::MetaTiler(unsigned cols, unsigned rows, unsigned tileSize, unsigned overlap) :
+_cols    ( osg::maximum(cols, 1u) ),
+_rows    ( osg::maximum(rows, 1u) ),
+_tileSize( tileSize ),
+_overlap ( overlap < tileSize ? overlap : 0u ),
+_recent  ( 8u )
+{
+    //nop
+}
+
+void
+MetaTiler::setLayerOptions(const osgDB::Options* readOptions)
+{
+    _layerOptions = readOptions;
+}
+
+void
+MetaTiler::setBlacklist(TileBlacklist* blacklist)
+{
+    _blacklist = blacklist;
+}
+
+osg::Image*
+MetaTiler::createImage(const TileKey&              key,
+                       Fetcher*                    fetcher,
+                       TileSource::ImageOperation* op,
+                       ProgressCallback*           progress)
+{
+    if ( !key.valid() || !fetcher )
+        return 0L;
+
+    unsigned tilesWide, tilesHigh;
+    key.getProfile()->getNumTiles(key.getLOD(), tilesWide, tilesHigh);
+
+    // the metatile containing this key; clamp it at the edges of the profile.
+    unsigned x0 = (key.getTileX() / _cols) * _cols;
+    unsigned y0 = (key.getTileY() / _rows) * _rows;
+
+    std::string metaKey = Stringify() << key.getLOD() << "/" << x0 << "/" << y0;
+
+    osg::ref_ptr<MetaTile> meta;
+
+    while( !meta.valid() )
+    {
+        bool fetcherThread = false;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            LRUCache< std::string, osg::ref_ptr<MetaTile> >::Record rec;
+            if ( _recent.get(metaKey, rec) )
+            {
+                meta = rec.value();
+            }
+            else
+            {
+                MetaTileMap::iterator i = _inFlight.find(metaKey);
+                if ( i != _inFlight.end() )
+                {
+                    meta = i->second.get();
+                }
+                else
+                {
+                    meta = new MetaTile();
+                    meta->_x0   = x0;
+                    meta->_y0   = y0;
+                    meta->_cols = osg::minimum(_cols, tilesWide - x0);
+                    meta->_rows = osg::minimum(_rows, tilesHigh - y0);
+                    meta->_canceled   = false;
+                    meta->_needsRetry = false;
+                    _inFlight[metaKey] = meta.get();
+                    fetcherThread = true;
+                }
+            }
+        }
+
+        if ( fetcherThread )
+        {
+            fetch(meta.get(), key, fetcher, op, progress);
+
+            meta->_canceled   = progress && progress->isCanceled();
+            meta->_needsRetry = progress && progress->needsRetry();
+
+            Threading::ScopedMutexLock lock(_mutex);
+            _inFlight.erase(metaKey);
+            if ( !meta->_tiles.empty() )
+                _recent.insert(metaKey, meta.get());
+            meta->_done.set();
+        }
+        else
+        {
+            // wait in slices, so our own caller can give up on the request
+            // without waiting for the thread that owns it.
+            while( !meta->_done.isSet() )
+            {
+                if ( progress && progress->isCanceled() )
+                    return 0L;
+                meta->_done.wait(WAIT_SLICE_MS);
+            }
+
+            if ( meta->_tiles.empty() )
+            {
+                // The thread that owned the request canceled it; that doesn't
+                // apply to us, so try again.
+                if ( meta->_canceled && !(progress && progress->isCanceled()) )
+                {
+                    meta = 0L;
+                    continue;
+                }
+
+                // Pass along a transient failure so the layer doesn't blacklist the tile.
+                if ( meta->_needsRetry && progress )
+                    progress->setNeedsRetry( true );
+            }
+            else
+            {
+                ++_numShared;
+            }
+        }
+    }
+
+    if ( meta->_tiles.empty() )
+        return 0L;
+
+    unsigned index = (key.getTileY() - meta->_y0) * meta->_cols + (key.getTileX() - meta->_x0);
+    osg::Image* tile = meta->_tiles[index].get();
+
+    // copy, since the caller owns the result and may modify it.
+    return tile ? ImageUtils::cloneImage(tile) : 0L;
+}
+
+void
+MetaTiler::fetch(MetaTile*                   meta,
+                 const TileKey&              key,
+                 Fetcher*                    fetcher,
+                 TileSource::ImageOperation* op,
+                 ProgressCallback*           progress)
+{
+    // the union of the extents of all the tiles in the metatile:
+    const Profile* profile = key.getProfile();
+    GeoExtent extent = TileKey(key.getLOD(), meta->_x0, meta->_y0, profile).getExtent();
+    extent.expandToInclude(
+        TileKey(key.getLOD(), meta->_x0 + meta->_cols - 1, meta->_y0 + meta->_rows - 1, profile).getExtent());
+
+    // adjacent tiles share "overlap" pixels:
+    const unsigned stride = _tileSize - _overlap;
+    const unsigned width  = meta->_cols * stride + _overlap;
+    const unsigned height = meta->_rows * stride + _overlap;
+
+    ++_numRequests;
+
+    osg::ref_ptr<osg::Image> image = fetcher->fetchMetaTile(extent, width, height, progress);
+    if ( !image.valid() )
+        return;
+
+    if ( progress && progress->isCanceled() )
+        return;
+
+    // a compressed image can't be split, so unpack it first.
+    if ( ImageUtils::isCompressed(image.get()) )
+    {
+        if ( !ImageUtils::canConvert(image.get(), GL_RGBA, GL_UNSIGNED_BYTE) )
+        {
+            OE_WARN << LC << "Cannot split compressed metatile image" << std::endl;
+            return;
+        }
+        image = ImageUtils::convertToRGBA8(image.get());
+    }
+
+    // some servers clamp the size of the response.
+    if ( image->s() != (int)width || image->t() != (int)height )
+    {
+        OE_DEBUG << LC << "Server returned " << image->s() << "x" << image->t()
+            << " instead of " << width << "x" << height << "; resampling" << std::endl;
+
+        osg::ref_ptr<osg::Image> resized;
+        if ( !ImageUtils::resizeImage(image.get(), width, height, resized) )
+            return;
+        image = resized.get();
+    }
+
+    // split it up. Row 0 of the image is the southern edge, but row 0 of the
+    // metatile (like TileKey Y) is the northern one.
+    meta->_tiles.resize(meta->_cols * meta->_rows);
+    for(unsigned r = 0; r < meta->_rows; ++r)
+    {
+        for(unsigned c = 0; c < meta->_cols; ++c)
+        {
+            osg::ref_ptr<osg::Image> tile = copySubImage(
+                image.get(),
+                c * stride,
+                (meta->_rows - 1 - r) * stride,
+                _tileSize);
+
+            if ( op )
+                (*op)( tile );
+
+            meta->_tiles[r * meta->_cols + c] = tile.get();
+        }
+    }
+
+    writeSiblings(meta, key);
+}
+
+void
+MetaTiler::writeSiblings(const MetaTile* meta, const TileKey& key)
+{
+    // A sibling the operation rejected (e.g. the layer's nodata image) has
+    // nothing to offer this session, just like a requested tile that failed.
+    if ( _blacklist.valid() )
+    {
+        for(unsigned r = 0; r < meta->_rows; ++r)
+        {
+            for(unsigned c = 0; c < meta->_cols; ++c)
+            {
+                TileKey sibling(key.getLOD(), meta->_x0 + c, meta->_y0 + r, key.getProfile());
+                if ( !meta->_tiles[r * meta->_cols + c].valid() && sibling != key )
+                    _blacklist->add( sibling );
+            }
+        }
+    }
+
+    CacheSettings* settings = CacheSettings::get(_layerOptions.get());
+    if ( !settings || !settings->isCacheEnabled() || !settings->cachePolicy()->isCacheWriteable() )
+        return;
+
+    CacheBin* bin = settings->getCacheBin();
+    if ( !bin )
+        return;
+
+    // The layer caches tiles in the map's profile. Siblings are in the source's
+    // profile, so they are only useful if the two match.
+    const TerrainLayer::CacheBinMetadata* binMeta =
+        dynamic_cast<const TerrainLayer::CacheBinMetadata*>(bin->getMetadata());
+
+    if ( !binMeta || !binMeta->_cacheProfile.isSet() )
+        return;
+
+    osg::ref_ptr<const Profile> cacheProfile = Profile::create(binMeta->_cacheProfile.get());
+    if ( !cacheProfile.valid() || !cacheProfile->isHorizEquivalentTo(key.getProfile()) )
+        return;
+
+    for(unsigned r = 0; r < meta->_rows; ++r)
+    {
+        for(unsigned c = 0; c < meta->_cols; ++c)
+        {
+            const osg::Image* tile = meta->_tiles[r * meta->_cols + c].get();
+
+            TileKey sibling(key.getLOD(), meta->_x0 + c, meta->_y0 + r, key.getProfile());
+
+            // the layer writes the requested tile itself.
+            if ( !tile || sibling == key )
+                continue;
+
+            // the layer would not ask the source for a blacklisted tile either.
+            if ( _blacklist.valid() && _blacklist->contains(sibling) )
+                continue;
+
+            bin->write(ImageLayer::getCacheKey(sibling), tile, 0L);
+        }
+    }
+}
@@ -84,6 +84,7 @@ ConsoleProgressCallback::reportProgress(double current, double total,
         OE_NOTICE 
             << "Stage " << (stage+1) << "/" << numStages 
             << "; completed " << percentComplete << "% " << current << " of " << total 
+            << (msg.empty() ? "" : "; ") << msg
             << std::endl;
     }
     else
@@ -150,7 +150,8 @@ _overrideCachePolicyInitialized( false )
 
 Registry::~Registry()
 {
-    //nop
+    // stop the HTTP transfer thread while the rest of the process is intact.
+    HTTPClient::globalShutdown();
 }
 
 Registry*
@@ -263,7 +263,10 @@ _tileSourceExpected(true)
 
 TerrainLayer::~TerrainLayer()
 {
-    //nop
+    if (_tileSource.valid())
+    {
+        _tileSource->getBlacklist()->flush();
+    }
 }
 
 void
@@ -413,6 +416,15 @@ TerrainLayer::open()
             {
                 _cacheSettings->setCacheBin(bin);
                 OE_INFO << LC << "Cache bin is [" << bin->getID() << "]\n";
+
+                // remember the tiles that have no data from one session to
+                // the next, so they aren't requested again.
+                if (_tileSource.valid() &&
+                    _cacheSettings->cachePolicy()->isCacheWriteable() &&
+                    _tileSource->getOptions().blacklistTTL().get() > 0u)
+                {
+                    _tileSource->getBlacklist()->setCacheBin(bin);
+                }
             }
         }
 
@@ -432,6 +444,11 @@ TerrainLayer::open()
 void
 TerrainLayer::close()
 {
+    if (_tileSource.valid())
+    {
+        _tileSource->getBlacklist()->flush();
+    }
+
     setProfile(0L);
     _tileSource = 0L;
     _openCalled = false;
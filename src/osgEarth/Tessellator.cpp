@@ -19,386 +19,906 @@
 * You should have received a copy of the GNU Lesser General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
-#include <limits.h>
-
 #include <osgEarth/Tessellator>
+#include <osgEarth/Notify>
+#include <algorithm>
+#include <deque>
+#include <float.h>
+#include <math.h>
 
 using namespace osgEarth;
 
 
 #define LC "[Tessellator] "
 
+// rings with more vertices than this are clipped with the z-order index
+#define MIN_VERTS_FOR_ZORDER 80u
+
+// largest tolerated difference between the triangulated area and the
+// polygon area, relative to the polygon area
+#define MAX_AREA_DEVIATION 1e-4
+
 /***************************************************/
 
 namespace
 {
-
-// Borrowed from osgUtil/DelaunayTriangulator.cpp
-// Compute the circumcircle of a triangle (only x and y coordinates are used),
-// return (Cx, Cy, r^2)
-inline osg::Vec3 compute_circumcircle(
-    const osg::Vec3 &a,
-    const osg::Vec3 &b,
-    const osg::Vec3 &c)
-{
-    float D =
-        (a.x() - c.x()) * (b.y() - c.y()) -
-        (b.x() - c.x()) * (a.y() - c.y());
-
-    float cx, cy, r2;
-
-    if(D==0.0)
+    // A vertex in a circular, doubly linked ring. The z-order links
+    // chain the nodes in the order of their z-order curve values.
+    struct Node
     {
-        // (Nearly) degenerate condition - either two of the points are equal (which we discount)
-        // or the three points are colinear. In this case we just determine the average of
-        // the three points as the centre for correctness, but squirt out a zero radius.
-        // This method will produce a triangulation with zero area, so we have to check later
-        cx = (a.x()+b.x()+c.x())/3.0;
-        cy = (a.y()+b.y()+c.y())/3.0;
-        r2 = 0.0;
-    }
-    else
+        Node(unsigned int index, double x_, double y_) :
+            i(index), x(x_), y(y_), prev(0L), next(0L), z(0u), prevZ(0L), nextZ(0L), steiner(false) { }
+
+        unsigned int i;
+        double       x, y;
+        Node*        prev;
+        Node*        next;
+        unsigned int z;
+        Node*        prevZ;
+        Node*        nextZ;
+        bool         steiner;
+    };
+
+    typedef std::vector<unsigned int> Triangles;
+
+    // twice the signed area of a ring; positive for counter-clockwise
+    double ringArea(const osg::Vec3Array& vertices, unsigned int first, unsigned int last)
     {
-        cx =
-        (((a.x() - c.x()) * (a.x() + c.x()) +
-        (a.y() - c.y()) * (a.y() + c.y())) / 2 * (b.y() - c.y()) -
-        ((b.x() - c.x()) * (b.x() + c.x()) +
-        (b.y() - c.y()) * (b.y() + c.y())) / 2 * (a.y() - c.y())) / D;
-
-        cy =
-        (((b.x() - c.x()) * (b.x() + c.x()) +
-        (b.y() - c.y()) * (b.y() + c.y())) / 2 * (a.x() - c.x()) -
-        ((a.x() - c.x()) * (a.x() + c.x()) +
-        (a.y() - c.y()) * (a.y() + c.y())) / 2 * (b.x() - c.x())) / D;
-
-      //  r2 = (c.x() - cx) * (c.x() - cx) + (c.y() - cy) * (c.y() - cy);
-        // the return r square is compared with r*r many times in an inner loop
-        // so for efficiency use the inefficient sqrt once rather than 30* multiplies later.
-        r2 = sqrt((c.x() - cx) * (c.x() - cx) + (c.y() - cy) * (c.y() - cy));
+        double sum = 0.0;
+        for(unsigned int i = first, j = last-1; i < last; j = i++)
+        {
+            sum += ((double)vertices[j].x() - (double)vertices[i].x()) *
+                   ((double)vertices[i].y() + (double)vertices[j].y());
+        }
+        return sum;
     }
-    return osg::Vec3(cx, cy, r2);
-}
 
-// Test whether a point (only the x and y coordinates are used) lies inside
-// a circle; the circle is passed as a vector: (Cx, Cy, r).
+    // whether a point lies inside a ring (even-odd rule)
+    bool pointInRing(const osg::Vec3Array& vertices, unsigned int first, unsigned int last, const osg::Vec3& p)
+    {
+        bool inside = false;
+        for(unsigned int i = first, j = last-1; i < last; j = i++)
+        {
+            const osg::Vec3& a = vertices[i];
+            const osg::Vec3& b = vertices[j];
+            if ( ((a.y() > p.y()) != (b.y() > p.y())) &&
+                 (p.x() < (b.x() - a.x()) * (p.y() - a.y()) / (b.y() - a.y()) + a.x()) )
+            {
+                inside = !inside;
+            }
+        }
+        return inside;
+    }
 
-inline bool point_in_circle(const osg::Vec3 &point, const osg::Vec3 &circle)
-{
-    float r2 =
-        (point.x() - circle.x()) * (point.x() - circle.x()) +
-        (point.y() - circle.y()) * (point.y() - circle.y());
-    return r2 <= circle.z()*circle.z();
-//    return r2 <= circle.z();
-}
+    /**
+     * Ear clipper after the "earcut" approach: holes are bridged into the
+     * outer ring (Eberly's method), and for large rings the search for
+     * vertices inside a candidate ear only visits the vertices whose z-order
+     * values fall within the ear's bounding box. When no ear is found it
+     * filters out degenerate vertices, then cures small self-intersections,
+     * then splits the ring along a valid diagonal.
+     */
+    class EarClipper
+    {
+    public:
+        EarClipper(const osg::Vec3Array& vertices) :
+            _vertices(vertices), _minX(0.0), _minY(0.0), _invSize(0.0) { }
 
-int checkCCW(double x1, double y1, double x2, double y2, double x3, double y3)
-{
-    double v = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
-    return (v == 0.0 ? 0 : (v > 0.0 ? 1 : -1));
-}
+        void run(unsigned int first, unsigned int last,
+                 const std::vector< std::pair<unsigned int, unsigned int> >& holes,
+                 Triangles& output)
+        {
+            Node* outer = linkedList(first, last, true);
+            if ( !outer || outer->next == outer->prev )
+                return;
 
-//bool point_in_tri(const osg::Vec3 &p, const osg::Vec3 &t1, const osg::Vec3 &t2, const osg::Vec3 &t3)
-bool point_in_tri(double xp, double yp, double x1, double y1, double x2, double y2, double x3, double y3)
-{
-  int t1 = checkCCW(xp, yp, x1, y1, x2, y2);
-  int t2 = checkCCW(xp, yp, x2, y2, x3, y3);
-  int t3 = checkCCW(xp, yp, x3, y3, x1, y1);
+            if ( !holes.empty() )
+                outer = eliminateHoles(holes, outer);
 
-  return t1 == t2 && t2 == t3;
-}
+            if ( last - first > MIN_VERTS_FOR_ZORDER )
+            {
+                double maxX, maxY;
+                _minX = maxX = _vertices[first].x();
+                _minY = maxY = _vertices[first].y();
+                for(unsigned int i = first+1; i < last; ++i)
+                {
+                    const osg::Vec3& v = _vertices[i];
+                    _minX = std::min(_minX, (double)v.x()); maxX = std::max(maxX, (double)v.x());
+                    _minY = std::min(_minY, (double)v.y()); maxY = std::max(maxY, (double)v.y());
+                }
 
-struct TriIndices
-{
-    unsigned int a;
-    unsigned int b;
-    unsigned int c;
+                // the z-order hash works on 15-bit integer coordinates
+                double size = std::max(maxX - _minX, maxY - _minY);
+                _invSize = size != 0.0 ? 32767.0 / size : 0.0;
+            }
 
-    TriIndices(unsigned int p1, unsigned int p2, unsigned int p3)
-      : a(p1), b(p2), c(p3)
-    {
-      //nop
-    }
-};
+            earcutLinked(outer, output, 0);
+        }
 
-typedef std::vector<TriIndices> TriList;
+    private:
+        const osg::Vec3Array& _vertices;
+        std::deque<Node>      _nodes;
+        double                _minX, _minY, _invSize;
 
-}
+        Node* insertNode(unsigned int i, Node* last)
+        {
+            _nodes.push_back(Node(i, _vertices[i].x(), _vertices[i].y()));
+            Node* p = &_nodes.back();
+            if ( !last )
+            {
+                p->prev = p;
+                p->next = p;
+            }
+            else
+            {
+                p->next = last->next;
+                p->prev = last;
+                last->next->prev = p;
+                last->next = p;
+            }
+            return p;
+        }
 
-bool
-Tessellator::tessellateGeometry(osg::Geometry &geom)
-{
-    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+        static void removeNode(Node* p)
+        {
+            p->next->prev = p->prev;
+            p->prev->next = p->next;
+            if ( p->prevZ ) p->prevZ->nextZ = p->nextZ;
+            if ( p->nextZ ) p->nextZ->prevZ = p->prevZ;
+        }
 
-    if (!vertices || vertices->empty() || geom.getPrimitiveSetList().empty()) return false;
+        // builds a ring in the given winding order
+        Node* linkedList(unsigned int first, unsigned int last, bool ccw)
+        {
+            Node* lastNode = 0L;
+            if ( ccw == (ringArea(_vertices, first, last) > 0.0) )
+            {
+                for(unsigned int i = first; i < last; ++i)
+                    lastNode = insertNode(i, lastNode);
+            }
+            else
+            {
+                for(unsigned int i = last; i-- > first; )
+                    lastNode = insertNode(i, lastNode);
+            }
 
-    // copy the original primitive set list
-    osg::Geometry::PrimitiveSetList originalPrimitives = geom.getPrimitiveSetList();
+            if ( lastNode && equals(lastNode, lastNode->next) )
+            {
+                removeNode(lastNode);
+                lastNode = lastNode->next;
+            }
+            return lastNode;
+        }
 
-    // clear the primitive sets
-    unsigned int nprimsetoriginal= geom.getNumPrimitiveSets();
-    if (nprimsetoriginal) geom.removePrimitiveSet(0, nprimsetoriginal);
+        // removes duplicate and collinear vertices
+        static Node* filterPoints(Node* start, Node* end =0L)
+        {
+            if ( !start )
+                return start;
+            if ( !end )
+                end = start;
+
+            Node* p = start;
+            bool again;
+            do
+            {
+                again = false;
+                if ( !p->steiner && (equals(p, p->next) || area(p->prev, p, p->next) == 0.0) )
+                {
+                    removeNode(p);
+                    p = end = p->prev;
+                    if ( p == p->next )
+                        break;
+                    again = true;
+                }
+                else
+                {
+                    p = p->next;
+                }
+            }
+            while( again || p != end );
 
-    bool success = true;
-    for (unsigned int i=0; i < originalPrimitives.size(); i++)
-    {
-        osg::ref_ptr<osg::PrimitiveSet> primitive = originalPrimitives[i].get();
+            return end;
+        }
 
-        if (primitive->getMode()==osg::PrimitiveSet::POLYGON || primitive->getMode()==osg::PrimitiveSet::LINE_LOOP)
+        void earcutLinked(Node* ear, Triangles& output, int pass)
         {
-            if (primitive->getType()==osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+            if ( !ear )
+                return;
+
+            if ( pass == 0 && _invSize != 0.0 )
+                indexCurve(ear);
+
+            Node* stop = ear;
+            while( ear->prev != ear->next )
             {
-                osg::DrawArrayLengths* drawArrayLengths = static_cast<osg::DrawArrayLengths*>(primitive.get());
-                unsigned int first = drawArrayLengths->getFirst();
-                for(osg::DrawArrayLengths::iterator itr=drawArrayLengths->begin();
-                    itr!=drawArrayLengths->end();
-                    ++itr)
+                Node* prev = ear->prev;
+                Node* next = ear->next;
+
+                if ( _invSize != 0.0 ? isEarHashed(ear) : isEar(ear) )
                 {
-                    unsigned int last = first + *itr;
-                    osg::PrimitiveSet* newPrimitive = tessellatePrimitive(first, last, vertices);
-                    if (newPrimitive)
+                    output.push_back(prev->i);
+                    output.push_back(ear->i);
+                    output.push_back(next->i);
+
+                    removeNode(ear);
+
+                    // skipping the next vertex leads to fewer sliver triangles
+                    ear = next->next;
+                    stop = next->next;
+                    continue;
+                }
+
+                ear = next;
+
+                // went all the way around without finding an ear:
+                if ( ear == stop )
+                {
+                    if ( pass == 0 )
                     {
-                        geom.addPrimitiveSet(newPrimitive);
+                        earcutLinked(filterPoints(ear), output, 1);
                     }
-                    else
+                    else if ( pass == 1 )
                     {
-                        // tessellation failed, add old primitive set back
-                        geom.addPrimitiveSet(primitive);
-                        success = false;
+                        ear = cureLocalIntersections(filterPoints(ear), output);
+                        earcutLinked(ear, output, 2);
                     }
+                    else if ( pass == 2 )
+                    {
+                        splitEarcut(ear, output);
+                    }
+                    break;
+                }
+            }
+        }
 
-                    first = last;
+        static bool isEar(Node* ear)
+        {
+            const Node* a = ear->prev;
+            const Node* b = ear;
+            const Node* c = ear->next;
+
+            if ( area(a, b, c) >= 0.0 )
+                return false; // reflex
+
+            double x0 = std::min(a->x, std::min(b->x, c->x)), y0 = std::min(a->y, std::min(b->y, c->y));
+            double x1 = std::max(a->x, std::max(b->x, c->x)), y1 = std::max(a->y, std::max(b->y, c->y));
+
+            for(const Node* p = c->next; p != a; p = p->next)
+            {
+                if ( inEar(p, a, b, c, x0, y0, x1, y1) )
+                    return false;
+            }
+            return true;
+        }
+
+        bool isEarHashed(Node* ear) const
+        {
+            const Node* a = ear->prev;
+            const Node* b = ear;
+            const Node* c = ear->next;
+
+            if ( area(a, b, c) >= 0.0 )
+                return false; // reflex
+
+            double x0 = std::min(a->x, std::min(b->x, c->x)), y0 = std::min(a->y, std::min(b->y, c->y));
+            double x1 = std::max(a->x, std::max(b->x, c->x)), y1 = std::max(a->y, std::max(b->y, c->y));
+
+            // z-order range of the ear's bounding box
+            unsigned int minZ = zOrder(x0, y0);
+            unsigned int maxZ = zOrder(x1, y1);
+
+            const Node* p = ear->prevZ;
+            const Node* n = ear->nextZ;
+
+            // search outward in both directions at once
+            while( p && p->z >= minZ && n && n->z <= maxZ )
+            {
+                if ( p != a && p != c && inEar(p, a, b, c, x0, y0, x1, y1) )
+                    return false;
+                p = p->prevZ;
+
+                if ( n != a && n != c && inEar(n, a, b, c, x0, y0, x1, y1) )
+                    return false;
+                n = n->nextZ;
+            }
+
+            while( p && p->z >= minZ )
+            {
+                if ( p != a && p != c && inEar(p, a, b, c, x0, y0, x1, y1) )
+                    return false;
+                p = p->prevZ;
+            }
+
+            while( n && n->z <= maxZ )
+            {
+                if ( n != a && n != c && inEar(n, a, b, c, x0, y0, x1, y1) )
+                    return false;
+                n = n->nextZ;
+            }
+
+            return true;
+        }
+
+        // whether a reflex vertex lies in the ear a-b-c
+        static bool inEar(const Node* p, const Node* a, const Node* b, const Node* c,
+                          double x0, double y0, double x1, double y1)
+        {
+            return
+                p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 &&
+                pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                area(p->prev, p, p->next) >= 0.0;
+        }
+
+        // clips off the triangles at small self-intersections
+        static Node* cureLocalIntersections(Node* start, Triangles& output)
+        {
+            Node* p = start;
+            do
+            {
+                Node* a = p->prev;
+                Node* b = p->next->next;
+
+                if ( !equals(a, b) && intersects(a, p, p->next, b) && locallyInside(a, b) && locallyInside(b, a) )
+                {
+                    output.push_back(a->i);
+                    output.push_back(p->i);
+                    output.push_back(b->i);
+
+                    removeNode(p);
+                    removeNode(p->next);
+
+                    p = start = b;
                 }
+                p = p->next;
             }
-            else
+            while( p != start );
+
+            return filterPoints(p);
+        }
+
+        // splits the ring in two along a valid diagonal and clips each half
+        void splitEarcut(Node* start, Triangles& output)
+        {
+            Node* a = start;
+            do
             {
-                if (primitive->getNumIndices()>=3)
+                Node* b = a->next->next;
+                while( b != a->prev )
                 {
-                    osg::PrimitiveSet* newPrimitive = tessellatePrimitive(primitive.get(), vertices);
-                    if (newPrimitive)
-                    {
-                        geom.addPrimitiveSet(newPrimitive);
-                    }
-                    else
+                    if ( a->i != b->i && isValidDiagonal(a, b) )
                     {
-                        // tessellation failed, add old primitive set back
-                        geom.addPrimitiveSet(primitive);
-                        success = false;
+                        Node* c = splitPolygon(a, b);
+
+                        a = filterPoints(a, a->next);
+                        c = filterPoints(c, c->next);
+
+                        earcutLinked(a, output, 0);
+                        earcutLinked(c, output, 0);
+                        return;
                     }
+                    b = b->next;
                 }
+                a = a->next;
             }
+            while( a != start );
         }
-        else
+
+        static bool compareX(const Node* a, const Node* b)
         {
-            //
-            // TODO: handle more primitive modes
-            //
+            return a->x < b->x;
         }
-    }
 
-    return success;
-}
+        // links every hole into the outer ring, left to right
+        Node* eliminateHoles(const std::vector< std::pair<unsigned int, unsigned int> >& holes, Node* outer)
+        {
+            std::vector<Node*> queue;
+            for(unsigned int h = 0; h < holes.size(); ++h)
+            {
+                Node* list = linkedList(holes[h].first, holes[h].second, false);
+                if ( !list )
+                    continue;
+                if ( list == list->next )
+                    list->steiner = true;
+                queue.push_back(getLeftmost(list));
+            }
 
+            std::sort(queue.begin(), queue.end(), compareX);
 
-osg::PrimitiveSet*
-Tessellator::tessellatePrimitive(osg::PrimitiveSet* primitive, osg::Vec3Array* vertices)
-{
-    //
-    //TODO: Hnadle more primitive types
-    //
+            for(unsigned int h = 0; h < queue.size(); ++h)
+            {
+                outer = eliminateHole(queue[h], outer);
+            }
+            return outer;
+        }
 
-    switch(primitive->getType())
-    {
-    case(osg::PrimitiveSet::DrawArraysPrimitiveType):
-        {
-            osg::DrawArrays* drawArray = static_cast<osg::DrawArrays*>(primitive);
-            unsigned int first = drawArray->getFirst();
-            unsigned int last = first+drawArray->getCount();
-            return tessellatePrimitive(first, last, vertices);
-         }
-    default:
-        OE_NOTICE << LC << "Primitive type " << primitive->getType()<< " not handled" << std::endl;
-        break;
-    }
+        Node* eliminateHole(Node* hole, Node* outer)
+        {
+            Node* bridge = findHoleBridge(hole, outer);
+            if ( !bridge )
+                return outer;
 
-    return 0L;
-}
+            Node* bridgeReverse = splitPolygon(bridge, hole);
+            filterPoints(bridgeReverse, bridgeReverse->next);
+            return filterPoints(bridge, bridge->next);
+        }
 
-osg::PrimitiveSet*
-Tessellator::tessellatePrimitive(unsigned int first, unsigned int last, osg::Vec3Array* vertices)
-{
-    std::vector<unsigned int> activeVerts;
-    activeVerts.reserve( last-first+1 );
-    for (unsigned int i=first; i < last; i++)
-    {
-        activeVerts.push_back(i);
-    }
+        // David Eberly's method for connecting a hole to the outer ring
+        static Node* findHoleBridge(Node* hole, Node* outer)
+        {
+            Node* p = outer;
+            double hx = hole->x, hy = hole->y;
+            double qx = -DBL_MAX;
+            Node* m = 0L;
+
+            // find the segment hit by a ray from the hole's leftmost point to
+            // the left; its endpoint with the lesser x is the candidate.
+            do
+            {
+                if ( hy <= p->y && hy >= p->next->y && p->next->y != p->y )
+                {
+                    double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+                    if ( x <= hx && x > qx )
+                    {
+                        qx = x;
+                        m = p->x < p->next->x ? p : p->next;
+                        if ( x == hx )
+                            return m; // hole touches the outer segment
+                    }
+                }
+                p = p->next;
+            }
+            while( p != outer );
 
-    TriList tris;
-    tris.reserve( activeVerts.size() );
+            if ( !m )
+                return 0L;
 
-    bool success = true;
-    unsigned int cursor = 0;
-    unsigned int cursor_start = 0;
-    unsigned int tradCursor = UINT_MAX;
-    while (activeVerts.size() > 3)
-    {
-        if (isConvex(*vertices, activeVerts, cursor))
-        {
-            bool tradEar = tradCursor != UINT_MAX;
-            if (isEar(*vertices, activeVerts, cursor, tradEar))
+            // if vertices lie inside the triangle of the hole point, the
+            // intersection and the candidate, take the one at the smallest
+            // angle to the ray instead.
+            const Node* stop = m;
+            double mx = m->x, my = m->y;
+            double tanMin = DBL_MAX;
+
+            p = m;
+            do
             {
-                unsigned int prev = cursor == 0 ? activeVerts.size() - 1 : cursor - 1;
-                unsigned int next = cursor == activeVerts.size() - 1 ? 0 : cursor + 1;
+                if ( hx >= p->x && p->x >= mx && hx != p->x &&
+                     pointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y) )
+                {
+                    double tan = fabs(hy - p->y) / (hx - p->x);
+                    if ( locallyInside(p, hole) &&
+                        (tan < tanMin || (tan == tanMin && (p->x > m->x || (p->x == m->x && sectorContainsSector(m, p))))) )
+                    {
+                        m = p;
+                        tanMin = tan;
+                    }
+                }
+                p = p->next;
+            }
+            while( p != stop );
 
-                tris.push_back(TriIndices(activeVerts[prev], activeVerts[cursor], activeVerts[next]));
-              
-                activeVerts.erase(activeVerts.begin() + cursor);
-                if (cursor >= activeVerts.size())
-                    cursor = 0;
+            return m;
+        }
 
-                cursor_start = cursor;
-                tradCursor = UINT_MAX;
+        static bool sectorContainsSector(const Node* m, const Node* p)
+        {
+            return area(m->prev, m, p->prev) < 0.0 && area(p->next, m, m->next) < 0.0;
+        }
 
-                continue;
+        // links the nodes in z-order
+        void indexCurve(Node* start)
+        {
+            Node* p = start;
+            do
+            {
+                if ( p->z == 0u )
+                    p->z = zOrder(p->x, p->y);
+                p->prevZ = p->prev;
+                p->nextZ = p->next;
+                p = p->next;
             }
-            
-            if (tradEar && tradCursor == UINT_MAX)
+            while( p != start );
+
+            p->prevZ->nextZ = 0L;
+            p->prevZ = 0L;
+
+            sortLinked(p);
+        }
+
+        // Simon Tatham's merge sort for linked lists
+        static Node* sortLinked(Node* list)
+        {
+            unsigned int inSize = 1u;
+            unsigned int numMerges;
+            do
             {
-                tradCursor = cursor;
+                Node* p = list;
+                Node* tail = 0L;
+                list = 0L;
+                numMerges = 0u;
+
+                while( p )
+                {
+                    ++numMerges;
+                    Node* q = p;
+                    unsigned int pSize = 0u;
+                    for(unsigned int i = 0; i < inSize; ++i)
+                    {
+                        ++pSize;
+                        q = q->nextZ;
+                        if ( !q )
+                            break;
+                    }
+
+                    unsigned int qSize = inSize;
+                    while( pSize > 0u || (qSize > 0u && q) )
+                    {
+                        Node* e;
+                        if ( pSize != 0u && (qSize == 0u || !q || p->z <= q->z) )
+                        {
+                            e = p;
+                            p = p->nextZ;
+                            --pSize;
+                        }
+                        else
+                        {
+                            e = q;
+                            q = q->nextZ;
+                            --qSize;
+                        }
+
+                        if ( tail )
+                            tail->nextZ = e;
+                        else
+                            list = e;
+
+                        e->prevZ = tail;
+                        tail = e;
+                    }
+                    p = q;
+                }
+
+                tail->nextZ = 0L;
+                inSize *= 2u;
             }
+            while( numMerges > 1u );
+
+            return list;
         }
 
-        cursor++;
-        if (cursor >= activeVerts.size())
-            cursor = 0;
+        // interleaves the bits of the 15-bit integer coordinates
+        unsigned int zOrder(double x, double y) const
+        {
+            unsigned int ix = (unsigned int)osg::clampBetween((x - _minX) * _invSize, 0.0, 32767.0);
+            unsigned int iy = (unsigned int)osg::clampBetween((y - _minY) * _invSize, 0.0, 32767.0);
+
+            ix = (ix | (ix << 8)) & 0x00FF00FF;
+            ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+            ix = (ix | (ix << 2)) & 0x33333333;
+            ix = (ix | (ix << 1)) & 0x55555555;
+
+            iy = (iy | (iy << 8)) & 0x00FF00FF;
+            iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+            iy = (iy | (iy << 2)) & 0x33333333;
+            iy = (iy | (iy << 1)) & 0x55555555;
+
+            return ix | (iy << 1);
+        }
 
-        if (cursor == cursor_start)
+        static Node* getLeftmost(Node* start)
         {
-            if (tradCursor != UINT_MAX)
+            Node* p = start;
+            Node* leftmost = start;
+            do
             {
-                // No ear was found with circumcircle test, use first traditional ear found
+                if ( p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y) )
+                    leftmost = p;
+                p = p->next;
+            }
+            while( p != start );
+            return leftmost;
+        }
+
+        static bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+        {
+            return
+                (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+                (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+                (bx - px) * (cy - py) >= (cx - px) * (by - py);
+        }
 
-                cursor = tradCursor;
+        // whether the diagonal a-b lies inside the ring
+        static bool isValidDiagonal(const Node* a, const Node* b)
+        {
+            return
+                a->next->i != b->i && a->prev->i != b->i && !intersectsPolygon(a, b) &&
+                ((locallyInside(a, b) && locallyInside(b, a) && middleInside(a, b) &&
+                  (area(a->prev, a, b->prev) != 0.0 || area(a, b->prev, b) != 0.0)) ||
+                 (equals(a, b) && area(a->prev, a, a->next) > 0.0 && area(b->prev, b, b->next) > 0.0));
+        }
+
+        // twice the signed area of a triangle; negative for counter-clockwise
+        static double area(const Node* p, const Node* q, const Node* r)
+        {
+            return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+        }
 
-                unsigned int prev = cursor == 0 ? activeVerts.size() - 1 : cursor - 1;
-                unsigned int next = cursor == activeVerts.size() - 1 ? 0 : cursor + 1;
+        static bool equals(const Node* a, const Node* b)
+        {
+            return a->x == b->x && a->y == b->y;
+        }
 
-                tris.push_back(TriIndices(activeVerts[prev], activeVerts[cursor], activeVerts[next]));
-                  
-                activeVerts.erase(activeVerts.begin() + cursor);
-                if (cursor >= activeVerts.size())
-                    cursor = 0;
+        static int sign(double v)
+        {
+            return v > 0.0 ? 1 : v < 0.0 ? -1 : 0;
+        }
 
-                cursor_start = cursor;
-                tradCursor = UINT_MAX;
+        static bool onSegment(const Node* p, const Node* q, const Node* r)
+        {
+            return
+                q->x <= std::max(p->x, r->x) && q->x >= std::min(p->x, r->x) &&
+                q->y <= std::max(p->y, r->y) && q->y >= std::min(p->y, r->y);
+        }
 
-                continue;
-            }
-            else
+        static bool intersects(const Node* p1, const Node* q1, const Node* p2, const Node* q2)
+        {
+            int o1 = sign(area(p1, q1, p2));
+            int o2 = sign(area(p1, q1, q2));
+            int o3 = sign(area(p2, q2, p1));
+            int o4 = sign(area(p2, q2, q1));
+
+            if ( o1 != o2 && o3 != o4 )
+                return true;
+
+            return
+                (o1 == 0 && onSegment(p1, p2, q1)) ||
+                (o2 == 0 && onSegment(p1, q2, q1)) ||
+                (o3 == 0 && onSegment(p2, p1, q2)) ||
+                (o4 == 0 && onSegment(p2, q1, q2));
+        }
+
+        static bool intersectsPolygon(const Node* a, const Node* b)
+        {
+            const Node* p = a;
+            do
             {
-                success = false;
-                break;
+                if ( p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i &&
+                     intersects(p, p->next, a, b) )
+                    return true;
+                p = p->next;
             }
+            while( p != a );
+            return false;
         }
-    }
 
-    if (success)
-    {
-        if (activeVerts.size() == 3)
+        static bool locallyInside(const Node* a, const Node* b)
         {
-            // add last tri
-            tris.push_back(TriIndices(activeVerts[0], activeVerts[1], activeVerts[2]));
+            return area(a->prev, a, a->next) < 0.0 ?
+                area(a, b, a->next) >= 0.0 && area(a, a->prev, b) >= 0.0 :
+                area(a, b, a->prev) < 0.0 || area(a, a->next, b) < 0.0;
         }
 
-        osg::DrawElementsUInt* triElements = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, 0);
-        triElements->reserve( tris.size() * 3 );
-        for (TriList::const_iterator it = tris.begin(); it != tris.end(); ++it)
+        static bool middleInside(const Node* a, const Node* b)
         {
-            triElements->push_back(it->a);
-            triElements->push_back(it->b);
-            triElements->push_back(it->c);
+            const Node* p = a;
+            bool inside = false;
+            double px = 0.5*(a->x + b->x), py = 0.5*(a->y + b->y);
+            do
+            {
+                if ( ((p->y > py) != (p->next->y > py)) && p->next->y != p->y &&
+                     (px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x) )
+                    inside = !inside;
+                p = p->next;
+            }
+            while( p != a );
+            return inside;
         }
 
-        return triElements;
-    }
-    else
-    {
-        //TODO: handle?
-        OE_DEBUG << LC << "Tessellation failed!" << std::endl;
-    }
+        // joins a and b with a bridge. Returns the copy of b on the new ring.
+        Node* splitPolygon(Node* a, Node* b)
+        {
+            _nodes.push_back(Node(a->i, a->x, a->y));
+            Node* a2 = &_nodes.back();
+            _nodes.push_back(Node(b->i, b->x, b->y));
+            Node* b2 = &_nodes.back();
 
-    return 0L;
-}
+            Node* an = a->next;
+            Node* bp = b->prev;
 
+            a->next = b;
+            b->prev = a;
 
-bool
-Tessellator::isConvex(const osg::Vec3Array &vertices, const std::vector<unsigned int> &activeVerts, unsigned int cursor)
-{
-    unsigned int prev = cursor == 0 ? activeVerts.size() - 1 : cursor - 1;
-    unsigned int next = cursor == activeVerts.size() - 1 ? 0 : cursor + 1;
+            a2->next = an;
+            an->prev = a2;
 
-    unsigned int a = activeVerts[prev];
-    unsigned int b = activeVerts[cursor];
-    unsigned int c = activeVerts[next];
+            b2->next = a2;
+            a2->prev = b2;
 
-    osg::Vec3d dataA;
-    dataA._v[0] = vertices[a][0];
-    dataA._v[1] = vertices[a][1];
-    dataA._v[2] = vertices[a][2];
+            bp->next = b2;
+            b2->prev = bp;
 
-    osg::Vec3d dataB;
-    dataB._v[0] = vertices[b][0];
-    dataB._v[1] = vertices[b][1];
-    dataB._v[2] = vertices[b][2];
+            return b2;
+        }
+    };
 
-    osg::Vec3d dataC;
-    dataC._v[0] = vertices[c][0];
-    dataC._v[1] = vertices[c][1];
-    dataC._v[2] = vertices[c][2];
+    struct Ring
+    {
+        Ring(GLenum mode_, unsigned int first_, unsigned int last_) :
+            mode(mode_), first(first_), last(last_) { }
 
-    //http://www.gamedev.net/topic/542870-determine-which-side-of-a-line-a-point-is/#entry4500667
-    //(Bx - Ax) * (Cy - Ay) - (By - Ay) * (Cx - Ax)
+        GLenum       mode;
+        unsigned int first;
+        unsigned int last;
+    };
 
-    return (dataB.x() - dataA.x()) * (dataC.y() - dataA.y()) - (dataB.y() - dataA.y()) * (dataC.x() - dataA.x()) > 0.0;
+    typedef std::vector<Ring> RingList;
 }
 
 bool
-Tessellator::isEar(const osg::Vec3Array &vertices, const std::vector<unsigned int> &activeVerts, unsigned int cursor, bool &tradEar)
+Tessellator::tessellateGeometry(osg::Geometry &geom)
 {
-    unsigned int prev = cursor == 0 ? activeVerts.size() - 1 : cursor - 1;
-    unsigned int next = cursor == activeVerts.size() - 1 ? 0 : cursor + 1;
+    osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
+
+    if (!vertices || vertices->empty() || geom.getPrimitiveSetList().empty()) return false;
+
+    // copy the original primitive set list
+    osg::Geometry::PrimitiveSetList originalPrimitives = geom.getPrimitiveSetList();
+
+    // clear the primitive sets
+    unsigned int nprimsetoriginal= geom.getNumPrimitiveSets();
+    if (nprimsetoriginal) geom.removePrimitiveSet(0, nprimsetoriginal);
+
+    bool success = true;
 
-    osg::Vec3d cc(compute_circumcircle(vertices[activeVerts[prev]], vertices[activeVerts[cursor]], vertices[activeVerts[next]]));
+    // collect the rings of the polygon primitive sets, in order.
+    RingList rings;
+    for (unsigned int i=0; i < originalPrimitives.size(); i++)
+    {
+        osg::ref_ptr<osg::PrimitiveSet> primitive = originalPrimitives[i].get();
+        GLenum mode = primitive->getMode();
 
-    unsigned int nextNext = next == activeVerts.size() - 1 ? 0 : next + 1;
+        if (mode==osg::PrimitiveSet::POLYGON || mode==osg::PrimitiveSet::LINE_LOOP)
+        {
+            if (primitive->getType()==osg::PrimitiveSet::DrawArrayLengthsPrimitiveType)
+            {
+                osg::DrawArrayLengths* drawArrayLengths = static_cast<osg::DrawArrayLengths*>(primitive.get());
+                unsigned int first = drawArrayLengths->getFirst();
+                for(osg::DrawArrayLengths::iterator itr=drawArrayLengths->begin();
+                    itr!=drawArrayLengths->end();
+                    ++itr)
+                {
+                    unsigned int last = first + *itr;
+                    if (*itr >= 3)
+                        rings.push_back(Ring(mode, first, last));
+                    first = last;
+                }
+            }
+            else if (primitive->getType()==osg::PrimitiveSet::DrawArraysPrimitiveType)
+            {
+                osg::DrawArrays* drawArray = static_cast<osg::DrawArrays*>(primitive.get());
+                if (drawArray->getCount() >= 3)
+                {
+                    unsigned int first = drawArray->getFirst();
+                    rings.push_back(Ring(mode, first, first + drawArray->getCount()));
+                }
+            }
+            else
+            {
+                OE_NOTICE << LC << "Primitive type " << primitive->getType()<< " not handled" << std::endl;
+                geom.addPrimitiveSet(primitive.get());
+                success = false;
+            }
+        }
+        else
+        {
+            // leave anything else alone
+            geom.addPrimitiveSet(primitive.get());
+        }
+    }
 
-		// Check every point not part of the ear
-    bool circEar = true;
-		while( nextNext != prev )
-		{
-        unsigned int p = activeVerts[nextNext];
+    // each outer ring takes the holes that follow it.
+    std::vector< std::pair<unsigned int, unsigned int> > holes;
+    for (unsigned int i=0; i < rings.size(); )
+    {
+        const Ring& outer = rings[i];
+        double outerArea = ringArea(*vertices, outer.first, outer.last);
 
-        if (circEar && point_in_circle(vertices[p], cc))
+        holes.clear();
+        unsigned int j = i+1;
+        for( ; j < rings.size(); ++j)
         {
-            circEar = false;
+            const Ring& hole = rings[j];
+            if (ringArea(*vertices, hole.first, hole.last) * outerArea >= 0.0)
+                break;
+
+            // a hole may touch its outer ring, so try a few of its vertices
+            bool inside = false;
+            for (unsigned int k = hole.first; k < hole.last && k < hole.first+3 && !inside; ++k)
+            {
+                inside = pointInRing(*vertices, outer.first, outer.last, (*vertices)[k]);
+            }
+            if (!inside)
+            {
+                // A hole we can't place would come out as a filled ring of
+                // its own; leave the whole geometry to the caller's fallback.
+                geom.removePrimitiveSet(0, geom.getNumPrimitiveSets());
+                for (unsigned int k=0; k < originalPrimitives.size(); ++k)
+                {
+                    geom.addPrimitiveSet(originalPrimitives[k].get());
+                }
+                return false;
+            }
 
-            if (tradEar)
-              return false;
+            holes.push_back(std::make_pair(hole.first, hole.last));
         }
 
-        if (!tradEar &&
-            point_in_tri(vertices[p].x(), vertices[p].y(),
-                         vertices[activeVerts[prev]].x(), vertices[activeVerts[prev]].y(),
-                         vertices[activeVerts[cursor]].x(), vertices[activeVerts[cursor]].y(),
-                         vertices[activeVerts[next]].x(), vertices[activeVerts[next]].y()))
-			  {
-            return false;
-			  }
+        osg::PrimitiveSet* triangles = tessellatePolygon(*vertices, outer.first, outer.last, holes);
+        if (triangles)
+        {
+            geom.addPrimitiveSet(triangles);
+        }
+        else
+        {
+            // tessellation failed, put the rings back
+            for (unsigned int k=i; k < j; ++k)
+            {
+                geom.addPrimitiveSet(new osg::DrawArrays(rings[k].mode, rings[k].first, rings[k].last - rings[k].first));
+            }
+            success = false;
+        }
+
+        i = j;
+    }
+
+    return success;
+}
+
+osg::DrawElementsUInt*
+Tessellator::tessellatePolygon(const osg::Vec3Array& vertices,
+                               unsigned int          first,
+                               unsigned int          last,
+                               const std::vector< std::pair<unsigned int, unsigned int> >& holes)
+{
+    if (last > vertices.size() || last < first + 3)
+        return 0L;
+
+    Triangles tris;
+    tris.reserve( 3 * (last - first) );
+
+    EarClipper clipper(vertices);
+    clipper.run(first, last, holes, tris);
+
+    // Degenerate input (self-intersections, holes crossing the outer ring)
+    // can leave parts uncovered or covered twice, so compare the areas.
+    double expected = fabs(ringArea(vertices, first, last));
+    for (unsigned int h=0; h < holes.size(); ++h)
+    {
+        expected -= fabs(ringArea(vertices, holes[h].first, holes[h].second));
+    }
 
-			  nextNext = nextNext == activeVerts.size() - 1 ? 0 : nextNext + 1;
-		}
+    double actual = 0.0;
+    for (unsigned int t=0; t+2 < tris.size(); t += 3)
+    {
+        const osg::Vec3& a = vertices[tris[t]];
+        const osg::Vec3& b = vertices[tris[t+1]];
+        const osg::Vec3& c = vertices[tris[t+2]];
+        actual += fabs(((double)a.x() - (double)c.x()) * ((double)b.y() - (double)a.y()) -
+                       ((double)a.x() - (double)b.x()) * ((double)c.y() - (double)a.y()));
+    }
+
+    if (tris.empty() || expected <= 0.0 || fabs(actual - expected) > MAX_AREA_DEVIATION * expected)
+    {
+        OE_DEBUG << LC << "Tessellation failed!" << std::endl;
+        return 0L;
+    }
 
-    tradEar = true;
+    osg::DrawElementsUInt* triElements = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, 0);
+    triElements->reserve( tris.size() );
+    for (Triangles::const_iterator it = tris.begin(); it != tris.end(); ++it)
+    {
+        triElements->push_back(*it);
+    }
 
-		return circEar;
-}
\ No newline at end of file
+    return triElements;
+}
@@ -26,10 +26,13 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/MemCache>
 #include <osgEarth/MapFrame>
+#include <osgEarth/IOTypes>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
+#include <fstream>
+#include <sstream>
 
 #define LC "[TileSource] "
 
@@ -40,17 +43,132 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
+// child of the cache bin metadata holding the persistent blacklist. The
+// metadata is not subject to the cache's size limit, unlike the records.
+#define BLACKLIST_KEY "blacklist"
+
+// additions between automatic writes of the persistent blacklist
+#define BLACKLIST_SAVE_PERIOD 32u
+
+namespace
+{
+    const char* s_hexDigits = "0123456789abcdef";
+
+    std::string toHex(const std::vector<unsigned char>& bytes)
+    {
+        std::string out(bytes.size()*2, '0');
+        for (unsigned i = 0; i < bytes.size(); ++i)
+        {
+            out[2*i]   = s_hexDigits[bytes[i] >> 4];
+            out[2*i+1] = s_hexDigits[bytes[i] & 0x0f];
+        }
+        return out;
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    bool fromHex(const std::string& in, std::vector<unsigned char>& bytes)
+    {
+        if (in.size() % 2u != 0u)
+            return false;
+        bytes.resize(in.size()/2);
+        for (unsigned i = 0; i < bytes.size(); ++i)
+        {
+            int hi = hexValue(in[2*i]), lo = hexValue(in[2*i+1]);
+            if (hi < 0 || lo < 0)
+                return false;
+            bytes[i] = (unsigned char)((hi << 4) | lo);
+        }
+        return true;
+    }
+}
+
 TileBlacklist::TileBlacklist() :
-_tiles(true, 1024)
+_tiles      ( true, 1024 ),
+_filterTime ( DateTime().asTimeStamp() ),
+_filterCount( 0u ),
+_capacity   ( 100000u ),
+_ttl        ( 0 ),
+_unsaved    ( 0u )
+{
+    //NOP
+}
+
+TileBlacklist::TileBlacklist(unsigned capacity, TimeSpan ttl) :
+_tiles      ( true, 1024 ),
+_filter     ( capacity ),
+_filterTime ( DateTime().asTimeStamp() ),
+_filterCount( 0u ),
+_capacity   ( std::max(capacity, 1u) ),
+_ttl        ( ttl ),
+_unsaved    ( 0u )
 {
     //NOP
 }
 
+std::string
+TileBlacklist::getPersistentKey(const TileKey& key) const
+{
+    // keys of other profiles must not collide with ours
+    return key.getProfile() ?
+        key.getProfile()->getHorizSignature() + "/" + key.str() :
+        key.str();
+}
+
+bool
+TileBlacklist::expired(TimeStamp t, TimeStamp now) const
+{
+    return _ttl > 0 && now - t > _ttl;
+}
+
 void
-TileBlacklist::add(const TileKey& key)
+TileBlacklist::restartFilter(TimeStamp now)
+{
+    _filter.clear();
+    _filterTime = now;
+    _filterCount = 0u;
+}
+
+void
+TileBlacklist::add(const TileKey& key, bool persistent)
 {
     _tiles.insert(key, true);
     OE_DEBUG << "Added " << key.str() << " to blacklist" << std::endl;
+
+    if (!persistent)
+        return;
+
+    bool saveNow = false;
+    {
+        Threading::ScopedWriteLock lock(_persistentMutex);
+        if (!_bin.valid())
+            return;
+
+        // The filter expires as a whole, and starts over once it holds as
+        // many tiles as it was sized for, before its error rate climbs.
+        TimeStamp now = DateTime().asTimeStamp();
+        if (expired(_filterTime, now) || _filterCount >= _capacity)
+        {
+            restartFilter(now);
+        }
+
+        _filter.insert(getPersistentKey(key));
+        ++_filterCount;
+
+        saveNow = ++_unsaved >= BLACKLIST_SAVE_PERIOD;
+    }
+
+    // if another thread is already writing, the next save picks these up.
+    if (saveNow && _saveMutex.trylock() == 0)
+    {
+        save();
+        _saveMutex.unlock();
+    }
 }
 
 void
@@ -58,6 +176,14 @@ TileBlacklist::remove(const TileKey& key)
 {
     _tiles.erase(key);
     OE_DEBUG << "Removed " << key.str() << " from blacklist" << std::endl;
+
+    Threading::ScopedWriteLock lock(_persistentMutex);
+    if (_bin.valid())
+    {
+        // a Bloom filter can't forget one entry, so start over.
+        restartFilter(DateTime().asTimeStamp());
+        ++_unsaved;
+    }
 }
 
 void
@@ -65,19 +191,123 @@ TileBlacklist::clear()
 {
     _tiles.clear();
     OE_DEBUG << "Cleared blacklist" << std::endl;
+
+    Threading::ScopedWriteLock lock(_persistentMutex);
+    if (_bin.valid())
+    {
+        restartFilter(DateTime().asTimeStamp());
+        ++_unsaved;
+    }
 }
 
 bool
 TileBlacklist::contains(const TileKey& key) const
 {
-    return _tiles.has(key);
+    if (_tiles.has(key))
+        return true;
+
+    Threading::ScopedReadLock lock(_persistentMutex);
+    if (!_bin.valid() || _filterCount == 0u)
+        return false;
+
+    return
+        !expired(_filterTime, DateTime().asTimeStamp()) &&
+        _filter.mightContain(getPersistentKey(key));
+}
+
+void
+TileBlacklist::setCacheBin(CacheBin* bin)
+{
+    Threading::ScopedWriteLock lock(_persistentMutex);
+    _bin = bin;
+    if (_bin.valid())
+        load();
+}
+
+void
+TileBlacklist::flush()
+{
+    Threading::ScopedMutexLock lock(_saveMutex);
+    save();
+}
+
+void
+TileBlacklist::load()
+{
+    Config conf = _bin->readMetadata().child(BLACKLIST_KEY);
+    if (conf.empty())
+        return;
+
+    TimeStamp filterTime = (TimeStamp)conf.value<long long>("time", 0ll);
+    unsigned numHashes = conf.value<unsigned>("hashes", 0u);
+    unsigned count = conf.value<unsigned>("count", 0u);
+
+    std::vector<unsigned char> bits;
+    if (!fromHex(conf.value("bits"), bits) || !_filter.setBits(bits, numHashes))
+    {
+        OE_WARN << LC << "Ignoring an unreadable blacklist in cache bin " << _bin->getID() << std::endl;
+        return;
+    }
+
+    if (expired(filterTime, DateTime().asTimeStamp()))
+    {
+        _filter.clear();
+        return;
+    }
+
+    _filterTime = filterTime;
+    _filterCount = count;
+    OE_INFO << LC << "Loaded a blacklist of " << count << " tiles from cache bin " << _bin->getID() << std::endl;
+}
+
+// Takes a snapshot of the blacklist under the lock and writes it to the bin
+// outside of it, so lookups never wait on the cache. The caller holds
+// _saveMutex, which keeps an older snapshot from overwriting a newer one.
+void
+TileBlacklist::save()
+{
+    osg::ref_ptr<CacheBin> bin;
+    Config conf(BLACKLIST_KEY);
+    {
+        Threading::ScopedWriteLock lock(_persistentMutex);
+        if (!_bin.valid() || _unsaved == 0u)
+            return;
+
+        TimeStamp now = DateTime().asTimeStamp();
+        if (expired(_filterTime, now))
+        {
+            restartFilter(now);
+        }
+
+        conf.set("time",   (long long)_filterTime);
+        conf.set("hashes", _filter.getNumHashes());
+        conf.set("count",  _filterCount);
+        conf.set("bits",   toHex(_filter.getBits()));
+
+        bin = _bin.get();
+        _unsaved = 0u;
+    }
+
+    // keep whatever else is in the metadata.
+    Config meta = bin->readMetadata();
+    meta.update(conf);
+    if (!bin->writeMetadata(meta))
+    {
+        OE_DEBUG << LC << "Cache bin " << bin->getID() << " cannot store the blacklist" << std::endl;
+    }
 }
 
 TileBlacklist*
 TileBlacklist::read(std::istream &in)
 {
     osg::ref_ptr< TileBlacklist > result = new TileBlacklist();
+    result->merge(in);
+    return result.release();
+}
 
+void
+TileBlacklist::merge(std::istream &in)
+{
     while (!in.eof())
     {
         std::string line;
@@ -87,13 +317,11 @@ TileBlacklist::read(std::istream &in)
             int z, x, y;
             if (sscanf(line.c_str(), "%d %d %d", &z, &x, &y) == 3)
             {
-                result->add(TileKey(z, x, y, 0L));
+                add(TileKey(z, x, y, 0L));
             }
 
         }
     }
-
-    return result.release();
 }
 
 TileBlacklist*
@@ -148,6 +376,8 @@ _noDataValue          ( (float)SHRT_MIN ),
 _minValidValue        ( -32000.0f ),
 _maxValidValue        (  32000.0f ),
 _L2CacheSize          ( 16 ),
+_blacklistTTL         ( 0u ),
+_blacklistCapacity    ( 100000u ),
 _bilinearReprojection ( true ),
 _coverage             ( false )
 { 
@@ -164,6 +394,8 @@ TileSourceOptions::getConfig() const
     conf.updateIfSet( "min_valid_value", _minValidValue );
     conf.updateIfSet( "max_valid_value", _maxValidValue );
     conf.updateIfSet( "blacklist_filename", _blacklistFilename);
+    conf.updateIfSet( "blacklist_ttl", _blacklistTTL );
+    conf.updateIfSet( "blacklist_capacity", _blacklistCapacity );
     conf.updateIfSet( "l2_cache_size", _L2CacheSize );
     conf.updateIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.updateIfSet( "max_data_level", _maxDataLevel );
@@ -192,6 +424,8 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "max_valid_value", _maxValidValue );
     conf.getIfSet( "nodata_max", _maxValidValue ); // backcompat
     conf.getIfSet( "blacklist_filename", _blacklistFilename);
+    conf.getIfSet( "blacklist_ttl", _blacklistTTL );
+    conf.getIfSet( "blacklist_capacity", _blacklistCapacity );
     conf.getIfSet( "l2_cache_size", _L2CacheSize );
     conf.getIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.getIfSet( "max_data_level", _maxDataLevel );
@@ -246,20 +480,17 @@ _openCalled( false )
         _blacklistFilename = _options.blacklistFilename().value();
     }
 
-    
-    if (!_blacklistFilename.empty() && osgDB::fileExists(_blacklistFilename))
-    {
-        _blacklist = TileBlacklist::read(_blacklistFilename);
-        if (_blacklist.valid())
-        {
-            OE_INFO << "Read blacklist from file" << _blacklistFilename << std::endl;
-        }
-    }
 
-    if (!_blacklist.valid())
+    _blacklist = new TileBlacklist(
+        _options.blacklistCapacity().get(),
+        (TimeSpan)_options.blacklistTTL().get() );
+    
+    if (!_blacklistFilename.empty() && osgDB::fileExists(_blacklistFilename) &&
+        osgDB::fileType(_blacklistFilename) == osgDB::REGULAR_FILE)
     {
-        //Initialize the blacklist if we couldn't read it.
-        _blacklist = new TileBlacklist();
+        std::ifstream in( _blacklistFilename.c_str() );
+        _blacklist->merge( in );
+        OE_INFO << "Read blacklist from file" << _blacklistFilename << std::endl;
     }
 }
 
@@ -342,39 +573,61 @@ osg::Image*
 TileSource::createImage(const TileKey&        key,
                         ImageOperation*       prepOp, 
                         ProgressCallback*     progress )
+{
+    return readImage(key, prepOp, progress).releaseImage();
+}
+
+ReadResult
+TileSource::readImage(const TileKey&        key,
+                      ImageOperation*       prepOp, 
+                      ProgressCallback*     progress )
 {
     if (getStatus().isError())
-        return 0L;
+        return ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
 
     // Try to get it from the memcache fist
     if (_memCache.valid())
     {
         ReadResult r = _memCache->getOrCreateDefaultBin()->readImage(key.str(), 0L);
         if ( r.succeeded() )
-            return r.releaseImage();
+            return r;
     }
 
-    osg::ref_ptr<osg::Image> newImage = createImage(key, progress);
-
-    if ( prepOp )
-        (*prepOp)( newImage );
+    ReadResult result = readAndPrepareImage(key, prepOp, progress);
 
-    if ( newImage.valid() && _memCache.valid() )
+    if ( result.succeeded() && _memCache.valid() )
     {
         // cache it to the memory cache.
-        _memCache->getOrCreateDefaultBin()->write(key.str(), newImage.get(), 0L);
+        _memCache->getOrCreateDefaultBin()->write(key.str(), result.getImage(), 0L);
     }
 
-    return newImage.release();
+    return result;
+}
+
+bool
+TileSource::readEncodedImage(const TileKey&    key,
+                             std::string&      out_data,
+                             std::string&      out_mimeType,
+                             ProgressCallback* progress)
+{
+    return false;
 }
 
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               HeightFieldOperation* prepOp, 
                               ProgressCallback*     progress )
+{
+    return readHeightField(key, prepOp, progress).release<osg::HeightField>();
+}
+
+ReadResult
+TileSource::readHeightField(const TileKey&        key,
+                            HeightFieldOperation* prepOp, 
+                            ProgressCallback*     progress )
 {
     if (getStatus().isError())
-        return 0L;
+        return ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
 
     // Try to get it from the memcache first:
     if (_memCache.valid())
@@ -382,22 +635,29 @@ TileSource::createHeightField(const TileKey&        key,
         ReadResult r = _memCache->getOrCreateDefaultBin()->readObject(key.str(), 0L);
         if ( r.succeeded() )
         {
-            return r.release<osg::HeightField>();
+            return r;
         }
     }
 
-    osg::ref_ptr<osg::HeightField> newHF = createHeightField( key, progress );
+    ReadResult result = readHeightField( key, progress );
+
+    osg::ref_ptr<osg::HeightField> newHF = result.get<osg::HeightField>();
 
     if ( prepOp )
         (*prepOp)( newHF );
 
-    if ( newHF.valid() && _memCache.valid() )
+    if ( !newHF.valid() )
+    {
+        return result.succeeded() ? ReadResult(ReadResult::RESULT_UNKNOWN_ERROR) : result;
+    }
+
+    if ( _memCache.valid() )
     {
         _memCache->getOrCreateDefaultBin()->write(key.str(), newHF.get(), 0L);
     }
 
     //TODO: why not just newHF.release()? -gw
-    return newHF.valid() ? new osg::HeightField( *newHF.get() ) : 0L;
+    return ReadResult( new osg::HeightField( *newHF.get() ) );
 }
 
 osg::Image*
@@ -407,6 +667,36 @@ TileSource::createImage(const TileKey&    key,
     return 0L;
 }
 
+ReadResult
+TileSource::readImage(const TileKey&    key,
+                      ProgressCallback* progress)
+{
+    osg::ref_ptr<osg::Image> image = createImage(key, progress);
+    return image.valid() ? ReadResult(image.get()) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+}
+
+ReadResult
+TileSource::readAndPrepareImage(const TileKey&    key,
+                                ImageOperation*   prepOp,
+                                ProgressCallback* progress)
+{
+    ReadResult result = readImage(key, progress);
+
+    if ( prepOp )
+    {
+        osg::ref_ptr<osg::Image> image = result.getImage();
+        (*prepOp)( image );
+
+        // the operation may replace the image
+        if ( image.get() != result.getImage() )
+        {
+            return image.valid() ? ReadResult(image.get()) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+        }
+    }
+
+    return result;
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               ProgressCallback*     progress)
@@ -424,6 +714,14 @@ TileSource::createHeightField(const TileKey&        key,
     return hf;
 }
 
+ReadResult
+TileSource::readHeightField(const TileKey&    key,
+                            ProgressCallback* progress)
+{
+    osg::ref_ptr<osg::HeightField> hf = createHeightField(key, progress);
+    return hf.valid() ? ReadResult(hf.get()) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+}
+
 bool
 TileSource::storeHeightField(const TileKey&     key,
                              osg::HeightField*  hf,
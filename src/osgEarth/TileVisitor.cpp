@@ -19,14 +19,144 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#define LC "[TileVisitor] "
 
 using namespace osgEarth;
 
+/*****************************************************************************************/
+
+namespace
+{
+    // Packs a key into 64 bits: 7 bits of LOD and 28 bits each of X and Y.
+    bool packKey(unsigned lod, unsigned x, unsigned y, unsigned long long& out)
+    {
+        const unsigned limit = 1u << 28;
+        if ( lod >= 128u || x >= limit || y >= limit )
+            return false;
+
+        out = ((unsigned long long)lod << 56) | ((unsigned long long)x << 28) | (unsigned long long)y;
+        return true;
+    }
+}
+
+TileJournal::TileJournal( const std::string& filename ):
+_filename( filename ),
+_file( 0L )
+{
+}
+
+TileJournal::~TileJournal()
+{
+    if ( _file )
+    {
+        ::fclose( _file );
+        _file = 0L;
+    }
+}
+
+std::string TileJournal::getPathForLayer( const std::string& folder, const TerrainLayer* layer )
+{
+    std::string name = layer->getName();
+    if ( name.empty() )
+        name = Stringify() << "layer_" << layer->getUID();
+
+    return osgDB::concatPaths( folder, toLegalFileName(name) + ".journal" );
+}
+
+bool TileJournal::open()
+{
+    _resumed.clear();
+
+    bool terminated = true;
+    std::ifstream in( _filename.c_str(), std::ios::in | std::ios::binary );
+    if ( in.is_open() )
+    {
+        std::string line;
+        while( getline(in, line) )
+        {
+            // the last line may be missing its newline if we crashed while writing it.
+            if ( in.eof() )
+            {
+                terminated = line.empty();
+                break;
+            }
+
+            std::vector< std::string > parts;
+            StringTokenizer(line, parts, ",");
+
+            unsigned long long packed;
+            if (parts.size() == 3 &&
+                packKey(as<unsigned>(parts[0], 128u), as<unsigned>(parts[1], 0u), as<unsigned>(parts[2], 0u), packed))
+            {
+                _resumed.push_back( packed );
+            }
+        }
+        in.close();
+    }
+
+    std::sort( _resumed.begin(), _resumed.end() );
+    _resumed.erase( std::unique(_resumed.begin(), _resumed.end()), _resumed.end() );
+
+    makeDirectoryForFile( _filename );
+    _file = ::fopen( _filename.c_str(), "ab" );
+    if ( !_file )
+    {
+        OE_WARN << LC << "Failed to open journal \"" << _filename << "\"" << std::endl;
+        return false;
+    }
+
+    // finish off a torn line so the next record starts fresh.
+    if ( !terminated )
+    {
+        ::fputc( '\n', _file );
+    }
+
+    if ( !_resumed.empty() )
+    {
+        OE_NOTICE << LC << "Resuming from journal \"" << _filename << "\"; "
+            << _resumed.size() << " tiles already done" << std::endl;
+    }
+
+    return true;
+}
+
+bool TileJournal::find( const TileKey& key ) const
+{
+    unsigned long long packed;
+    if ( _resumed.empty() || !packKey(key.getLevelOfDetail(), key.getTileX(), key.getTileY(), packed) )
+        return false;
+
+    return std::binary_search( _resumed.begin(), _resumed.end(), packed );
+}
+
+void TileJournal::record( const TileKey& key )
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _fileMutex );
+    if ( _file )
+    {
+        ::fprintf( _file, "%u, %u, %u\n", key.getLevelOfDetail(), key.getTileX(), key.getTileY() );
+        ::fflush( _file );
+    }
+}
+
+/*****************************************************************************************/
+
 TileVisitor::TileVisitor():
 _total(0),
 _processed(0),
+_resumed(0),
 _minLevel(0),
-_maxLevel(5)
+_maxLevel(5),
+_startTime(0),
+_lastLevel(0),
+_order(ORDER_DEPTH_FIRST),
+_workingSetSize(4096)
 {
 }
 
@@ -35,15 +165,41 @@ TileVisitor::TileVisitor(TileHandler* handler):
 _tileHandler( handler ),
 _total(0),
 _processed(0),
+_resumed(0),
 _minLevel(0),
-_maxLevel(5)
+_maxLevel(5),
+_startTime(0),
+_lastLevel(0),
+_order(ORDER_DEPTH_FIRST),
+_workingSetSize(4096)
 {
 }
 
 void TileVisitor::resetProgress()
 {
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
     _total = 0;
     _processed = 0;
+    _resumed = 0;
+    _startTime = osg::Timer::instance()->tick();
+    _lastLevel = 0;
+    _levelStats.clear();
+    _levelStart.clear();
+}
+
+void TileVisitor::setJournal( TileJournal* journal )
+{
+    _journal = journal;
+}
+
+void TileVisitor::setTraversalOrder( TraversalOrder order )
+{
+    _order = order;
+}
+
+void TileVisitor::setWorkingSetSize( unsigned int tiles )
+{
+    _workingSetSize = osg::maximum( tiles, 16u );
 }
 
 void TileVisitor::addExtent( const GeoExtent& extent )
@@ -91,9 +247,20 @@ void TileVisitor::run( const Profile* mapProfile )
     std::vector<TileKey> keys;
     mapProfile->getRootKeys(keys);
 
-    for (unsigned int i = 0; i < keys.size(); ++i)
+    if (_order == ORDER_DEPTH_FIRST)
+    {
+        for (unsigned int i = 0; i < keys.size(); ++i)
+        {
+            processKey( keys[i] );
+        }
+    }
+    else
     {
-        processKey( keys[i] );
+        sortAlongCurve( keys );
+        for (unsigned int i = 0; i < keys.size(); ++i)
+        {
+            processChunk( keys[i] );
+        }
     }
 }
 
@@ -111,22 +278,14 @@ void TileVisitor::estimate()
     _total = est.getNumTiles();
 }
 
-void TileVisitor::processKey( const TileKey& key )
-{        
-    // If we've been cancelled then just return.
-    if (_progress && _progress->isCanceled())
-    {        
-        return;
-    }    
-
-    unsigned int x, y, lod;
-    key.getTileXY(x, y);
-    lod = key.getLevelOfDetail();    
+bool TileVisitor::visitKey( const TileKey& key )
+{
+    unsigned int lod = key.getLevelOfDetail();    
 
     // Only process this key if it has a chance of succeeding.
     if (_tileHandler && !_tileHandler->hasData(key))
     {                
-        return;
+        return false;
     }    
 
     bool traverseChildren = false;
@@ -139,6 +298,19 @@ void TileVisitor::processKey( const TileKey& key )
         {
             traverseChildren = true;
         }
+        else if (_journal.valid() && _journal->find( key ))
+        {
+            // Handled successfully in a previous run. Only successes are
+            // journaled and every visitor descends below a successful tile
+            // (MultithreadedTileVisitor below every queued one), so resuming
+            // walks the same tree as the original run.
+            traverseChildren = true;
+            {
+                OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+                ++_resumed;
+            }
+            incrementProgress(1);
+        }
         else
         {         
             // Process the key
@@ -146,8 +318,19 @@ void TileVisitor::processKey( const TileKey& key )
         }
     }
 
+    return traverseChildren && lod < _maxLevel;
+}
+
+void TileVisitor::processKey( const TileKey& key )
+{        
+    // If we've been cancelled then just return.
+    if (_progress && _progress->isCanceled())
+    {        
+        return;
+    }    
+
     // Traverse the children
-    if (traverseChildren && lod < _maxLevel)
+    if (visitKey( key ))
     {
         for (unsigned int i = 0; i < 4; i++)
         {
@@ -157,6 +340,142 @@ void TileVisitor::processKey( const TileKey& key )
     }       
 }
 
+void TileVisitor::processChunk( const TileKey& root )
+{
+    // How many levels fit in the working set
+    unsigned int chunkLevels = 1;
+    while ((1u << (2*(chunkLevels+1))) <= _workingSetSize && chunkLevels < 15)
+    {
+        ++chunkLevels;
+    }
+
+    // Make the top chunks the shallow ones so that the bottom levels, where
+    // most of the tiles are, always come in full-sized chunks.
+    unsigned int lod = root.getLevelOfDetail();
+    unsigned int remaining = lod <= _maxLevel ? _maxLevel - lod + 1 : 1;
+    unsigned int depth = remaining % chunkLevels > 0 ? remaining % chunkLevels : chunkLevels;
+
+    // Visit the chunk one level at a time. Each level is sorted along the
+    // curve so that consecutive tiles are neighbors in the source and cache.
+    std::vector<TileKey> level( 1, root ), next;
+    for (unsigned int d = 0; !level.empty(); ++d)
+    {
+        next.clear();
+        for (unsigned int i = 0; i < level.size(); ++i)
+        {
+            if (_progress && _progress->isCanceled())
+            {
+                return;
+            }
+
+            // A tile without data (or whose handler says stop) prunes its children.
+            if (visitKey( level[i] ))
+            {
+                for (unsigned int c = 0; c < 4; ++c)
+                {
+                    next.push_back( level[i].createChildKey(c) );
+                }
+            }
+        }
+
+        sortAlongCurve( next );
+
+        // The next level becomes a row of new chunks once this one is deep enough.
+        if (d+1 == depth)
+        {
+            for (unsigned int i = 0; i < next.size(); ++i)
+            {
+                processChunk( next[i] );
+            }
+            return;
+        }
+
+        level.swap( next );
+    }
+}
+
+namespace
+{
+    // Position of (x, y) along a Hilbert curve filling an n x n grid (n a power of two).
+    unsigned long long hilbertIndex( unsigned int n, unsigned int x, unsigned int y )
+    {
+        unsigned long long d = 0;
+        for (unsigned int s = n/2; s > 0; s /= 2)
+        {
+            unsigned int rx = (x & s) > 0 ? 1u : 0u;
+            unsigned int ry = (y & s) > 0 ? 1u : 0u;
+            d += (unsigned long long)s * (unsigned long long)s * ((3u * rx) ^ ry);
+
+            // rotate the quadrant so the curve stays continuous
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s-1 - (x & (s-1));
+                    y = s-1 - (y & (s-1));
+                }
+                unsigned int t = x;
+                x = y;
+                y = t;
+            }
+        }
+        return d;
+    }
+
+    // Position of (x, y) along a Z-order (Morton) curve.
+    unsigned long long zIndex( unsigned int x, unsigned int y )
+    {
+        unsigned long long d = 0;
+        for (unsigned int b = 0; b < 32; ++b)
+        {
+            d |= (unsigned long long)((x >> b) & 1u) << (2*b);
+            d |= (unsigned long long)((y >> b) & 1u) << (2*b + 1);
+        }
+        return d;
+    }
+
+    struct CurveEntry
+    {
+        unsigned long long index;
+        unsigned int       slot;
+        bool operator < (const CurveEntry& rhs) const { return index < rhs.index; }
+    };
+}
+
+void TileVisitor::sortAlongCurve( std::vector<TileKey>& keys ) const
+{
+    if (keys.size() < 2)
+        return;
+
+    // All keys handed to us are on the same level.
+    unsigned int wide, high;
+    keys[0].getProfile()->getNumTiles( keys[0].getLevelOfDetail(), wide, high );
+    unsigned int n = 1;
+    while (n < wide || n < high)
+        n *= 2;
+
+    // Lay a wide grid along the first half of the curve so it stays continuous.
+    bool swapXY = wide > high;
+
+    std::vector<CurveEntry> entries( keys.size() );
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        entries[i].slot  = i;
+        unsigned int x = swapXY ? keys[i].getTileY() : keys[i].getTileX();
+        unsigned int y = swapXY ? keys[i].getTileX() : keys[i].getTileY();
+        entries[i].index = _order == ORDER_HILBERT ? hilbertIndex( n, x, y ) : zIndex( x, y );
+    }
+    std::sort( entries.begin(), entries.end() );
+
+    std::vector<TileKey> sorted;
+    sorted.reserve( keys.size() );
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+        sorted.push_back( keys[entries[i].slot] );
+    }
+    keys.swap( sorted );
+}
+
 void TileVisitor::incrementProgress(unsigned int amount)
 {
     {
@@ -166,13 +485,75 @@ void TileVisitor::incrementProgress(unsigned int amount)
     if (_progress.valid())
     {
         // If report progress returns true then mark the task as being cancelled.
-        if (_progress->reportProgress( _processed, _total ))
+        if (_progress->reportProgress( _processed, _total, getProgressMessage() ))
         {
             _progress->cancel();
         }
     }    
 }
 
+void TileVisitor::tileHandled( const TileKey& key, bool result )
+{
+    if (_journal.valid() && result)
+    {
+        _journal->record( key );
+    }
+
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+
+        unsigned int lod = key.getLevelOfDetail();
+        osg::Timer_t now = osg::Timer::instance()->tick();
+        if (lod >= _levelStats.size())
+        {
+            _levelStats.resize( lod+1 );
+            _levelStart.resize( lod+1, 0 );
+        }
+        if (_levelStats[lod].processed == 0)
+        {
+            _levelStart[lod] = now;
+        }
+        _levelStats[lod].processed++;
+        _levelStats[lod].seconds = osg::Timer::instance()->delta_s( _levelStart[lod], now );
+        _lastLevel = lod;
+    }
+
+    incrementProgress(1);
+}
+
+void TileVisitor::getLevelStats( std::vector<LevelStats>& out ) const
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+    out = _levelStats;
+}
+
+double TileVisitor::getETA() const
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+
+    // tiles resumed from the journal cost nothing, so leave them out of the rate.
+    unsigned int done = _processed - _resumed;
+    double elapsed = osg::Timer::instance()->delta_s( _startTime, osg::Timer::instance()->tick() );
+    if (done == 0 || elapsed <= 0.0 || _total < _processed)
+        return -1.0;
+
+    return (double)(_total - _processed) * elapsed / (double)done;
+}
+
+std::string TileVisitor::getProgressMessage() const
+{
+    double eta = getETA();
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+    if (eta < 0.0 || _lastLevel >= _levelStats.size())
+        return "";
+
+    return Stringify() 
+        << "level " << _lastLevel << ": "
+        << std::fixed << std::setprecision(1) << _levelStats[_lastLevel].tilesPerSecond() << " tiles/s, "
+        << "ETA " << prettyPrintTime( eta );
+}
+
 bool TileVisitor::handleTile( const TileKey& key )
 {    
     bool result = false;
@@ -181,7 +562,7 @@ bool TileVisitor::handleTile( const TileKey& key )
         result = _tileHandler->handleTile( key, *this );
     }
 
-    incrementProgress(1);    
+    tileHandled( key, result );
     
     return result;
 }
@@ -189,36 +570,40 @@ bool TileVisitor::handleTile( const TileKey& key )
 
 
 /*****************************************************************************************/
-/**
- * A TaskRequest that runs a TileHandler in a background thread.
- */
-class HandleTileTask : public TaskRequest
-{
-public:
-    HandleTileTask( TileHandler* handler, TileVisitor* visitor, const TileKey& key ):      
-      _handler( handler ),
-          _visitor(visitor),
-          _key( key )
-      {
 
-      }
+namespace
+{
+    /**
+     * Worker thread that drains a MultithreadedTileVisitor's queue.
+     */
+    class TileWorker : public OpenThreads::Thread
+    {
+    public:
+        TileWorker( MultithreadedTileVisitor* visitor, TileHandler* handler ):
+            _visitor( visitor ),
+            _handler( handler )
+        {
+        }
 
-      virtual void operator()(ProgressCallback* progress )
-      {         
-          if (_handler.valid())
-          {                           
-              _handler->handleTile( _key, *_visitor.get() );
-              _visitor->incrementProgress(1);
-          }
-      }
+        virtual void run()
+        {
+            TileKey key;
+            while (_visitor->nextKey( key ))
+            {
+                bool result = _handler.valid() ? _handler->handleTile( key, *_visitor ) : false;
+                _visitor->tileHandled( key, result );
+            }
+        }
 
-      osg::ref_ptr<TileHandler> _handler;
-      TileKey _key;
-      osg::ref_ptr<TileVisitor> _visitor;
-};
+        MultithreadedTileVisitor* _visitor;
+        osg::ref_ptr<TileHandler> _handler;
+    };
+}
 
 MultithreadedTileVisitor::MultithreadedTileVisitor():
-_numThreads( OpenThreads::GetNumberOfProcessors() )
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_maxQueueSize( 1000 ),
+_queueClosed( false )
 {
     // We must do this to avoid an error message in OpenSceneGraph b/c the findWrapper method doesn't appear to be threadsafe.
     // This really isn't a big deal b/c this only effects data that is already cached.
@@ -227,7 +612,9 @@ _numThreads( OpenThreads::GetNumberOfProcessors() )
 
 MultithreadedTileVisitor::MultithreadedTileVisitor( TileHandler* handler ):
 TileVisitor( handler ),
-    _numThreads( OpenThreads::GetNumberOfProcessors() )
+    _numThreads( OpenThreads::GetNumberOfProcessors() ),
+    _maxQueueSize( 1000 ),
+    _queueClosed( false )
 {
 }
 
@@ -241,39 +628,100 @@ void MultithreadedTileVisitor::setNumThreads( unsigned int numThreads)
     _numThreads = numThreads; 
 }
 
+unsigned int MultithreadedTileVisitor::getMaxQueueSize() const
+{
+    return _maxQueueSize;
+}
+
+void MultithreadedTileVisitor::setMaxQueueSize( unsigned int maxQueueSize )
+{
+    _maxQueueSize = osg::maximum( maxQueueSize, 1u );
+}
+
 void MultithreadedTileVisitor::run(const Profile* mapProfile)
 {                   
-    // Start up the task service
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _queueMutex );
+        _queueClosed = false;
+    }
+
+    // Start up the workers
     OE_INFO << "Starting " << _numThreads << std::endl;
-    _taskService = new TaskService( "MTTileHandler", _numThreads, 1000 );
+    std::vector< TileWorker* > workers;
+    for (unsigned int i = 0; i < osg::maximum( _numThreads, 1u ); ++i)
+    {
+        workers.push_back( new TileWorker( this, _tileHandler.get() ) );
+        workers.back()->start();
+    }
 
-    // Produce the tiles
+    // Produce the tiles; this blocks whenever the queue is full.
     TileVisitor::run( mapProfile );
 
-    // Send a poison pill to kill all the threads
-    _taskService->add( new PoisonPill() );
+    // No more keys are coming; let the workers finish what's queued and exit.
+    closeQueue();
 
-    OE_INFO << "Waiting on threads to complete" << _taskService->getNumRequests() << " tasks remaining" << std::endl;
-
-    // Wait for everything to finish, checking for cancellation while we wait so we can kill all the existing tasks.
-    while (_taskService->areThreadsRunning())
+    OE_INFO << "Waiting on threads to complete" << std::endl;
+    for (unsigned int i = 0; i < workers.size(); ++i)
     {
-        OpenThreads::Thread::microSleep(10000);
-        if (_progress && _progress->isCanceled())
-        {            
-            _taskService->cancelAll();
-        }
+        workers[i]->join();
+        delete workers[i];
     }
     OE_INFO << "All threads have completed" << std::endl;
 }
 
 bool MultithreadedTileVisitor::handleTile( const TileKey& key )        
 {    
-    // Add the tile to the task queue.
-    _taskService->add( new HandleTileTask(_tileHandler, this, key ) );
+    // Add the tile to the queue, waiting for room if necessary.
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _queueMutex );
+    while (_queue.size() >= _maxQueueSize && !_queueClosed)
+    {
+        _queueNotFull.wait( &_queueMutex );
+    }
+
+    if (_queueClosed)
+        return false;
+
+    _queue.push( key );
+    _queueNotEmpty.signal();
     return true;
 }
 
+bool MultithreadedTileVisitor::nextKey( TileKey& key )
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _queueMutex );
+    while (_queue.empty() && !_queueClosed)
+    {
+        _queueNotEmpty.wait( &_queueMutex );
+    }
+
+    // On cancellation, drop whatever is queued and release the producer.
+    if (_progress.valid() && _progress->isCanceled())
+    {
+        _queueClosed = true;
+        while (!_queue.empty())
+            _queue.pop();
+        _queueNotFull.broadcast();
+        _queueNotEmpty.broadcast();
+        return false;
+    }
+
+    if (_queue.empty())
+        return false;
+
+    key = _queue.front();
+    _queue.pop();
+    _queueNotFull.signal();
+    return true;
+}
+
+void MultithreadedTileVisitor::closeQueue()
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _queueMutex );
+    _queueClosed = true;
+    _queueNotEmpty.broadcast();
+    _queueNotFull.broadcast();
+}
+
 /*****************************************************************************************/
 
 TaskList::TaskList(const Profile* profile):
@@ -415,20 +863,33 @@ void MultiprocessTileVisitor::setEarthFile( const std::string& earthFile )
 class ExecuteTask : public TaskRequest
 {
 public:
-    ExecuteTask(const std::string& command, TileVisitor* visitor, unsigned int count):            
+    ExecuteTask(const std::string& command, TileVisitor* visitor, const TileKeyList& keys):            
       _command( command ),
       _visitor( visitor ),
-      _count( count )
+      _keys( keys )
       {
       }
 
       virtual void operator()(ProgressCallback* progress )
       {         
-          system(_command.c_str());     
+          int status = system(_command.c_str());     
 
           // Cleanup the temp files and increment the progress on the visitor.
+          // Only a batch that ran to completion goes into the journal, so a
+          // failed one is picked up again on resume.
           cleanupTempFiles();
-          _visitor->incrementProgress( _count );
+          if (status == 0)
+          {
+              for (unsigned int i = 0; i < _keys.size(); i++)
+              {
+                  _visitor->tileHandled( _keys[i], true );
+              }
+          }
+          else
+          {
+              OE_WARN << LC << "Command failed (" << status << "): " << _command << std::endl;
+              _visitor->incrementProgress( _keys.size() );
+          }
       }
 
       void addTempFile( const std::string& filename )
@@ -448,7 +909,7 @@ public:
       std::vector< std::string > _tempFiles;
       std::string _command;
       TileVisitor* _visitor;
-      unsigned int _count;
+      TileKeyList _keys;
 };
 
 void MultiprocessTileVisitor::processBatch()
@@ -466,7 +927,7 @@ void MultiprocessTileVisitor::processBatch()
     std::stringstream command;        
     command << _tileHandler->getProcessString() << " --tiles " << filename << " " << _earthFile;
     OE_INFO << "Running command " << command.str() << std::endl;
-    osg::ref_ptr< ExecuteTask > task = new ExecuteTask( command.str(), this, tasks.getKeys().size() );
+    osg::ref_ptr< ExecuteTask > task = new ExecuteTask( command.str(), this, tasks.getKeys() );
     // Add the task file as a temp file to the task to make sure it gets deleted
     task->addTempFile( filename );
 
@@ -491,10 +952,18 @@ void TileKeyListVisitor::run(const Profile* mapProfile)
 
     for (TileKeyList::iterator itr = _keys.begin(); itr != _keys.end(); ++itr)
     {
-        if (_tileHandler)
+        if (_journal.valid() && _journal->find( *itr ))
         {
-            _tileHandler->handleTile( *itr, *this );
+            {
+                OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_progressMutex );
+                ++_resumed;
+            }
             incrementProgress(1);
         }
+        else if (_tileHandler)
+        {
+            bool result = _tileHandler->handleTile( *itr, *this );
+            tileHandled( *itr, result );
+        }
     }
 }
@@ -20,9 +20,13 @@
 #include <osgEarth/Cache>
 #include <osgEarth/CacheBin>
 #include <osgEarth/HTTPClient>
+#include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Atomic>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/ReaderWriter>
@@ -288,40 +292,27 @@ namespace
 
     struct ReadObject
     {
+        const char* name() const { return "object"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
-        {
-            HTTPRequest req(uri);            
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            return HTTPClient::readObject(req, opt, p);
-        }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readObject(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readObjectFile(uri, opt)); }
     };
 
     struct ReadNode
     {
+        const char* name() const { return "node"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
-        {
-            HTTPRequest req(uri);            
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
-            return HTTPClient::readNode(req, opt, p);
-        }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readNode(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readNodeFile(uri, opt)); }
     };
 
     struct ReadImage
     {
+        const char* name() const { return "image"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { 
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0); 
         }
@@ -335,14 +326,9 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) { 
-            HTTPRequest req(uri);            
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { 
             ReadResult r = HTTPClient::readImage(req, opt, p);
-            if ( r.getImage() ) r.getImage()->setFileName( uri );
+            if ( r.getImage() ) r.getImage()->setFileName( req.getURL() );
             return r;
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { 
@@ -354,21 +340,346 @@ namespace
 
     struct ReadString
     {
+        const char* name() const { return "string"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readString(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readString(key, 0L); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readString(req, opt, p); }
+        ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return readStringFile(uri, opt); }
+    };
+
+    //--------------------------------------------------------------------
+    // Cache revalidation
+
+    // Finds an HTTP response header stored in a cache record's metadata.
+    // Header names are case-insensitive (and lower-case under HTTP/2).
+    std::string getHeader( const Config& metadata, const std::string& name )
+    {
+        for( ConfigSet::const_iterator i = metadata.children().begin(); i != metadata.children().end(); ++i )
         {
-            HTTPRequest req(uri);            
-            if (lastModified > 0)
+            if ( ciEquals(i->key(), name) )
+                return i->value();
+        }
+        return std::string();
+    }
+
+    // Adds the validators of an expired cache record to a request so the
+    // server can answer "304 Not Modified" instead of resending the data.
+    void setValidators( HTTPRequest& request, const ReadResult& cached )
+    {
+        std::string etag = getHeader( cached.metadata(), "ETag" );
+        if ( !etag.empty() )
+        {
+            request.setETag( etag );
+        }
+
+        // Prefer the server's own Last-Modified date, echoed verbatim; fall
+        // back on the time the record was written to the cache.
+        std::string lastModified = getHeader( cached.metadata(), "Last-Modified" );
+        if ( !lastModified.empty() )
+        {
+            request.addHeader( "If-Modified-Since", lastModified );
+        }
+        else if ( cached.lastModifiedTime() > 0 )
+        {
+            request.setLastModified( cached.lastModifiedTime() );
+        }
+    }
+
+    // Copies the validators of a "304 Not Modified" response into the
+    // metadata of the record it revalidated, so the next revalidation
+    // presents the current ones. Returns true if any of them changed.
+    bool updateValidators( Config& metadata, const Config& response )
+    {
+        const char* names[2] = { "ETag", "Last-Modified" };
+        bool changed = false;
+        for(unsigned n=0; n<2; ++n)
+        {
+            std::string value = getHeader( response, names[n] );
+            if ( value.empty() || value == getHeader(metadata, names[n]) )
+                continue;
+
+            for( ConfigSet::iterator i = metadata.children().begin(); i != metadata.children().end(); )
             {
-                req.setLastModified(lastModified);
+                if ( ciEquals(i->key(), names[n]) )
+                    i = metadata.children().erase( i );
+                else
+                    ++i;
             }
-            return HTTPClient::readString(req, opt, p);
+            metadata.add( names[n], value );
+            changed = true;
         }
-        ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return readStringFile(uri, opt); }
+        return changed;
+    }
+
+    //--------------------------------------------------------------------
+    // Reads a remote URI, consulting the cache.
+
+    template<typename READ_FUNCTOR>
+    ReadResult readRemote(
+        READ_FUNCTOR&         reader,
+        const URI&            uri,
+        const osgDB::Options* localOptions,
+        URIReadCallback*      cb,
+        ProgressCallback*     progress,
+        bool&                 gotResultFromCallback)
+    {
+        ReadResult result;
+
+        bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
+
+        optional<CachePolicy> cp;
+        osg::ref_ptr<CacheBin> bin;
+
+        CacheSettings* cacheSettings = CacheSettings::get(localOptions);
+        if (cacheSettings)
+        {
+            cp = cacheSettings->cachePolicy();
+            if (cp->isCacheEnabled() && callbackCachingOK)
+            {
+                bin = cacheSettings->getCacheBin(); 
+            }
+        }
+
+        bool expired = false;
+        // first try to go to the cache if there is one:
+        if ( bin && cp->isCacheReadable() )
+        {                                                
+            result = reader.fromCache( bin, uri.cacheKey() );                        
+            if ( result.succeeded() )
+            {                                        
+                expired = cp->isExpired(result.lastModifiedTime());
+                result.setIsFromCache(true);
+            }
+        }
+
+        // If it's not cached, or it is cached but is expired then try to hit the server.                    
+        if ( result.empty() || expired )
+        {                        
+            // Need to do this to support nested PLODs and Proxynodes.
+            osg::ref_ptr<osgDB::Options> remoteOptions =
+                Registry::instance()->cloneOrCreateOptions( localOptions );
+            remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
+
+            // Store the existing object from the cache if there is one.
+            osg::ref_ptr< osg::Object > object = result.getObject();
+
+            // try to use the callback if it's set. Callback ignores the caching policy.
+            if ( cb )
+            {                
+                result = reader.fromCallback( cb, uri.full(), remoteOptions.get() );
+
+                if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
+                {
+                    // "not implemented" is the only excuse for falling back
+                    gotResultFromCallback = true;
+                }
+            }
+
+            if ( !gotResultFromCallback )
+            {                            
+                // still no data, go to the source:
+                if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                {                                
+                    HTTPRequest request( uri.full() );
+
+                    // revalidate an expired record with a conditional GET:
+                    if ( expired )
+                        setValidators( request, result );
+
+                    ReadResult remoteResult = reader.fromHTTP( request, remoteOptions.get(), progress );
+                    if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
+                    {                                    
+                        OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
+                        if (bin)
+                        {
+                            Config metadata = result.metadata();
+                            if ( updateValidators(metadata, remoteResult.metadata()) && cp->isCacheWriteable() )
+                            {
+                                // Rewrite the record with the new validators, which also
+                                // renews its timestamp.
+                                result.setMetadata( metadata );
+                                bin->write( uri.cacheKey(), result.getObject(), metadata, remoteOptions );
+                            }
+                            else
+                            {
+                                // Touch the cached item to update it's last modified timestamp so it doesn't expire again immediately.
+                                bin->touch( uri.cacheKey() );
+                            }
+                        }
+                    }
+                    else
+                    {
+                        OE_DEBUG << LC << "Got remote result for " << uri.full() << std::endl;
+                        result = remoteResult;                                    
+                    }
+                }
+
+                // write the result to the cache if possible:
+                if ( result.succeeded() && !result.isFromCache() && bin && cp->isCacheWriteable() && bin )
+                {
+                    OE_DEBUG << LC << "Writing " << uri.cacheKey() << " to cache" << std::endl;
+                    bin->write( uri.cacheKey(), result.getObject(), result.metadata(), remoteOptions );
+                }
+            }
+        }
+
+        return result;
+    }
+
+    //--------------------------------------------------------------------
+    // Single-flight coalescing: when several threads read the same remote
+    // URI at once, the first one does the work and the others wait for its
+    // result instead of issuing duplicate requests.
+
+    struct InFlightRead : public osg::Referenced
+    {
+        InFlightRead() : _waiters(0), _fromCallback(false), _canceled(false), _needsRetry(false) { }
+        Threading::Event _done;
+        ReadResult       _result;
+        unsigned         _waiters;
+        bool             _fromCallback;
+        bool             _canceled;
+        bool             _needsRetry;
     };
 
+    typedef std::map<std::string, osg::ref_ptr<InFlightRead> > InFlightReadTable;
+
+    Threading::Mutex    s_inFlightMutex;
+    InFlightReadTable   s_inFlight;
+    OpenThreads::Atomic s_numCoalesced;
+
+    // How often a waiting thread checks its own progress callback for cancelation
+    const unsigned WAIT_SLICE_MS = 50u;
+
+    // Deep copy of a result, so each caller owns the object it gets back.
+    ReadResult copyResult(const ReadResult& in)
+    {
+        osg::ref_ptr<osg::Object> object;
+        if ( in.getObject() )
+        {
+            object = in.getObject()->clone( osg::CopyOp::DEEP_COPY_ALL );
+            osg::Image* image = dynamic_cast<osg::Image*>( object.get() );
+            if ( image )
+            {
+                // dirty() leaves the cloned payload stale, so attach the
+                // bytes again afterwards; a direct read would return them too.
+                ImageUtils::removeEncodedPayload( image );
+                image->dirty();
+
+                std::string data, mimeType;
+                if ( ImageUtils::getEncodedPayload(in.getImage(), data, mimeType) )
+                    ImageUtils::setEncodedPayload( image, data, mimeType );
+            }
+        }
+
+        ReadResult out( in.code(), object.get(), in.metadata() );
+        out.setIsFromCache( in.isFromCache() );
+        out.setLastModifiedTime( in.lastModifiedTime() );
+        out.setDuration( in.duration() );
+        out.setErrorDetail( in.errorDetail() );
+        return out;
+    }
+
+    template<typename READ_FUNCTOR>
+    ReadResult coalescedRead(
+        READ_FUNCTOR&         reader,
+        const URI&            uri,
+        const osgDB::Options* localOptions,
+        URIReadCallback*      cb,
+        ProgressCallback*     progress,
+        bool&                 gotResultFromCallback)
+    {
+        // Key on the cache key, plus anything else that changes the result: the
+        // data type, the cache bin we would write to, the plugin options and the
+        // read callback.
+        CacheSettings* cacheSettings = CacheSettings::get( localOptions );
+        CacheBin* bin = cacheSettings ? cacheSettings->getCacheBin() : 0L;
+
+        std::string key = Stringify()
+            << reader.name() << "|"
+            << (const void*)cb << "|"
+            << (bin ? bin->getID() : std::string()) << "|"
+            << (localOptions ? localOptions->getOptionString() : std::string()) << "|"
+            << uri.cacheKey();
+
+        while( true )
+        {
+            osg::ref_ptr<InFlightRead> flight;
+            bool leader = false;
+            {
+                Threading::ScopedMutexLock lock( s_inFlightMutex );
+                InFlightReadTable::iterator i = s_inFlight.find( key );
+                if ( i != s_inFlight.end() )
+                {
+                    flight = i->second.get();
+                    flight->_waiters++;
+                }
+                else
+                {
+                    flight = new InFlightRead();
+                    s_inFlight[key] = flight.get();
+                    leader = true;
+                }
+            }
+
+            if ( leader )
+            {
+                ReadResult result = readRemote( reader, uri, localOptions, cb, progress, gotResultFromCallback );
+
+                unsigned waiters;
+                {
+                    Threading::ScopedMutexLock lock( s_inFlightMutex );
+                    s_inFlight.erase( key );
+                    waiters = flight->_waiters;
+                }
+
+                // Waiters get a private copy, since our caller may modify the result
+                // while they are copying it.
+                if ( waiters > 0 )
+                {
+                    flight->_result       = copyResult( result );
+                    flight->_fromCallback = gotResultFromCallback;
+                    flight->_canceled     = result.code() == ReadResult::RESULT_CANCELED || (progress && progress->isCanceled());
+                    flight->_needsRetry   = progress && progress->needsRetry();
+                }
+
+                flight->_done.set();
+                return result;
+            }
+
+            // Wait for the leader, but honor our own cancelation while we wait.
+            while( !flight->_done.wait(WAIT_SLICE_MS) )
+            {
+                if ( progress && progress->isCanceled() )
+                {
+                    // so the leader doesn't copy a result for us
+                    Threading::ScopedMutexLock lock( s_inFlightMutex );
+                    flight->_waiters--;
+                    return ReadResult( ReadResult::RESULT_CANCELED );
+                }
+            }
+
+            // The leader's request was canceled. That was the leader's decision and
+            // doesn't apply to us, so try again (perhaps as the leader).
+            if ( flight->_canceled )
+            {
+                if ( progress && progress->isCanceled() )
+                    return ReadResult( ReadResult::RESULT_CANCELED );
+                continue;
+            }
+
+            ++s_numCoalesced;
+
+            // Pass along transient failures so the caller knows to try again later.
+            if ( flight->_needsRetry && progress )
+                progress->setNeedsRetry( true );
+
+            gotResultFromCallback = flight->_fromCallback;
+            return copyResult( flight->_result );
+        }
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -452,84 +763,7 @@ namespace
                 // remote URI, consider caching:
                 else
                 {
-                    bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
-
-                    optional<CachePolicy> cp;
-                    osg::ref_ptr<CacheBin> bin;
-
-                    CacheSettings* cacheSettings = CacheSettings::get(localOptions.get());
-                    if (cacheSettings)
-                    {
-                        cp = cacheSettings->cachePolicy();
-                        if (cp->isCacheEnabled() && callbackCachingOK)
-                        {
-                            bin = cacheSettings->getCacheBin(); 
-                        }
-                    }
-
-                    bool expired = false;
-                    // first try to go to the cache if there is one:
-                    if ( bin && cp->isCacheReadable() )
-                    {                                                
-                        result = reader.fromCache( bin, uri.cacheKey() );                        
-                        if ( result.succeeded() )
-                        {                                        
-                            expired = cp->isExpired(result.lastModifiedTime());
-                            result.setIsFromCache(true);
-                        }
-                    }
-
-                    // If it's not cached, or it is cached but is expired then try to hit the server.                    
-                    if ( result.empty() || expired )
-                    {                        
-                        // Need to do this to support nested PLODs and Proxynodes.
-                        osg::ref_ptr<osgDB::Options> remoteOptions =
-                            Registry::instance()->cloneOrCreateOptions( localOptions );
-                        remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
-
-                        // Store the existing object from the cache if there is one.
-                        osg::ref_ptr< osg::Object > object = result.getObject();
-
-                        // try to use the callback if it's set. Callback ignores the caching policy.
-                        if ( cb )
-                        {                
-                            result = reader.fromCallback( cb, uri.full(), remoteOptions.get() );
-
-                            if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
-                            {
-                                // "not implemented" is the only excuse for falling back
-                                gotResultFromCallback = true;
-                            }
-                        }
-
-                        if ( !gotResultFromCallback )
-                        {                            
-                            // still no data, go to the source:
-                            if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
-                            {                                
-                                ReadResult remoteResult = reader.fromHTTP( uri.full(), remoteOptions.get(), progress, result.lastModifiedTime() );
-                                if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
-                                {                                    
-                                    OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
-                                    // Touch the cached item to update it's last modified timestamp so it doesn't expire again immediately.
-                                    if (bin)
-                                        bin->touch( uri.cacheKey() );
-                                }
-                                else
-                                {
-                                    OE_DEBUG << LC << "Got remote result for " << uri.full() << std::endl;
-                                    result = remoteResult;                                    
-                                }
-                            }
-
-                            // write the result to the cache if possible:
-                            if ( result.succeeded() && !result.isFromCache() && bin && cp->isCacheWriteable() && bin )
-                            {
-                                OE_DEBUG << LC << "Writing " << uri.cacheKey() << " to cache" << std::endl;
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata(), remoteOptions );
-                            }
-                        }
-                    }
+                    result = coalescedRead( reader, uri, localOptions.get(), cb, progress, gotResultFromCallback );
                 }
 
 
@@ -563,6 +797,12 @@ namespace
     }
 }
 
+unsigned
+URI::getNumCoalescedRequests()
+{
+    return s_numCoalesced;
+}
+
 ReadResult
 URI::readObject(const osgDB::Options* dbOptions,
                 ProgressCallback*     progress ) const
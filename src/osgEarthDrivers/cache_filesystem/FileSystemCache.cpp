@@ -42,6 +42,13 @@ using namespace osgEarth::Threading;
 #define OSG_EXT   ".osgb"
 #define OSG_COMPRESS
 
+// records sharing their data through hard links also share the file times,
+// so each of them keeps its own time in its metadata.
+#define TIME_FIELD "fs.time"
+
+// smaller data is written out per record
+#define MIN_BLOB_SIZE 128u
+
 namespace
 {
     /** 
@@ -72,6 +79,7 @@ namespace
         void init();
 
         std::string _rootPath;
+        bool        _deduplicate;
     };
 
     /** 
@@ -81,7 +89,7 @@ namespace
     class FileSystemCacheBin : public CacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath, bool deduplicate );
 
     public: // CacheBin interface
 
@@ -103,6 +111,10 @@ namespace
 
         bool clear();
 
+        bool compact();
+
+        unsigned long long deduplicate();
+
         Config readMetadata();
 
         bool writeMetadata( const Config& meta );
@@ -118,10 +130,23 @@ namespace
 
         const osgDB::Options* mergeOptions(const osgDB::Options* in);
 
+        osg::Object* readPayloadFile(const std::string& path, const Config& meta, const osgDB::Options* dbo);
+
+        /** Writes a record's data, sharing the file with identical records if possible */
+        bool writeData(const std::string& path, const std::string& data, Config& meta);
+
+        /** Path of the file holding data with the given content hash */
+        std::string getBlobPath(const std::string& hash) const;
+
+        /** Removes blobs that no record links to any more; returns the bytes freed */
+        unsigned long long sweepBlobs();
+
         bool                              _ok;
         bool                              _binPathExists;
         std::string                       _metaPath;       // full path to the bin's metadata file
         std::string                       _binPath;        // full path to the bin's root folder
+        std::string                       _blobPath;       // full path to the cache's shared data folder
+        bool                              _deduplicate;
         osg::ref_ptr<osgDB::ReaderWriter> _rw;
         osg::ref_ptr<osgDB::Options>      _zlibOptions;
         mutable Threading::ReadWriteMutex _mutex;
@@ -151,6 +176,38 @@ namespace
             meta.fromJSON( bufStr );
         }
     }
+
+    bool readFile( const std::string& fullPath, std::string& data )
+    {
+        std::ifstream in( fullPath.c_str(), std::ios::in | std::ios::binary );
+        if ( !in.is_open() )
+            return false;
+
+        std::stringstream buf;
+        buf << in.rdbuf();
+        data = buf.str();
+        return true;
+    }
+
+    bool writeFile( const std::string& fullPath, const std::string& data )
+    {
+        std::ofstream out( fullPath.c_str(), std::ios::out | std::ios::binary );
+        if ( !out.is_open() )
+            return false;
+
+        out.write( data.data(), data.size() );
+        out.close();
+        return !out.fail();
+    }
+
+    /** Time the record was written, which a linked record keeps in its metadata */
+    TimeStamp getRecordTime( const std::string& fullPath, const Config& meta )
+    {
+        if ( meta.hasValue(TIME_FIELD) )
+            return DateTime( meta.value(TIME_FIELD) ).asTimeStamp();
+        else
+            return osgEarth::getLastModifiedTime( fullPath );
+    }
 }
 
 
@@ -178,6 +235,7 @@ namespace
         }
 
         _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+        _deduplicate = fsco.deduplicate().get();
         init();
     }
 
@@ -190,7 +248,7 @@ namespace
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _deduplicate ) );
     }
 
     CacheBin*
@@ -202,7 +260,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _deduplicate );
             }
         }
         return _defaultBin.get();
@@ -288,14 +346,19 @@ namespace
     }
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
+                                           const std::string&   rootPath,
+                                           bool                 deduplicate) :
     CacheBin            ( binID ),
     _binPathExists      ( false ),
+    _deduplicate        ( deduplicate ),
     _ok( true )
     {
         _binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
 
+        // shared by all bins, so identical data is stored once per cache
+        _blobPath = osgDB::concatPaths( rootPath, "_blobs" );
+
         _rw = osgDB::Registry::instance()->getReaderWriterForExtension(OSG_FORMAT);
 
 #ifdef OSG_COMPRESS
@@ -306,6 +369,57 @@ namespace
 #endif
     }
 
+    osg::Object*
+    FileSystemCacheBin::readPayloadFile(const std::string& path, const Config& meta, const osgDB::Options* dbo)
+    {
+        std::string data;
+        if ( !readFile(path, data) )
+            return 0L;
+
+        return readEncodedPayload( data, meta, dbo );
+    }
+
+    std::string
+    FileSystemCacheBin::getBlobPath(const std::string& hash) const
+    {
+        return osgDB::concatPaths( osgDB::concatPaths(_blobPath, hash.substr(0, 2)), hash );
+    }
+
+    bool
+    FileSystemCacheBin::writeData(const std::string& path, const std::string& data, Config& meta)
+    {
+        // never write through a record that may share its file with others
+        ::unlink( path.c_str() );
+        meta.remove( TIME_FIELD );
+
+        if ( _deduplicate && data.size() >= MIN_BLOB_SIZE )
+        {
+            std::string blob = getBlobPath( contentHash(data) );
+            bool created = false;
+            if ( !osgDB::fileExists(blob) )
+            {
+                // write under a temporary name so a blob is never seen half-written
+                osgEarth::makeDirectoryForFile( blob );
+                std::string temp = getTempName( blob );
+                if ( writeFile(temp, data) )
+                    created = ::rename( temp.c_str(), blob.c_str() ) == 0;
+                ::unlink( temp.c_str() );
+            }
+
+            if ( linkFile(blob, path) )
+            {
+                meta.set( TIME_FIELD, DateTime().asCompactISO8601() );
+                return true;
+            }
+
+            // don't leave behind a blob that no record links to
+            if ( created && getLinkCount(blob) == 1u )
+                ::unlink( blob.c_str() );
+        }
+
+        return writeFile( path, data );
+    }
+
     const osgDB::Options*
     FileSystemCacheBin::mergeOptions(const osgDB::Options* dbo)
     {
@@ -338,26 +452,34 @@ namespace
         if ( !osgDB::fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
-        osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);     
-
         osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
 
-        osgDB::ReaderWriter::ReadResult r;
         {
             ScopedReadLock lock(_mutex);
 
-            r = _rw->readImage( path, dbo.get() );
-            if ( !r.success() )
-                return ReadResult();
-
             // read metadata
             Config meta;
             std::string metafile = fileURI.full() + ".meta";
             if ( osgDB::fileExists(metafile) )
                 readMeta( metafile, meta );
 
-            ReadResult rr( r.getImage(), meta );
-            rr.setLastModifiedTime(timeStamp);
+            osg::ref_ptr<osg::Object> object;
+            if ( isEncodedPayload(meta) )
+            {
+                object = readPayloadFile( path, meta, dbo.get() );
+            }
+            else
+            {
+                osgDB::ReaderWriter::ReadResult r = _rw->readImage( path, dbo.get() );
+                if ( r.success() )
+                    object = r.getImage();
+            }
+
+            if ( !object.valid() )
+                return ReadResult();
+
+            ReadResult rr( object.get(), meta );
+            rr.setLastModifiedTime( getRecordTime(path, meta) );
             return rr;            
         }
     }
@@ -375,26 +497,34 @@ namespace
         if ( !osgDB::fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
-        osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);
-
         osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
 
-        osgDB::ReaderWriter::ReadResult r;
         {
             ScopedReadLock lock(_mutex);
 
-            r = _rw->readObject( path, dbo.get() );
-            if ( !r.success() )
-                return ReadResult();
-
             // read metadata
             Config meta;
             std::string metafile = fileURI.full() + ".meta";
             if ( osgDB::fileExists(metafile) )
                 readMeta( metafile, meta );
 
-            ReadResult rr( r.getObject(), meta );
-            rr.setLastModifiedTime(timeStamp);
+            osg::ref_ptr<osg::Object> object;
+            if ( isEncodedPayload(meta) )
+            {
+                object = readPayloadFile( path, meta, dbo.get() );
+            }
+            else
+            {
+                osgDB::ReaderWriter::ReadResult r = _rw->readObject( path, dbo.get() );
+                if ( r.success() )
+                    object = r.getObject();
+            }
+
+            if ( !object.valid() )
+                return ReadResult();
+
+            ReadResult rr( object.get(), meta );
+            rr.setLastModifiedTime( getRecordTime(path, meta) );
             return rr;            
         }
     }
@@ -438,30 +568,49 @@ namespace
 
             osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
 
-            if ( dynamic_cast<const osg::Image*>(object) )
+            // A string, or an image that still carries the bytes it was decoded from, is
+            // stored verbatim (under the usual record name, so status/touch/
+            // remove work unchanged) and its mime type noted in the metadata.
+            std::string payload;
+            Config metadata(meta);
+
+            if ( getEncodedPayload(object, payload, metadata) )
             {
-                std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeImage( *static_cast<const osg::Image*>(object), filename, dbo.get() );
-                objWriteOK = r.success();
+                objWriteOK = true;
             }
-            else if ( dynamic_cast<const osg::Node*>(object) )
+            else
             {
-                std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeNode(*static_cast<const osg::Node*>(object), filename, dbo.get());
+                // serialize in memory, so identical records can be found by
+                // their content and share one file.
+                std::stringstream buf;
+                if ( dynamic_cast<const osg::Image*>(object) )
+                    r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, dbo.get() );
+                else if ( dynamic_cast<const osg::Node*>(object) )
+                    r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, dbo.get() );
+                else
+                    r = _rw->writeObject( *object, buf, dbo.get() );
+
                 objWriteOK = r.success();
+                if ( objWriteOK )
+                    payload = buf.str();
             }
-            else
+
+            if ( objWriteOK )
             {
                 std::string filename = fileURI.full() + OSG_EXT;
-                r = _rw->writeObject(*object, filename, dbo.get());
-                objWriteOK = r.success();
+                objWriteOK = writeData( filename, payload, metadata );
             }
 
-            // write metadata
-            if ( !meta.empty() && objWriteOK )
+            // write metadata; drop any stale metadata so an old payload
+            // marker can't be applied to a new record.
+            std::string metaname = fileURI.full() + ".meta";
+            if ( !metadata.empty() && objWriteOK )
+            {
+                writeMeta( metaname, metadata );
+            }
+            else if ( objWriteOK && osgDB::fileExists(metaname) )
             {
-                std::string metaname = fileURI.full() + ".meta";
-                writeMeta( metaname, meta );
+                ::unlink( metaname.c_str() );
             }
         }
 
@@ -511,6 +660,21 @@ namespace
         std::string path( fileURI.full() + OSG_EXT );
 
         ScopedWriteLock lock(_mutex);
+
+        // a linked record can't touch the file without touching its twins
+        std::string metafile = fileURI.full() + ".meta";
+        if ( osgDB::fileExists(metafile) )
+        {
+            Config meta;
+            readMeta( metafile, meta );
+            if ( meta.hasValue(TIME_FIELD) )
+            {
+                meta.set( TIME_FIELD, DateTime().asCompactISO8601() );
+                writeMeta( metafile, meta );
+                return true;
+            }
+        }
+
         return osgEarth::touchFile( path );
     }
 
@@ -563,7 +727,115 @@ namespace
 
         ScopedWriteLock lock(_mutex);
         std::string binDir = osgDB::getFilePath( _metaPath );
-        return purgeDirectory( binDir );
+        bool ok = purgeDirectory( binDir );
+        sweepBlobs();
+        return ok;
+    }
+
+    bool
+    FileSystemCacheBin::compact()
+    {
+        if ( !binValidForReading() )
+            return false;
+
+        ScopedWriteLock lock(_mutex);
+        unsigned long long bytes = sweepBlobs();
+        OE_INFO << LC << "Bin " << getID() << ": freed " << bytes << " bytes of unreferenced data" << std::endl;
+        return true;
+    }
+
+    unsigned long long
+    FileSystemCacheBin::sweepBlobs()
+    {
+        unsigned long long bytes = 0ull;
+        osgDB::DirectoryContents dirs = osgDB::getDirectoryContents( _blobPath );
+        for( osgDB::DirectoryContents::iterator d = dirs.begin(); d != dirs.end(); ++d )
+        {
+            if ( d->size() != 2 || d->compare("..") == 0 )
+                continue;
+
+            std::string dir = osgDB::concatPaths( _blobPath, *d );
+            osgDB::DirectoryContents files = osgDB::getDirectoryContents( dir );
+            for( osgDB::DirectoryContents::iterator f = files.begin(); f != files.end(); ++f )
+            {
+                // skip anything but finished blobs, named by their 64-digit hash.
+                if ( f->size() != 64 )
+                    continue;
+
+                // a blob whose only name is its own belongs to no record.
+                std::string full = osgDB::concatPaths( dir, *f );
+                if ( getLinkCount(full) == 1u )
+                {
+                    std::ifstream in( full.c_str(), std::ios::in | std::ios::binary | std::ios::ate );
+                    unsigned long long size = in.is_open() ? (unsigned long long)in.tellg() : 0ull;
+                    in.close();
+
+                    if ( ::unlink(full.c_str()) == 0 )
+                        bytes += size;
+                }
+            }
+        }
+        return bytes;
+    }
+
+    unsigned long long
+    FileSystemCacheBin::deduplicate()
+    {
+        if ( !_deduplicate || !binValidForWriting() )
+            return 0ull;
+
+        ScopedWriteLock lock(_mutex);
+
+        CollectFilesVisitor v;
+        v.traverse( _binPath );
+
+        unsigned long long reclaimed = 0ull;
+        for( std::vector<std::string>::const_iterator i = v.filenames.begin(); i != v.filenames.end(); ++i )
+        {
+            const std::string& path = *i;
+            if ( osgDB::getLowerCaseFileExtension(path) != OSG_FORMAT || getLinkCount(path) != 1u )
+                continue;
+
+            std::string data;
+            if ( !readFile(path, data) || data.size() < MIN_BLOB_SIZE )
+                continue;
+
+            std::string metafile = osgDB::getNameLessExtension(path) + ".meta";
+            Config meta;
+            if ( osgDB::fileExists(metafile) )
+                readMeta( metafile, meta );
+            TimeStamp t = getRecordTime( path, meta );
+
+            std::string blob = getBlobPath( contentHash(data) );
+            if ( !osgDB::fileExists(blob) )
+            {
+                // the first record with this data becomes the blob.
+                osgEarth::makeDirectoryForFile( blob );
+                if ( !linkFile(path, blob) )
+                    continue;
+            }
+            else
+            {
+                // link under a temporary name first so the record is never missing.
+                std::string temp = getTempName( path );
+                if ( !linkFile(blob, temp) )
+                    continue;
+#ifdef WIN32
+                ::unlink( path.c_str() );
+#endif
+                bool renamed = ::rename( temp.c_str(), path.c_str() ) == 0;
+                ::unlink( temp.c_str() );
+                if ( !renamed )
+                    continue;
+
+                reclaimed += data.size();
+            }
+
+            meta.set( TIME_FIELD, DateTime(t).asCompactISO8601() );
+            writeMeta( metafile, meta );
+        }
+
+        return reclaimed;
     }
 
     Config
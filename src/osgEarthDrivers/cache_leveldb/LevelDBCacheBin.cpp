@@ -20,6 +20,7 @@
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
 #include <osgEarth/Random>
+#include <osgEarth/StringUtils>
 #include <osgDB/Registry>
 #include <leveldb/write_batch.h>
 #include <string>
@@ -78,6 +79,22 @@ namespace
 
 #define TIME_FIELD "leveldb.time"
 
+// time of the record's entry in the access time index, once a read
+// has moved it away from the time the record was written.
+#define ACCESS_FIELD "leveldb.atime"
+
+// smaller data is stored in the record itself; sharing it would save
+// little more than the reference costs.
+#define MIN_BLOB_SIZE 128u
+
+namespace
+{
+    DateTime getAccessTime(const Config& meta)
+    {
+        return DateTime(meta.value(meta.hasValue(ACCESS_FIELD) ? ACCESS_FIELD : TIME_FIELD));
+    }
+}
+
 
 LevelDBCacheBin::LevelDBCacheBin(const std::string& binID,
                                  leveldb::DB*       db,
@@ -199,7 +216,13 @@ LevelDBCacheBin::metaEnd() const
 std::string
 LevelDBCacheBin::timeKey(const DateTime& t, const std::string& key) const
 {
-    return "t" + SEP + t.asCompactISO8601() + SEP + getID() + SEP + key;
+    return timeKeyFromTuple(t, binDataKeyTuple(key));
+}
+
+std::string
+LevelDBCacheBin::timeKeyFromTuple(const DateTime& t, const std::string& tuple) const
+{
+    return "t" + SEP + t.asCompactISO8601() + SEP + tuple;
 }
 
 std::string
@@ -226,6 +249,18 @@ LevelDBCacheBin::timeEndGlobal() const
     return "t" + SEP + "\xff";
 }
 
+std::string
+LevelDBCacheBin::blobKey(const std::string& hash) const
+{
+    return "h" + SEP + hash;
+}
+
+std::string
+LevelDBCacheBin::refsKey(const std::string& hash) const
+{
+    return "r" + SEP + hash;
+}
+
 ReadResult
 LevelDBCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
 {
@@ -278,22 +313,53 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
     }
 
+    // the data may be shared with other records, under its content hash.
+    std::string hash;
+    if ( getBlobReference(datavalue, hash) )
+    {
+        status = _db->Get( ro, blobKey(hash), &datavalue );
+        if ( !status.ok() )
+        {
+            OE_WARN << LC << "Bin " << getID() << ": missing shared data for (" << key << ")" << std::endl;
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+        }
+    }
+
     // blend the data string
     if ( _tracker->seed().isSet() )
         unblend(datavalue, _tracker->seed().value());
 
-    // finally, decode the OSGB stream into an object.
-    std::istringstream datastream(datavalue);
-    osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
-    if ( !r.success() )
+    osg::ref_ptr<osg::Object> object;
+
+    if ( isEncodedPayload(metadata) )
     {
-        OE_WARN << LC << "Cache read failure!"
-            << "\n reader = " << reader.name()
-            << "\n error detail = " << r.message()
-            << "\n data value = " << datavalue
-            << "\n";
+        // the record holds the original encoded bytes; decode them directly.
+        object = readEncodedPayload(datavalue, metadata, reader._op);
+        if ( !object.valid() )
+        {
+            OE_WARN << LC << "Cache read failure!"
+                << "\n error detail = cannot decode encoded payload"
+                << "\n";
 
-        return ReadResult(ReadResult::RESULT_READER_ERROR);
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+    }
+    else
+    {
+        // finally, decode the OSGB stream into an object.
+        std::istringstream datastream(datavalue);
+        osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
+        if ( !r.success() )
+        {
+            OE_WARN << LC << "Cache read failure!"
+                << "\n reader = " << reader.name()
+                << "\n error detail = " << r.message()
+                << "\n data value = " << datavalue
+                << "\n";
+
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+        object = r.getObject();
     }
         
     if ( _debug )
@@ -301,16 +367,15 @@ LevelDBCacheBin::read(const std::string& key, const Reader& reader)
         OE_NOTICE << LC << "Bin " << getID() << ": read (" << key << ")\n";
     }
 
-    // if there's a size limit, we need to 'touch' the record.
+    // if there's a size limit, note the access; the tracker batches these
+    // up for the maintenance thread instead of rewriting the index here.
     if ( _tracker->hasSizeLimit() )
     {
-        // Room for optimization here since we already have the 
-        // meta/time records around.
-        touch( key );
+        _tracker->recordAccess( binDataKeyTuple(key), getAccessTime(metadata).asTimeStamp() );
     }
 
     ++_tracker->hits;
-    ReadResult rr(r.getObject(), metadata);
+    ReadResult rr(object.get(), metadata);
     rr.setLastModifiedTime(lastModified);    
     return rr;
 }
@@ -343,8 +408,17 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
 
     std::string       data;
     std::stringstream datastream;
+    Config            metadata(meta);
+
+    // A string, or an image that still carries the bytes it was decoded from,
+    // is stored verbatim, skipping the OSGB encode here and the decode on read.
+    bool isPayload = getEncodedPayload(object, data, metadata);
 
-    if ( dynamic_cast<const osg::Image*>(object) )
+    if ( isPayload )
+    {
+        objWriteOK = true;
+    }
+    else if ( dynamic_cast<const osg::Image*>(object) )
     {
         if ( (_rw->supportedFeatures() & _rw->FEATURE_WRITE_IMAGE) == 0 )
         {
@@ -379,28 +453,67 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
     {
         DateTime now;
         leveldb::WriteBatch batch;
+        ::off_t bytes = 0;
 
         // write the data:
-        data = datastream.str();
+        if ( !isPayload )
+            data = datastream.str();
+
+        std::string hash;
+        if ( _tracker->deduplicate() && data.size() >= MIN_BLOB_SIZE )
+            hash = contentHash(data);
+
         if ( _tracker->seed().isSet() )
             blend(data, _tracker->seed().value());
+
+        // reference counts must not change between reading and writing them.
+        ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+        // let go of the data of any record we're overwriting, unless it is
+        // the very same blob:
+        std::string olddata, oldhash;
+        if ( _db->Get(leveldb::ReadOptions(), dataKey(key), &olddata).ok() &&
+             getBlobReference(olddata, oldhash) &&
+             oldhash != hash )
+        {
+            bytes -= releaseBlobReference(oldhash, batch);
+        }
+
+        // identical data is stored once and referenced by its hash:
+        if ( !hash.empty() )
+        {
+            if ( hash != oldhash )
+                bytes += addBlobReference(hash, data, batch);
+            data = makeBlobReference(hash);
+        }
+
         batch.Put( dataKey(key), data );
+        bytes += data.size();
 
-        // write the timestamp index:
+        // replace the timestamp index of any record we're overwriting:
+        std::string oldmeta;
+        if ( _db->Get(leveldb::ReadOptions(), metaKey(key), &oldmeta).ok() )
+        {
+            Config oldmetadata;
+            decodeMeta(oldmeta, oldmetadata);
+            batch.Delete( timeKey(getAccessTime(oldmetadata), key) );
+        }
         batch.Put( timeKey(now, key), binDataKeyTuple(key) );
 
         // write the metadata:
-        Config metadata(meta);
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
+        metadata.remove( ACCESS_FIELD );
         encodeMeta( metadata, data );
         batch.Put( metaKey(key), data );
+        bytes += data.size();
 
         objWriteOK = _db->Write( leveldb::WriteOptions(), &batch ).ok();
 
         if ( objWriteOK )
         {
             ++_tracker->writes;
-            postWrite();
+            if ( bytes > 0 )
+                postWrite(bytes);
             
             if ( _debug )
             {
@@ -419,38 +532,68 @@ LevelDBCacheBin::write(const std::string& key, const osg::Object* object, const
     return objWriteOK;
 }
 
+::off_t
+LevelDBCacheBin::addBlobReference(const std::string& hash, const std::string& data, leveldb::WriteBatch& batch)
+{
+    std::string refs;
+    if ( _db->Get(leveldb::ReadOptions(), refsKey(hash), &refs).ok() )
+    {
+        batch.Put( refsKey(hash), Stringify() << (as<unsigned>(refs, 0u) + 1u) );
+        return 0;
+    }
+
+    // first record with this data
+    batch.Put( blobKey(hash), data );
+    batch.Put( refsKey(hash), "1" );
+    return data.size();
+}
+
+::off_t
+LevelDBCacheBin::releaseBlobReference(const std::string& hash, leveldb::WriteBatch& batch)
+{
+    leveldb::ReadOptions ro;
+    std::string refs;
+    if ( !_db->Get(ro, refsKey(hash), &refs).ok() )
+        return 0;
+
+    unsigned count = as<unsigned>(refs, 0u);
+    if ( count > 1u )
+    {
+        batch.Put( refsKey(hash), Stringify() << (count - 1u) );
+        return 0;
+    }
+
+    // that was the last reference
+    std::string blob;
+    ::off_t bytes = 0;
+    if ( _db->Get(ro, blobKey(hash), &blob).ok() )
+        bytes = blob.size();
+    batch.Delete( blobKey(hash) );
+    batch.Delete( refsKey(hash) );
+    return bytes;
+}
+
+::off_t
+LevelDBCacheBin::releaseData(const std::string& datakey, leveldb::WriteBatch& batch)
+{
+    std::string value, hash;
+    if ( _db->Get(leveldb::ReadOptions(), datakey, &value).ok() && getBlobReference(value, hash) )
+        return releaseBlobReference(hash, batch);
+    return 0;
+}
+
 void
-LevelDBCacheBin::postWrite()
+LevelDBCacheBin::postWrite(::off_t bytes)
 {
     if ( _tracker->hasSizeLimit() )
     {
-        if ( _tracker->isOverLimit() )
-        {
-            if ( _tracker->isTimeToPurge() )
-            {
-                this->purgeOldest(_tracker->numToPurge());
-
-                if (_debug)
-                {
-                    off_t size = _tracker->calcSize();
-                    OE_NOTICE 
-                        << LC << "Cache size = " << (size/1048576) << " MB; " 
-                        << "Hit ratio = " << (float)_tracker->hits/(float)_tracker->reads << std::endl;
-                }
-            }
-        }
-        else
+        _tracker->addBytes(bytes);
+
+        // Eviction runs on the cache's maintenance thread; just wake it up
+        // so the writer never waits on a purge.
+        if ( _tracker->isOverLimit() || _tracker->isTimeToCheckSize() )
         {
-            if ( _tracker->isTimeToCheckSize() )
-            {
-                off_t size = _tracker->calcSize();
-                if ( _debug )
-                {
-                    OE_NOTICE 
-                        << LC << "Cache size = " << (size/1048576) << " MB; " 
-                        << "Hit ratio = " << (float)_tracker->hits/(float)_tracker->reads << std::endl;
-                }
-            }
+            _tracker->requestMaintenance();
         }
     }
 }
@@ -483,6 +626,8 @@ LevelDBCacheBin::remove(const std::string& key)
     if ( !binValidForReading() )
         return false;
 
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
     // first read in the time from the metadata record.
     std::string metavalue;
     if ( _db->Get(leveldb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
@@ -490,9 +635,10 @@ LevelDBCacheBin::remove(const std::string& key)
 
     Config metadata;
     decodeMeta(metavalue, metadata);
-    DateTime t(metadata.value(TIME_FIELD));
+    DateTime t = getAccessTime(metadata);
 
     leveldb::WriteBatch batch;
+    releaseData( dataKey(key), batch );
     batch.Delete( dataKey(key) );
     batch.Delete( metaKey(key) );
     batch.Delete( timeKey(t, key) );
@@ -517,6 +663,9 @@ LevelDBCacheBin::touch(const std::string& key)
     if ( !binValidForWriting() )
         return false;
 
+    // same lock as write(), so the old time key we delete is the current one.
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
     // first read in the time from the metadata record.
     std::string metavalue;
     if ( _db->Get(leveldb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
@@ -524,13 +673,14 @@ LevelDBCacheBin::touch(const std::string& key)
 
     Config metadata;
     decodeMeta(metavalue, metadata);
-    DateTime oldtime(metadata.value(TIME_FIELD));
+    DateTime oldtime = getAccessTime(metadata);
         
     leveldb::WriteBatch batch;
 
     // In a transaction, update the metadata record with the current time.
     std::string newtime = DateTime().asCompactISO8601();
     metadata.set(TIME_FIELD, newtime);
+    metadata.remove(ACCESS_FIELD);
     encodeMeta(metadata, metavalue);
     batch.Put(metaKey(key), metavalue);
 
@@ -560,13 +710,23 @@ LevelDBCacheBin::clear()
     
     leveldb::WriteOptions wo;
     std::string binphrase = binPhrase();
-    leveldb::WriteBatch batch;
+    std::string databegin = dataBegin();
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
     leveldb::Iterator* i = _db->NewIterator(leveldb::ReadOptions());
     for(i->SeekToFirst(); i->Valid(); i->Next())
     {
         std::string key = i->key().ToString();
         if ( key.find(binphrase) != std::string::npos )
         {
+            // records of this bin no longer hold on to shared data
+            std::string hash;
+            if ( key.compare(0, databegin.size(), databegin) == 0 && getBlobReference(i->value().ToString(), hash) )
+            {
+                leveldb::WriteBatch batch;
+                releaseBlobReference( hash, batch );
+                _db->Write( wo, &batch );
+            }
+
             _db->Delete( wo, i->key() );
         }
     }
@@ -592,6 +752,60 @@ LevelDBCacheBin::compact()
     return false;
 }
 
+unsigned long long
+LevelDBCacheBin::deduplicate()
+{
+    if ( !binValidForWriting() )
+        return 0ull;
+
+    long long reclaimed = 0;
+    unsigned count = 0u;
+
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+    // the iterator reads a snapshot, so rewriting records as we go is safe.
+    std::string limit = dataEnd();
+    leveldb::Iterator* it = _db->NewIterator(leveldb::ReadOptions());
+    for(it->Seek(dataBegin()); it->Valid() && it->key().ToString() < limit; it->Next())
+    {
+        std::string value = it->value().ToString();
+        std::string hash;
+        if ( value.size() < MIN_BLOB_SIZE || getBlobReference(value, hash) )
+            continue;
+
+        // hash what was written, before any obfuscation
+        std::string data = value;
+        if ( _tracker->seed().isSet() )
+            unblend(data, _tracker->seed().value());
+        hash = contentHash(data);
+
+        leveldb::WriteBatch batch;
+        ::off_t added = addBlobReference(hash, value, batch);
+        std::string ref = makeBlobReference(hash);
+        batch.Put( it->key(), ref );
+        if ( !_db->Write(leveldb::WriteOptions(), &batch).ok() )
+            continue;
+
+        reclaimed += (long long)value.size() - (long long)ref.size() - (long long)added;
+        ++count;
+    }
+    delete it;
+
+    // release the space of the rewritten records
+    std::string begin = dataBegin();
+    std::string blobBegin = "h" + SEP, blobEnd = "h" + SEP + "\xff";
+    leveldb::Slice b0(begin), e0(limit), b1(blobBegin), e1(blobEnd);
+    _db->CompactRange(&b0, &e0);
+    _db->CompactRange(&b1, &e1);
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": deduplicated " << count << " record(s)" << std::endl;
+    }
+
+    return reclaimed > 0 ? (unsigned long long)reclaimed : 0ull;
+}
+
 unsigned
 LevelDBCacheBin::getStorageSize()
 {
@@ -659,9 +873,23 @@ LevelDBCacheBin::purgeOldest(unsigned maxnum)
     if ( !binValidForWriting() )
         return false;
 
-    leveldb::Iterator* it = _db->NewIterator(leveldb::ReadOptions());
+    PurgeRange range;
+    purgeOldest(maxnum, range);
+    compactPurged(range);
+    return true;
+}
+
+::off_t
+LevelDBCacheBin::purgeOldest(unsigned maxnum, PurgeRange& range)
+{
+    if ( !binValidForWriting() )
+        return 0;
+
+    leveldb::ReadOptions ro;
+    leveldb::Iterator* it = _db->NewIterator(ro);
 
     unsigned count = 0;
+    ::off_t bytes = 0;
     std::string limit = timeEndGlobal();
 
     // note: this will delete records NOT OF THIS BIN as well!
@@ -673,22 +901,132 @@ LevelDBCacheBin::purgeOldest(unsigned maxnum)
             break;
 
         std::string tuple = it->value().ToString();
+        std::string timekey = it->key().ToString();
+        std::string datakey = dataKeyFromTuple(tuple);
+        std::string metakey = metaKeyFromTuple(tuple);
+
+        // A concurrent write() may replace the record, so read it again and
+        // delete it in one batch while the blob references can't change.
+        // (The space is reclaimed by compactPurged.)
+        ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+        // the iterator sees a snapshot; a record rewritten since then has
+        // a new time key and is no longer the oldest.
+        std::string value, hash;
+        if ( !_db->Get(leveldb::ReadOptions(), timekey, &value).ok() )
+            continue;
+
+        leveldb::WriteBatch batch;
+
+        // tally what the record occupied, for the tracker's byte target:
+        if ( _db->Get(leveldb::ReadOptions(), datakey, &value).ok() )
+        {
+            bytes += value.size();
 
-        // doing this in a WriteBatch did not work. The size of the
-        // database would never go down.
-        leveldb::WriteOptions wo;
-        _db->Delete( wo, dataKeyFromTuple(tuple) );
-        _db->Delete( wo, metaKeyFromTuple(tuple) );
-        _db->Delete( wo, it->key() );
+            // shared data only goes with its last reference
+            if ( getBlobReference(value, hash) )
+                bytes += releaseBlobReference( hash, batch );
+        }
+        if ( _db->Get(leveldb::ReadOptions(), metakey, &value).ok() )
+            bytes += value.size();
+        bytes += timekey.size() + tuple.size();
+
+        batch.Delete( datakey );
+        batch.Delete( metakey );
+        batch.Delete( timekey );
+        _db->Write( leveldb::WriteOptions(), &batch );
+
+        range.include(tuple, timekey);
     }
 
     delete it;
 
     if ( _debug )
     {
-        OE_NOTICE << LC << "Purged " << count << " record(s) for "
-            << (_tracker->calcSize()/1048576) << " MB" << std::endl;
+        OE_NOTICE << LC << "Purged " << count << " record(s), about "
+            << (bytes/1024) << " KB" << std::endl;
     }
 
-    return true;
+    return bytes;
+}
+
+void
+LevelDBCacheBin::compactPurged(const PurgeRange& range)
+{
+    if ( !binValidForWriting() || range.maxTimeKey.empty() )
+        return;
+
+    // deleted records only release their space once compacted; limit the
+    // work to the key ranges the purge actually touched.
+    std::string begin[3], end[3];
+    begin[0] = dataKeyFromTuple(range.minTuple), end[0] = dataKeyFromTuple(range.maxTuple);
+    begin[1] = metaKeyFromTuple(range.minTuple), end[1] = metaKeyFromTuple(range.maxTuple);
+    begin[2] = timeBeginGlobal(),                end[2] = range.maxTimeKey;
+
+    for(unsigned i=0; i<3; ++i)
+    {
+        leveldb::Slice b(begin[i]), e(end[i]);
+        _db->CompactRange(&b, &e);
+    }
+}
+
+unsigned
+LevelDBCacheBin::flushAccesses()
+{
+    if ( !binValidForWriting() )
+        return 0u;
+
+    std::set<std::string> tuples;
+    _tracker->takeAccesses(tuples);
+    if ( tuples.empty() )
+        return 0u;
+
+    DateTime now;
+    std::string newtime = now.asCompactISO8601();
+    leveldb::ReadOptions ro;
+    leveldb::WriteBatch batch;
+    unsigned count = 0u;
+
+    // write() and touch() replace the metadata and time key under this lock
+    // too; reading and rewriting them without it could restore stale metadata
+    // and strand the record's newer time key.
+    ScopedMutexLock lock( _tracker->getBlobMutex() );
+
+    for(std::set<std::string>::const_iterator i = tuples.begin(); i != tuples.end(); ++i)
+    {
+        const std::string& tuple = *i;
+
+        // the record may have been purged or removed since it was read.
+        std::string metakey = metaKeyFromTuple(tuple);
+        std::string metavalue;
+        if ( !_db->Get(ro, metakey, &metavalue).ok() )
+            continue;
+
+        Config metadata;
+        decodeMeta(metavalue, metadata);
+        DateTime oldtime = getAccessTime(metadata);
+
+        // record the new access time without disturbing the write time,
+        // which is what expiration is based on.
+        metadata.set(ACCESS_FIELD, newtime);
+        encodeMeta(metadata, metavalue);
+        batch.Put(metakey, metavalue);
+
+        batch.Delete( timeKeyFromTuple(oldtime, tuple) );
+        batch.Put( timeKeyFromTuple(now, tuple), tuple );
+        ++count;
+    }
+
+    if ( count > 0u && !_db->Write(leveldb::WriteOptions(), &batch).ok() )
+    {
+        OE_WARN << LC << "Failed to update access times for " << count << " record(s)" << std::endl;
+        return 0u;
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Updated access times for " << count << " record(s)" << std::endl;
+    }
+
+    return count;
 }
@@ -37,16 +37,96 @@
 
 #define OSGEARTH_ENV_CACHE_MAX_SIZE_MB "OSGEARTH_CACHE_MAX_SIZE_MB"
 
-#define ROCKSDB_CACHE_VERSION 1
+#define ROCKSDB_CACHE_VERSION 2
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers::RocksDBCache;
 
+//------------------------------------------------------------------------
+
+namespace osgEarth { namespace Drivers { namespace RocksDBCache
+{
+    /**
+     * Background thread that writes batched access times to the time index
+     * and, while the cache is over its size limit, evicts the least recently
+     * used records a step at a time. Readers and writers only signal it.
+     *
+     * The pending accesses and the time index are shared by every bin (each
+     * time key carries its record's bin ID), so one pass through them keeps
+     * the named bins in LRU order along with the default one; the bin passed
+     * in only supplies the key helpers.
+     */
+    class Maintenance : public OpenThreads::Thread
+    {
+    public:
+        Maintenance(RocksDBCacheBin* bin, Tracker* tracker) :
+            _bin(bin), _tracker(tracker), _done(false) { }
+
+        void cancelAndJoin()
+        {
+            _done = true;
+            _tracker->requestMaintenance();
+            join();
+        }
+
+        void run()
+        {
+            while( !_done )
+            {
+                _tracker->waitForMaintenance();
+
+                // even on the way out, so recent reads are not lost.
+                _bin->flushAccesses();
+
+                if ( !_done && _tracker->hasSizeLimit() )
+                {
+                    _tracker->calcSize();
+                    if ( _tracker->isOverLimit() )
+                    {
+                        evict();
+                    }
+                }
+            }
+        }
+
+    private:
+        void evict()
+        {
+            ::off_t excess = _tracker->getSize() - _tracker->getPurgeTarget();
+            ::off_t freed  = 0;
+
+            RocksDBCacheBin::PurgeRange range;
+            while( freed < excess && !_done )
+            {
+                ::off_t bytes = _bin->purgeOldest(_tracker->numToPurge(), range);
+                if ( bytes == 0 )
+                    break;
+                freed += bytes;
+            }
+
+            _bin->compactPurged(range);
+            ::off_t size = _tracker->calcSize();
+
+            OE_DEBUG << LC << "Evicted " << (freed/1048576) << " MB; "
+                << "cache size = " << (size/1048576) << " MB; "
+                << "hit ratio = " << (float)_tracker->hits/(float)_tracker->reads << std::endl;
+        }
+
+        osg::ref_ptr<RocksDBCacheBin> _bin;
+        osg::ref_ptr<Tracker>         _tracker;
+        volatile bool                 _done;
+    };
+} } }
+
+//------------------------------------------------------------------------
+
 
 RocksDBCacheImpl::RocksDBCacheImpl( const CacheOptions& options ) :
 osgEarth::Cache( options ),
 _options       ( options ),
-_active        ( true )
+_active        ( true ),
+_db            ( 0L ),
+_maintenance   ( 0L )
 {
     // Force OSG to initialize the image wrapper. Failure to do this can result
     // in a race condition within OSG when the cache is accessed from multiple threads.
@@ -105,6 +185,13 @@ _active        ( true )
 
 RocksDBCacheImpl::~RocksDBCacheImpl()
 {
+    if ( _maintenance )
+    {
+        _maintenance->cancelAndJoin();
+        delete _maintenance;
+        _maintenance = 0L;
+    }
+
     if ( _db )
     {
         // problem. This destructor causes a lockup sometimes. Perhaps try
@@ -131,10 +218,17 @@ RocksDBCacheImpl::init()
 
     open();
 
-    // Do an initial size check.
+    // Do an initial size check, and start the thread that keeps the access
+    // index current and the cache under its size limit.
     if ( _db )
     {
+        _tracker->setDatabase(_db);
         _tracker->calcSize();
+
+        // any bin will do; maintenance covers the records of all of them.
+        RocksDBCacheBin* bin = static_cast<RocksDBCacheBin*>(getOrCreateDefaultBin());
+        _maintenance = new Maintenance(bin, _tracker.get());
+        _maintenance->start();
     }
 
     if ( _active )
@@ -20,6 +20,7 @@
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
 #include <osgEarth/Random>
+#include <osgEarth/StringUtils>
 #include <osgDB/Registry>
 #include <rocksdb/write_batch.h>
 #include <string>
@@ -78,6 +79,22 @@ namespace
 
 #define TIME_FIELD "rocksdb.time"
 
+// time of the record's entry in the access time index, once a read
+// has moved it away from the time the record was written.
+#define ACCESS_FIELD "rocksdb.atime"
+
+// smaller data is stored in the record itself; sharing it would save
+// little more than the reference costs.
+#define MIN_BLOB_SIZE 128u
+
+namespace
+{
+    DateTime getAccessTime(const Config& meta)
+    {
+        return DateTime(meta.value(meta.hasValue(ACCESS_FIELD) ? ACCESS_FIELD : TIME_FIELD));
+    }
+}
+
 
 RocksDBCacheBin::RocksDBCacheBin(const std::string& binID,
                                  rocksdb::DB*       db,
@@ -199,7 +216,13 @@ RocksDBCacheBin::metaEnd() const
 std::string
 RocksDBCacheBin::timeKey(const DateTime& t, const std::string& key) const
 {
-    return "t" + SEP + t.asCompactISO8601() + SEP + getID() + SEP + key;
+    return timeKeyFromTuple(t, binDataKeyTuple(key));
+}
+
+std::string
+RocksDBCacheBin::timeKeyFromTuple(const DateTime& t, const std::string& tuple) const
+{
+    return "t" + SEP + t.asCompactISO8601() + SEP + tuple;
 }
 
 std::string
@@ -226,6 +249,18 @@ RocksDBCacheBin::timeEndGlobal() const
     return "t" + SEP + "\xff";
 }
 
+std::string
+RocksDBCacheBin::blobKey(const std::string& hash) const
+{
+    return "h" + SEP + hash;
+}
+
+std::string
+RocksDBCacheBin::refsKey(const std::string& hash) const
+{
+    return "r" + SEP + hash;
+}
+
 ReadResult
 RocksDBCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
 {
@@ -272,22 +307,53 @@ RocksDBCacheBin::read(const std::string& key, const Reader& reader)
         return ReadResult(ReadResult::RESULT_NOT_FOUND);
     }
 
+    // the data may be shared with other records, under its content hash.
+    std::string hash;
+    if ( getBlobReference(datavalue, hash) )
+    {
+        status = _db->Get( ro, blobKey(hash), &datavalue );
+        if ( !status.ok() )
+        {
+            OE_WARN << LC << "Bin " << getID() << ": missing shared data for (" << key << ")" << std::endl;
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+        }
+    }
+
     // blend the data string
     if ( _tracker->seed().isSet() )
         unblend(datavalue, _tracker->seed().value());
 
-    // finally, decode the OSGB stream into an object.
-    std::istringstream datastream(datavalue);
-    osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
-    if ( !r.success() )
+    osg::ref_ptr<osg::Object> object;
+
+    if ( isEncodedPayload(metadata) )
     {
-        OE_WARN << LC << "Cache read failure!"
-            << "\n reader = " << reader.name()
-            << "\n error detail = " << r.message()
-            << "\n data value = " << datavalue
-            << "\n";
+        // the record holds the original encoded bytes; decode them directly.
+        object = readEncodedPayload(datavalue, metadata, reader._op);
+        if ( !object.valid() )
+        {
+            OE_WARN << LC << "Cache read failure!"
+                << "\n error detail = cannot decode encoded payload"
+                << "\n";
 
-        return ReadResult(ReadResult::RESULT_READER_ERROR);
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+    }
+    else
+    {
+        // finally, decode the OSGB stream into an object.
+        std::istringstream datastream(datavalue);
+        osgDB::ReaderWriter::ReadResult r = reader.read(datastream);
+        if ( !r.success() )
+        {
+            OE_WARN << LC << "Cache read failure!"
+                << "\n reader = " << reader.name()
+                << "\n error detail = " << r.message()
+                << "\n data value = " << datavalue
+                << "\n";
+
+            return ReadResult(ReadResult::RESULT_READER_ERROR);
+        }
+        object = r.getObject();
     }
         
     if ( _debug )
@@ -295,16 +361,15 @@ RocksDBCacheBin::read(const std::string& key, const Reader& reader)
         OE_NOTICE << LC << "Bin " << getID() << ": read (" << key << ")\n";
     }
 
-    // if there's a size limit, we need to 'touch' the record.
+    // if there's a size limit, note the access; the tracker batches these
+    // up for the maintenance thread instead of rewriting the index here.
     if ( _tracker->hasSizeLimit() )
     {
-        // Room for optimization here since we already have the 
-        // meta/time records around.
-        touch( key );
+        _tracker->recordAccess( binDataKeyTuple(key), getAccessTime(metadata).asTimeStamp() );
     }
 
     ++_tracker->hits;
-    ReadResult rr(r.getObject(), metadata);
+    ReadResult rr(object.get(), metadata);
     rr.setLastModifiedTime(lastModified);    
     return rr;
 }
@@ -337,8 +402,17 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
 
     std::string       data;
     std::stringstream datastream;
+    Config            metadata(meta);
+
+    // A string, or an image that still carries the bytes it was decoded from,
+    // is stored verbatim, skipping the OSGB encode here and the decode on read.
+    bool isPayload = getEncodedPayload(object, data, metadata);
 
-    if ( dynamic_cast<const osg::Image*>(object) )
+    if ( isPayload )
+    {
+        objWriteOK = true;
+    }
+    else if ( dynamic_cast<const osg::Image*>(object) )
     {
         if ( (_rw->supportedFeatures() & _rw->FEATURE_WRITE_IMAGE) == 0 )
         {
@@ -373,28 +447,67 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
     {
         DateTime now;
         rocksdb::WriteBatch batch;
+        ::off_t bytes = 0;
 
         // write the data:
-        data = datastream.str();
+        if ( !isPayload )
+            data = datastream.str();
+
+        std::string hash;
+        if ( _tracker->deduplicate() && data.size() >= MIN_BLOB_SIZE )
+            hash = contentHash(data);
+
         if ( _tracker->seed().isSet() )
             blend(data, _tracker->seed().value());
+
+        // reference counts must not change between reading and writing them.
+        ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+        // let go of the data of any record we're overwriting, unless it is
+        // the very same blob:
+        std::string olddata, oldhash;
+        if ( _db->Get(rocksdb::ReadOptions(), dataKey(key), &olddata).ok() &&
+             getBlobReference(olddata, oldhash) &&
+             oldhash != hash )
+        {
+            bytes -= releaseBlobReference(oldhash, batch);
+        }
+
+        // identical data is stored once and referenced by its hash:
+        if ( !hash.empty() )
+        {
+            if ( hash != oldhash )
+                bytes += addBlobReference(hash, data, batch);
+            data = makeBlobReference(hash);
+        }
+
         batch.Put( dataKey(key), data );
+        bytes += data.size();
 
-        // write the timestamp index:
+        // replace the timestamp index of any record we're overwriting:
+        std::string oldmeta;
+        if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &oldmeta).ok() )
+        {
+            Config oldmetadata;
+            decodeMeta(oldmeta, oldmetadata);
+            batch.Delete( timeKey(getAccessTime(oldmetadata), key) );
+        }
         batch.Put( timeKey(now, key), binDataKeyTuple(key) );
 
         // write the metadata:
-        Config metadata(meta);
         metadata.set( TIME_FIELD, now.asCompactISO8601() );
+        metadata.remove( ACCESS_FIELD );
         encodeMeta( metadata, data );
         batch.Put( metaKey(key), data );
+        bytes += data.size();
 
         objWriteOK = _db->Write( rocksdb::WriteOptions(), &batch ).ok();
 
         if ( objWriteOK )
         {
             ++_tracker->writes;
-            postWrite();
+            if ( bytes > 0 )
+                postWrite(bytes);
             
             if ( _debug )
             {
@@ -413,38 +526,68 @@ RocksDBCacheBin::write(const std::string& key, const osg::Object* object, const
     return objWriteOK;
 }
 
+::off_t
+RocksDBCacheBin::addBlobReference(const std::string& hash, const std::string& data, rocksdb::WriteBatch& batch)
+{
+    std::string refs;
+    if ( _db->Get(rocksdb::ReadOptions(), refsKey(hash), &refs).ok() )
+    {
+        batch.Put( refsKey(hash), Stringify() << (as<unsigned>(refs, 0u) + 1u) );
+        return 0;
+    }
+
+    // first record with this data
+    batch.Put( blobKey(hash), data );
+    batch.Put( refsKey(hash), "1" );
+    return data.size();
+}
+
+::off_t
+RocksDBCacheBin::releaseBlobReference(const std::string& hash, rocksdb::WriteBatch& batch)
+{
+    rocksdb::ReadOptions ro;
+    std::string refs;
+    if ( !_db->Get(ro, refsKey(hash), &refs).ok() )
+        return 0;
+
+    unsigned count = as<unsigned>(refs, 0u);
+    if ( count > 1u )
+    {
+        batch.Put( refsKey(hash), Stringify() << (count - 1u) );
+        return 0;
+    }
+
+    // that was the last reference
+    std::string blob;
+    ::off_t bytes = 0;
+    if ( _db->Get(ro, blobKey(hash), &blob).ok() )
+        bytes = blob.size();
+    batch.Delete( blobKey(hash) );
+    batch.Delete( refsKey(hash) );
+    return bytes;
+}
+
+::off_t
+RocksDBCacheBin::releaseData(const std::string& datakey, rocksdb::WriteBatch& batch)
+{
+    std::string value, hash;
+    if ( _db->Get(rocksdb::ReadOptions(), datakey, &value).ok() && getBlobReference(value, hash) )
+        return releaseBlobReference(hash, batch);
+    return 0;
+}
+
 void
-RocksDBCacheBin::postWrite()
+RocksDBCacheBin::postWrite(::off_t bytes)
 {
     if ( _tracker->hasSizeLimit() )
     {
-        if ( _tracker->isOverLimit() )
-        {
-            if ( _tracker->isTimeToPurge() )
-            {
-                this->purgeOldest(_tracker->numToPurge());
-
-                if (_debug)
-                {
-                    off_t size = _tracker->calcSize();
-                    OE_NOTICE 
-                        << LC << "Cache size = " << (size/1048576) << " MB; " 
-                        << "Hit ratio = " << (float)_tracker->hits/(float)_tracker->reads << std::endl;
-                }
-            }
-        }
-        else
+        _tracker->addBytes(bytes);
+
+        // Eviction runs on the cache's maintenance thread; just wake it up
+        // so the writer never waits on a purge.
+        if ( _tracker->isOverLimit() || _tracker->isTimeToCheckSize() )
         {
-            if ( _tracker->isTimeToCheckSize() )
-            {
-                off_t size = _tracker->calcSize();
-                if ( _debug )
-                {
-                    OE_NOTICE 
-                        << LC << "Cache size = " << (size/1048576) << " MB; " 
-                        << "Hit ratio = " << (float)_tracker->hits/(float)_tracker->reads << std::endl;
-                }
-            }
+            _tracker->requestMaintenance();
         }
     }
 }
@@ -477,6 +620,8 @@ RocksDBCacheBin::remove(const std::string& key)
     if ( !binValidForReading() )
         return false;
 
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
     // first read in the time from the metadata record.
     std::string metavalue;
     if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
@@ -484,9 +629,10 @@ RocksDBCacheBin::remove(const std::string& key)
 
     Config metadata;
     decodeMeta(metavalue, metadata);
-    DateTime t(metadata.value(TIME_FIELD));
+    DateTime t = getAccessTime(metadata);
 
     rocksdb::WriteBatch batch;
+    releaseData( dataKey(key), batch );
     batch.Delete( dataKey(key) );
     batch.Delete( metaKey(key) );
     batch.Delete( timeKey(t, key) );
@@ -511,6 +657,9 @@ RocksDBCacheBin::touch(const std::string& key)
     if ( !binValidForWriting() )
         return false;
 
+    // same lock as write(), so the old time key we delete is the current one.
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
     // first read in the time from the metadata record.
     std::string metavalue;
     if ( _db->Get(rocksdb::ReadOptions(), metaKey(key), &metavalue).ok() == false )
@@ -518,13 +667,14 @@ RocksDBCacheBin::touch(const std::string& key)
 
     Config metadata;
     decodeMeta(metavalue, metadata);
-    DateTime oldtime(metadata.value(TIME_FIELD));
+    DateTime oldtime = getAccessTime(metadata);
         
     rocksdb::WriteBatch batch;
 
     // In a transaction, update the metadata record with the current time.
     std::string newtime = DateTime().asCompactISO8601();
     metadata.set(TIME_FIELD, newtime);
+    metadata.remove(ACCESS_FIELD);
     encodeMeta(metadata, metavalue);
     batch.Put(metaKey(key), metavalue);
 
@@ -554,13 +704,23 @@ RocksDBCacheBin::clear()
     
     rocksdb::WriteOptions wo;
     std::string binphrase = binPhrase();
-    rocksdb::WriteBatch batch;
+    std::string databegin = dataBegin();
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
     rocksdb::Iterator* i = _db->NewIterator(rocksdb::ReadOptions());
     for(i->SeekToFirst(); i->Valid(); i->Next())
     {
         std::string key = i->key().ToString();
         if ( key.find(binphrase) != std::string::npos )
         {
+            // records of this bin no longer hold on to shared data
+            std::string hash;
+            if ( key.compare(0, databegin.size(), databegin) == 0 && getBlobReference(i->value().ToString(), hash) )
+            {
+                rocksdb::WriteBatch batch;
+                releaseBlobReference( hash, batch );
+                _db->Write( wo, &batch );
+            }
+
             _db->Delete( wo, i->key() );
         }
     }
@@ -586,6 +746,60 @@ RocksDBCacheBin::compact()
     return false;
 }
 
+unsigned long long
+RocksDBCacheBin::deduplicate()
+{
+    if ( !binValidForWriting() )
+        return 0ull;
+
+    long long reclaimed = 0;
+    unsigned count = 0u;
+
+    ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+    // the iterator reads a snapshot, so rewriting records as we go is safe.
+    std::string limit = dataEnd();
+    rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions());
+    for(it->Seek(dataBegin()); it->Valid() && it->key().ToString() < limit; it->Next())
+    {
+        std::string value = it->value().ToString();
+        std::string hash;
+        if ( value.size() < MIN_BLOB_SIZE || getBlobReference(value, hash) )
+            continue;
+
+        // hash what was written, before any obfuscation
+        std::string data = value;
+        if ( _tracker->seed().isSet() )
+            unblend(data, _tracker->seed().value());
+        hash = contentHash(data);
+
+        rocksdb::WriteBatch batch;
+        ::off_t added = addBlobReference(hash, value, batch);
+        std::string ref = makeBlobReference(hash);
+        batch.Put( it->key(), ref );
+        if ( !_db->Write(rocksdb::WriteOptions(), &batch).ok() )
+            continue;
+
+        reclaimed += (long long)value.size() - (long long)ref.size() - (long long)added;
+        ++count;
+    }
+    delete it;
+
+    // release the space of the rewritten records
+    std::string begin = dataBegin();
+    std::string blobBegin = "h" + SEP, blobEnd = "h" + SEP + "\xff";
+    rocksdb::Slice b0(begin), e0(limit), b1(blobBegin), e1(blobEnd);
+    _db->CompactRange(&b0, &e0);
+    _db->CompactRange(&b1, &e1);
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": deduplicated " << count << " record(s)" << std::endl;
+    }
+
+    return reclaimed > 0 ? (unsigned long long)reclaimed : 0ull;
+}
+
 unsigned
 RocksDBCacheBin::getStorageSize()
 {
@@ -653,9 +867,23 @@ RocksDBCacheBin::purgeOldest(unsigned maxnum)
     if ( !binValidForWriting() )
         return false;
 
-    rocksdb::Iterator* it = _db->NewIterator(rocksdb::ReadOptions());
+    PurgeRange range;
+    purgeOldest(maxnum, range);
+    compactPurged(range);
+    return true;
+}
+
+::off_t
+RocksDBCacheBin::purgeOldest(unsigned maxnum, PurgeRange& range)
+{
+    if ( !binValidForWriting() )
+        return 0;
+
+    rocksdb::ReadOptions ro;
+    rocksdb::Iterator* it = _db->NewIterator(ro);
 
     unsigned count = 0;
+    ::off_t bytes = 0;
     std::string limit = timeEndGlobal();
 
     // note: this will delete records NOT OF THIS BIN as well!
@@ -667,22 +895,132 @@ RocksDBCacheBin::purgeOldest(unsigned maxnum)
             break;
 
         std::string tuple = it->value().ToString();
+        std::string timekey = it->key().ToString();
+        std::string datakey = dataKeyFromTuple(tuple);
+        std::string metakey = metaKeyFromTuple(tuple);
+
+        // A concurrent write() may replace the record, so read it again and
+        // delete it in one batch while the blob references can't change.
+        // (The space is reclaimed by compactPurged.)
+        ScopedMutexLock blobLock( _tracker->getBlobMutex() );
+
+        // the iterator sees a snapshot; a record rewritten since then has
+        // a new time key and is no longer the oldest.
+        std::string value, hash;
+        if ( !_db->Get(rocksdb::ReadOptions(), timekey, &value).ok() )
+            continue;
+
+        rocksdb::WriteBatch batch;
+
+        // tally what the record occupied, for the tracker's byte target:
+        if ( _db->Get(rocksdb::ReadOptions(), datakey, &value).ok() )
+        {
+            bytes += value.size();
 
-        // doing this in a WriteBatch did not work. The size of the
-        // database would never go down.
-        rocksdb::WriteOptions wo;
-        _db->Delete( wo, dataKeyFromTuple(tuple) );
-        _db->Delete( wo, metaKeyFromTuple(tuple) );
-        _db->Delete( wo, it->key() );
+            // shared data only goes with its last reference
+            if ( getBlobReference(value, hash) )
+                bytes += releaseBlobReference( hash, batch );
+        }
+        if ( _db->Get(rocksdb::ReadOptions(), metakey, &value).ok() )
+            bytes += value.size();
+        bytes += timekey.size() + tuple.size();
+
+        batch.Delete( datakey );
+        batch.Delete( metakey );
+        batch.Delete( timekey );
+        _db->Write( rocksdb::WriteOptions(), &batch );
+
+        range.include(tuple, timekey);
     }
 
     delete it;
 
     if ( _debug )
     {
-        OE_NOTICE << LC << "Purged " << count << " record(s) for "
-            << (_tracker->calcSize()/1048576) << " MB" << std::endl;
+        OE_NOTICE << LC << "Purged " << count << " record(s), about "
+            << (bytes/1024) << " KB" << std::endl;
     }
 
-    return true;
+    return bytes;
+}
+
+void
+RocksDBCacheBin::compactPurged(const PurgeRange& range)
+{
+    if ( !binValidForWriting() || range.maxTimeKey.empty() )
+        return;
+
+    // deleted records only release their space once compacted; limit the
+    // work to the key ranges the purge actually touched.
+    std::string begin[3], end[3];
+    begin[0] = dataKeyFromTuple(range.minTuple), end[0] = dataKeyFromTuple(range.maxTuple);
+    begin[1] = metaKeyFromTuple(range.minTuple), end[1] = metaKeyFromTuple(range.maxTuple);
+    begin[2] = timeBeginGlobal(),                end[2] = range.maxTimeKey;
+
+    for(unsigned i=0; i<3; ++i)
+    {
+        rocksdb::Slice b(begin[i]), e(end[i]);
+        _db->CompactRange(&b, &e);
+    }
+}
+
+unsigned
+RocksDBCacheBin::flushAccesses()
+{
+    if ( !binValidForWriting() )
+        return 0u;
+
+    std::set<std::string> tuples;
+    _tracker->takeAccesses(tuples);
+    if ( tuples.empty() )
+        return 0u;
+
+    DateTime now;
+    std::string newtime = now.asCompactISO8601();
+    rocksdb::ReadOptions ro;
+    rocksdb::WriteBatch batch;
+    unsigned count = 0u;
+
+    // write() and touch() replace the metadata and time key under this lock
+    // too; reading and rewriting them without it could restore stale metadata
+    // and strand the record's newer time key.
+    ScopedMutexLock lock( _tracker->getBlobMutex() );
+
+    for(std::set<std::string>::const_iterator i = tuples.begin(); i != tuples.end(); ++i)
+    {
+        const std::string& tuple = *i;
+
+        // the record may have been purged or removed since it was read.
+        std::string metakey = metaKeyFromTuple(tuple);
+        std::string metavalue;
+        if ( !_db->Get(ro, metakey, &metavalue).ok() )
+            continue;
+
+        Config metadata;
+        decodeMeta(metavalue, metadata);
+        DateTime oldtime = getAccessTime(metadata);
+
+        // record the new access time without disturbing the write time,
+        // which is what expiration is based on.
+        metadata.set(ACCESS_FIELD, newtime);
+        encodeMeta(metadata, metavalue);
+        batch.Put(metakey, metavalue);
+
+        batch.Delete( timeKeyFromTuple(oldtime, tuple) );
+        batch.Put( timeKeyFromTuple(now, tuple), tuple );
+        ++count;
+    }
+
+    if ( count > 0u && !_db->Write(rocksdb::WriteOptions(), &batch).ok() )
+    {
+        OE_WARN << LC << "Failed to update access times for " << count << " record(s)" << std::endl;
+        return 0u;
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Updated access times for " << count << " record(s)" << std::endl;
+    }
+
+    return count;
 }
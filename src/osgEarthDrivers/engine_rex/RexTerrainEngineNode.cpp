@@ -1151,7 +1151,7 @@ RexTerrainEngineNode::updateState()
                     {
                         // install Color Filter function calls:
                         const ColorFilterChain& chain = layer->getColorFilters();
-                        if ( chain.size() > 0 )
+                        if ( chain.size() > 0 && !layer->getColorFiltersBaked() )
                         {
                             haveColorFilters = true;
                             if ( ifStarted ) cf_body << I << "else if ";
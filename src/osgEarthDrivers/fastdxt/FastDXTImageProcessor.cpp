@@ -18,6 +18,7 @@
 */
 
 #include <osg/Texture>
+#include <osg/Math>
 #include <osgDB/Registry>
 #include <osg/Notify>
 #include <osgEarth/ImageUtils>
@@ -25,6 +26,13 @@
 #include "libdxt.h"
 #include <string.h>
 
+#include <OpenThreads/Thread>
+
+// Images with fewer block rows than this per band compress on the calling
+// thread; handing a typical tile (256 or 512 pixels) to other threads costs
+// more than it saves.
+#define MIN_BLOCK_ROWS_PER_THREAD 128
+
 class FastDXTProcessor : public osgDB::ImageProcessor
 {
 public:
@@ -38,17 +46,11 @@ public:
             image.scaleImage(s, t, image.r());
         }
 
-        osg::Image* sourceImage = &image;
-
-        //FastDXT only works on RGBA imagery so we must convert it
-        osg::ref_ptr< osg::Image > rgba;
-        if (image.getPixelFormat() != GL_RGBA)
+        //Blocks are 4x4 so smaller images can't be compressed
+        if (image.s() < 4 || image.t() < 4)
         {
-            osg::Timer_t start = osg::Timer::instance()->tick();
-            rgba = osgEarth::ImageUtils::convertToRGBA8( &image );
-            osg::Timer_t end = osg::Timer::instance()->tick();
-            OE_INFO << "conversion to rgba took" << osg::Timer::instance()->delta_m(start, end) << std::endl;
-            sourceImage = rgba.get();
+            OE_INFO << "FastDXT: image is too small to compress" << std::endl;
+            return;
         }
 
         int format;
@@ -65,34 +67,68 @@ public:
             pixelFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
             OE_INFO << "FastDXT dxt5 format" << std::endl;
             break;
+        case osg::Texture::USE_RGTC1_COMPRESSION:
+            format = FORMAT_BC4;
+            pixelFormat = GL_COMPRESSED_RED_RGTC1_EXT;
+            OE_INFO << "FastDXT using bc4 format" << std::endl;
+            break;
+        case osg::Texture::USE_RGTC2_COMPRESSION:
+            format = FORMAT_BC5;
+            pixelFormat = GL_COMPRESSED_RED_GREEN_RGTC2_EXT;
+            OE_INFO << "FastDXT using bc5 format" << std::endl;
+            break;
         default:
             OSG_WARN << "Unhandled compressed format" << compressedFormat << std::endl;
             return;
             break;
         }
 
+        osg::Image* sourceImage = &image;
+
+        //FastDXT only works on RGBA imagery so we must convert it
+        osg::ref_ptr< osg::Image > rgba;
+        if (image.getPixelFormat() != GL_RGBA || image.getDataType() != GL_UNSIGNED_BYTE)
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            rgba = osgEarth::ImageUtils::convertToRGBA8( &image );
+            osg::Timer_t end = osg::Timer::instance()->tick();
+            OE_INFO << "conversion to rgba took" << osg::Timer::instance()->delta_m(start, end) << std::endl;
+            sourceImage = rgba.get();
+        }
+
         //Copy over the source data to an array
+        unsigned int numPixels = sourceImage->s() * sourceImage->t();
         unsigned char *in = 0;
-        in = (unsigned char*)memalign(16, sourceImage->getTotalSizeInBytes());
-        memcpy(in, sourceImage->data(0,0), sourceImage->getTotalSizeInBytes());
-
+        in = (unsigned char*)memalign(16, numPixels*4);
+        memcpy(in, sourceImage->data(0,0), numPixels*4);
 
+        //BC5 encodes red and green; a luminance-alpha image keeps its alpha in green
+        if (format == FORMAT_BC5 && image.getPixelFormat() == GL_LUMINANCE_ALPHA)
+        {
+            for (unsigned int i = 0; i < numPixels; ++i)
+                in[i*4+1] = in[i*4+3];
+        }
 
         //Allocate memory for the output
         unsigned char* out = (unsigned char*)memalign(16, image.s()*image.t()*4);
         memset(out, 0, image.s()*image.t()*4);
 
+        //Split large images into bands of block rows for the shared thread pool
+        int numThreads = osg::minimum(
+            OpenThreads::GetNumberOfProcessors(),
+            (sourceImage->t()/4) / MIN_BLOCK_ROWS_PER_THREAD);
+
         osg::Timer_t start = osg::Timer::instance()->tick();
-        int outputBytes = CompressDXT(in, out, sourceImage->s(), sourceImage->t(), format);
+        int outputBytes = CompressDXT(in, out, sourceImage->s(), sourceImage->t(), format, numThreads);
         osg::Timer_t end = osg::Timer::instance()->tick();
-        OE_INFO << "compression took" << osg::Timer::instance()->delta_m(start, end) << std::endl;
+        OE_INFO << "compression took" << osg::Timer::instance()->delta_m(start, end) << " (" << osg::maximum(numThreads, 1) << " threads)" << std::endl;
 
         //Allocate and copy over the output data to the correct size array.
         unsigned char* data = (unsigned char*)malloc(outputBytes);
         memcpy(data, out, outputBytes);
         memfree(out);
         memfree(in);
-        image.setImage(image.s(), image.t(), image.r(), pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
+        image.setImage(image.s(), image.t(), 1, pixelFormat, pixelFormat, GL_UNSIGNED_BYTE, data, osg::Image::USE_MALLOC_FREE);
     }
 
     virtual void generateMipMap(osg::Image& image, bool resizeToPowerOfTwo, CompressionMethod method)
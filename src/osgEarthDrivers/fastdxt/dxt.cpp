@@ -20,6 +20,10 @@ void GetMinMaxColors_Intrinsics( const byte *colorBlock, byte *minColor, byte *m
 // for DXT5
 void GetMinMaxColorsAlpha(  byte *colorBlock, byte *minColor, byte *maxColor );
 
+// for BC4/BC5: exact per-channel range, no inset
+void GetMinMaxChannels( const byte *colorBlock, byte *minColor, byte *maxColor );
+void GetMinMaxChannels_Intrinsics( const byte *colorBlock, byte *minColor, byte *maxColor );
+
 
 word ColorTo565( const byte *color );
 
@@ -36,14 +40,17 @@ void EmitAlphaIndices( const byte *colorBlock, const byte minAlpha, const byte m
 void EmitAlphaIndicesFast( const byte *colorBlock, const byte minAlpha, const byte maxAlpha, byte *&outData);
 void EmitAlphaIndices_Intrinsics( const byte *colorBlock, const byte minAlpha, const byte maxAlpha, byte *&outData);
 
+// Emit indices for any one channel (DXT5 alpha, BC4, BC5)
+void EmitChannelIndicesFast( const byte *colorBlock, int channel, const byte minValue, const byte maxValue, byte *&outData);
+
 
 void CompressImageDXT1( const byte *inBuf, byte *outBuf,
 			int width, int height, int &outputBytes )
 {
   ALIGN16( byte *outData );
   ALIGN16( byte block[64] );
-  ALIGN16( byte minColor[4] );
-  ALIGN16( byte maxColor[4] );
+  ALIGN16( byte minColor[16] ); // GetMinMaxColors_Intrinsics stores 16 bytes
+  ALIGN16( byte maxColor[16] );
 
   outData = outBuf;
   for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
@@ -126,8 +133,8 @@ void CompressImageDXT5( const byte *inBuf, byte *outBuf, int width, int height,
   ALIGN16( byte *outData );
   
   ALIGN16( byte block[64] );
-  ALIGN16( byte minColor[4] );
-  ALIGN16( byte maxColor[4] );
+  ALIGN16( byte minColor[16] ); // GetMinMaxColors_Intrinsics stores 16 bytes
+  ALIGN16( byte maxColor[16] );
   
   outData = outBuf;
   for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
@@ -173,6 +180,68 @@ void CompressImageDXT5( const byte *inBuf, byte *outBuf, int width, int height,
 
 
 
+void CompressImageBC4( const byte *inBuf, byte *outBuf, int width, int height,
+                       int &outputBytes )
+{
+  ALIGN16( byte *outData );
+  ALIGN16( byte block[64] );
+  ALIGN16( byte minColor[16] );
+  ALIGN16( byte maxColor[16] );
+
+  outData = outBuf;
+  for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
+    for ( int i = 0; i < width; i += 4 ) {
+
+#if defined(DXT_INTR)
+      ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+      GetMinMaxChannels_Intrinsics( block, minColor, maxColor );
+#else
+      ExtractBlock( inBuf + i * 4, width, block );
+      GetMinMaxChannels( block, minColor, maxColor );
+#endif
+
+      EmitByte( maxColor[0], outData );
+      EmitByte( minColor[0], outData );
+      EmitChannelIndicesFast( block, 0, minColor[0], maxColor[0], outData );
+    }
+  }
+  outputBytes = int( outData - outBuf );
+}
+
+void CompressImageBC5( const byte *inBuf, byte *outBuf, int width, int height,
+                       int &outputBytes )
+{
+  ALIGN16( byte *outData );
+  ALIGN16( byte block[64] );
+  ALIGN16( byte minColor[16] );
+  ALIGN16( byte maxColor[16] );
+
+  outData = outBuf;
+  for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
+    for ( int i = 0; i < width; i += 4 ) {
+
+#if defined(DXT_INTR)
+      ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+      GetMinMaxChannels_Intrinsics( block, minColor, maxColor );
+#else
+      ExtractBlock( inBuf + i * 4, width, block );
+      GetMinMaxChannels( block, minColor, maxColor );
+#endif
+
+      // red block, then green block
+      EmitByte( maxColor[0], outData );
+      EmitByte( minColor[0], outData );
+      EmitChannelIndicesFast( block, 0, minColor[0], maxColor[0], outData );
+
+      EmitByte( maxColor[1], outData );
+      EmitByte( minColor[1], outData );
+      EmitChannelIndicesFast( block, 1, minColor[1], maxColor[1], outData );
+    }
+  }
+  outputBytes = int( outData - outBuf );
+}
+
+
 void ExtractBlock( const byte *inPtr, int width, byte *colorBlock )
 {
   for ( int j = 0; j < 4; j++ ) {
@@ -296,6 +365,24 @@ void GetMinMaxColorsByBBox( const byte *colorBlock, byte *minColor, byte *maxCol
 }
 
 
+//
+// GetMinMaxChannels for BC4/BC5. The endpoints are stored exactly
+// so unlike the color path there's no inset.
+//
+void GetMinMaxChannels( const byte *colorBlock, byte *minColor, byte *maxColor )
+{
+  minColor[0] = minColor[1] = minColor[2] = minColor[3] = 255;
+  maxColor[0] = maxColor[1] = maxColor[2] = maxColor[3] = 0;
+
+  for ( int i = 0; i < 16; i++ ) {
+    for ( int c = 0; c < 4; c++ ) {
+      if ( colorBlock[i*4+c] < minColor[c] ) { minColor[c] = colorBlock[i*4+c]; }
+      if ( colorBlock[i*4+c] > maxColor[c] ) { maxColor[c] = colorBlock[i*4+c]; }
+    }
+  }
+}
+
+
 //
 // GetMinMaxColorsAlpha for DXT5
 //
@@ -469,6 +556,12 @@ void EmitAlphaIndices( const byte *colorBlock, const byte minAlpha, const byte m
 
 
 void EmitAlphaIndicesFast( const byte *colorBlock, const byte minAlpha, const byte maxAlpha, byte *&outData )
+{
+  EmitChannelIndicesFast( colorBlock, 3, minAlpha, maxAlpha, outData );
+}
+
+
+void EmitChannelIndicesFast( const byte *colorBlock, int channel, const byte minAlpha, const byte maxAlpha, byte *&outData )
 {
   //assert( maxAlpha > minAlpha );
 
@@ -482,7 +575,7 @@ void EmitAlphaIndicesFast( const byte *colorBlock, const byte minAlpha, const by
   byte ab6 = ( 2 * maxAlpha + 5 * minAlpha ) / 7 + mid;
   byte ab7 = ( 1 * maxAlpha + 6 * minAlpha ) / 7 + mid;
 
-  colorBlock += 3;
+  colorBlock += channel;
 
   for ( int i = 0; i < 16; i++ ) {
 
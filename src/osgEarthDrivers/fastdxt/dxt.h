@@ -64,5 +64,11 @@ void CompressImageDXT5( const byte *inBuf, byte *outBuf, int width, int height,
 // Compress to DXT5 format, first convert to YCoCg color space
 void CompressImageDXT5YCoCg( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
 
+// Compress the red channel to BC4 (RGTC1) format
+void CompressImageBC4( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
+
+// Compress the red and green channels to BC5 (RGTC2) format
+void CompressImageBC5( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
+
 // Compute error between two images
 double ComputeError( const byte *original, const byte *dxt, int width, int height);
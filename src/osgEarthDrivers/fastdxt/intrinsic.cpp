@@ -140,6 +140,44 @@ void GetMinMaxColors_Intrinsics( const byte *colorBlock, byte *minColor, byte *m
 }
 
 
+// Exact per-channel bounding box of a block, for BC4/BC5. Same reduction
+// as GetMinMaxColors_Intrinsics without the inset. Stores 16 bytes.
+void GetMinMaxChannels_Intrinsics( const byte *colorBlock, byte *minColor, byte *maxColor )
+{
+    __m128i t0, t1, t3, t4, t6, t7;
+
+    t0 = _mm_load_si128 ( (__m128i*) colorBlock );
+    t1 = t0;
+
+    __m128i t16 = _mm_load_si128 ( (__m128i*) (colorBlock+16) );
+    t0 = _mm_min_epu8 ( t0, t16);
+    t1 = _mm_max_epu8 ( t1, t16);
+
+    __m128i t32 = _mm_load_si128 ( (__m128i*) (colorBlock+32) );
+    t0 = _mm_min_epu8 ( t0, t32);
+    t1 = _mm_max_epu8 ( t1, t32);
+
+    __m128i t48 = _mm_load_si128 ( (__m128i*) (colorBlock+48) );
+    t0 = _mm_min_epu8 ( t0, t48);
+    t1 = _mm_max_epu8 ( t1, t48);
+
+    t3 = _mm_shuffle_epi32( t0, R_SHUFFLE_D( 2, 3, 2, 3 ) );
+    t4 = _mm_shuffle_epi32( t1, R_SHUFFLE_D( 2, 3, 2, 3 ) );
+
+    t0 = _mm_min_epu8 ( t0, t3);
+    t1 = _mm_max_epu8 ( t1, t4);
+
+    t6 = _mm_shufflelo_epi16( t0, R_SHUFFLE_D( 2, 3, 2, 3 ) );
+    t7 = _mm_shufflelo_epi16( t1, R_SHUFFLE_D( 2, 3, 2, 3 ) );
+
+    t0 = _mm_min_epu8 ( t0, t6);
+    t1 = _mm_max_epu8 ( t1, t7);
+
+    _mm_store_si128 ( (__m128i*) minColor, t0 );
+    _mm_store_si128 ( (__m128i*) maxColor, t1 );
+}
+
+
 ALIGN16( static word SIMD_SSE2_word_0[8] ) = { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 };
 ALIGN16( static word SIMD_SSE2_word_1[8] ) = { 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001 };
 ALIGN16( static word SIMD_SSE2_word_2[8] ) = { 0x0002, 0x0002, 0x0002, 0x0002, 0x0002, 0x0002, 0x0002, 0x0002 };
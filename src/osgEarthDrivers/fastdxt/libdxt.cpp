@@ -30,9 +30,15 @@
 #include <malloc.h>
 #endif
 
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
+#include <vector>
+
 typedef struct _work_t {
 	int width, height;
 	int nbb;
+	int format;
 	byte *in, *out;
 } work_t;
 
@@ -65,31 +71,114 @@ void *slave5ycocg(void *arg)
 	return NULL;
 }
 
-int CompressDXT(const byte *in, byte *out, int width, int height, int format)
+void *slavebc4(void *arg)
+{
+	work_t *param = (work_t*) arg;
+	int nbbytes = 0;
+	CompressImageBC4( param->in, param->out, param->width, param->height, nbbytes);
+	param->nbb = nbbytes;
+	return NULL;
+}
+
+void *slavebc5(void *arg)
+{
+	work_t *param = (work_t*) arg;
+	int nbbytes = 0;
+	CompressImageBC5( param->in, param->out, param->width, param->height, nbbytes);
+	param->nbb = nbbytes;
+	return NULL;
+}
+
+void *slave(void *arg)
+{
+	work_t *param = (work_t*) arg;
+	switch (param->format) {
+		case FORMAT_DXT1:      return slave1(arg);
+		case FORMAT_DXT5:      return slave5(arg);
+		case FORMAT_DXT5YCOCG: return slave5ycocg(arg);
+		case FORMAT_BC4:       return slavebc4(arg);
+		case FORMAT_BC5:       return slavebc5(arg);
+	}
+	return NULL;
+}
+
+// Compresses one band of block rows on the shared pool.
+struct SlaveTask : public osgEarth::TaskRequest
+{
+	SlaveTask(work_t* job, osgEarth::Threading::MultiEvent& done) : _job(job), _done(done) { }
+	void operator()(osgEarth::ProgressCallback*) { slave(_job); _done.notify(); }
+	work_t*                          _job;
+	osgEarth::Threading::MultiEvent& _done;
+};
+
+static osgEarth::Threading::Mutex s_poolMutex;
+
+// One pool of threads shared by all compressions, created on first use. It is
+// never destroyed, so no threads are joined while the process shuts down.
+static osgEarth::TaskService* getPool()
+{
+	static osgEarth::TaskService* s_pool = 0L;
+	osgEarth::Threading::ScopedMutexLock lock(s_poolMutex);
+	if (!s_pool)
+	{
+		s_pool = new osgEarth::TaskService("FastDXT", OpenThreads::GetNumberOfProcessors());
+		s_pool->ref();
+	}
+	return s_pool;
+}
+
+int BlockSizeDXT(int format)
+{
+	return (format == FORMAT_DXT1 || format == FORMAT_BC4) ? 8 : 16;
+}
+
+int CompressDXT(const byte *in, byte *out, int width, int height, int format, int numThreads)
 { 
-  int        nbbytes;
-
-  work_t job;
-
-  job.width = width;
-  job.height = height;
-  job.nbb = 0;
-  job.in =  (byte*)in;
-  job.out = out;
-  
-  switch (format) {
-      case FORMAT_DXT1:
-          slave1(&job);
-          break;
-      case FORMAT_DXT5:
-          slave5(&job);
-          break;
-      case FORMAT_DXT5YCOCG:
-          slave5ycocg(&job);
-          break;
+  int blockRows = height / 4;
+
+  // Bands are whole block rows so each one starts on a block boundary in
+  // both buffers and the threads never share a cache line of output.
+  if (numThreads > blockRows)
+    numThreads = blockRows;
+  if (numThreads < 1)
+    numThreads = 1;
+
+  std::vector<work_t> jobs(numThreads);
+  int rowsDone = 0;
+  for (int t = 0; t < numThreads; ++t)
+  {
+    int rows = blockRows / numThreads + (t < blockRows % numThreads ? 1 : 0);
+    work_t& job = jobs[t];
+    job.width  = width;
+    job.height = rows * 4;
+    job.nbb    = 0;
+    job.format = format;
+    job.in     = (byte*)in + rowsDone * 4 * width * 4;
+    job.out    = out + rowsDone * (width / 4) * BlockSizeDXT(format);
+    rowsDone  += rows;
+  }
+
+  if (numThreads == 1)
+  {
+    slave(&jobs[0]);
   }
+  else
+  {
+    // the calling thread takes the first band; the pool does the rest.
+    osgEarth::TaskService* pool = getPool();
+    osgEarth::Threading::MultiEvent done(numThreads - 1);
+    for (int t = 1; t < numThreads; ++t)
+    {
+      pool->add(new SlaveTask(&jobs[t], done));
+    }
 
-  // Join all the threads
-  nbbytes = job.nbb;
+    slave(&jobs[0]);
+
+    done.wait();
+  }
+
+  int nbbytes = 0;
+  for (int t = 0; t < numThreads; ++t)
+    nbbytes += jobs[t].nbb;
   return nbbytes;
-}
\ No newline at end of file
+}
@@ -28,8 +28,16 @@
 #define FORMAT_DXT1      1
 #define FORMAT_DXT5      2
 #define FORMAT_DXT5YCOCG 3
+#define FORMAT_BC4       4
+#define FORMAT_BC5       5
 
 
-int CompressDXT(const byte *in, byte *out, int width, int height, int format);
+// Compresses an RGBA image whose dimensions are multiples of 4. With numThreads > 1
+// the image is split into bands of block rows that compress concurrently.
+// Returns the number of bytes written to "out".
+int CompressDXT(const byte *in, byte *out, int width, int height, int format, int numThreads =1);
+
+// Size in bytes of one compressed 4x4 block in the given format.
+int BlockSizeDXT(int format);
 
 
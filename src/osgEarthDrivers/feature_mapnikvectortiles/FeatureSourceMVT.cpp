@@ -21,6 +21,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/GeoData>
+#include <osgEarth/ThreadingUtils>
 #include <osgEarthFeatures/FeatureSource>
 #include <osgEarthFeatures/MVT>
 #include <osgEarthFeatures/Filter>
@@ -48,7 +49,8 @@ public:
       _options     ( options ),
       _minLevel(0),
       _maxLevel(14),
-      _database(0L)
+      _database(0L),
+      _selectTile(0L)
     {
         _compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
         if (!_compressor.valid())
@@ -59,8 +61,11 @@ public:
 
     /** Destruct the object, cleaning up and OGR handles. */
     virtual ~MVTFeatureSource()
-    {               
-        //nop
+    {
+        if (_selectTile)
+            sqlite3_finalize( _selectTile );
+        if (_database)
+            sqlite3_close( _database );
     }
 
     FeatureCursor* createFeatureCursor( const Symbology::Query& query )
@@ -81,43 +86,43 @@ public:
         key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
         tileY  = numRows - tileY - 1;
 
-        //Get the image
-        sqlite3_stmt* select = NULL;
-        std::string queryStr = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-        int rc = sqlite3_prepare_v2( _database, queryStr.c_str(), -1, &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << queryStr << "; " << sqlite3_errmsg(_database) << std::endl;
+        FeatureList features;
+
+        if (!_selectTile)
             return NULL;
-        }
 
-        bool valid = true;        
+        //Get the tile, reusing the statement prepared at initialization.
+        //Only the fetch is serialized; the tile is decoded outside the lock.
+        std::string tileData;
+        bool found = false;
+        {
+            Threading::ScopedMutexLock lock( _selectTileMutex );
 
-        sqlite3_bind_int( select, 1, z );
-        sqlite3_bind_int( select, 2, tileX );
-        sqlite3_bind_int( select, 3, tileY );
+            sqlite3_bind_int( _selectTile, 1, z );
+            sqlite3_bind_int( _selectTile, 2, tileX );
+            sqlite3_bind_int( _selectTile, 3, tileY );
 
-        rc = sqlite3_step( select );
+            if ( sqlite3_step( _selectTile ) == SQLITE_ROW )
+            {
+                const char* data = (const char*)sqlite3_column_blob( _selectTile, 0 );
+                int dataLen = sqlite3_column_bytes( _selectTile, 0 );
+                tileData.assign( data, dataLen );
+                found = true;
+            }
 
-        FeatureList features;
+            sqlite3_reset( _selectTile );
+            sqlite3_clear_bindings( _selectTile );
+        }
 
-        if ( rc == SQLITE_ROW)
-        {                     
-            // the pointer returned from _blob gets freed internally by sqlite, supposedly
-            const char* data = (const char*)sqlite3_column_blob( select, 0 );
-            int dataLen = sqlite3_column_bytes( select, 0 );
-            std::string dataBuffer( data, dataLen );
-            std::stringstream in(dataBuffer);
-            MVT::read(in, key, features);
+        if ( found )
+        {
+            MVT::read(tileData.data(), tileData.size(), key, features);
         }
         else
         {
-            OE_DEBUG << LC << "SQL QUERY failed for " << queryStr << ": " << std::endl;
-            valid = false;
+            OE_DEBUG << LC << "SQL QUERY failed for tile " << key.str() << std::endl;
         }
 
-        sqlite3_finalize( select );
-
         // apply filters before returning.
         applyFilters( features, query.tileKey()->getExtent() );
 
@@ -245,6 +250,13 @@ protected:
             return Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to open database, " << sqlite3_errmsg(_database));
         }
 
+        std::string queryStr = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+        rc = sqlite3_prepare_v2( _database, queryStr.c_str(), -1, &_selectTile, 0L );
+        if ( rc != SQLITE_OK )
+        {
+            return Status::Error(Status::ResourceUnavailable, Stringify() << "Failed to prepare SQL: " << queryStr << "; " << sqlite3_errmsg(_database));
+        }
+
         setFeatureProfile(createFeatureProfile());
 
         return Status::OK();
@@ -284,6 +296,8 @@ private:
     osg::ref_ptr<osgDB::Options>    _dbOptions;    
     osg::ref_ptr<osgDB::BaseCompressor> _compressor;
     sqlite3* _database;
+    sqlite3_stmt* _selectTile;
+    Threading::Mutex _selectTileMutex;
     unsigned int _minLevel;
     unsigned int _maxLevel;
 };
@@ -68,13 +68,31 @@ namespace
     }
 }
 
+/**
+ * Reads chunks ahead of the consumer on its own thread.
+ */
+class FeatureCursorOGR::Prefetcher : public OpenThreads::Thread
+{
+public:
+    Prefetcher( FeatureCursorOGR* cursor ) : _cursor( cursor ) { }
+
+    void run()
+    {
+        _cursor->prefetch();
+    }
+
+private:
+    FeatureCursorOGR* _cursor;
+};
+
 
 FeatureCursorOGR::FeatureCursorOGR(OGRDataSourceH              dsHandle,
                                    OGRLayerH                   layerHandle,
                                    const FeatureSource*        source,
                                    const FeatureProfile*       profile,
                                    const Symbology::Query&     query,
-                                   const FeatureFilterList&    filters) :
+                                   const FeatureFilterList&    filters,
+                                   bool                        prefetch) :
 _source           ( source ),
 _dsHandle         ( dsHandle ),
 _layerHandle      ( layerHandle ),
@@ -85,7 +103,11 @@ _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_prefetcher       ( 0L ),
+_pendingReady     ( false ),
+_pendingEnd       ( false ),
+_prefetchDone     ( false )
 {
     {
         OGR_SCOPED_LOCK;
@@ -179,11 +201,28 @@ _filters          ( filters )
         }
     }
 
+    if ( prefetch && _resultSetHandle )
+    {
+        _prefetcher = new Prefetcher( this );
+        _prefetcher->start();
+    }
+
     readChunk();
 }
 
 FeatureCursorOGR::~FeatureCursorOGR()
 {
+    if ( _prefetcher )
+    {
+        {
+            Threading::ScopedMutexLock lock( _pendingMutex );
+            _prefetchDone = true;
+            _pendingCond.broadcast();
+        }
+        _prefetcher->join();
+        delete _prefetcher;
+    }
+
     OGR_SCOPED_LOCK;
 
     if ( _nextHandleToQueue )
@@ -223,37 +262,103 @@ FeatureCursorOGR::nextFeature()
     return _lastFeatureReturned.get();
 }
 
+unsigned
+FeatureCursorOGR::nextBatch( FeatureList& output, unsigned max )
+{
+    // hands over the queued features directly, reading the next chunk
+    // as the queue runs out.
+    unsigned count = 0;
+    while( count < max && hasMore() )
+    {
+        if ( _queue.size() == 1u )
+            readChunk();
+
+        output.push_back( _queue.front() );
+        _queue.pop();
+        ++count;
+    }
+    return count;
+}
+
 // reads a chunk of features into a memory cache; do this for performance
 // and to avoid needing the OGR Mutex every time
 void
 FeatureCursorOGR::readChunk()
 {
-    if ( !_resultSetHandle )
+    if ( !_resultSetHandle || _resultSetEndReached )
         return;
-    
-    OGR_SCOPED_LOCK;
 
-    while( _queue.size() < _chunkSize && !_resultSetEndReached )
+    if ( _prefetcher )
     {
-        FeatureList filterList;
-        while( filterList.size() < _chunkSize && !_resultSetEndReached )
+        // take the chunk the reader thread has ready, and let it start the next one:
+        FeatureList chunk;
+        {
+            Threading::ScopedMutexLock lock( _pendingMutex );
+            while( !_pendingReady )
+                _pendingCond.wait( &_pendingMutex );
+
+            chunk.swap( _pending );
+            _pendingReady = false;
+            _resultSetEndReached = _pendingEnd;
+            _pendingCond.broadcast();
+        }
+
+        for(FeatureList::const_iterator i = chunk.begin(); i != chunk.end(); ++i)
+        {
+            _queue.push( i->get() );
+        }
+    }
+    else
+    {
+        while( _queue.size() < _chunkSize && !_resultSetEndReached )
         {
-            OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
-            if ( handle )
+            FeatureList chunk;
+            _resultSetEndReached = readFeatures( chunk );
+
+            for(FeatureList::const_iterator i = chunk.begin(); i != chunk.end(); ++i)
             {
-                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get() );
+                _queue.push( i->get() );
+            }
+        }
+    }
+}
 
-                if (feature.valid() &&
-                    !_source->isBlacklisted( feature->getFID() ) &&
-                    validateGeometry( feature->getGeometry() ))
+// reads and filters features until there are at least _chunkSize of them.
+// Only the OGR calls run under the OGR Mutex, so other GDAL users can get
+// in between features. Returns true at the end of the result set.
+bool
+FeatureCursorOGR::readFeatures( FeatureList& output )
+{
+    bool end = false;
+    unsigned count = 0;
+
+    while( count < _chunkSize && !end && !_prefetchDone )
+    {
+        FeatureList filterList;
+        unsigned numRead = 0;
+        while( numRead < _chunkSize && !end )
+        {
+            osg::ref_ptr<Feature> feature;
+            {
+                OGR_SCOPED_LOCK;
+                OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
+                if ( handle )
+                {
+                    feature = OgrUtils::createFeature( handle, _profile.get() );
+                    OGR_F_Destroy( handle );
+                }
+                else
                 {
-                    filterList.push_back( feature.release() );
+                    end = true;
                 }
-                OGR_F_Destroy( handle );
             }
-            else
+
+            if (feature.valid() &&
+                !_source->isBlacklisted( feature->getFID() ) &&
+                validateGeometry( feature->getGeometry() ))
             {
-                _resultSetEndReached = true;
+                filterList.push_back( feature.release() );
+                ++numRead;
             }
         }
 
@@ -278,10 +383,35 @@ FeatureCursorOGR::readChunk()
             }
         }
 
-        for(FeatureList::const_iterator i = filterList.begin(); i != filterList.end(); ++i)
-        {
-            _queue.push( i->get() );
-        }
+        count += filterList.size();
+        output.splice( output.end(), filterList );
     }
+
+    return end;
 }
 
+// body of the Prefetcher thread
+void
+FeatureCursorOGR::prefetch()
+{
+    bool end = false;
+    while( !end )
+    {
+        FeatureList chunk;
+        end = readFeatures( chunk );
+
+        Threading::ScopedMutexLock lock( _pendingMutex );
+
+        // wait for the consumer to take the previous chunk:
+        while( _pendingReady && !_prefetchDone )
+            _pendingCond.wait( &_pendingMutex );
+
+        if ( _prefetchDone )
+            return;
+
+        _pending.swap( chunk );
+        _pendingEnd = end;
+        _pendingReady = true;
+        _pendingCond.broadcast();
+    }
+}
@@ -304,6 +304,13 @@ public:
             {
                 featureProfile->geoInterp() = _options.geoInterp().get();
             }
+
+            // store the schema fields in slots rather than per-feature tables:
+            if ( !_schema.empty() )
+            {
+                featureProfile->setSchemaIndex( new FeatureSchemaIndex(_schema) );
+            }
+
             setFeatureProfile(featureProfile);
         }
 
@@ -352,7 +359,8 @@ public:
                     this,
                     getFeatureProfile(),
                     query,
-                    getFilters() );
+                    getFilters(),
+                    _options.prefetch() == true );
             }
             else
             {
@@ -112,8 +112,9 @@ public: // FeatureFilter
                                 if (itr->get()->getGeometry()->intersects( feature->getGeometry() ) )
                                 {
                                     // Copy the attributes in the boundary to the feature
-                                    for (AttributeTable::const_iterator attrItr = itr->get()->getAttrs().begin();
-                                         attrItr != itr->get()->getAttrs().end();
+                                    AttributeTable attrs = itr->get()->getAttrs();
+                                    for (AttributeTable::const_iterator attrItr = attrs.begin();
+                                         attrItr != attrs.end();
                                          attrItr++)
                                     {
                                         feature->set( attrItr->first, attrItr->second );
@@ -1331,6 +1331,19 @@ public:
 
     }
 
+    ReadResult readImage( const TileKey&        key,
+                          ProgressCallback*     progress)
+    {
+        // tiles past the data's resolution or outside its extent will never exist.
+        if (key.getLevelOfDetail() > _maxDataLevel || !intersects(key))
+        {
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+        }
+
+        osg::Image* image = createImage(key, progress);
+        return image ? ReadResult(image) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+    }
+
     osg::Image* createImage( const TileKey&        key,
                              ProgressCallback*     progress)
     {
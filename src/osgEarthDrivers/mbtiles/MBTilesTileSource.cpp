@@ -268,6 +268,11 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
         osgEarth::endsWith(_tileFormat, "jpg", false) ||
         osgEarth::endsWith(_tileFormat, "jpeg", false);
 
+    // mime type of the tile data, which decoded images carry with their bytes
+    _tileMimeType = _tileFormat.find('/') != std::string::npos ?
+        _tileFormat :
+        osgEarth::Registry::instance()->getMimeTypeForExtension(_tileFormat);
+
     // make an empty image.
     int size = 256;
     _emptyImage = new osg::Image();
@@ -296,8 +301,6 @@ MBTilesTileSource::createImage(const TileKey&    key,
     Threading::ScopedMutexLock exclusiveLock(_mutex);
 
     int z = key.getLevelOfDetail();
-    int x = key.getTileX();
-    int y = key.getTileY();
 
     if (z < (int)_minLevel)
     {
@@ -310,6 +313,56 @@ MBTilesTileSource::createImage(const TileKey&    key,
         return NULL;
     }
 
+    std::string dataBuffer;
+    if ( !readTileData(key, dataBuffer) )
+        return NULL;
+
+    // decode the raw image data:
+    osg::Image* result = NULL;
+    std::istringstream inputStream(dataBuffer);
+    osgDB::ReaderWriter::ReadResult rr = _rw->readImage( inputStream, _dbOptions.get() );
+    if (rr.validImage())
+    {
+        result = rr.takeImage();                
+
+        // so the tile can be copied to another store without re-encoding
+        if ( ImageUtils::getKeepEncodedPayloads(_dbOptions.get()) && !_tileMimeType.empty() )
+            ImageUtils::setEncodedPayload( result, dataBuffer, _tileMimeType );
+    }
+
+    return result;
+}
+
+bool
+MBTilesTileSource::readEncodedImage(const TileKey&    key,
+                                    std::string&      out_data,
+                                    std::string&      out_mimeType,
+                                    ProgressCallback* progress)
+{
+    if ( _tileMimeType.empty() )
+        return false;
+
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    // below the min level createImage makes up an empty image; there are no bytes to copy.
+    int z = key.getLevelOfDetail();
+    if (z < (int)_minLevel || z > (int)_maxLevel)
+        return false;
+
+    if ( !readTileData(key, out_data) )
+        return false;
+
+    out_mimeType = _tileMimeType;
+    return true;
+}
+
+bool
+MBTilesTileSource::readTileData(const TileKey& key, std::string& out_data)
+{
+    int z = key.getLevelOfDetail();
+    int x = key.getTileX();
+    int y = key.getTileY();
+
     unsigned int numRows, numCols;
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
@@ -321,7 +374,7 @@ MBTilesTileSource::createImage(const TileKey&    key,
     if ( rc != SQLITE_OK )
     {
         OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
+        return false;
     }
 
     bool valid = true;        
@@ -330,7 +383,6 @@ MBTilesTileSource::createImage(const TileKey&    key,
     sqlite3_bind_int( select, 2, x );
     sqlite3_bind_int( select, 3, y );
 
-    osg::Image* result = NULL;
     rc = sqlite3_step( select );
     if ( rc == SQLITE_ROW)
     {                     
@@ -338,12 +390,12 @@ MBTilesTileSource::createImage(const TileKey&    key,
         const char* data = (const char*)sqlite3_column_blob( select, 0 );
         int dataLen = sqlite3_column_bytes( select, 0 );
 
-        std::string dataBuffer( data, dataLen );
+        out_data.assign( data, dataLen );
 
         // decompress if necessary:
         if ( _compressor.valid() )
         {
-            std::istringstream inputStream(dataBuffer);
+            std::istringstream inputStream(out_data);
             std::string value;
             if ( !_compressor->decompress(inputStream, value) )
             {
@@ -352,18 +404,7 @@ MBTilesTileSource::createImage(const TileKey&    key,
             }
             else
             {
-                dataBuffer = value;
-            }
-        }
-
-        // decode the raw image data:
-        if ( valid )
-        {
-            std::istringstream inputStream(dataBuffer);
-            osgDB::ReaderWriter::ReadResult rr = _rw->readImage( inputStream, _dbOptions.get() );
-            if (rr.validImage())
-            {
-                result = rr.takeImage();                
+                out_data.swap( value );
             }
         }
     }
@@ -374,7 +415,7 @@ MBTilesTileSource::createImage(const TileKey&    key,
     }
 
     sqlite3_finalize( select );
-    return result;
+    return valid;
 }
 
 bool 
@@ -387,26 +428,31 @@ MBTilesTileSource::storeImage(const TileKey&    key,
 
     Threading::ScopedMutexLock exclusiveLock(_mutex);
 
-    // encode the data stream:
-    std::stringstream buf;
-    osgDB::ReaderWriter::WriteResult wr;
-    if ( _forceRGB && ImageUtils::hasAlphaChannel(image) )
+    // store the bytes the image was read from if they are already in our
+    // format; otherwise encode the data stream:
+    std::string value;
+    if ( !ImageUtils::getEncodedPayload(image, _rw.get(), value) )
     {
-        osg::ref_ptr<osg::Image> rgb = ImageUtils::convertToRGB8(image);
-        wr = _rw->writeImage(*(rgb.get()), buf, _dbOptions.get());
-    }
-    else
-    {
-        wr = _rw->writeImage(*image, buf, _dbOptions.get());
-    }
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult wr;
+        if ( _forceRGB && ImageUtils::hasAlphaChannel(image) )
+        {
+            osg::ref_ptr<osg::Image> rgb = ImageUtils::convertToRGB8(image);
+            wr = _rw->writeImage(*(rgb.get()), buf, _dbOptions.get());
+        }
+        else
+        {
+            wr = _rw->writeImage(*image, buf, _dbOptions.get());
+        }
 
-    if ( wr.error() )
-    {
-        OE_WARN << LC << "Image encoding failed: " << wr.message() << std::endl;
-        return false;
-    }
+        if ( wr.error() )
+        {
+            OE_WARN << LC << "Image encoding failed: " << wr.message() << std::endl;
+            return false;
+        }
 
-    std::string value = buf.str();
+        value = buf.str();
+    }
     
     // compress if necessary:
     if ( _compressor.valid() )
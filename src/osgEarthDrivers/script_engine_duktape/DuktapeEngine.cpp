@@ -54,28 +54,226 @@ namespace
         return 0;
     }
 
-    static duk_ret_t oe_duk_save_feature(duk_context* ctx)
+    // Hidden (internal) property keys, which scripts cannot see.
+#define FEATURE_PTR   "\xFF" "ptr"   // native Feature pointer
+#define FEATURE_PROPS "\xFF" "props" // properties proxy of the bound feature
+#define FEATURE_ATTRS "\xFF" "attrs" // proxy target, holding values set by the script
+#define FEATURE_GEOM  "\xFF" "geom"  // geometry object of the bound feature
+
+    // native feature pointer stored on the object at the index.
+    const Feature* getFeature(duk_context* ctx, duk_idx_t index)
     {
-        // stack: [ptr]
+        duk_get_prop_string(ctx, index, FEATURE_PTR);
+        const Feature* feature = reinterpret_cast<const Feature*>(duk_get_pointer(ctx, -1));
+        duk_pop(ctx);
+        return feature;
+    }
+
+    void pushAttr(duk_context* ctx, const AttributeValue& value)
+    {
+        if ( !value.second.set )
+        {
+            duk_push_null(ctx);
+            return;
+        }
 
-        // pull the feature ptr from argument #0
-        Feature* feature = reinterpret_cast<Feature*>(duk_require_pointer(ctx, 0));
+        switch( value.first ) {
+        case ATTRTYPE_DOUBLE: duk_push_number (ctx, value.getDouble()); break;
+        case ATTRTYPE_INT:    duk_push_int    (ctx, value.getInt()); break;
+        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, value.getBool()); break;
+        case ATTRTYPE_STRING:
+        default:              duk_push_string (ctx, value.getString().c_str()); break;
+        }
+    }
 
-        // Fetch the feature data:
-        duk_push_global_object(ctx);                    
-        // [ptr, global]
+    // Whether the key at key_i is an own property of the object at obj_i.
+    // duk_has_prop also searches the prototype chain, which would turn
+    // "toString" or "constructor" into built-ins instead of attributes.
+    bool hasOwnProp(duk_context* ctx, duk_idx_t obj_i, duk_idx_t key_i)
+    {
+        obj_i = duk_normalize_index(ctx, obj_i);
+        key_i = duk_normalize_index(ctx, key_i);
+
+        duk_get_global_string(ctx, "Object");            // [Object]
+        duk_get_prop_string(ctx, -1, "prototype");        // [Object, proto]
+        duk_get_prop_string(ctx, -1, "hasOwnProperty");   // [Object, proto, func]
+        duk_dup(ctx, obj_i);
+        duk_dup(ctx, key_i);
+        duk_call_method(ctx, 1);                          // [Object, proto, result]
+        bool result = duk_to_boolean(ctx, -1) != 0;
+        duk_pop_3(ctx);
+        return result;
+    }
 
-        if ( !duk_get_prop_string(ctx, -1, "feature") || !duk_is_object(ctx, -1))
+    // feature.properties is a Proxy that reads attributes from the native
+    // Feature on demand. Values the script sets land on the proxy target,
+    // which feature.save() writes back.
+
+    // get trap. stack: [target, key, receiver]
+    static duk_ret_t oe_duk_props_get(duk_context* ctx)
+    {
+        if ( hasOwnProp(ctx, 0, 1) )
+        {
+            duk_dup(ctx, 1);
+            duk_get_prop(ctx, 0);
+            return 1;
+        }
+
+        const Feature* feature = getFeature(ctx, 0);
+        if ( !feature || !duk_is_string(ctx, 1) )
             return 0;
 
-         // [ptr, global, feature]
+        AttributeValue value;
+        if ( !feature->getValue(duk_get_string(ctx, 1), value) )
+            return 0;
+
+        pushAttr(ctx, value);
+        return 1;
+    }
+
+    // has trap. stack: [target, key]
+    static duk_ret_t oe_duk_props_has(duk_context* ctx)
+    {
+        if ( hasOwnProp(ctx, 0, 1) )
+        {
+            duk_push_true(ctx);
+            return 1;
+        }
+
+        const Feature* feature = getFeature(ctx, 0);
+        duk_push_boolean(ctx, feature && duk_is_string(ctx, 1) && feature->hasAttr(duk_get_string(ctx, 1)));
+        return 1;
+    }
 
-        if ( duk_get_prop_string(ctx, -1, "properties") && duk_is_object(ctx, -1) )
+    // enumerate and ownKeys traps. stack: [target]
+    static duk_ret_t oe_duk_props_keys(duk_context* ctx)
+    {
+        duk_idx_t keys_i = duk_push_array(ctx);
+        duk_uarridx_t n = 0;
+
+        const Feature* feature = getFeature(ctx, 0);
+        if ( feature )
         {
-            // [ptr, global, feature, props]
-            duk_enum(ctx, -1, 0);                       
-        
-            // [ptr, global, feature, props, enum]
+            const AttributeTable& attrs = feature->getAttrs();
+            for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                duk_push_string(ctx, a->first.c_str());
+                duk_put_prop_index(ctx, keys_i, n++);
+            }
+        }
+
+        // plus any new properties set by the script:
+        duk_enum(ctx, 0, DUK_ENUM_OWN_PROPERTIES_ONLY);
+        while( duk_next(ctx, -1, 0/*get_value=false*/) )
+        {
+            if ( !feature || !feature->hasAttr(duk_get_string(ctx, -1)) )
+                duk_put_prop_index(ctx, keys_i, n++);
+            else
+                duk_pop(ctx);
+        }
+        duk_pop(ctx);
+
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_feature_get_id(duk_context* ctx)
+    {
+        duk_push_this(ctx);
+        const Feature* feature = getFeature(ctx, -1);
+        if ( !feature )
+            return 0;
+
+        duk_push_number(ctx, (double)feature->getFID());
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_feature_get_properties(duk_context* ctx)
+    {
+        duk_push_this(ctx);                              // [this]
+        duk_idx_t this_i = duk_get_top_index(ctx);
+        if ( duk_get_prop_string(ctx, this_i, FEATURE_PROPS) )
+            return 1;                                    // [this, props]
+        duk_pop(ctx);                                    // [this]
+
+        duk_get_global_string(ctx, "Proxy");             // [this, Proxy]
+
+        duk_push_object(ctx);                            // [this, Proxy, target]
+        duk_get_prop_string(ctx, this_i, FEATURE_PTR);
+        duk_put_prop_string(ctx, -2, FEATURE_PTR);
+        duk_dup(ctx, -1);
+        duk_put_prop_string(ctx, this_i, FEATURE_ATTRS);
+
+        duk_push_heap_stash(ctx);                        // [this, Proxy, target, stash]
+        duk_get_prop_string(ctx, -1, "oe_props_handler");
+        duk_remove(ctx, -2);                             // [this, Proxy, target, handler]
+
+        duk_new(ctx, 2);                                 // [this, props]
+        duk_dup(ctx, -1);
+        duk_put_prop_string(ctx, this_i, FEATURE_PROPS);
+        return 1;
+    }
+
+    // replacing the properties object outright. stack: [value]
+    static duk_ret_t oe_duk_feature_set_properties(duk_context* ctx)
+    {
+        duk_push_this(ctx);
+        duk_idx_t this_i = duk_get_top_index(ctx);
+        duk_dup(ctx, 0);
+        duk_put_prop_string(ctx, this_i, FEATURE_PROPS);
+        duk_dup(ctx, 0);
+        duk_put_prop_string(ctx, this_i, FEATURE_ATTRS);
+        return 0;
+    }
+
+    // the geometry is only converted to GeoJSON when a script asks for it.
+    static duk_ret_t oe_duk_feature_get_geometry(duk_context* ctx)
+    {
+        duk_push_this(ctx);                              // [this]
+        duk_idx_t this_i = duk_get_top_index(ctx);
+        if ( duk_get_prop_string(ctx, this_i, FEATURE_GEOM) )
+            return 1;                                    // [this, geometry]
+        duk_pop(ctx);                                    // [this]
+
+        const Feature* feature = getFeature(ctx, this_i);
+        if ( !feature || !feature->getGeometry() )
+            return 0;
+
+        std::string json = GeometryUtils::geometryToGeoJSON(feature->getGeometry());
+        duk_push_string(ctx, json.c_str());              // [this, json]
+        duk_json_decode(ctx, -1);                        // [this, geometry]
+        GeometryAPI::bind(ctx);
+
+        duk_dup(ctx, -1);
+        duk_put_prop_string(ctx, this_i, FEATURE_GEOM);
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_feature_set_geometry(duk_context* ctx)
+    {
+        duk_push_this(ctx);
+        duk_idx_t this_i = duk_get_top_index(ctx);
+        duk_dup(ctx, 0);
+        duk_put_prop_string(ctx, this_i, FEATURE_GEOM);
+        return 0;
+    }
+
+    // feature.save(): writes the properties set by the script, and the
+    // geometry if the script touched it, back to the native Feature.
+    static duk_ret_t oe_duk_save_feature(duk_context* ctx)
+    {
+        duk_push_this(ctx);                              // [this]
+        duk_idx_t this_i = duk_get_top_index(ctx);
+
+        Feature* feature = const_cast<Feature*>(getFeature(ctx, this_i));
+        if ( !feature )
+            return 0;
+
+        if ( duk_get_prop_string(ctx, this_i, FEATURE_ATTRS) && duk_is_object(ctx, -1) )
+        {
+            // [this, attrs]
+            duk_enum(ctx, -1, 0);
+
+            // [this, attrs, enum]
             while( duk_next(ctx, -1, 1/*get_value=true*/) )
             {
                 std::string key( duk_get_string(ctx, -2) );
@@ -95,39 +293,43 @@ namespace
                 {
                     feature->setNull( key );
                 }
-                 duk_pop_2(ctx);
+                duk_pop_2(ctx);
             }
 
-            duk_pop_2(ctx);
-            // [ptr, global, feature]
-        }
-        else
-        {   // [ptr, global, feature, undefined]
             duk_pop(ctx);
-            // [ptr, global, feature]
+            // [this, attrs]
         }
+        duk_pop(ctx);
+        // [this]
 
         // save the geometry, if set:
-        if ( duk_get_prop_string(ctx, -1, "geometry")&& duk_is_object(ctx, -1) )
+        if ( duk_get_prop_string(ctx, this_i, FEATURE_GEOM) && duk_is_object(ctx, -1) )
         {
-            // [ptr, global, feature, geometry]
-            std::string json( duk_json_encode(ctx, -1) ); // [ptr, global, feature, json]
+            // [this, geometry]
+            std::string json( duk_json_encode(ctx, -1) ); // [this, json]
             Geometry* newGeom = GeometryUtils::geometryFromGeoJSON(json);
             if ( newGeom )
             {
                 feature->setGeometry( newGeom );
             }
-            duk_pop(ctx);
-            // [ptr, global, feature]
         }
-        else
+        duk_pop(ctx);
+        // [this]
+
+        return 0;           // no return values.
+    }
+
+    void defineAccessor(duk_context* ctx, duk_idx_t obj_i, const char* name, duk_c_function getter, duk_c_function setter)
+    {
+        duk_uint_t flags = DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_ENUMERABLE;
+        duk_push_string(ctx, name);
+        duk_push_c_function(ctx, getter, 0);
+        if ( setter )
         {
-            // [ptr, global, feature, undefined]
+            duk_push_c_function(ctx, setter, 1);
+            flags |= DUK_DEFPROP_HAVE_SETTER;
         }
-        
-        // [ptr, global, feature]
-        duk_pop_2(ctx);     // [ptr] (as we found it)
-        return 0;           // no return values.
+        duk_def_prop(ctx, obj_i, flags);
     }
 }
 
@@ -135,65 +337,44 @@ namespace
 
 namespace
 {
-    // Create a "feature" object in the global namespace.
-    void setFeature(duk_context* ctx, Feature const* feature, bool complete)
+    // Create the "feature" object in the global namespace. It is created
+    // once per context and re-bound to each feature the engine runs on.
+    void installFeature(duk_context* ctx, bool complete)
     {
-        duk_push_global_object(ctx);                             // [global]
-
-        // Complete profile: properties, geometry, and API bindings.
+        duk_push_heap_stash(ctx);                                // [stash]
+
+        duk_push_object(ctx);                                    // [stash, handler]
+        duk_push_c_function(ctx, oe_duk_props_get, 3);
+        duk_put_prop_string(ctx, -2, "get");
+        duk_push_c_function(ctx, oe_duk_props_has, 2);
+        duk_put_prop_string(ctx, -2, "has");
+        duk_push_c_function(ctx, oe_duk_props_keys, 1);
+        duk_put_prop_string(ctx, -2, "enumerate");
+        duk_push_c_function(ctx, oe_duk_props_keys, 1);
+        duk_put_prop_string(ctx, -2, "ownKeys");
+        duk_put_prop_string(ctx, -2, "oe_props_handler");       // [stash]
+
+        duk_idx_t feature_i = duk_push_object(ctx);              // [stash, feature]
+        duk_push_string(ctx, "Feature");
+        duk_put_prop_string(ctx, feature_i, "type");
+        defineAccessor(ctx, feature_i, "id", oe_duk_feature_get_id, 0L);
+        defineAccessor(ctx, feature_i, "properties", oe_duk_feature_get_properties, oe_duk_feature_set_properties);
+        defineAccessor(ctx, feature_i, "attributes", oe_duk_feature_get_properties, oe_duk_feature_set_properties);
+
+        // Complete profile: geometry and the save() function.
         if ( complete )
         {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
-            duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
-            duk_put_prop_string(ctx, -2, "feature");             // [global]
-
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
-
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
-
-            GeometryAPI::bindToFeature(ctx);
+            defineAccessor(ctx, feature_i, "geometry", oe_duk_feature_get_geometry, oe_duk_feature_set_geometry);
+            duk_push_c_function(ctx, oe_duk_save_feature, 0);
+            duk_put_prop_string(ctx, feature_i, "save");
         }
 
-        // Minimal profile: ID and properties only. MUCH faster!
-        else
-        {
-            duk_idx_t feature_i = duk_push_object(ctx);
-            {
-                duk_push_int(ctx, feature->getFID());
-                duk_put_prop_string(ctx, feature_i, "id");
-
-                duk_idx_t props_i = duk_push_object(ctx);
-                {
-                    const AttributeTable& attrs = feature->getAttrs();
-                    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
-                    {
-                        AttributeType type = a->second.first;
-                        switch(type) {
-                        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
-                        case ATTRTYPE_INT:    duk_push_int    (ctx, a->second.getInt()); break;
-                        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
-                        case ATTRTYPE_STRING:
-                        default:              duk_push_string (ctx, a->second.getString().c_str()); break;
-                        }
-                        duk_put_prop_string(ctx, props_i, a->first.c_str());
-                    }
-                }
-                duk_put_prop_string(ctx, feature_i, "properties");
-            }
-            duk_put_prop_string(ctx, -2, "feature");
-        }
+        duk_dup(ctx, feature_i);
+        duk_put_global_string(ctx, "feature");
+        duk_put_prop_string(ctx, -2, "oe_feature");             // [stash]
 
-        duk_pop(ctx); 
+        duk_pop(ctx);                                            // []
     }
-    
 }
 
 //............................................................................
@@ -201,6 +382,7 @@ namespace
 DuktapeEngine::Context::Context()
 {
     _ctx = 0L;
+    _numPrograms = 0u;
 }
 
 void
@@ -232,15 +414,78 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
 
         if ( complete )
         {
-            // feature.save() callback
-            duk_push_c_function(_ctx, oe_duk_save_feature, 1/*numargs*/); // [global, function]
-            duk_put_prop_string(_ctx, -2, "oe_duk_save_feature");         // [global]
-
             GeometryAPI::install(_ctx);
         }
 
         duk_pop(_ctx); // []
+
+        installFeature(_ctx, complete);
+    }
+}
+
+void
+DuktapeEngine::Context::bind(const Feature* feature)
+{
+    duk_push_heap_stash(_ctx);                                   // [stash]
+    duk_get_prop_string(_ctx, -1, "oe_feature");                 // [stash, feature]
+
+    // detach the properties of the previous feature, in case the
+    // script held on to them.
+    if ( duk_get_prop_string(_ctx, -1, FEATURE_ATTRS) && duk_is_object(_ctx, -1) )
+    {
+        duk_push_pointer(_ctx, 0L);
+        duk_put_prop_string(_ctx, -2, FEATURE_PTR);
+    }
+    duk_pop(_ctx);                                               // [stash, feature]
+
+    duk_del_prop_string(_ctx, -1, FEATURE_PROPS);
+    duk_del_prop_string(_ctx, -1, FEATURE_ATTRS);
+    duk_del_prop_string(_ctx, -1, FEATURE_GEOM);
+
+    duk_push_pointer(_ctx, (void*)feature);
+    duk_put_prop_string(_ctx, -2, FEATURE_PTR);
+
+    duk_put_global_string(_ctx, "feature");                      // [stash]
+    duk_pop(_ctx);                                               // []
+
+    // remember the feature so we don't re-bind it if not necessary
+    _feature = feature;
+}
+
+#define MAX_PROGRAMS 128u
+
+bool
+DuktapeEngine::Context::pushProgram(const std::string& code)
+{
+    // compiled snippets are cached in the heap stash, keyed by source.
+    duk_push_heap_stash(_ctx);                                   // [stash]
+    if ( !duk_get_prop_string(_ctx, -1, "oe_programs") || _numPrograms >= MAX_PROGRAMS )
+    {
+        duk_pop(_ctx);
+        duk_push_object(_ctx);
+        duk_dup(_ctx, -1);
+        duk_put_prop_string(_ctx, -3, "oe_programs");
+        _numPrograms = 0u;
+    }                                                            // [stash, programs]
+
+    bool ok = true;
+    if ( !duk_get_prop_string(_ctx, -1, code.c_str()) )          // [stash, programs, function]
+    {
+        duk_pop(_ctx);                                           // [stash, programs]
+
+        // On error, the top of stack will hold the error message instead.
+        ok = (duk_pcompile_string(_ctx, DUK_COMPILE_EVAL, code.c_str()) == 0);
+        if ( ok )
+        {
+            duk_dup(_ctx, -1);
+            duk_put_prop_string(_ctx, -3, code.c_str());
+            ++_numPrograms;
+        }
     }
+
+    duk_remove(_ctx, -2);
+    duk_remove(_ctx, -2);                                        // [function]
+    return ok;
 }
 
 DuktapeEngine::Context::~Context()
@@ -288,20 +533,21 @@ DuktapeEngine::run(const std::string&   code,
     duk_context* ctx = c._ctx;
 #endif
 
-	if ( feature && feature != c._feature.get() )
+    if ( feature != c._feature.get() || !c._feature.valid() )
     {
-		// encode the feature in the global object and push a native pointer:
-		setFeature(ctx, feature, complete);
-	}
-
-    // remember the feature so we don't re-create it if not necessary
-    c._feature = feature;
+        c.bind(feature);
+    }
 
     // run the script. On error, the top of stack will hold the error
     // message instead of the return value.
     std::string resultString;
 
-    bool ok = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
+    bool ok = c.pushProgram(code);                        // [ function ]
+    if ( ok )
+    {
+        ok = (duk_pcall(ctx, 0) == DUK_EXEC_SUCCESS);     // [ "result" ]
+    }
+
     const char* resultVal = duk_to_string(ctx, -1);
     if ( resultVal )
         resultString = resultVal;
@@ -318,3 +564,74 @@ DuktapeEngine::run(const std::string&   code,
         ScriptResult(resultString, true) :
         ScriptResult("", false, resultString);
 }
+
+void
+DuktapeEngine::run(const std::string&         code,
+                   const FeatureList&         features,
+                   std::vector<ScriptResult>& results,
+                   FilterContext const*       context)
+{
+    results.clear();
+    if ( features.empty() )
+        return;
+
+    if (code.empty())
+    {
+        results.assign(features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+        return;
+    }
+
+    bool complete = (getProfile() == "full");
+
+#ifdef MAXIMUM_ISOLATION
+    // brand new context every time
+    Context c;
+    c.initialize( _options, complete );
+    duk_context* ctx = c._ctx;
+#else
+    // cache the Context on a per-thread basis
+    Context& c = _contexts.get();
+    c.initialize( _options, complete );
+    duk_context* ctx = c._ctx;
+#endif
+
+    // compile once, then call the same function for each feature.
+    if ( !c.pushProgram(code) )                           // [ function ]
+    {
+        std::string error = duk_safe_to_string(ctx, -1);
+        OE_WARN << LC << "Error: source =" << std::endl << code << std::endl;
+        duk_pop(ctx); // []
+        results.assign(features.size(), ScriptResult("", false, error));
+        return;
+    }
+
+    results.reserve( features.size() );
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        if ( i->get() != c._feature.get() || !c._feature.valid() )
+        {
+            c.bind( i->get() );
+        }
+
+        duk_dup(ctx, -1);                                 // [ function, function ]
+        bool ok = (duk_pcall(ctx, 0) == DUK_EXEC_SUCCESS); // [ function, "result" ]
+
+        std::string resultString;
+        const char* resultVal = duk_to_string(ctx, -1);
+        if ( resultVal )
+            resultString = resultVal;
+
+        if ( !ok )
+        {
+            OE_WARN << LC << "Error: source =" << std::endl << code << std::endl;
+        }
+
+        duk_pop(ctx);                                     // [ function ]
+
+        results.push_back( ok ?
+            ScriptResult(resultString, true) :
+            ScriptResult("", false, resultString) );
+    }
+
+    duk_pop(ctx); // []
+}
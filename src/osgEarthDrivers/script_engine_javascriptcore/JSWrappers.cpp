@@ -49,8 +49,9 @@ static JSValueRef JSFeature_getProperty(JSContextRef ctx, JSObjectRef object, JS
             return object;
         }
         
-        osgEarth::Features::AttributeTable::const_iterator it = feature->getAttrs().find(attr);
-        if (it != feature->getAttrs().end())
+        osgEarth::Features::AttributeTable attrs = feature->getAttrs();
+        osgEarth::Features::AttributeTable::const_iterator it = attrs.find(attr);
+        if (it != attrs.end())
         {
             osgEarth::Features::AttributeType atype = (*it).second.first;
             switch (atype)
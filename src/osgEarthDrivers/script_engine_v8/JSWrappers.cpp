@@ -82,10 +82,11 @@ JSFeature::GetAttributesObjectTemplate(v8::Isolate* isolate)
 v8::Handle<v8::Value>
 JSFeature::GetFeatureAttr(const std::string& attr, Feature const* feature)
 {
-  AttributeTable::const_iterator it = feature->getAttrs().find(attr);
+  AttributeTable attrs = feature->getAttrs();
+  AttributeTable::const_iterator it = attrs.find(attr);
 
   // If the key is not present return an empty handle as signal
-  if (it == feature->getAttrs().end())
+  if (it == attrs.end())
     return v8::Handle<v8::Value>();
 
   // Otherwise fetch the value and wrap it in a JavaScript string
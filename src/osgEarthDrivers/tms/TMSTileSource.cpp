@@ -24,6 +24,7 @@
 #include <osgEarth/FileUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <fstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -195,17 +196,26 @@ TMSTileSource::getCachePolicyHint(const Profile* targetProfile) const
 osg::Image*
 TMSTileSource::createImage(const TileKey&    key,
                            ProgressCallback* progress)
+{
+    return readImage(key, progress).releaseImage();
+}
+
+ReadResult
+TMSTileSource::readImage(const TileKey&    key,
+                         ProgressCallback* progress)
 {
     if (_tileMap.valid() && key.getLevelOfDetail() <= _tileMap->getMaxLevel() )
     {
         std::string image_url = _tileMap->getURL( key, _invertY );
 
-        osg::ref_ptr<osg::Image> image;
+        ReadResult result;
         if (!image_url.empty())
         {
-            image = URI(image_url).readImage( _dbOptions.get(), progress ).getImage();
+            result = URI(image_url).readImage( _dbOptions.get(), progress );
         }
 
+        osg::ref_ptr<osg::Image> image = result.getImage();
+
         if (!image.valid())
         {
             if (image_url.empty() || !_tileMap->intersectsKey(key))
@@ -215,20 +225,24 @@ TMSTileSource::createImage(const TileKey&    key,
                 if (key.getLevelOfDetail() <= _tileMap->getMaxLevel())
                 {
                     OE_DEBUG << LC << "Returning empty image " << std::endl;
-                    return ImageUtils::createEmptyImage();
+                    return ReadResult( ImageUtils::createEmptyImage() );
                 }
             }
+
+            return result.failed() ? result : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
         }
         
-        if (image.valid() && _options.coverage() == true)
+        if (_options.coverage() == true)
         {
             image->setInternalTextureFormat(GL_LUMINANCE32F_ARB);
             ImageUtils::markAsUnNormalized(image, true);
         }
 
-        return image.release();
+        return ReadResult( image.get() );
     }
-    return 0;
+
+    // the repository has no tiles past its maximum level.
+    return ReadResult( _tileMap.valid() ? ReadResult::RESULT_NOT_FOUND : ReadResult::RESULT_UNKNOWN_ERROR );
 }
 
 bool
@@ -252,7 +266,16 @@ TMSTileSource::storeImage(const TileKey& key,
         {
             osgDB::ReaderWriter::WriteResult result;
 
-            if ( _forceRGB && ImageUtils::hasAlphaChannel(image) )
+            // write the bytes the image was read from if they are already in our format:
+            std::string payload;
+            if ( ImageUtils::getEncodedPayload(image, _writer.get(), payload) )
+            {
+                std::ofstream out( image_url.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+                out.write( payload.c_str(), payload.size() );
+                if ( !out.good() )
+                    result = osgDB::ReaderWriter::WriteResult::ERROR_IN_WRITING_FILE;
+            }
+            else if ( _forceRGB && ImageUtils::hasAlphaChannel(image) )
             {
                 osg::ref_ptr<osg::Image> rgbImage = ImageUtils::convertToRGB8(image);
                 result = _writer->writeImage( *(rgbImage.get()), image_url, _dbOptions.get());
@@ -49,6 +49,19 @@ osgEarth::Status WCS11Source::initialize(const osgDB::Options* dbOptions)
     setProfile( osgEarth::Registry::instance()->getGlobalGeodeticProfile() );
     _dbOptions = Registry::instance()->cloneOrCreateOptions( dbOptions );    
 
+    // Metatiling: fetch blocks of adjacent tiles in one request. Siblings stay in
+    // the metatiler's memory cache since the elevation layer post-processes
+    // heightfields before it caches them. WCS 1.1 samples on the edges of the
+    // bounding box, so adjacent tiles share one row/column of samples.
+    if ( _options.metaTileCols().get() > 1u || _options.metaTileRows().get() > 1u )
+    {
+        _metaTiler = new MetaTiler(
+            _options.metaTileCols().get(),
+            _options.metaTileRows().get(),
+            _options.tileSize().get(),
+            1u );
+    }
+
     return STATUS_OK;
 }
 
@@ -64,13 +77,37 @@ osg::Image*
 WCS11Source::createImage(const TileKey&        key,
                          ProgressCallback*     progress)
 {
-    HTTPRequest request = createRequest( key );
+    if ( _metaTiler.valid() )
+    {
+        return _metaTiler->createImage( key, this, 0L, progress );
+    }
+
+    HTTPRequest request = createRequest( key.getExtent(), _options.tileSize().get(), _options.tileSize().get() );
 
     OE_INFO << "[osgEarth::WCS1.1] Key=" << key.str() << " URL = " << request.getURL() << std::endl;
 
-    double lon0,lat0,lon1,lat1;
-    key.getExtent().getBounds( lon0, lat0, lon1, lat1 );
+    return fetchCoverage( request, progress );
+}
+
 
+osg::Image*
+WCS11Source::fetchMetaTile(const GeoExtent&      extent,
+                           unsigned              width,
+                           unsigned              height,
+                           ProgressCallback*     progress)
+{
+    HTTPRequest request = createRequest( extent, width, height );
+
+    OE_INFO << "[osgEarth::WCS1.1] Metatile " << width << "x" << height << " URL = " << request.getURL() << std::endl;
+
+    return fetchCoverage( request, progress );
+}
+
+
+osg::Image*
+WCS11Source::fetchCoverage(const HTTPRequest&    request,
+                           ProgressCallback*     progress)
+{
     // download the data. It's a multipart-mime stream, so we have to use HTTP directly.
     HTTPResponse response = HTTPClient::get( request, _dbOptions.get(), progress );
     if ( !response.isOK() )
@@ -141,15 +178,15 @@ http://server/ArcGIS/services/WorldElevation/MapServer/WCSServer
 
 
 HTTPRequest
-WCS11Source::createRequest( const TileKey& key ) const
+WCS11Source::createRequest( const GeoExtent& extent, unsigned lonSamples, unsigned latSamples ) const
 {
     std::stringstream buf;
 
     double lon_min, lat_min, lon_max, lat_max;
-    key.getExtent().getBounds( lon_min, lat_min, lon_max, lat_max );
+    extent.getBounds( lon_min, lat_min, lon_max, lat_max );
 
-    int lon_samples = _options.tileSize().value();
-    int lat_samples = _options.tileSize().value();
+    int lon_samples = (int)lonSamples;
+    int lat_samples = (int)latSamples;
     double lon_interval = (lon_max-lon_min)/(double)(lon_samples-1);
     double lat_interval = (lat_max-lat_min)/(double)(lat_samples-1);
 
@@ -23,6 +23,7 @@
 #include <osgEarth/TileKey>
 #include <osgEarth/TileSource>
 #include <osgEarth/HTTPClient>
+#include <osgEarth/MetaTiler>
 #include <osg/Image>
 #include <osg/Shape>
 #include <osgDB/ReaderWriter>
@@ -32,7 +33,7 @@
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
 
-class WCS11Source : public TileSource
+class WCS11Source : public TileSource, public MetaTiler::Fetcher
 {
 public:
     WCS11Source( const TileSourceOptions& opt );
@@ -51,13 +52,24 @@ public: // TileSource interface
     
     std::string getExtension() const;
 
+public: // MetaTiler::Fetcher
+
+    osg::Image* fetchMetaTile(
+        const GeoExtent&      extent,
+        unsigned              width,
+        unsigned              height,
+        ProgressCallback*     progress );
+
 private:
     const WCSOptions _options;
     std::string _covFormat, _osgFormat;
 
     osg::ref_ptr<osgDB::Options> _dbOptions;
+    osg::ref_ptr<MetaTiler>      _metaTiler;
+
+    HTTPRequest createRequest( const GeoExtent& extent, unsigned lonSamples, unsigned latSamples ) const;
 
-    HTTPRequest createRequest( const TileKey& key ) const;
+    osg::Image* fetchCoverage( const HTTPRequest& request, ProgressCallback* progress );
 };
 
 #endif // OSGEARTH_WCS_PLUGIN_WCS11SOURCE_H_
@@ -24,6 +24,7 @@
 #include <osgEarth/XmlUtils>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Containers>
+#include <osgEarth/MetaTiler>
 #include <osgEarthUtil/WMS>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -66,7 +67,7 @@ namespace
 
 //----------------------------------------------------------------------------
 
-class WMSSource : public TileSource, public SequenceControl
+class WMSSource : public TileSource, public SequenceControl, public MetaTiler::Fetcher
 {
 public:
 	WMSSource( const TileSourceOptions& options ) : TileSource( options ), _options(options)
@@ -150,18 +151,24 @@ public:
             << "&LAYERS=" << _options.layers().value()
             << "&FORMAT=" << ( wmsFormatToUse.empty() ? std::string("image/") + _formatToUse : wmsFormatToUse )
             << "&STYLES=" << _options.style().value()
-            << (_options.wmsVersion().value() == "1.3.0" ? "&CRS=" : "&SRS=") << _srsToUse            
-            << "&WIDTH="<< _options.tileSize().value()
-            << "&HEIGHT="<< _options.tileSize().value()
-            << "&BBOX=%lf,%lf,%lf,%lf";
+            << (_options.wmsVersion().value() == "1.3.0" ? "&CRS=" : "&SRS=") << _srsToUse;
+
+        std::string head = buf.str();
 
         // then the optional keys:
+        std::string tail;
         if ( _options.transparent().isSet() )
-            buf << "&TRANSPARENT=" << (_options.transparent() == true ? "TRUE" : "FALSE");
-            
+            tail = std::string("&TRANSPARENT=") + (_options.transparent() == true ? "TRUE" : "FALSE");
+
+        _prototype = Stringify()
+            << head
+            << "&WIDTH="<< _options.tileSize().value()
+            << "&HEIGHT="<< _options.tileSize().value()
+            << "&BBOX=%lf,%lf,%lf,%lf"
+            << tail;
 
-        _prototype = "";
-        _prototype = buf.str();
+        // metatile requests vary in size at the edges of the profile:
+        _metaPrototype = head + "&WIDTH=%u&HEIGHT=%u&BBOX=%lf,%lf,%lf,%lf" + tail;
 
         //OE_NOTICE << "Prototype " << _prototype << std::endl;
 
@@ -261,6 +268,23 @@ public:
             OE_INFO << LC << "No JPL/TileService spec found; assuming standard WMS" << std::endl;
         }
 
+        // Metatiling: request blocks of adjacent tiles at once. Not compatible with
+        // TileService, which dictates fixed tile patterns.
+        if ( (_options.metaTileCols().get() > 1u || _options.metaTileRows().get() > 1u) && !_tileService.valid() )
+        {
+            _metaTiler = new MetaTiler(
+                _options.metaTileCols().get(),
+                _options.metaTileRows().get(),
+                _options.tileSize().get() );
+
+            // the layer's read options carry its cache bin, for storing siblings.
+            _metaTiler->setLayerOptions( dbOptions );
+            _metaTiler->setBlacklist( getBlacklist() );
+
+            OE_INFO << LC << "Metatiling enabled ("
+                << _options.metaTileCols().get() << "x" << _options.metaTileRows().get() << ")" << std::endl;
+        }
+
         // Use the override profile if one is passed in.
         if ( getProfile() == 0L )
         {
@@ -361,6 +385,36 @@ public:
     }
 
 
+    /** override */
+    ReadResult readAndPrepareImage( const TileKey& key, ImageOperation* op, ProgressCallback* progress )
+    {
+        // Metatiles cover single images only, not WMS-T sequences. The metatiler
+        // applies the operation to the siblings it caches, too.
+        if ( _metaTiler.valid() && _timesVec.size() <= 1 )
+        {
+            osg::Image* image = _metaTiler->createImage( key, this, op, progress );
+            return image ? ReadResult(image) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+        }
+        return TileSource::readAndPrepareImage( key, op, progress );
+    }
+
+    /** override (MetaTiler::Fetcher) */
+    osg::Image* fetchMetaTile( const GeoExtent& extent, unsigned width, unsigned height, ProgressCallback* progress )
+    {
+        char buf[2048];
+        sprintf(buf, _metaPrototype.c_str(), width, height, extent.xMin(), extent.yMin(), extent.xMax(), extent.yMax());
+
+        std::string uri(buf);
+        if ( osgDB::containsServerAddress( uri ) )
+            uri = replaceIn(uri, " ", "%20");
+
+        if ( _timesVec.size() == 1 )
+            uri = uri + (uri.find("?") == std::string::npos ? "?" : "&") + std::string("TIME=") + _timesVec[0];
+
+        ReadResult response = URI( uri ).readImage( _dbOptions.get(), progress );
+        return response.succeeded() ? response.releaseImage() : 0L;
+    }
+
     /** override */
     osg::Image* createImage( const TileKey& key, ProgressCallback* progress )
     {
@@ -565,6 +619,8 @@ private:
     osg::ref_ptr<TileService>        _tileService;
     osg::ref_ptr<const Profile>      _profile;
     std::string                      _prototype;
+    std::string                      _metaPrototype;
+    osg::ref_ptr<MetaTiler>          _metaTiler;
     std::vector<std::string>         _timesVec;
     osg::ref_ptr<osgDB::Options>     _dbOptions;
     bool                             _isPlaying;
@@ -24,6 +24,8 @@
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/ImageToHeightFieldConverter>
 
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -34,6 +36,7 @@
 #include <OpenThreads/Atomic>
 
 #include <sstream>
+#include <fstream>
 #include <iomanip>
 #include <string.h>
 
@@ -93,45 +96,53 @@ public:
       osg::Image* createImage(const TileKey&     key,
           ProgressCallback*  progress )
       {
-          unsigned x, y;
-          key.getTileXY( x, y );
+          return readImage( key, progress ).releaseImage();
+      }
 
-          if ( _options.invertY() == true )
-          {
-              unsigned cols=0, rows=0;
-              key.getProfile()->getNumTiles( key.getLevelOfDetail(), cols, rows );
-              y = rows - y - 1;
-          }
+      ReadResult readImage(const TileKey&     key,
+          ProgressCallback*  progress )
+      {
+          URI uri = getURI( key );
 
-          std::string location = _template;
+          OE_TEST << LC << "URI: " << uri.full() << ", key: " << uri.cacheKey() << std::endl;
 
-          // support OpenLayers template style:
-          replaceIn( location, "${x}", Stringify() << x );
-          replaceIn( location, "${y}", Stringify() << y );
-          replaceIn( location, "${z}", Stringify() << key.getLevelOfDetail() );
+          return uri.readImage( _dbOptions.get(), progress );
+      }
 
-          // failing that, legacy osgearth style:
-          replaceIn( location, "{x}", Stringify() << x );
-          replaceIn( location, "{y}", Stringify() << y );
-          replaceIn( location, "{z}", Stringify() << key.getLevelOfDetail() );
+      bool readEncodedImage(const TileKey&    key,
+          std::string&      out_data,
+          std::string&      out_mimeType,
+          ProgressCallback* progress )
+      {
+          URI uri = getURI( key );
 
-          std::string cacheKey;
+          // straight from the server or the disk; the URI cache holds decoded images.
+          if ( osgDB::containsServerAddress(uri.full()) )
+          {
+              HTTPResponse response = HTTPClient::get( uri.full(), _dbOptions.get(), progress );
+              if ( !response.isOK() || response.getNumParts() == 0u )
+                  return false;
 
-          if ( !_rotateChoices.empty() )
+              out_data = response.getPartAsString(0);
+              out_mimeType = response.getMimeType();
+          }
+          else
           {
-              cacheKey = location;
-              unsigned index = (++_rotate_iter) % _rotateChoices.size();
-              replaceIn( location, _rotateString, Stringify() << _rotateChoices[index] );
+              std::ifstream in( uri.full().c_str(), std::ios::in | std::ios::binary );
+              if ( !in.is_open() )
+                  return false;
+
+              std::stringstream buf;
+              buf << in.rdbuf();
+              out_data = buf.str();
+              out_mimeType.clear();
           }
 
+          // servers don't always say:
+          if ( out_mimeType.empty() )
+              out_mimeType = Registry::instance()->getMimeTypeForExtension( _format );
 
-          URI uri( location, _options.url()->context() );
-          if ( !cacheKey.empty() )
-              uri.setCacheKey( cacheKey );
-
-          OE_TEST << LC << "URI: " << uri.full() << ", key: " << uri.cacheKey() << std::endl;
-
-          return uri.getImage( _dbOptions.get(), progress );
+          return !out_data.empty() && !out_mimeType.empty();
       }
 
       virtual std::string getExtension() const 
@@ -142,44 +153,95 @@ public:
       osg::HeightField* createHeightField( const TileKey&        key,
           ProgressCallback*     progress)
       {
+          return readHeightField( key, progress ).release<osg::HeightField>();
+      }
+
+      ReadResult readHeightField( const TileKey&        key,
+          ProgressCallback*     progress)
+      {
+          if (getStatus().isError())
+              return ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
+
+          ReadResult result = readImage(key, progress);
+          if (!result.succeeded())
+              return result;
+
+          osg::Image* image = result.getImage();
+          osg::HeightField *hf = 0;
+
           // MapBox encoded elevation PNG.
           // https://www.mapbox.com/blog/terrain-rgb/
           if (_options.elevationEncoding().value() == "mapbox")
           {
-              if (getStatus().isError())
-                  return 0L;
+              // Allocate the heightfield.
+              hf = new osg::HeightField();
+              hf->allocate( image->s(), image->t() );
 
-              osg::HeightField *hf = 0;
-              osg::ref_ptr<osg::Image> image = createImage(key, progress);
-              if (image.valid())
+              ImageUtils::PixelReader reader(image);
+              for (unsigned int c = 0; c < image->s(); c++)
               {
-                  // Allocate the heightfield.
-                  hf = new osg::HeightField();
-                  hf->allocate( image->s(), image->t() );
-
-                  ImageUtils::PixelReader reader(image.get());
-                  for (unsigned int c = 0; c < image->s(); c++)
+                  for (unsigned int r = 0; r < image->t(); r++)
                   {
-                      for (unsigned int r = 0; r < image->t(); r++)
-                      {
-                          osg::Vec4 pixel = reader(c, r);
-                          pixel.r() *= 255.0;
-                          pixel.g() *= 255.0;
-                          pixel.b() *= 255.0;
-                          float h = -10000.0f + ((pixel.r() * 256.0f * 256.0f + pixel.g() * 256.0f + pixel.b()) * 0.1f);
-                          hf->setHeight(c, r, h);
-                      }
+                      osg::Vec4 pixel = reader(c, r);
+                      pixel.r() *= 255.0;
+                      pixel.g() *= 255.0;
+                      pixel.b() *= 255.0;
+                      float h = -10000.0f + ((pixel.r() * 256.0f * 256.0f + pixel.g() * 256.0f + pixel.b()) * 0.1f);
+                      hf->setHeight(c, r, h);
                   }
               }
-              return hf;        
           }
           else
           {
-              return TileSource::createHeightField( key, progress );
+              ImageToHeightFieldConverter conv;
+              hf = conv.convert( image );
           }
+
+          return hf ? ReadResult(hf) : ReadResult(ReadResult::RESULT_UNKNOWN_ERROR);
       }
 
 private:
+    // the URI of a tile, filled in from the template.
+    URI getURI(const TileKey& key)
+    {
+        unsigned x, y;
+        key.getTileXY( x, y );
+
+        if ( _options.invertY() == true )
+        {
+            unsigned cols=0, rows=0;
+            key.getProfile()->getNumTiles( key.getLevelOfDetail(), cols, rows );
+            y = rows - y - 1;
+        }
+
+        std::string location = _template;
+
+        // support OpenLayers template style:
+        replaceIn( location, "${x}", Stringify() << x );
+        replaceIn( location, "${y}", Stringify() << y );
+        replaceIn( location, "${z}", Stringify() << key.getLevelOfDetail() );
+
+        // failing that, legacy osgearth style:
+        replaceIn( location, "{x}", Stringify() << x );
+        replaceIn( location, "{y}", Stringify() << y );
+        replaceIn( location, "{z}", Stringify() << key.getLevelOfDetail() );
+
+        std::string cacheKey;
+
+        if ( !_rotateChoices.empty() )
+        {
+            cacheKey = location;
+            unsigned index = (++_rotate_iter) % _rotateChoices.size();
+            replaceIn( location, _rotateString, Stringify() << _rotateChoices[index] );
+        }
+
+        URI uri( location, _options.url()->context() );
+        if ( !cacheKey.empty() )
+            uri.setCacheKey( cacheKey );
+
+        return uri;
+    }
+
     const XYZOptions       _options;
     std::string            _format;
     std::string            _template;
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/AltitudeFilter>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/GeoData>
 
@@ -65,13 +66,20 @@ AltitudeFilter::push( FeatureList& features, FilterContext& cx )
 void
 AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 {
-    NumericExpression scaleExpr;
+    const FeatureSchemaIndex* schemaIndex = cx.profile() ? cx.profile()->getSchemaIndex() : 0L;
+
+    CompiledNumericExpression scaleExpr;
     if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-        scaleExpr = *_altitude->verticalScale();
+        scaleExpr = CompiledNumericExpression( *_altitude->verticalScale(), schemaIndex );
 
-    NumericExpression offsetExpr;
+    CompiledNumericExpression offsetExpr;
     if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-        offsetExpr = *_altitude->verticalOffset();
+        offsetExpr = CompiledNumericExpression( *_altitude->verticalOffset(), schemaIndex );
+
+    CompiledStringExpression scriptExpr;
+    if ( _altitude.valid() && _altitude->script().isSet() )
+        scriptExpr = CompiledStringExpression( *_altitude->script(), schemaIndex );
+    std::string scriptResult;
 
     bool gpuClamping =
         _altitude.valid() &&
@@ -88,8 +96,7 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
         // run a symbol script if present.
         if ( _altitude.valid() && _altitude->script().isSet() )
         {
-            StringExpression temp( _altitude->script().get() );
-            feature->eval( temp, &cx );
+            scriptExpr.eval( feature, scriptResult, &cx );
         }
 
         double minHAT       =  DBL_MAX;
@@ -97,11 +104,11 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 
         double scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            scaleZ = scaleExpr.eval( feature, &cx );
 
         optional<double> offsetZ( 0.0 );
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );       
+            offsetZ = offsetExpr.eval( feature, &cx );
         
         GeometryIterator gi( feature->getGeometry() );
         while( gi.hasMore() )
@@ -159,13 +166,20 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     // establish an elevation query interface based on the features' SRS.
     ElevationQuery eq( mapf );
 
-    NumericExpression scaleExpr;
+    const FeatureSchemaIndex* schemaIndex = cx.profile() ? cx.profile()->getSchemaIndex() : 0L;
+
+    CompiledNumericExpression scaleExpr;
     if ( _altitude->verticalScale().isSet() )
-        scaleExpr = *_altitude->verticalScale();
+        scaleExpr = CompiledNumericExpression( *_altitude->verticalScale(), schemaIndex );
 
-    NumericExpression offsetExpr;
+    CompiledNumericExpression offsetExpr;
     if ( _altitude->verticalOffset().isSet() )
-        offsetExpr = *_altitude->verticalOffset();
+        offsetExpr = CompiledNumericExpression( *_altitude->verticalOffset(), schemaIndex );
+
+    CompiledStringExpression scriptExpr;
+    if ( _altitude->script().isSet() )
+        scriptExpr = CompiledStringExpression( *_altitude->script(), schemaIndex );
+    std::string scriptResult;
 
     // whether to record the min/max height-above-terrain values.
     bool collectHATs =
@@ -187,8 +201,7 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
         // run a symbol script if present.
         if ( _altitude.valid() && _altitude->script().isSet() )
         {
-            StringExpression temp( _altitude->script().get() );
-            feature->eval( temp, &cx );
+            scriptExpr.eval( feature, scriptResult, &cx );
         }
 
         double maxTerrainZ  = -DBL_MAX;
@@ -198,11 +211,11 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
 
         double scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            scaleZ = scaleExpr.eval( feature, &cx );
 
         double offsetZ = 0.0;
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );
+            offsetZ = offsetExpr.eval( feature, &cx );
 
         osgEarth::Bounds bounds = feature->getGeometry()->getBounds();
         const osg::Vec2d& center = bounds.center2d();
@@ -20,6 +20,7 @@
 #include <osgEarthFeatures/Session>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osgEarthFeatures/PolygonizeLines>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthSymbology/TextSymbol>
 #include <osgEarthSymbology/PointSymbol>
 #include <osgEarthSymbology/LineSymbol>
@@ -55,39 +56,35 @@ using namespace osgEarth::Symbology;
 
 namespace
 {
-    bool isCCW(double x1, double y1, double x2, double y2, double x3, double y3)
+    /**
+     * Runs symbol scripts, compiling each script once for as long as
+     * consecutive features share the symbol (as they do with the filter's style).
+     */
+    class SymbolScriptRunner
     {
-        return (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1) > 0.0;
-    }
-
-    bool segmentsIntersect(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4)
-    {
-        return isCCW(x1, y1, x3, y3, x4, y4) != isCCW(x2, y2, x3, y3, x4, y4) && isCCW(x1, y1, x2, y2, x3, y3) != isCCW(x1, y1, x2, y2, x4, y4);
-    }
-
-    bool holeCompare(osgEarth::Symbology::Ring* i, osgEarth::Symbology::Ring* j)
-    {
-        return i->getBounds().xMax() > j->getBounds().xMax();
-    }
-
-    bool segmentsIntersect(double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4, double &xi, double &yi)
-    {
-        double d = (y4-y3) * (x2-x1) - (x4-x3) * (y2-y1);
-
-        if (d == 0) return false; // parallel
-
-        double ua = ((x4-x3) * (y1-y3) - (y4-y3) * (x1-x3)) / d;
-        double ub = ((x2-x1) * (y1-y3) - (y2-y1) * (x1-x3)) / d;
+    public:
+        SymbolScriptRunner(const FeatureSchemaIndex* index) : _index(index), _symbol(0L) { }
 
-        if (ua >= 0.0 && ua <= 1.0 && ub >= 0.0 && ub <= 1.0)
+        void run(const Symbol* symbol, const StringExpression& script, const Feature* feature, FilterContext& context)
         {
-            xi = x1 + ua * (x2 - x1);
-            yi = y1 + ua * (y2 - y1);
-
-            return true;
+            if ( symbol != _symbol )
+            {
+                _expr = CompiledStringExpression( script, _index );
+                _symbol = symbol;
+            }
+            _expr.eval( feature, _result, &context );
         }
 
-        return false;
+    private:
+        const FeatureSchemaIndex* _index;
+        const Symbol*             _symbol;
+        CompiledStringExpression  _expr;
+        std::string               _result;
+    };
+
+    const FeatureSchemaIndex* getSchemaIndex(const FilterContext& context)
+    {
+        return context.profile() ? context.profile()->getSchemaIndex() : 0L;
     }
 }
 
@@ -119,6 +116,11 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
         makeECEF   = context.getOutputSRS()->isGeographic();
     }
 
+    SymbolScriptRunner scripts( getSchemaIndex(context) );
+    CompiledStringExpression featureNameExpr;
+    if ( _featureNameExpr.isSet() )
+        featureNameExpr = CompiledStringExpression( *_featureNameExpr, getSchemaIndex(context) );
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -136,8 +138,7 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
         // run a symbol script if present.
         if ( poly->script().isSet() )
         {
-            StringExpression temp( poly->script().get() );
-            input->eval( temp, &context );
+            scripts.run( poly, poly->script().get(), input, context );
         }
 
         GeometryIterator parts( input->getGeometry(), false );
@@ -163,7 +164,8 @@ BuildGeometryFilter::processPolygons(FeatureList& features, FilterContext& conte
             // are we embedding a feature name?
             if ( _featureNameExpr.isSet() )
             {
-                const std::string& name = input->eval( _featureNameExpr.mutable_value(), &context );
+                std::string name;
+                featureNameExpr.eval( input, name, &context );
                 osgGeom->setName( name );
             }
 
@@ -275,6 +277,8 @@ BuildGeometryFilter::processPolygonizedLines(FeatureList&   features,
         //mapSRS     = context.getSession()->getMapInfo().getProfile()->getSRS();
     }
 
+    SymbolScriptRunner scripts( getSchemaIndex(context) );
+
     // iterate over all features.
     for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
     {
@@ -290,8 +294,7 @@ BuildGeometryFilter::processPolygonizedLines(FeatureList&   features,
         // run a symbol script if present.
         if ( line->script().isSet() )
         {
-            StringExpression temp( line->script().get() );
-            input->eval( temp, &context );
+            scripts.run( line, line->script().get(), input, context );
         }
 
         // The operator we'll use to make lines into polygons.
@@ -370,6 +373,11 @@ BuildGeometryFilter::processLines(FeatureList& features, FilterContext& context)
         makeECEF = outputSRS->isGeographic();
     }
 
+    SymbolScriptRunner scripts( getSchemaIndex(context) );
+    CompiledStringExpression featureNameExpr;
+    if ( _featureNameExpr.isSet() )
+        featureNameExpr = CompiledStringExpression( *_featureNameExpr, getSchemaIndex(context) );
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -385,8 +393,7 @@ BuildGeometryFilter::processLines(FeatureList& features, FilterContext& context)
         // run a symbol script if present.
         if ( line->script().isSet() )
         {
-            StringExpression temp( line->script().get() );
-            input->eval( temp, &context );
+            scripts.run( line, line->script().get(), input, context );
         }
 
         GeometryIterator parts( input->getGeometry(), true );
@@ -418,7 +425,8 @@ BuildGeometryFilter::processLines(FeatureList& features, FilterContext& context)
             // embed the feature name if requested. Warning: blocks geometry merge optimization!
             if ( _featureNameExpr.isSet() )
             {
-                const std::string& name = input->eval( _featureNameExpr.mutable_value(), &context );
+                std::string name;
+                featureNameExpr.eval( input, name, &context );
                 osgGeom->setName( name );
             }
 
@@ -496,6 +504,10 @@ BuildGeometryFilter::processPoints(FeatureList& features, FilterContext& context
         makeECEF = outputSRS->isGeographic();
     }
 
+    CompiledStringExpression featureNameExpr;
+    if ( _featureNameExpr.isSet() )
+        featureNameExpr = CompiledStringExpression( *_featureNameExpr, getSchemaIndex(context) );
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -529,7 +541,8 @@ BuildGeometryFilter::processPoints(FeatureList& features, FilterContext& context
             // embed the feature name if requested. Warning: blocks geometry merge optimization!
             if ( _featureNameExpr.isSet() )
             {
-                const std::string& name = input->eval( _featureNameExpr.mutable_value(), &context );
+                std::string name;
+                featureNameExpr.eval( input, name, &context );
                 osgGeom->setName( name );
             }
 
@@ -914,6 +927,32 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
     osgUtil::SmoothingVisitor::smooth( *osgGeom );
 }
 
+// appends one ring of a polygon to the geometry as a line loop
+void
+BuildGeometryFilter::addPolygonRing(Geometry*               ring,
+                                    const SpatialReference* featureSRS,
+                                    const SpatialReference* outputSRS,
+                                    bool                    makeECEF,
+                                    osg::Geometry*          osgGeom,
+                                    const osg::Matrixd      &world2local)
+{
+    osg::ref_ptr<osg::Vec3Array> points = new osg::Vec3Array();
+    transformAndLocalize( ring->asVector(), featureSRS, points.get(), outputSRS, world2local, makeECEF );
+
+    GLenum mode = GL_LINE_LOOP;
+    if ( osgGeom->getVertexArray() == 0L )
+    {
+        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, 0, points->size() ) );
+        osgGeom->setVertexArray( points.get() );
+    }
+    else
+    {
+        osg::Vec3Array* v = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
+        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, v->size(), points->size() ) );
+        std::copy(points->begin(), points->end(), std::back_inserter(*v));
+    }
+}
+
 // builds and tessellates a polygon (with or without holes)
 void
 BuildGeometryFilter::buildPolygon(Geometry*               ring,
@@ -926,161 +965,24 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
     if ( !ring->isValid() )
         return;
 
+    // The outer ring and each hole go in as separate loops; the tessellator
+    // recognizes the holes by their opposite winding and bridges them in.
     ring->rewind(osgEarth::Symbology::Geometry::ORIENTATION_CCW);
-
-    osg::ref_ptr<osg::Vec3Array> allPoints = new osg::Vec3Array();
-    transformAndLocalize( ring->asVector(), featureSRS, allPoints.get(), outputSRS, world2local, makeECEF );
+    addPolygonRing( ring, featureSRS, outputSRS, makeECEF, osgGeom, world2local );
 
     Polygon* poly = dynamic_cast<Polygon*>(ring);
     if ( poly )
     {
-        RingCollection ordered(poly->getHoles().begin(), poly->getHoles().end());
-        std::sort(ordered.begin(), ordered.end(), holeCompare);
-
-        for( RingCollection::const_iterator h = ordered.begin(); h != ordered.end(); ++h )
+        for( RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h )
         {
             Geometry* hole = h->get();
             if ( hole->isValid() )
             {
                 hole->rewind(osgEarth::Symbology::Geometry::ORIENTATION_CW);
-
-                osg::ref_ptr<osg::Vec3Array> holePoints = new osg::Vec3Array();
-                transformAndLocalize( hole->asVector(), featureSRS, holePoints.get(), outputSRS, world2local, makeECEF );
-
-                // find the point with the highest x value
-                unsigned int hCursor = 0;
-                for (unsigned int i=1; i < holePoints->size(); i++)
-                {
-                    if ((*holePoints)[i].x() > (*holePoints)[hCursor].x())
-                      hCursor = i;
-                }
-
-                double x1 = (*holePoints)[hCursor].x();
-                double y1 = (*holePoints)[hCursor].y();
-                double y2 = (*holePoints)[hCursor].y();
-
-                unsigned int edgeCursor = UINT_MAX;
-                double edgeDistance = DBL_MAX;
-                unsigned int foundPointCursor = UINT_MAX;
-                for (unsigned int i=0; i < allPoints->size(); i++)
-                {
-                    unsigned int next = i == allPoints->size() - 1 ? 0 : i + 1;
-                    double xMax = osg::maximum((*allPoints)[i].x(), (*allPoints)[next].x());
-
-                    if (xMax > (*holePoints)[hCursor].x())
-                    {
-                        double x2 = xMax + 1.0;
-                        double x3 = (*allPoints)[i].x();
-                        double y3 = (*allPoints)[i].y();
-                        double x4 = (*allPoints)[next].x();
-                        double y4 = (*allPoints)[next].y();
-
-                        double xi=0.0, yi=0.0;
-                        bool intersects = false;
-                        unsigned int hitPointCursor = UINT_MAX;
-                        if (y1 == y3 && x3 > x1)
-                        {
-                            xi = x3;
-                            hitPointCursor = i;
-                            intersects = true;
-                        }
-                        else if (y1 == y4 && x4 > x1)
-                        {
-                            xi = x4;
-                            hitPointCursor = next;
-                            intersects = true;
-                        }
-                        else if (segmentsIntersect(x1, y1, x2, y2, x3, y3, x4, y4, xi, yi))
-                        {
-                            intersects = true;
-                        }
-
-                        double dist = (osg::Vec2d(xi, yi) - osg::Vec2d(x1, y1)).length();
-                        if (intersects && dist < edgeDistance)
-                        {
-                            foundPointCursor = hitPointCursor;
-                            edgeCursor = hitPointCursor != UINT_MAX ? hitPointCursor : (x3 >= x4 ? i : next);
-                            edgeDistance = dist;
-                        }
-                    }
-                }
-
-                if (foundPointCursor == UINT_MAX && edgeCursor != UINT_MAX)
-                {
-                    // test for intersecting edges between x1 and x2
-                    // (skipping the two segments for which edgeCursor is a vert)
-
-                    double x2 = (*allPoints)[edgeCursor].x();
-                    y2 = (*allPoints)[edgeCursor].y();
-
-                    bool foundIntersection = false;
-                    for (unsigned int i=0; i < allPoints->size(); i++)
-                    {
-                        unsigned int next = i == allPoints->size() - 1 ? 0 : i + 1;
-
-                        if (i == edgeCursor || next == edgeCursor)
-                          continue;
-
-                        double x3 = (*allPoints)[i].x();
-                        double y3 = (*allPoints)[i].y();
-                        double x4 = (*allPoints)[next].x();
-                        double y4 = (*allPoints)[next].y();
-
-                        foundIntersection = foundIntersection || segmentsIntersect(x1, y1, x2, y2, x3, y3, x4, y4);
-
-                        if (foundIntersection)
-                        {
-                            unsigned int prev = i == 0 ? allPoints->size() - 1 : i - 1;
-
-                            if (!isCCW((*allPoints)[prev].x(), (*allPoints)[prev].y(), x3, y3, x4, y4))
-                            {
-                                edgeCursor = i;
-                                x2 = (*allPoints)[edgeCursor].x();
-                                y2 = (*allPoints)[edgeCursor].y();
-                                foundIntersection = false;
-                            }
-                        }
-
-                    }
-                }
-
-                if (edgeCursor != UINT_MAX)
-                {
-                    // build array of correctly ordered new points to add to the outer loop
-                    osg::ref_ptr<osg::Vec3Array> insertPoints = new osg::Vec3Array();
-                    insertPoints->reserve(holePoints->size() + 2);
-
-                    unsigned int p = hCursor;
-                    do
-                    {
-                        insertPoints->push_back((*holePoints)[p]);
-                        p = p == holePoints->size() - 1 ? 0 : p + 1;
-                    } while(p != hCursor);
-
-                    insertPoints->push_back((*holePoints)[hCursor]);
-                    insertPoints->push_back((*allPoints)[edgeCursor]);
-                    
-                    // insert new points into outer loop
-                    osg::Vec3Array::iterator it = edgeCursor == allPoints->size() - 1 ? allPoints->end() : allPoints->begin() + (edgeCursor + 1);
-                    allPoints->insert(it, insertPoints->begin(), insertPoints->end());
-                }
+                addPolygonRing( hole, featureSRS, outputSRS, makeECEF, osgGeom, world2local );
             }
         }
     }
-    
-    GLenum mode = GL_LINE_LOOP;
-    if ( osgGeom->getVertexArray() == 0L )
-    {
-        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, 0, allPoints->size() ) );
-        osgGeom->setVertexArray( allPoints.get() );
-    }
-    else
-    {
-        osg::Vec3Array* v = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
-        osgGeom->addPrimitiveSet( new osg::DrawArrays( mode, v->size(), allPoints->size() ) );
-        //v->reserve(v->size() + allPoints->size());
-        std::copy(allPoints->begin(), allPoints->end(), std::back_inserter(*v));
-    }
 
     //// Normal computation.
     //// Not completely correct, but better than no normals at all. TODO: update this
@@ -0,0 +1,241 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/CompiledExpression>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/Session>
+#include <osgEarthFeatures/ScriptEngine>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+#define LC "[CompiledExpression] "
+
+#define MAX_FIXED_VALUES 16u
+
+namespace
+{
+    template<typename VARIABLES>
+    void resolveSlots(const VARIABLES& vars, const FeatureSchemaIndex* index, std::vector<int>& slots)
+    {
+        slots.resize( vars.size() );
+        for(unsigned i=0; i<vars.size(); ++i)
+            slots[i] = index ? index->getSlot( vars[i].first ) : -1;
+    }
+
+    /** Runs a variable that is not an attribute as a script. */
+    ScriptResult runScript(const std::string& code, const Feature* feature, FilterContext const* context)
+    {
+        if ( context && context->getSession() )
+        {
+            ScriptEngine* engine = context->getSession()->getScriptEngine();
+            if ( engine )
+                return engine->run( code, feature, context );
+        }
+        return ScriptResult( "", false, "" );
+    }
+}
+
+//........................................................................
+
+CompiledNumericExpression::CompiledNumericExpression()
+{
+    //nop
+}
+
+CompiledNumericExpression::CompiledNumericExpression(const NumericExpression& expr,
+                                                     const FeatureSchemaIndex* index) :
+_expr ( expr ),
+_index( index )
+{
+    resolveSlots( _expr.variables(), index, _slots );
+}
+
+void
+CompiledNumericExpression::getValues(const Feature*       feature,
+                                     FilterContext const* context,
+                                     double*              values) const
+{
+    const NumericExpression::Variables& vars = _expr.variables();
+    bool useSlots = _index.valid() && feature->getSchemaIndex() == _index.get();
+
+    for(unsigned i=0; i<vars.size(); ++i)
+    {
+        values[i] = 0.0;
+
+        // a slot that isn't present may have its value in the table
+        bool found;
+        const AttributeSlot* slot = useSlots && _slots[i] >= 0 ? feature->getSlot( _slots[i] ) : 0L;
+        if ( slot && slot->present )
+        {
+            found = true;
+            values[i] = slot->getDouble( 0.0 );
+        }
+        else
+        {
+            found = feature->getValue( vars[i].first, values[i] );
+        }
+
+        if ( !found && context && context->getSession() )
+        {
+            //No attr found, look for script
+            ScriptResult result = runScript( vars[i].first, feature, context );
+            if ( result.success() )
+                values[i] = result.asDouble();
+            else if ( context->getSession()->getScriptEngine() )
+                OE_WARN << LC << "Feature Script error on '" << _expr.expr() << "': " << result.message() << std::endl;
+        }
+    }
+}
+
+double
+CompiledNumericExpression::eval(const Feature* feature, FilterContext const* context) const
+{
+    unsigned numVars = _expr.variables().size();
+    if ( !feature || numVars == 0u )
+        return _expr.eval( (const double*)0L );
+
+    double fixed[MAX_FIXED_VALUES];
+    std::vector<double> heap;
+    double* values = fixed;
+    if ( numVars > MAX_FIXED_VALUES )
+    {
+        heap.resize( numVars );
+        values = &heap[0];
+    }
+
+    getValues( feature, context, values );
+    return _expr.eval( values );
+}
+
+void
+CompiledNumericExpression::eval(const FeatureList&   features,
+                                std::vector<double>& output,
+                                FilterContext const* context) const
+{
+    output.resize( features.size() );
+
+    // one buffer serves the whole list.
+    std::vector<double> values( std::max(_expr.variables().size(), (size_t)1u) );
+
+    unsigned n = 0;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++n)
+    {
+        // a NULL entry evaluates like eval(0L) does.
+        if ( !i->valid() )
+        {
+            output[n] = _expr.eval( (const double*)0L );
+            continue;
+        }
+        getValues( i->get(), context, &values[0] );
+        output[n] = _expr.eval( &values[0] );
+    }
+}
+
+//........................................................................
+
+CompiledStringExpression::CompiledStringExpression()
+{
+    //nop
+}
+
+CompiledStringExpression::CompiledStringExpression(const StringExpression& expr,
+                                                   const FeatureSchemaIndex* index) :
+_expr ( expr ),
+_index( index )
+{
+    resolveSlots( _expr.variables(), index, _slots );
+}
+
+void
+CompiledStringExpression::getValues(const Feature*       feature,
+                                    FilterContext const* context,
+                                    std::string*         values) const
+{
+    const StringExpression::Variables& vars = _expr.variables();
+    bool useSlots = _index.valid() && feature->getSchemaIndex() == _index.get();
+
+    for(unsigned i=0; i<vars.size(); ++i)
+    {
+        values[i].clear();
+
+        // a slot that isn't present may have its value in the table
+        bool found;
+        const AttributeSlot* slot = useSlots && _slots[i] >= 0 ? feature->getSlot( _slots[i] ) : 0L;
+        if ( slot && slot->present )
+        {
+            found = true;
+            if ( slot->type == ATTRTYPE_STRING && slot->set )
+                values[i] = *slot->stringValue;
+            else
+                values[i] = slot->getString();
+        }
+        else
+        {
+            found = feature->getValue( vars[i].first, values[i] );
+        }
+
+        if ( !found && context && context->getSession() )
+        {
+            //No attr found, look for script
+            ScriptResult result = runScript( vars[i].first, feature, context );
+            if ( result.success() )
+                values[i] = result.asString();
+            else if ( context->getSession()->getScriptEngine() )
+                OE_WARN << LC << "Feature Script error on '" << _expr.expr() << "': " << result.message() << std::endl;
+        }
+    }
+}
+
+void
+CompiledStringExpression::eval(const Feature*       feature,
+                               std::string&         output,
+                               FilterContext const* context) const
+{
+    std::vector<std::string> values( _expr.variables().size() );
+    if ( feature && !values.empty() )
+        getValues( feature, context, &values[0] );
+    _expr.eval( values.empty() ? 0L : &values[0], output );
+}
+
+void
+CompiledStringExpression::eval(const FeatureList&        features,
+                               std::vector<std::string>& output,
+                               FilterContext const*      context) const
+{
+    output.resize( features.size() );
+
+    // one set of buffers serves the whole list, so their storage is reused.
+    std::vector<std::string> values( _expr.variables().size() );
+
+    unsigned n = 0;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++n)
+    {
+        if ( !values.empty() )
+        {
+            // a NULL entry evaluates like eval(0L) does, with empty values.
+            if ( i->valid() )
+                getValues( i->get(), context, &values[0] );
+            else
+                for(unsigned v=0; v<values.size(); ++v)
+                    values[v].clear();
+        }
+        _expr.eval( values.empty() ? 0L : &values[0], output[n] );
+    }
+}
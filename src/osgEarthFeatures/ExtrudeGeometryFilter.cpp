@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
 #include <osgEarthFeatures/Session>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osgEarthSymbology/ResourceCache>
 #include <osgEarth/ECEF>
@@ -932,6 +933,20 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
     Random wallSkinPRNG( _wallSkinSymbol.valid()? *_wallSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
     Random roofSkinPRNG( _roofSkinSymbol.valid()? *_roofSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
 
+    // resolve expression variables to attribute slots once for the whole list.
+    const FeatureSchemaIndex* schemaIndex = context.profile() ? context.profile()->getSchemaIndex() : 0L;
+
+    CompiledStringExpression scriptExpr;
+    if ( _extrusionSymbol->script().isSet() )
+        scriptExpr = CompiledStringExpression( *_extrusionSymbol->script(), schemaIndex );
+    std::string scriptResult;
+
+    CompiledNumericExpression heightExpr;
+    if ( _heightExpr.isSet() )
+        heightExpr = CompiledNumericExpression( *_heightExpr, schemaIndex );
+
+    CompiledStringExpression featureNameExpr( _featureNameExpr, schemaIndex );
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -939,8 +954,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
         // run a symbol script if present.
         if ( _extrusionSymbol->script().isSet() )
         {
-            StringExpression temp( _extrusionSymbol->script().get() );
-            input->eval( temp, &context );
+            scriptExpr.eval( input, scriptResult, &context );
         }
 
         // iterator over the parts.
@@ -984,7 +998,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             }
             else if ( _heightExpr.isSet() )
             {
-                height = input->eval( _heightExpr.mutable_value(), &context );
+                height = heightExpr.eval( input, &context );
             }
             else
             {
@@ -1112,7 +1126,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             // Set up for feature naming and feature indexing:
             std::string name;
             if ( !_featureNameExpr.empty() )
-                name = input->eval( _featureNameExpr, &context );
+                featureNameExpr.eval( input, name, &context );
 
             FeatureIndexBuilder* index = context.featureIndex();
 
@@ -88,6 +88,18 @@ FeatureProfile::setProfile( const osgEarth::Profile* profile )
     _profile = profile;
 }
 
+FeatureSchemaIndex*
+FeatureProfile::getSchemaIndex() const
+{
+    return _schemaIndex.get();
+}
+
+void
+FeatureProfile::setSchemaIndex( FeatureSchemaIndex* index )
+{
+    _schemaIndex = index;
+}
+
 //----------------------------------------------------------------------------
 
 std::string
@@ -144,9 +156,135 @@ AttributeValue::getBool( bool defaultValue ) const
 
 //----------------------------------------------------------------------------
 
+FeatureSchemaIndex::FeatureSchemaIndex( const FeatureSchema& schema, unsigned maxStringsPerField ) :
+_schema( schema ),
+_maxStringsPerField( maxStringsPerField )
+{
+    for(FeatureSchema::const_iterator i = schema.begin(); i != schema.end(); ++i)
+    {
+        if ( _slots.find(i->first) == _slots.end() )
+        {
+            _slots[i->first] = _names.size();
+            _names.push_back( toLower(i->first) );
+        }
+    }
+    _strings.resize( _names.size() );
+}
+
+int
+FeatureSchemaIndex::getSlot( const std::string& name ) const
+{
+    std::map<std::string, int, CIStringComp>::const_iterator i = _slots.find( name );
+    return i != _slots.end() ? i->second : -1;
+}
+
+const std::string*
+FeatureSchemaIndex::intern( unsigned slot, const std::string& value )
+{
+    if ( slot >= _strings.size() )
+        return 0L;
+
+    Threading::ScopedMutexLock lock( _stringsMutex );
+    std::set<std::string>& strings = _strings[slot];
+
+    std::set<std::string>::const_iterator i = strings.find( value );
+    if ( i != strings.end() )
+        return &(*i);
+
+    // A field with this many values (names, IDs, ...) gains nothing from
+    // sharing them, and would grow the index for as long as it lives.
+    if ( strings.size() >= _maxStringsPerField )
+        return 0L;
+
+    return &(*strings.insert( value ).first);
+}
+
+unsigned
+FeatureSchemaIndex::getNumStrings( unsigned slot ) const
+{
+    Threading::ScopedMutexLock lock( _stringsMutex );
+    return slot < _strings.size() ? _strings[slot].size() : 0u;
+}
+
+//----------------------------------------------------------------------------
+
+std::string
+AttributeSlot::getString() const
+{
+    switch( type ) {
+        case ATTRTYPE_STRING: return stringValue ? *stringValue : EMPTY_STRING;
+        case ATTRTYPE_DOUBLE: return osgEarth::toString(doubleValue);
+        case ATTRTYPE_INT:    return osgEarth::toString(intValue);
+        case ATTRTYPE_BOOL:   return osgEarth::toString(boolValue);
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+    return EMPTY_STRING;
+}
+
+double
+AttributeSlot::getDouble( double defaultValue ) const 
+{
+    switch( type ) {
+        case ATTRTYPE_STRING: return stringValue ? osgEarth::as<double>(*stringValue, defaultValue) : defaultValue;
+        case ATTRTYPE_DOUBLE: return doubleValue;
+        case ATTRTYPE_INT:    return (double)intValue;
+        case ATTRTYPE_BOOL:   return boolValue? 1.0 : 0.0;
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+    return defaultValue;
+}
+
+int
+AttributeSlot::getInt( int defaultValue ) const 
+{
+    switch( type ) {
+        case ATTRTYPE_STRING: return stringValue ? osgEarth::as<int>(*stringValue, defaultValue) : defaultValue;
+        case ATTRTYPE_DOUBLE: return (int)doubleValue;
+        case ATTRTYPE_INT:    return intValue;
+        case ATTRTYPE_BOOL:   return boolValue? 1 : 0;
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+    return defaultValue;
+}
+
+bool
+AttributeSlot::getBool( bool defaultValue ) const 
+{
+    switch( type ) {
+        case ATTRTYPE_STRING: return stringValue ? osgEarth::as<bool>(*stringValue, defaultValue) : defaultValue;
+        case ATTRTYPE_DOUBLE: return doubleValue != 0.0;
+        case ATTRTYPE_INT:    return intValue != 0;
+        case ATTRTYPE_BOOL:   return boolValue;
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+    return defaultValue;
+}
+
+AttributeValue
+AttributeSlot::getValue() const
+{
+    AttributeValue a;
+    a.first = type;
+    a.second.set = set;
+    a.second.doubleValue = 0.0;
+    a.second.intValue = 0;
+    a.second.boolValue = false;
+    switch( type ) {
+        case ATTRTYPE_STRING: if ( stringValue ) a.second.stringValue = *stringValue; break;
+        case ATTRTYPE_DOUBLE: a.second.doubleValue = doubleValue; break;
+        case ATTRTYPE_INT:    a.second.intValue = intValue; break;
+        case ATTRTYPE_BOOL:   a.second.boolValue = boolValue; break;
+        case ATTRTYPE_UNSPECIFIED: break;
+    }
+    return a;
+}
+
+//----------------------------------------------------------------------------
+
 Feature::Feature( FeatureID fid ) :
 _fid( fid ),
-_srs( 0L )
+_srs( 0L ),
+_geomShared( false )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
@@ -155,7 +293,8 @@ _srs( 0L )
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
 _geom ( geom ),
 _srs  ( srs ),
-_fid  ( fid )
+_fid  ( fid ),
+_geomShared( false )
 {
     if ( !style.empty() )
         _style = style;
@@ -168,10 +307,23 @@ _fid      ( rhs._fid ),
 _attrs    ( rhs._attrs ),
 _style    ( rhs._style ),
 _geoInterp( rhs._geoInterp ),
-_srs      ( rhs._srs.get() )
+_srs      ( rhs._srs.get() ),
+_schemaIndex( rhs._schemaIndex.get() ),
+_slots    ( rhs._slots ),
+_geomShared( false )
 {
     if ( rhs._geom.valid() )
-        _geom = rhs._geom->clone();
+    {
+        if ( copyOp.getCopyFlags() & osg::CopyOp::DEEP_COPY_OBJECTS )
+        {
+            _geom = rhs._geom->clone();
+        }
+        else
+        {
+            _geom = rhs._geom.get();
+            _geomShared = true;
+        }
+    }
 
     dirty();
 }
@@ -199,9 +351,23 @@ void
 Feature::setGeometry( Geometry* geom )
 {
     _geom = geom;
+    _geomShared = false;
     dirty();
 }
 
+Geometry*
+Feature::getGeometry()
+{
+    // the caller may change it, so stop sharing it first
+    if ( _geomShared )
+    {
+        _geom = _geom->clone();
+        _geomShared = false;
+    }
+    dirty();
+    return _geom.get();
+}
+
 void
 Feature::dirty()
 {
@@ -210,9 +376,133 @@ Feature::dirty()
     //_cachedBoundingPolytopeValid = false;
 }
 
+void
+Feature::setSchemaIndex( FeatureSchemaIndex* index )
+{
+    // move slot values back into the table first:
+    if ( _schemaIndex.valid() )
+    {
+        for(unsigned i=0; i<_slots.size(); ++i)
+        {
+            if ( _slots[i].present )
+                _attrs[_schemaIndex->getName(i)] = _slots[i].getValue();
+        }
+    }
+
+    _schemaIndex = index;
+    _slots.clear();
+
+    if ( _schemaIndex.valid() )
+    {
+        _slots.resize( _schemaIndex->getNumSlots() );
+
+        for(AttributeTable::iterator i = _attrs.begin(); i != _attrs.end(); )
+        {
+            int slot = _schemaIndex->getSlot( i->first );
+            const std::string* str = 0L;
+            if ( slot >= 0 && i->second.first == ATTRTYPE_STRING )
+            {
+                str = _schemaIndex->intern( slot, i->second.second.stringValue );
+            }
+
+            // strings the index won't keep stay in the table.
+            if ( slot >= 0 && (str || i->second.first != ATTRTYPE_STRING) )
+            {
+                AttributeSlot& s = _slots[slot];
+                s.type    = i->second.first;
+                s.present = true;
+                s.set     = i->second.second.set;
+                switch( s.type ) {
+                    case ATTRTYPE_STRING: s.stringValue = str; break;
+                    case ATTRTYPE_DOUBLE: s.doubleValue = i->second.second.doubleValue; break;
+                    case ATTRTYPE_INT:    s.intValue    = i->second.second.intValue; break;
+                    case ATTRTYPE_BOOL:   s.boolValue   = i->second.second.boolValue; break;
+                    case ATTRTYPE_UNSPECIFIED: break;
+                }
+                _attrs.erase( i++ );
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+}
+
+AttributeSlot*
+Feature::getSlot( const std::string& name )
+{
+    if ( !_schemaIndex.valid() )
+        return 0L;
+
+    int slot = _schemaIndex->getSlot( name );
+    if ( slot < 0 )
+        return 0L;
+
+    // the value may have been kept in the table (see setString).
+    if ( !_attrs.empty() )
+        _attrs.erase( _schemaIndex->getName(slot) );
+
+    return &_slots[slot];
+}
+
+const AttributeSlot*
+Feature::getSlot( const std::string& name ) const
+{
+    if ( !_schemaIndex.valid() )
+        return 0L;
+
+    int slot = _schemaIndex->getSlot( name );
+    return slot >= 0 && _slots[slot].present ? &_slots[slot] : 0L;
+}
+
+void
+Feature::setString( AttributeSlot* s, const std::string& value, bool set )
+{
+    unsigned slot = s - &_slots[0];
+    const std::string* str = _schemaIndex->intern( slot, value );
+    if ( str )
+    {
+        s->type = ATTRTYPE_STRING;
+        s->stringValue = str;
+        s->present = true;
+        s->set = set;
+    }
+    else
+    {
+        s->present = false;
+        AttributeValue& a = _attrs[_schemaIndex->getName(slot)];
+        a.first = ATTRTYPE_STRING;
+        a.second.stringValue = value;
+        a.second.set = set;
+    }
+}
+
+AttributeTable
+Feature::getAttrs() const
+{
+    AttributeTable attrs( _attrs );
+    if ( _schemaIndex.valid() )
+    {
+        for(unsigned i=0; i<_slots.size(); ++i)
+        {
+            if ( _slots[i].present )
+                attrs[_schemaIndex->getName(i)] = _slots[i].getValue();
+        }
+    }
+    return attrs;
+}
+
 void
 Feature::set( const std::string& name, const std::string& value )
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        setString( s, value, true );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
@@ -222,6 +512,15 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        s->type = ATTRTYPE_DOUBLE;
+        s->doubleValue = value;
+        s->present = s->set = true;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
@@ -231,6 +530,15 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        s->type = ATTRTYPE_INT;
+        s->intValue = value;
+        s->present = s->set = true;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
@@ -240,12 +548,42 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, const AttributeValue& value)
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s && value.first == ATTRTYPE_STRING )
+    {
+        setString( s, value.second.stringValue, value.second.set );
+        return;
+    }
+    if ( s )
+    {
+        s->type = value.first;
+        s->present = true;
+        s->set = value.second.set;
+        switch( s->type ) {
+            case ATTRTYPE_STRING: break;
+            case ATTRTYPE_DOUBLE: s->doubleValue = value.second.doubleValue; break;
+            case ATTRTYPE_INT:    s->intValue    = value.second.intValue; break;
+            case ATTRTYPE_BOOL:   s->boolValue   = value.second.boolValue; break;
+            case ATTRTYPE_UNSPECIFIED: break;
+        }
+        return;
+    }
+
     _attrs[ name ] = value;
 }
 
 void
 Feature::set( const std::string& name, bool value )
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        s->type = ATTRTYPE_BOOL;
+        s->boolValue = value;
+        s->present = s->set = true;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
@@ -255,6 +593,14 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        s->present = true;
+        s->set = false;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];    
     a.second.set = false;
 }
@@ -262,6 +608,15 @@ Feature::setNull( const std::string& name)
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
+    AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        s->type = type;
+        s->present = true;
+        s->set = false;
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = type;    
     a.second.set = false;
@@ -273,44 +628,112 @@ Feature::setNull( const std::string& name, AttributeType type)
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    return getSlot(name) != 0L || _attrs.find(name) != _attrs.end();
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+        return s->getString();
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+        return s->getDouble(defaultValue);
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+        return s->getInt(defaultValue);
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+        return s->getBool(defaultValue);
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+        return s->set;
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.second.set : false;
 }
 
+bool
+Feature::getValue( const std::string& name, double& out ) const
+{
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        out = s->getDouble(0.0);
+        return true;
+    }
+
+    AttributeTable::const_iterator i = _attrs.find(name);
+    if ( i != _attrs.end() )
+        out = i->second.getDouble(0.0);
+    return i != _attrs.end();
+}
+
+bool
+Feature::getValue( const std::string& name, std::string& out ) const
+{
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        out = s->getString();
+        return true;
+    }
+
+    AttributeTable::const_iterator i = _attrs.find(name);
+    if ( i != _attrs.end() )
+        out = i->second.getString();
+    return i != _attrs.end();
+}
+
+bool
+Feature::getValue( const std::string& name, AttributeValue& out ) const
+{
+    const AttributeSlot* s = getSlot(name);
+    if ( s )
+    {
+        out = s->getValue();
+        return true;
+    }
+
+    AttributeTable::const_iterator i = _attrs.find(name);
+    if ( i != _attrs.end() )
+        out = i->second;
+    return i != _attrs.end();
+}
+
 double
 Feature::eval( NumericExpression& expr, FilterContext const* context ) const
 {
@@ -318,10 +741,9 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      if (getValue(i->first, val))
       {
-        val = ai->second.getDouble(0.0);
+        //nop
       }
       else if (context && context->getSession())
       {
@@ -351,10 +773,9 @@ Feature::eval(NumericExpression& expr, Session* session) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         double val = 0.0;
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-        if (ai != _attrs.end())
+        if (getValue(i->first, val))
         {
-            val = ai->second.getDouble(0.0);
+            //nop
         }
         else if (session)
         {
@@ -387,10 +808,9 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      if (getValue(i->first, val))
       {
-        val = ai->second.getString();
+        //nop
       }
       else if (context && context->getSession())
       {
@@ -419,10 +839,9 @@ Feature::eval(StringExpression& expr, Session* session) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         std::string val = "";
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-        if (ai != _attrs.end())
+        if (getValue(i->first, val))
         {
-            val = ai->second.getString();
+            //nop
         }
         else if (session)
         {
@@ -552,10 +971,11 @@ Feature::getGeoJSON() const
 
     //Write out all the properties         
     Json::Value props(Json::objectValue);    
-    if (getAttrs().size() > 0)
+    AttributeTable attrs = getAttrs();
+    if (attrs.size() > 0)
     {
 
-        for (AttributeTable::const_iterator itr = getAttrs().begin(); itr != getAttrs().end(); ++itr)
+        for (AttributeTable::const_iterator itr = attrs.begin(); itr != attrs.end(); ++itr)
         {
             if (itr->second.first == ATTRTYPE_INT)
             {
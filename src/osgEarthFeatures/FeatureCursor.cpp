@@ -24,20 +24,36 @@ using namespace OpenThreads;
 
 //---------------------------------------------------------------------------
 
+unsigned
+FeatureCursor::nextBatch( FeatureList& output, unsigned max )
+{
+    unsigned count = 0;
+    while( count < max && hasMore() )
+    {
+        Feature* f = nextFeature();
+        if ( f )
+        {
+            output.push_back( f );
+            ++count;
+        }
+    }
+    return count;
+}
+
 void
 FeatureCursor::fill( FeatureList& list )
 {
     while( hasMore() )
     {
-        list.push_back( nextFeature() );
+        nextBatch( list, ~0u );
     }
 }
 
 //---------------------------------------------------------------------------
 
-FeatureListCursor::FeatureListCursor(const FeatureList& features) :
+FeatureListCursor::FeatureListCursor(const FeatureList& features, bool clone) :
 _features( features ),
-_clone   ( false )
+_clone   ( clone )
 {
     _iter = _features.begin();
 }
@@ -53,7 +69,22 @@ FeatureListCursor::nextFeature()
 {
     Feature* r = _iter->get();
     _iter++;
-    return _clone ? osg::clone(r, osg::CopyOp::DEEP_COPY_ALL) : r;
+    return _clone && r ? new Feature(*r, osg::CopyOp::SHALLOW_COPY) : r;
+}
+
+unsigned
+FeatureListCursor::nextBatch( FeatureList& output, unsigned max )
+{
+    unsigned count = 0;
+    for( ; count < max && _iter != _features.end(); ++_iter )
+    {
+        if ( _iter->valid() )
+        {
+            output.push_back( _clone ? new Feature(*_iter->get(), osg::CopyOp::SHALLOW_COPY) : _iter->get() );
+            ++count;
+        }
+    }
+    return count;
 }
 
 //---------------------------------------------------------------------------
@@ -17,18 +17,49 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/FeatureListSource>
+#include <algorithm>
+#include <cmath>
 
 using namespace osgEarth::Features;
 
+// children per R-tree node
+#define NODE_SIZE 16
+
+namespace
+{
+    struct SortByX {
+        template<typename T> bool operator()(const T& a, const T& b) const {
+            return a.box.xmin+a.box.xmax < b.box.xmin+b.box.xmax;
+        }
+    };
+
+    struct SortByY {
+        template<typename T> bool operator()(const T& a, const T& b) const {
+            return a.box.ymin+a.box.ymax < b.box.ymin+b.box.ymax;
+        }
+    };
+
+    template<typename T>
+    bool sortByOrder(const T* a, const T* b) {
+        return a->order < b->order;
+    }
+}
+
 FeatureListSource::FeatureListSource():
-FeatureSource()
+FeatureSource(),
+_numDeleted  ( 0 ),
+_nextOrder   ( 0 ),
+_indexValid  ( false )
 {
     //nop
 }
 
 FeatureListSource::FeatureListSource(const GeoExtent& defaultExtent ) :
 FeatureSource (),
-_defaultExtent( defaultExtent )
+_defaultExtent( defaultExtent ),
+_numDeleted   ( 0 ),
+_nextOrder    ( 0 ),
+_indexValid   ( false )
 {
     //nop
 }
@@ -39,15 +70,45 @@ FeatureListSource::createFeatureCursor( const Symbology::Query& query )
     if (getFeatureProfile() == 0L)
         setFeatureProfile(createFeatureProfile());
 
-    //Create a copy of all of the features before returning the cursor.
-    //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
+    // the area to query, in feature coordinates:
+    Bounds bounds;
+    if ( query.bounds().isSet() )
+    {
+        bounds = query.bounds().get();
+    }
+    else if ( query.tileKey().isSet() && getFeatureProfile() && getFeatureProfile()->getSRS() )
+    {
+        GeoExtent localEx = query.tileKey()->getExtent().transform( getFeatureProfile()->getSRS() );
+        if ( localEx.isValid() )
+            bounds = localEx.bounds();
+    }
+
     FeatureList cursorFeatures;
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
     {
-        Feature* feature = new osgEarth::Features::Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
-        cursorFeatures.push_back( feature );
-    }    
-    return new FeatureListCursor( cursorFeatures );
+        Threading::ScopedMutexLock lock(_indexMutex);
+
+        if ( !bounds.isValid() )
+        {
+            cursorFeatures = _features;
+        }
+        else
+        {
+            ensureIndex();
+
+            std::vector<const IndexEntry*> hits;
+            queryIndex( bounds, hits );
+            std::sort( hits.begin(), hits.end(), sortByOrder<IndexEntry> );
+
+            for(std::vector<const IndexEntry*>::const_iterator i = hits.begin(); i != hits.end(); ++i)
+                cursorFeatures.push_back( (*i)->feature );
+        }
+    }
+
+    // The processing filters in osgEarth can modify the features as they are operating
+    // and we don't want our original data destroyed; so the cursor copies each
+    // feature as it's read. The copy shares the geometry until a filter asks to
+    // modify it, and features outside the query are never copied.
+    return new FeatureListCursor( cursorFeatures, true );
 }
 
 const FeatureProfile*
@@ -82,36 +143,247 @@ FeatureListSource::createFeatureProfile()
 bool
 FeatureListSource::deleteFeature(FeatureID fid)
 {
+    Threading::ScopedMutexLock lock(_indexMutex);
+    ensureIndex();
+
+    FIDIndex::iterator i = _fids.find( fid );
+    if ( i == _fids.end() )
+        return false;
+
+    dirtyFeatureProfile();
+
+    // hold on to the feature until it's out of the index
+    osg::ref_ptr<Feature> feature = i->second->get();
+    _features.erase( i->second );
+    _fids.erase( i );
+    removeFromIndex( feature.get() );
+
+    // only the caller's own changes go unindexed
+    dirty();
+    sync( _indexRevision );
+    return true;
+}
+
+FeatureList&
+FeatureListSource::getFeatures()
+{
+    Threading::ScopedMutexLock lock(_indexMutex);
+    _indexValid = false;
+    dirtyFeatureProfile();
+    return _features;
+}
+
+Feature*
+FeatureListSource::getFeature( FeatureID fid )
+{
+    Threading::ScopedMutexLock lock(_indexMutex);
+    ensureIndex();
+
+    FIDIndex::iterator i = _fids.find( fid );
+    return i != _fids.end() ? i->second->get() : 0L;
+}
+
+bool FeatureListSource::insertFeature(Feature* feature)
+{
+    Threading::ScopedMutexLock lock(_indexMutex);
+
+    // index the new feature only if the rest of the index is current
+    bool indexed = _indexValid && inSyncWith(_indexRevision);
+
     dirtyFeatureProfile();
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
+    _features.push_back( feature );
+    dirty();
+
+    if ( indexed )
     {
-        if (itr->get()->getFID() == fid)
+        _fids.insert( std::make_pair(feature->getFID(), --_features.end()) );
+
+        IndexEntry entry;
+        if ( makeEntry(feature, entry) )
+            _unindexed.push_back( entry );
+
+        sync( _indexRevision );
+    }
+    return true;
+}
+
+void
+FeatureListSource::ensureIndex()
+{
+    // rebuild after outside changes, or once the unpacked part gets big enough
+    // to slow queries down:
+    if (!_indexValid ||
+        outOfSyncWith(_indexRevision) ||
+        (_unindexed.size() > NODE_SIZE*NODE_SIZE && _unindexed.size() > _entries.size()/4) ||
+        (_numDeleted > NODE_SIZE*NODE_SIZE && _numDeleted > _entries.size()/4))
+    {
+        buildIndex();
+    }
+}
+
+bool
+FeatureListSource::makeEntry(Feature* feature, IndexEntry& entry)
+{
+    if ( !feature || !feature->getGeometry() )
+        return false;
+
+    Bounds b = feature->getGeometry()->getBounds();
+    if ( !b.isValid() )
+        return false;
+
+    entry.box.xmin = b.xMin();
+    entry.box.ymin = b.yMin();
+    entry.box.xmax = b.xMax();
+    entry.box.ymax = b.yMax();
+    entry.feature  = feature;
+    entry.order    = _nextOrder++;
+    return true;
+}
+
+void
+FeatureListSource::buildIndex()
+{
+    _fids.clear();
+    _entries.clear();
+    _nodes.clear();
+    _unindexed.clear();
+    _numDeleted = 0;
+    _nextOrder = 0;
+
+    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+    {
+        Feature* feature = itr->get();
+        _fids.insert( std::make_pair(feature->getFID(), itr) );
+
+        IndexEntry entry;
+        if ( makeEntry(feature, entry) )
+            _entries.push_back( entry );
+    }
+
+    // Sort-Tile-Recursive packing: cut the leaves into vertical slices by x,
+    // then sort each slice by y, so every run of NODE_SIZE leaves is compact.
+    if ( !_entries.empty() )
+    {
+        unsigned numLeaves = (_entries.size() + NODE_SIZE - 1) / NODE_SIZE;
+        unsigned numSlices = (unsigned)std::ceil(std::sqrt((double)numLeaves));
+        unsigned sliceSize = numSlices * NODE_SIZE;
+
+        std::sort( _entries.begin(), _entries.end(), SortByX() );
+        for(unsigned s = 0; s < _entries.size(); s += sliceSize)
         {
-            _features.erase( itr );
-            dirty();
-            return true;
+            unsigned end = std::min(s + sliceSize, (unsigned)_entries.size());
+            std::sort( _entries.begin() + s, _entries.begin() + end, SortByY() );
+        }
+
+        // build the levels above the leaves until one node covers everything
+        unsigned count = _entries.size();
+        while ( _nodes.empty() || count > 1 )
+        {
+            std::vector<IndexBox> level;
+            for(unsigned first = 0; first < count; first += NODE_SIZE)
+            {
+                unsigned last = std::min(first + NODE_SIZE, count);
+                IndexBox box = _nodes.empty() ? _entries[first].box : _nodes.back()[first];
+                for(unsigned c = first+1; c < last; ++c)
+                {
+                    const IndexBox& child = _nodes.empty() ? _entries[c].box : _nodes.back()[c];
+                    box.xmin = std::min(box.xmin, child.xmin);
+                    box.ymin = std::min(box.ymin, child.ymin);
+                    box.xmax = std::max(box.xmax, child.xmax);
+                    box.ymax = std::max(box.ymax, child.ymax);
+                }
+                level.push_back( box );
+            }
+            _nodes.push_back( level );
+            count = level.size();
         }
     }
-    return false;
+
+    _indexValid = true;
+    sync( _indexRevision );
 }
 
-Feature*
-FeatureListSource::getFeature( FeatureID fid )
+void
+FeatureListSource::queryIndex(const Bounds& bounds, std::vector<const IndexEntry*>& hits) const
 {
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
+    if ( !_nodes.empty() && _nodes.back()[0].intersects(bounds) )
     {
-        if (itr->get()->getFID() == fid)
+        // (level, node) pairs still to visit
+        std::vector< std::pair<unsigned, unsigned> > stack;
+        stack.push_back( std::make_pair((unsigned)_nodes.size()-1, 0u) );
+
+        while( !stack.empty() )
         {
-            return itr->get();
+            unsigned level = stack.back().first;
+            unsigned first = stack.back().second * NODE_SIZE;
+            stack.pop_back();
+
+            if ( level == 0 )
+            {
+                unsigned last = std::min(first + NODE_SIZE, (unsigned)_entries.size());
+                for(unsigned c = first; c < last; ++c)
+                {
+                    if ( _entries[c].feature && _entries[c].box.intersects(bounds) )
+                        hits.push_back( &_entries[c] );
+                }
+            }
+            else
+            {
+                const std::vector<IndexBox>& children = _nodes[level-1];
+                unsigned last = std::min(first + NODE_SIZE, (unsigned)children.size());
+                for(unsigned c = first; c < last; ++c)
+                {
+                    if ( children[c].intersects(bounds) )
+                        stack.push_back( std::make_pair(level-1, c) );
+                }
+            }
         }
     }
-    return NULL;
+
+    for(std::vector<IndexEntry>::const_iterator i = _unindexed.begin(); i != _unindexed.end(); ++i)
+    {
+        if ( i->box.intersects(bounds) )
+            hits.push_back( &(*i) );
+    }
 }
 
-bool FeatureListSource::insertFeature(Feature* feature)
+void
+FeatureListSource::removeFromIndex(Feature* feature)
 {
-    dirtyFeatureProfile();
-    _features.push_back( feature );
-    dirty();
-    return true;
+    for(std::vector<IndexEntry>::iterator i = _unindexed.begin(); i != _unindexed.end(); ++i)
+    {
+        if ( i->feature == feature )
+        {
+            _unindexed.erase( i );
+            return;
+        }
+    }
+
+    // find the leaf by the feature's bounds; fall back on a scan in case
+    // the geometry changed since it was indexed
+    if ( feature->getGeometry() && feature->getGeometry()->getBounds().isValid() )
+    {
+        std::vector<const IndexEntry*> hits;
+        Bounds b = feature->getGeometry()->getBounds();
+        queryIndex( b, hits );
+        for(std::vector<const IndexEntry*>::iterator i = hits.begin(); i != hits.end(); ++i)
+        {
+            if ( (*i)->feature == feature )
+            {
+                const_cast<IndexEntry*>(*i)->feature = 0L;
+                ++_numDeleted;
+                return;
+            }
+        }
+    }
+
+    for(std::vector<IndexEntry>::iterator i = _entries.begin(); i != _entries.end(); ++i)
+    {
+        if ( i->feature == feature )
+        {
+            i->feature = 0L;
+            ++_numDeleted;
+            return;
+        }
+    }
 }
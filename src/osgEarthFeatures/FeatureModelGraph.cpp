@@ -18,8 +18,10 @@
  */
 
 #include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/CropFilter>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/FeatureTileCodec>
 #include <osgEarthFeatures/Session>
 
 #include <osgEarth/Map>
@@ -32,6 +34,7 @@
 #include <osgEarth/FadeEffect>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/TaskService>
 #include <osgEarth/ThreadingUtils>
 
 #include <osg/CullFace>
@@ -326,6 +329,13 @@ FeatureModelGraph::ctor()
         //_session->setResourceCache( new ResourceCache(_session->getDBOptions()) );
         _session->setResourceCache(new ResourceCache());
     }
+
+    // A pool for compiling the style groups of a tile concurrently. It is shared
+    // by all the pager threads loading this graph, which caps the layer's total.
+    if ( _options.buildThreads().get() > 1u )
+    {
+        _buildService = new TaskService( "FeatureModelGraph", _options.buildThreads().get() );
+    }
     
     // Calculate the usable extent (in both feature and map coordinates) and bounds.
     const Profile* mapProfile = _session->getMapInfo().getProfile();
@@ -800,6 +810,37 @@ FeatureModelGraph::load(unsigned lod, unsigned tileX, unsigned tileY,
 }
 
 
+/**
+ * Computes the world bound of a subtile on a build thread.
+ */
+class FeatureModelGraph::SubtileBoundTask : public TaskRequest
+{
+public:
+    SubtileBoundTask(const FeatureModelGraph* graph,
+                     const GeoExtent&         extent,
+                     const MapFrame*          mapf,
+                     osg::BoundingSphered&    output,
+                     Threading::MultiEvent&   done) :
+    _graph ( graph ),
+    _extent( extent ),
+    _mapf  ( mapf ),
+    _output( output ),
+    _done  ( done ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        _output = _graph->getBoundInWorldCoords( _extent, _mapf );
+        _done.notify();
+    }
+
+private:
+    const FeatureModelGraph* _graph;
+    GeoExtent                _extent;
+    const MapFrame*          _mapf;
+    osg::BoundingSphered&    _output;
+    Threading::MultiEvent&   _done;
+};
+
 void
 FeatureModelGraph::buildSubTilePagedLODs(unsigned        parentLOD,
                                          unsigned        parentTileX,
@@ -829,13 +870,38 @@ FeatureModelGraph::buildSubTilePagedLODs(unsigned        parentLOD,
         return;
     }
     
+    // compute the subtile bounds first. Each one samples the elevation data,
+    // so run them on the build threads if there are any.
+    GeoExtent            subtileExtents[4];
+    osg::BoundingSphered subtileBounds[4];
+    for( unsigned k = 0; k < 4; ++k )
+    {
+        subtileExtents[k] = s_getTileExtent( subtileLOD, subtileX + k/2, subtileY + k%2, _usableFeatureExtent );
+    }
+
+    if ( _buildService.valid() )
+    {
+        Threading::MultiEvent done( 4 );
+        for( unsigned k = 0; k < 4; ++k )
+        {
+            _buildService->add( new SubtileBoundTask(this, subtileExtents[k], mapf, subtileBounds[k], done) );
+        }
+        done.wait();
+    }
+    else
+    {
+        for( unsigned k = 0; k < 4; ++k )
+        {
+            subtileBounds[k] = getBoundInWorldCoords( subtileExtents[k], mapf );
+        }
+    }
+
     // make a paged LOD for each subtile:
     for( unsigned u = subtileX; u <= subtileX + 1; ++u )
     {
         for( unsigned v = subtileY; v <= subtileY + 1; ++v )
         {
-            GeoExtent subtileFeatureExtent = s_getTileExtent( subtileLOD, u, v, _usableFeatureExtent );
-            osg::BoundingSphered subtile_bs = getBoundInWorldCoords( subtileFeatureExtent, mapf );
+            const osg::BoundingSphered& subtile_bs = subtileBounds[(u-subtileX)*2 + (v-subtileY)];
       
             // Calculate the maximum camera range for the LOD.
             float maxRange;
@@ -937,7 +1003,17 @@ FeatureModelGraph::readTileFromCache(const std::string&    cacheKey,
 
         if (rr.succeeded())
         {
-            group = dynamic_cast<osg::Group*>(rr.getNode());
+            // compact tiles come back as a string; anything else is an osgb graph.
+            const std::string& data = rr.getString();
+            if (FeatureTileCodec::isEncoded(data.data(), data.size()))
+            {
+                osg::ref_ptr<osg::Node> node = FeatureTileCodec::decode(data.data(), data.size());
+                group = dynamic_cast<osg::Group*>(node.get());
+            }
+            else
+            {
+                group = dynamic_cast<osg::Group*>(rr.getNode());
+            }
             OE_DEBUG << LC << "Loaded from the cache (key = " << cacheKey << ")\n";
             ++_cacheHits;
 
@@ -983,7 +1059,16 @@ FeatureModelGraph::writeTileToCache(const std::string&    cacheKey,
 
     if (cacheBin && policy->isCacheWriteable())
     {
-        cacheBin->writeNode(cacheKey, node, Config(), writeOptions);
+        // prefer the compact tile format, and fall back on osgb for graphs it cannot carry.
+        // The bin stores a string's bytes as they are, without an osgb wrapper.
+        std::string buffer;
+        if (FeatureTileCodec::encode(node, buffer))
+        {
+            osg::ref_ptr<StringObject> encoded = new StringObject(buffer);
+            cacheBin->write(cacheKey, encoded.get(), Config(), writeOptions);
+        }
+        else
+            cacheBin->writeNode(cacheKey, node, Config(), writeOptions);
         OE_DEBUG << LC << "Wrote " << cacheKey << " to cache\n";
     }
     return true;
@@ -1059,7 +1144,9 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
                 const StyleSelector* selector = _session->styles()->getSelector( *level.styleName() );
                 if ( selector )
                 {
-                    buildStyleGroups( selector, query, index, group.get(), readOptions );
+                    StyleGroupJobs jobs;
+                    buildStyleGroups( selector, query, index, jobs );
+                    compileStyleGroups( jobs, group.get(), readOptions );
                 }
             }
         }
@@ -1154,39 +1241,45 @@ FeatureModelGraph::build(const Style&          defaultStyle,
         // each feature has its own style, so use that and ignore the style catalog.
         osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor( baseQuery );
 
+        FeatureList batch;
         while( cursor.valid() && cursor->hasMore() )
         {
-            Feature* feature = cursor->nextFeature();
-            if ( feature )
+            batch.clear();
+            cursor->nextBatch( batch );
+            for( FeatureList::iterator f = batch.begin(); f != batch.end(); ++f )
             {
-                FeatureList list;
-                list.push_back( feature );
-                osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor(list);
+                Feature* feature = f->get();
+                if ( feature )
+                {
+                    FeatureList list;
+                    list.push_back( feature );
+                    osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor(list);
 
-                FilterContext context( _session.get(), featureProfile, workingExtent, index );
+                    FilterContext context( _session.get(), featureProfile, workingExtent, index );
 
-                // note: gridding is not supported for embedded styles.
-                osg::ref_ptr<osg::Node> node;
+                    // note: gridding is not supported for embedded styles.
+                    osg::ref_ptr<osg::Node> node;
 
-                // Get the Group that parents all features of this particular style. Note, this
-                // might be NULL if the factory does not support style groups.
-                osg::Group* styleGroup = getOrCreateStyleGroupFromFactory( *feature->style() );
-                if ( styleGroup )
-                {
-                    if ( !group->containsNode( styleGroup ) )
+                    // Get the Group that parents all features of this particular style. Note, this
+                    // might be NULL if the factory does not support style groups.
+                    osg::Group* styleGroup = getOrCreateStyleGroupFromFactory( *feature->style() );
+                    if ( styleGroup )
                     {
-                        group->addChild( styleGroup );
+                        if ( !group->containsNode( styleGroup ) )
+                        {
+                            group->addChild( styleGroup );
+                        }
                     }
-                }
 
-                if ( createOrUpdateNode(cursor.get(), *feature->style(), context, readOptions, node))
-                {
-                    if ( node.valid() )
+                    if ( createOrUpdateNode(cursor.get(), *feature->style(), context, readOptions, node))
                     {
-                        if ( styleGroup )
-                            styleGroup->addChild( node.get() );
-                        else
-                            group->addChild( node.get() );
+                        if ( node.valid() )
+                        {
+                            if ( styleGroup )
+                                styleGroup->addChild( node.get() );
+                            else
+                                group->addChild( node.get() );
+                        }
                     }
                 }
             }
@@ -1202,6 +1295,9 @@ FeatureModelGraph::build(const Style&          defaultStyle,
         // a create a node for each style group.
         if ( styles->selectors().size() > 0 )
         {
+            // collect a job per style group, then compile them all at once:
+            StyleGroupJobs jobs;
+
             for( StyleSelectorList::const_iterator i = styles->selectors().begin(); i != styles->selectors().end(); ++i )
             {
                 // pull the selected style...
@@ -1215,8 +1311,8 @@ FeatureModelGraph::build(const Style&          defaultStyle,
                     Query combinedQuery = baseQuery.combineWith( *sel.query() );
                     combinedQuery.setMap(_session->createMapFrame());// _session->getMap() );
 
-                    // query, sort, and add each style group to th parent:
-                    queryAndSortIntoStyleGroups( combinedQuery, *sel.styleExpression(), index, group, readOptions );
+                    // query, sort, and add a job for each style group:
+                    queryAndSortIntoStyleGroups( combinedQuery, *sel.styleExpression(), index, jobs );
                 }
 
                 // otherwise, all feature returned by this query will have the same style:
@@ -1224,17 +1320,16 @@ FeatureModelGraph::build(const Style&          defaultStyle,
                 {
                     // combine the selection style with the incoming base style:
                     Style selectedStyle = *styles->getStyle( sel.getSelectedStyleName() );
-                    Style combinedStyle = defaultStyle.combineWith( selectedStyle );
-
-                    // .. and merge it's query into the existing query
-                    Query combinedQuery = baseQuery.combineWith( *sel.query() );
-                    combinedQuery.setMap(_session->createMapFrame());// _session->getMap() );
 
-                    // then create the node.
-                    osg::Group* styleGroup = createStyleGroup( combinedStyle, combinedQuery, index, readOptions );
+                    jobs.push_back( StyleGroupJob() );
+                    StyleGroupJob& job = jobs.back();
+                    job.style = defaultStyle.combineWith( selectedStyle );
 
-                    if ( styleGroup && !group->containsNode(styleGroup) )
-                        group->addChild( styleGroup );
+                    // .. and merge it's query into the existing query
+                    job.fromQuery = true;
+                    job.query = baseQuery.combineWith( *sel.query() );
+                    job.query.setMap(_session->createMapFrame());// _session->getMap() );
+                    job.index = index;
                 }
 
                 // Tried to apply a selector query to a tiled source, which is illegal because
@@ -1247,6 +1342,8 @@ FeatureModelGraph::build(const Style&          defaultStyle,
                         << std::endl;
                 }
             }
+
+            compileStyleGroups( jobs, group, readOptions );
         }
 
         // if no selectors are present, render all the features with a single style.
@@ -1286,8 +1383,7 @@ void
 FeatureModelGraph::buildStyleGroups(const StyleSelector*  selector,
                                     const Query&          baseQuery,
                                     FeatureIndexBuilder*  index,
-                                    osg::Group*           parent,
-                                    const osgDB::Options* readOptions)
+                                    StyleGroupJobs&       jobs)
 {
     OE_TEST << LC << "buildStyleGroups: " << selector->name() << std::endl;
 
@@ -1299,27 +1395,26 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector*  selector,
         Query combinedQuery = baseQuery.combineWith( *selector->query() );
         combinedQuery.setMap(_session->createMapFrame());// _session->getMap() );
 
-        // query, sort, and add each style group to the parent:
-        queryAndSortIntoStyleGroups( combinedQuery, *selector->styleExpression(), index, parent, readOptions );
+        // query, sort, and add a job for each style group:
+        queryAndSortIntoStyleGroups( combinedQuery, *selector->styleExpression(), index, jobs );
     }
 
     // otherwise, all feature returned by this query will have the same style:
     else
     {
+        jobs.push_back( StyleGroupJob() );
+        StyleGroupJob& job = jobs.back();
+
         // combine the selection style with the incoming base style:
         const Style* selectedStyle = _session->styles()->getStyle(selector->getSelectedStyleName());
-        Style style;
         if ( selectedStyle )
-            style = *selectedStyle;
+            job.style = *selectedStyle;
 
         // .. and merge it's query into the existing query
-        Query combinedQuery = baseQuery.combineWith( *selector->query() );
-        combinedQuery.setMap(_session->createMapFrame());// _session->getMap() );
-
-        // then create the node.
-        osg::Node* node = createStyleGroup(style, combinedQuery, index, readOptions);
-        if ( node && !parent->containsNode(node) )
-            parent->addChild( node );
+        job.fromQuery = true;
+        job.query = baseQuery.combineWith( *selector->query() );
+        job.query.setMap(_session->createMapFrame());// _session->getMap() );
+        job.index = index;
     }
 }
 
@@ -1328,15 +1423,13 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector*  selector,
  * Querys the feature source;
  * Visits each feature and uses the Style Expression to resolve its style class;
  * Sorts the features into bins based on style class;
- * Compiles each bin into a separate style group;
- * Adds the resulting style groups to the provided parent.
+ * Adds a job to compile each bin into a separate style group.
  */
 void
 FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
                                                const StringExpression& styleExpr,
                                                FeatureIndexBuilder*    index,
-                                               osg::Group*             parent,
-                                               const osgDB::Options*   readOptions)
+                                               StyleGroupJobs&         jobs)
 {
     // the profile of the features
     const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
@@ -1352,19 +1445,25 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
     // establish the working bounds and a context:
     Bounds bounds = query.bounds().isSet() ? *query.bounds() : extent.bounds();
     FilterContext context( _session.get(), featureProfile, GeoExtent(featureProfile->getSRS(), bounds), index );
-    StringExpression styleExprCopy( styleExpr );
+    CompiledStringExpression compiledStyleExpr( styleExpr, featureProfile->getSchemaIndex() );
 
     // visit each feature and run the expression to sort it into a bin.
     std::map<std::string, FeatureList> styleBins;
+    FeatureList batch;
+    std::vector<std::string> styleStrings;
     while( cursor->hasMore() )
     {
-        osg::ref_ptr<Feature> feature = cursor->nextFeature();
-        if ( feature.valid() )
+        batch.clear();
+        cursor->nextBatch( batch );
+        compiledStyleExpr.eval( batch, styleStrings, &context );
+
+        unsigned n = 0;
+        for( FeatureList::iterator f = batch.begin(); f != batch.end(); ++f, ++n )
         {
-            const std::string& styleString = feature->eval( styleExprCopy, &context );
+            const std::string& styleString = styleStrings[n];
             if (!styleString.empty() && styleString != "null")
             {
-                styleBins[styleString].push_back( feature.get() );
+                styleBins[styleString].push_back( f->get() );
             }
         }
     }
@@ -1398,18 +1497,90 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
                 combinedStyle = *selectedStyle;
         }
 
-        // if there is a valid style, create the node and add it. (Otherwise we will skip
+        // if there is a valid style, queue up the node. (Otherwise we will skip
         // the feature.)
         if ( !combinedStyle.empty() )
         {
-            osg::Group* styleGroup = createStyleGroup(combinedStyle, workingSet, context, readOptions);
-            if ( styleGroup )
-                parent->addChild( styleGroup );
+            jobs.push_back( StyleGroupJob() );
+            StyleGroupJob& job = jobs.back();
+            job.style = combinedStyle;
+            job.workingSet.swap( workingSet );
+            job.context = context;
         }
     }
 }
 
 
+/**
+ * Compiles one style group on a build thread.
+ */
+class FeatureModelGraph::StyleGroupTask : public TaskRequest
+{
+public:
+    StyleGroupTask(FeatureModelGraph*     graph,
+                   StyleGroupJob&         job,
+                   const osgDB::Options*  readOptions,
+                   Threading::MultiEvent& done) :
+    _graph      ( graph ),
+    _job        ( job ),
+    _readOptions( readOptions ),
+    _done       ( done ) { }
+
+    void operator()( ProgressCallback* progress )
+    {
+        _graph->compileStyleGroup( _job, _readOptions.get() );
+        _done.notify();
+    }
+
+private:
+    FeatureModelGraph*                 _graph;
+    StyleGroupJob&                     _job;
+    osg::ref_ptr<const osgDB::Options> _readOptions;
+    Threading::MultiEvent&             _done;
+};
+
+void
+FeatureModelGraph::compileStyleGroups(StyleGroupJobs&       jobs,
+                                      osg::Group*           parent,
+                                      const osgDB::Options* readOptions)
+{
+    if ( _buildService.valid() && jobs.size() > 1 )
+    {
+        Threading::MultiEvent done( jobs.size() );
+        for( StyleGroupJobs::iterator i = jobs.begin(); i != jobs.end(); ++i )
+        {
+            _buildService->add( new StyleGroupTask(this, *i, readOptions, done) );
+        }
+        done.wait();
+    }
+    else
+    {
+        for( StyleGroupJobs::iterator i = jobs.begin(); i != jobs.end(); ++i )
+        {
+            compileStyleGroup( *i, readOptions );
+        }
+    }
+
+    // add the results in job order, so the graph doesn't depend on which
+    // job finished first.
+    for( StyleGroupJobs::iterator i = jobs.begin(); i != jobs.end(); ++i )
+    {
+        if ( i->result.valid() && !parent->containsNode(i->result.get()) )
+            parent->addChild( i->result.get() );
+    }
+}
+
+void
+FeatureModelGraph::compileStyleGroup(StyleGroupJob&        job,
+                                     const osgDB::Options* readOptions)
+{
+    if ( job.fromQuery )
+        job.result = createStyleGroup( job.style, job.query, job.index, readOptions );
+    else
+        job.result = createStyleGroup( job.style, job.workingSet, job.context, readOptions );
+}
+
+
 osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&          style, 
                                     FeatureList&          workingSet, 
@@ -1606,8 +1777,12 @@ FeatureModelGraph::getOrCreateStyleGroupFromFactory(const Style& style)
     // Warning. This needs attention w.r.t. caching, since the "global" styles don't cache. -gw
     checkForGlobalStyles( style );
 
-    // Apply render symbology at the style group level.
-    applyRenderSymbology(style, styleGroup);
+    // Apply render symbology at the style group level. This can touch the
+    // graph's own state, and style groups may compile concurrently.
+    {
+        OpenThreads::ScopedLock< OpenThreads::ReentrantMutex > lk(_clampableMutex);
+        applyRenderSymbology(style, styleGroup);
+    }
 
     return styleGroup;
 }
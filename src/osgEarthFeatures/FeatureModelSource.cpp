@@ -42,7 +42,8 @@ _clusterCulling    ( true ),
 _backfaceCulling   ( true ),
 _alphaBlending     ( true ),
 _sessionWideResourceCache( true ),
-_nodeCaching(false)
+_nodeCaching(false),
+_buildThreads( 1u )
 {
     fromConfig(co.getConfig());
 }
@@ -65,6 +66,7 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
     conf.getIfSet( "node_caching",     _nodeCaching );
+    conf.getIfSet( "build_threads",    _buildThreads );
     
     conf.getIfSet( "session_wide_resource_cache", _sessionWideResourceCache );
 }
@@ -87,6 +89,7 @@ FeatureModelOptions::getConfig() const
     conf.updateIfSet( "backface_culling", _backfaceCulling );
     conf.updateIfSet( "alpha_blending",   _alphaBlending );
     conf.updateIfSet( "node_caching",     _nodeCaching );
+    conf.updateIfSet( "build_threads",    _buildThreads );
     
     conf.updateIfSet( "session_wide_resource_cache", _sessionWideResourceCache );
 
@@ -121,6 +124,7 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
     conf.getIfSet( "node_caching",     _nodeCaching );
+    conf.getIfSet( "build_threads",    _buildThreads );
     
     conf.getIfSet( "session_wide_resource_cache", _sessionWideResourceCache );
 }
@@ -149,6 +153,7 @@ FeatureModelSourceOptions::getConfig() const
     conf.updateIfSet( "backface_culling", _backfaceCulling );
     conf.updateIfSet( "alpha_blending",   _alphaBlending );
     conf.updateIfSet( "node_caching",     _nodeCaching );
+    conf.updateIfSet( "build_threads",    _buildThreads );
     
     conf.updateIfSet( "session_wide_resource_cache", _sessionWideResourceCache );
 
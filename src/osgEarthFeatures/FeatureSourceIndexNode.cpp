@@ -112,7 +112,11 @@ FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -121,7 +125,11 @@ FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -130,7 +138,11 @@ FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
     RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
+    if ( r )
+    {
+        Threading::ScopedMutexLock lock( _fidsMutex );
+        _fids[ feature->getFID() ] = r;
+    }
     return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
 }
 
@@ -0,0 +1,786 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureTileCodec>
+#include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/Version>
+#include <string.h>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+#define LC "[FeatureTileCodec] "
+
+// Layout, all integers native 32-bit and every block padded to 4 bytes:
+//
+//   header:    "OEFT", version, byte-order mark
+//   node:      type, name, node mask, state set, type-specific data, children
+//   state set: flag, rendering hint, bin mode/number/name, modes, uniforms
+//   geometry:  flags, arrays (type, binding, normalize, count, raw data),
+//              vertex attribute arrays, primitive sets
+//
+// A byte-order mark that does not match the host makes the tile undecodable,
+// which the cache treats as a miss.
+
+namespace
+{
+    const char     MAGIC[4]   = { 'O', 'E', 'F', 'T' };
+    const unsigned VERSION    = 1u;
+    const unsigned BOM        = 0x01020304u;
+    const unsigned MAX_DEPTH  = 64u;
+
+    enum NodeType
+    {
+        NODE_GROUP,
+        NODE_INDEX,
+        NODE_TRANSFORM,
+        NODE_GEODE,
+        NODE_GEOMETRY
+    };
+
+    enum PrimitiveType
+    {
+        PRIM_DRAW_ARRAYS,
+        PRIM_DRAW_ARRAY_LENGTHS,
+        PRIM_ELEMENTS_UBYTE,
+        PRIM_ELEMENTS_USHORT,
+        PRIM_ELEMENTS_UINT
+    };
+
+    /** True if the object is exactly the named class, not a subclass of it. */
+    bool isExactly(const osg::Object* obj, const char* libraryName, const char* className)
+    {
+        return
+            ::strcmp(obj->libraryName(), libraryName) == 0 &&
+            ::strcmp(obj->className(), className) == 0;
+    }
+
+    /** Size of one array element, or zero for array types the codec does not carry. */
+    unsigned elementSize(const osg::Array* array)
+    {
+        switch( array->getType() )
+        {
+        case osg::Array::FloatArrayType: return sizeof(float);
+        case osg::Array::Vec2ArrayType:  return sizeof(osg::Vec2f);
+        case osg::Array::Vec3ArrayType:  return sizeof(osg::Vec3f);
+        case osg::Array::Vec4ArrayType:  return sizeof(osg::Vec4f);
+        case osg::Array::UIntArrayType:  return sizeof(GLuint);
+        case osg::Array::Vec4ubArrayType:return sizeof(osg::Vec4ub);
+        default: return 0u;
+        }
+    }
+
+    osg::Array* createArray(unsigned type, unsigned count)
+    {
+        switch( type )
+        {
+        case osg::Array::FloatArrayType: return new osg::FloatArray(count);
+        case osg::Array::Vec2ArrayType:  return new osg::Vec2Array(count);
+        case osg::Array::Vec3ArrayType:  return new osg::Vec3Array(count);
+        case osg::Array::Vec4ArrayType:  return new osg::Vec4Array(count);
+        case osg::Array::UIntArrayType:  return new osg::UIntArray(count);
+        case osg::Array::Vec4ubArrayType:return new osg::Vec4ubArray(count);
+        default: return 0L;
+        }
+    }
+
+    //........................................................................
+
+    struct Writer
+    {
+        std::string& _out;
+
+        Writer(std::string& out) : _out(out) { }
+
+        void pad()
+        {
+            while( (_out.size() & 3u) != 0u )
+                _out.push_back('\0');
+        }
+
+        void bytes(const void* data, unsigned size)
+        {
+            if ( size > 0u )
+                _out.append( (const char*)data, size );
+            pad();
+        }
+
+        void u32(unsigned value)
+        {
+            bytes( &value, sizeof(value) );
+        }
+
+        void str(const std::string& value)
+        {
+            u32( value.size() );
+            bytes( value.data(), value.size() );
+        }
+
+        bool stateSet(const osg::StateSet* ss)
+        {
+            u32( ss ? 1u : 0u );
+            if ( !ss )
+                return true;
+
+            if (!ss->getAttributeList().empty()        ||
+                !ss->getTextureAttributeList().empty() ||
+                !ss->getTextureModeList().empty()      ||
+                ss->getUpdateCallback()                ||
+                ss->getEventCallback()                 ||
+                ss->getUserDataContainer())
+            {
+                return false;
+            }
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,4,0)
+            if ( !ss->getDefineList().empty() )
+                return false;
+#endif
+
+            u32( ss->getRenderingHint() );
+            u32( ss->getRenderBinMode() );
+            u32( ss->getBinNumber() );
+            str( ss->getBinName() );
+            u32( ss->getNestRenderBins() ? 1u : 0u );
+
+            const osg::StateSet::ModeList& modes = ss->getModeList();
+            u32( modes.size() );
+            for(osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i)
+            {
+                u32( i->first );
+                u32( i->second );
+            }
+
+            const osg::StateSet::UniformList& uniforms = ss->getUniformList();
+            u32( uniforms.size() );
+            for(osg::StateSet::UniformList::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i)
+            {
+                const osg::Uniform* u = i->second.first.get();
+                if (u->getNumElements() != 1u || u->getUpdateCallback() || u->getEventCallback())
+                    return false;
+
+                unsigned bits;
+                switch( u->getType() )
+                {
+                case osg::Uniform::UNSIGNED_INT: { unsigned v; u->get(v); bits = v; break; }
+                case osg::Uniform::INT:          { int v; u->get(v); ::memcpy(&bits, &v, 4); break; }
+                case osg::Uniform::FLOAT:        { float v; u->get(v); ::memcpy(&bits, &v, 4); break; }
+                case osg::Uniform::BOOL:         { bool v; u->get(v); bits = v ? 1u : 0u; break; }
+                default: return false;
+                }
+
+                str( u->getName() );
+                u32( u->getType() );
+                u32( bits );
+                u32( i->second.second );
+            }
+            return true;
+        }
+
+        bool array(const osg::Array* a)
+        {
+            if ( !a )
+            {
+                u32( osg::Array::ArrayType );
+                return true;
+            }
+
+            unsigned size = elementSize(a);
+            if ( size == 0u || a->getUserDataContainer() || ::strcmp(a->libraryName(), "osg") != 0 )
+                return false;
+
+            u32( a->getType() );
+            u32( a->getBinding() );
+            u32( a->getNormalize() ? 1u : 0u );
+            u32( a->getPreserveDataType() ? 1u : 0u );
+            u32( a->getNumElements() );
+            bytes( a->getDataPointer(), a->getNumElements() * size );
+            return true;
+        }
+
+        bool primitiveSet(const osg::PrimitiveSet* p)
+        {
+            if ( p->getUserDataContainer() )
+                return false;
+
+            if ( isExactly(p, "osg", "DrawArrays") )
+            {
+                const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>(p);
+                u32( PRIM_DRAW_ARRAYS );
+                u32( p->getMode() );
+                u32( p->getNumInstances() );
+                u32( da->getFirst() );
+                u32( da->getCount() );
+            }
+            else if ( isExactly(p, "osg", "DrawArrayLengths") )
+            {
+                const osg::DrawArrayLengths* dal = static_cast<const osg::DrawArrayLengths*>(p);
+                u32( PRIM_DRAW_ARRAY_LENGTHS );
+                u32( p->getMode() );
+                u32( p->getNumInstances() );
+                u32( dal->getFirst() );
+                u32( dal->size() );
+                bytes( dal->getDataPointer(), dal->getTotalDataSize() );
+            }
+            else
+            {
+                unsigned type;
+                if      ( isExactly(p, "osg", "DrawElementsUByte") )  type = PRIM_ELEMENTS_UBYTE;
+                else if ( isExactly(p, "osg", "DrawElementsUShort") ) type = PRIM_ELEMENTS_USHORT;
+                else if ( isExactly(p, "osg", "DrawElementsUInt") )   type = PRIM_ELEMENTS_UINT;
+                else return false;
+
+                const osg::DrawElements* de = static_cast<const osg::DrawElements*>(p);
+                u32( type );
+                u32( p->getMode() );
+                u32( p->getNumInstances() );
+                u32( de->getNumIndices() );
+                bytes( de->getDataPointer(), de->getTotalDataSize() );
+            }
+            return true;
+        }
+
+        bool geometry(const osg::Drawable* drawable)
+        {
+            if (!isExactly(drawable, "osg", "Geometry") ||
+                drawable->getUpdateCallback() ||
+                drawable->getCullCallback() ||
+                drawable->getDrawCallback() ||
+                drawable->getUserDataContainer())
+            {
+                return false;
+            }
+
+            const osg::Geometry* geom = static_cast<const osg::Geometry*>(drawable);
+
+            u32( NODE_GEOMETRY );
+            str( geom->getName() );
+            if ( !stateSet(geom->getStateSet()) )
+                return false;
+
+            u32( geom->getUseDisplayList() ? 1u : 0u );
+            u32( geom->getUseVertexBufferObjects() ? 1u : 0u );
+
+            // the vertex array must be plain floats; double-precision arrays
+            // are not carried.
+            if ( geom->getVertexArray() && geom->getVertexArray()->getType() != osg::Array::Vec3ArrayType )
+                return false;
+
+            if (!array(geom->getVertexArray()) ||
+                !array(geom->getNormalArray()) ||
+                !array(geom->getColorArray())  ||
+                !array(geom->getSecondaryColorArray()) ||
+                !array(geom->getFogCoordArray()))
+            {
+                return false;
+            }
+
+            u32( geom->getNumTexCoordArrays() );
+            for(unsigned i=0; i<geom->getNumTexCoordArrays(); ++i)
+                if ( !array(geom->getTexCoordArray(i)) )
+                    return false;
+
+            u32( geom->getNumVertexAttribArrays() );
+            for(unsigned i=0; i<geom->getNumVertexAttribArrays(); ++i)
+                if ( !array(geom->getVertexAttribArray(i)) )
+                    return false;
+
+            u32( geom->getNumPrimitiveSets() );
+            for(unsigned i=0; i<geom->getNumPrimitiveSets(); ++i)
+                if ( !primitiveSet(geom->getPrimitiveSet(i)) )
+                    return false;
+
+            return true;
+        }
+
+        bool node(const osg::Node* n)
+        {
+            if (n->getUpdateCallback() ||
+                n->getEventCallback()  ||
+                n->getCullCallback()   ||
+                n->getUserDataContainer())
+            {
+                return false;
+            }
+
+            unsigned type;
+            if      ( isExactly(n, "osg", "Group") )                                     type = NODE_GROUP;
+            else if ( isExactly(n, "osgEarth::Features", "FeatureSourceIndexNode") )     type = NODE_INDEX;
+            else if ( isExactly(n, "osg", "MatrixTransform") )                           type = NODE_TRANSFORM;
+            else if ( isExactly(n, "osg", "Geode") )                                     type = NODE_GEODE;
+            else return false;
+
+            u32( type );
+            str( n->getName() );
+            u32( n->getNodeMask() );
+            if ( !stateSet(n->getStateSet()) )
+                return false;
+
+            if ( type == NODE_INDEX )
+            {
+                const FeatureSourceIndexNode::FIDMap& fids = static_cast<const FeatureSourceIndexNode*>(n)->getFIDMap();
+                u32( fids.size() );
+                for(FeatureSourceIndexNode::FIDMap::const_iterator i = fids.begin(); i != fids.end(); ++i)
+                {
+                    unsigned long long fid = i->second->_fid;
+                    bytes( &fid, sizeof(fid) );
+                    u32( i->second->_oid );
+                }
+            }
+
+            else if ( type == NODE_TRANSFORM )
+            {
+                const osg::MatrixTransform* mt = static_cast<const osg::MatrixTransform*>(n);
+                if ( mt->getReferenceFrame() != osg::Transform::RELATIVE_RF )
+                    return false;
+                osg::Matrixd m = mt->getMatrix();
+                bytes( m.ptr(), 16*sizeof(double) );
+            }
+
+            else if ( type == NODE_GEODE )
+            {
+                const osg::Geode* geode = static_cast<const osg::Geode*>(n);
+                u32( geode->getNumDrawables() );
+                for(unsigned i=0; i<geode->getNumDrawables(); ++i)
+                    if ( !geometry(geode->getDrawable(i)) )
+                        return false;
+                return true;
+            }
+
+            const osg::Group* group = static_cast<const osg::Group*>(n);
+            u32( group->getNumChildren() );
+            for(unsigned i=0; i<group->getNumChildren(); ++i)
+                if ( !node(group->getChild(i)) )
+                    return false;
+
+            return true;
+        }
+    };
+
+    //........................................................................
+
+    struct Reader
+    {
+        const char* _ptr;
+        const char* _end;
+        bool        _ok;
+
+        Reader(const char* data, unsigned size) : _ptr(data), _end(data+size), _ok(true) { }
+
+        unsigned remaining() const { return _end - _ptr; }
+
+        /** Reads a block, advancing past its padding. Fails if it overruns the buffer. */
+        bool bytes(void* dst, unsigned size)
+        {
+            unsigned padded = (size + 3u) & ~3u;
+            if ( !_ok || padded < size || padded > remaining() )
+                return _ok = false;
+            if ( size > 0u )
+                ::memcpy( dst, _ptr, size );
+            _ptr += padded;
+            return true;
+        }
+
+        unsigned u32()
+        {
+            unsigned value = 0u;
+            bytes( &value, sizeof(value) );
+            return value;
+        }
+
+        /** Reads an element count, failing if that many elements cannot fit in what's left. */
+        unsigned count(unsigned elementSize)
+        {
+            unsigned n = u32();
+            if ( _ok && elementSize > 0u && n > remaining() / elementSize )
+                _ok = false;
+            return _ok ? n : 0u;
+        }
+
+        std::string str()
+        {
+            unsigned n = count(1u);
+            std::string value;
+            if ( _ok && n > 0u )
+            {
+                value.resize( n );
+                bytes( &value[0], n );
+            }
+            return value;
+        }
+
+        osg::StateSet* stateSet()
+        {
+            if ( u32() == 0u )
+                return 0L;
+
+            osg::ref_ptr<osg::StateSet> ss = new osg::StateSet();
+            ss->setRenderingHint( u32() );
+            unsigned binMode = u32();
+            int      binNum  = (int)u32();
+            std::string binName = str();
+            ss->setRenderBinDetails( binNum, binName, (osg::StateSet::RenderBinMode)binMode );
+            ss->setNestRenderBins( u32() != 0u );
+
+            unsigned numModes = count(8u);
+            for(unsigned i=0; _ok && i<numModes; ++i)
+            {
+                GLenum mode = u32();
+                ss->setMode( mode, u32() );
+            }
+
+            unsigned numUniforms = count(16u);
+            for(unsigned i=0; _ok && i<numUniforms; ++i)
+            {
+                std::string name = str();
+                unsigned type = u32();
+                unsigned bits = u32();
+                unsigned over = u32();
+
+                osg::Uniform* u;
+                switch( type )
+                {
+                case osg::Uniform::UNSIGNED_INT: u = new osg::Uniform(name.c_str(), bits); break;
+                case osg::Uniform::INT:          { int v; ::memcpy(&v, &bits, 4); u = new osg::Uniform(name.c_str(), v); break; }
+                case osg::Uniform::FLOAT:        { float v; ::memcpy(&v, &bits, 4); u = new osg::Uniform(name.c_str(), v); break; }
+                case osg::Uniform::BOOL:         u = new osg::Uniform(name.c_str(), bits != 0u); break;
+                default: _ok = false; return 0L;
+                }
+                ss->addUniform( u, over );
+            }
+
+            return _ok ? ss.release() : 0L;
+        }
+
+        /** Reads an array record, or returns NULL if the record is empty. */
+        osg::Array* array()
+        {
+            unsigned type = u32();
+            if ( !_ok || type == osg::Array::ArrayType )
+                return 0L;
+
+            unsigned binding   = u32();
+            bool     normalize = u32() != 0u;
+            bool     preserve  = u32() != 0u;
+
+            osg::ref_ptr<osg::Array> a = createArray(type, 0u);
+            if ( !a.valid() )
+            {
+                _ok = false;
+                return 0L;
+            }
+
+            unsigned n = count( elementSize(a.get()) );
+            if ( !_ok )
+                return 0L;
+
+            a = createArray(type, n);
+            if ( n > 0u && !bytes(const_cast<GLvoid*>(a->getDataPointer()), n * elementSize(a.get())) )
+                return 0L;
+
+            a->setBinding( (osg::Array::Binding)binding );
+            a->setNormalize( normalize );
+            a->setPreserveDataType( preserve );
+            return a.release();
+        }
+
+        osg::PrimitiveSet* primitiveSet()
+        {
+            unsigned type      = u32();
+            GLenum   mode      = u32();
+            int      instances = (int)u32();
+            if ( !_ok )
+                return 0L;
+
+            osg::ref_ptr<osg::PrimitiveSet> p;
+
+            if ( type == PRIM_DRAW_ARRAYS )
+            {
+                GLint   first = (GLint)u32();
+                GLsizei num   = (GLsizei)u32();
+                p = new osg::DrawArrays(mode, first, num, instances);
+            }
+            else if ( type == PRIM_DRAW_ARRAY_LENGTHS )
+            {
+                GLint    first = (GLint)u32();
+                unsigned n     = count(sizeof(GLsizei));
+                osg::DrawArrayLengths* dal = new osg::DrawArrayLengths(mode, first, n);
+                p = dal;
+                if ( n > 0u )
+                    bytes( &dal->front(), n*sizeof(GLsizei) );
+            }
+            else if ( type == PRIM_ELEMENTS_UBYTE )
+            {
+                unsigned n = count(1u);
+                osg::DrawElementsUByte* de = new osg::DrawElementsUByte(mode, n);
+                p = de;
+                if ( n > 0u )
+                    bytes( &de->front(), n );
+            }
+            else if ( type == PRIM_ELEMENTS_USHORT )
+            {
+                unsigned n = count(sizeof(GLushort));
+                osg::DrawElementsUShort* de = new osg::DrawElementsUShort(mode, n);
+                p = de;
+                if ( n > 0u )
+                    bytes( &de->front(), n*sizeof(GLushort) );
+            }
+            else if ( type == PRIM_ELEMENTS_UINT )
+            {
+                unsigned n = count(sizeof(GLuint));
+                osg::DrawElementsUInt* de = new osg::DrawElementsUInt(mode, n);
+                p = de;
+                if ( n > 0u )
+                    bytes( &de->front(), n*sizeof(GLuint) );
+            }
+            else
+            {
+                _ok = false;
+            }
+
+            if ( !_ok )
+                return 0L;
+
+            p->setNumInstances( instances );
+            return p.release();
+        }
+
+        /** Whether the primitive set only refers to vertices [0, numVerts). */
+        static bool inRange(const osg::PrimitiveSet* p, unsigned numVerts)
+        {
+            if ( const osg::DrawArrays* da = dynamic_cast<const osg::DrawArrays*>(p) )
+            {
+                return
+                    da->getFirst() >= 0 && da->getCount() >= 0 &&
+                    (unsigned long long)da->getFirst() + (unsigned long long)da->getCount() <= numVerts;
+            }
+            else if ( const osg::DrawArrayLengths* dal = dynamic_cast<const osg::DrawArrayLengths*>(p) )
+            {
+                if ( dal->getFirst() < 0 )
+                    return false;
+                unsigned long long end = dal->getFirst();
+                for(unsigned i=0; i<dal->size(); ++i)
+                {
+                    if ( (*dal)[i] < 0 )
+                        return false;
+                    end += (*dal)[i];
+                }
+                return end <= numVerts;
+            }
+            else if ( const osg::DrawElements* de = dynamic_cast<const osg::DrawElements*>(p) )
+            {
+                for(unsigned i=0; i<de->getNumIndices(); ++i)
+                {
+                    if ( de->getElement(i) >= numVerts )
+                        return false;
+                }
+                return true;
+            }
+            return false;
+        }
+
+        osg::Geometry* geometry()
+        {
+            if ( u32() != NODE_GEOMETRY || !_ok )
+            {
+                _ok = false;
+                return 0L;
+            }
+
+            osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+            geom->setName( str() );
+            geom->setStateSet( stateSet() );
+            geom->setUseDisplayList( u32() != 0u );
+            geom->setUseVertexBufferObjects( u32() != 0u );
+
+            geom->setVertexArray( array() );
+            geom->setNormalArray( array() );
+            geom->setColorArray( array() );
+            geom->setSecondaryColorArray( array() );
+            geom->setFogCoordArray( array() );
+
+            unsigned numTexCoords = count(4u);
+            for(unsigned i=0; _ok && i<numTexCoords; ++i)
+            {
+                osg::Array* a = array();
+                if ( a )
+                    geom->setTexCoordArray( i, a );
+            }
+
+            unsigned numAttribs = count(4u);
+            for(unsigned i=0; _ok && i<numAttribs; ++i)
+            {
+                osg::Array* a = array();
+                if ( a )
+                    geom->setVertexAttribArray( i, a );
+            }
+
+            // Primitives are drawn straight from the arrays, so a tile that
+            // refers to vertices past the end of them is corrupt.
+            const osg::Array* verts = geom->getVertexArray();
+            unsigned numVerts = verts ? verts->getNumElements() : 0u;
+
+            unsigned numPrims = count(12u);
+            for(unsigned i=0; _ok && i<numPrims; ++i)
+            {
+                osg::ref_ptr<osg::PrimitiveSet> p = primitiveSet();
+                if ( p.valid() && !inRange(p.get(), numVerts) )
+                {
+                    OE_DEBUG << LC << "Primitive set " << i << " is out of range of the " << numVerts << " vertices" << std::endl;
+                    _ok = false;
+                }
+                if ( _ok && p.valid() )
+                    geom->addPrimitiveSet( p.get() );
+            }
+
+            return _ok ? geom.release() : 0L;
+        }
+
+        osg::Node* node(unsigned depth)
+        {
+            if ( depth > MAX_DEPTH )
+            {
+                _ok = false;
+                return 0L;
+            }
+
+            unsigned type = u32();
+            if ( !_ok )
+                return 0L;
+
+            osg::ref_ptr<osg::Node> n;
+            osg::Group* group = 0L;
+
+            switch( type )
+            {
+            case NODE_GROUP:     n = group = new osg::Group(); break;
+            case NODE_INDEX:     n = group = new FeatureSourceIndexNode(); break;
+            case NODE_TRANSFORM: n = group = new osg::MatrixTransform(); break;
+            case NODE_GEODE:     n = new osg::Geode(); break;
+            default:             _ok = false; return 0L;
+            }
+
+            n->setName( str() );
+            n->setNodeMask( u32() );
+            n->setStateSet( stateSet() );
+
+            if ( type == NODE_INDEX )
+            {
+                FeatureSourceIndexNode::FIDMap fids;
+                unsigned numFIDs = count(12u);
+                for(unsigned i=0; _ok && i<numFIDs; ++i)
+                {
+                    unsigned long long fid = 0ull;
+                    bytes( &fid, sizeof(fid) );
+                    ObjectID oid = u32();
+                    fids[(FeatureID)fid] = new RefIDPair((FeatureID)fid, oid);
+                }
+                static_cast<FeatureSourceIndexNode*>(group)->setFIDMap( fids );
+            }
+
+            else if ( type == NODE_TRANSFORM )
+            {
+                osg::Matrixd m;
+                bytes( m.ptr(), 16*sizeof(double) );
+                static_cast<osg::MatrixTransform*>(group)->setMatrix( m );
+            }
+
+            else if ( type == NODE_GEODE )
+            {
+                osg::Geode* geode = static_cast<osg::Geode*>(n.get());
+                unsigned numDrawables = count(4u);
+                for(unsigned i=0; _ok && i<numDrawables; ++i)
+                {
+                    osg::Geometry* geom = geometry();
+                    if ( geom )
+                        geode->addDrawable( geom );
+                }
+                return _ok ? n.release() : 0L;
+            }
+
+            unsigned numChildren = count(4u);
+            for(unsigned i=0; _ok && i<numChildren; ++i)
+            {
+                osg::Node* child = node(depth+1);
+                if ( child )
+                    group->addChild( child );
+            }
+
+            return _ok ? n.release() : 0L;
+        }
+    };
+}
+
+//........................................................................
+
+bool
+FeatureTileCodec::encode(const osg::Node* node, std::string& output)
+{
+    output.clear();
+    if ( !node )
+        return false;
+
+    Writer writer(output);
+    writer.bytes( MAGIC, sizeof(MAGIC) );
+    writer.u32( VERSION );
+    writer.u32( BOM );
+
+    if ( !writer.node(node) )
+    {
+        OE_DEBUG << LC << "Graph holds data the tile format cannot carry\n";
+        output.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+FeatureTileCodec::isEncoded(const char* data, unsigned size)
+{
+    return data && size >= 12u && ::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+osg::Node*
+FeatureTileCodec::decode(const char* data, unsigned size)
+{
+    if ( !isEncoded(data, size) )
+        return 0L;
+
+    Reader reader(data + sizeof(MAGIC), size - sizeof(MAGIC));
+
+    unsigned version = reader.u32();
+    unsigned bom     = reader.u32();
+    if ( version != VERSION || bom != BOM )
+    {
+        OE_DEBUG << LC << "Tile version or byte order does not match this build\n";
+        return 0L;
+    }
+
+    osg::ref_ptr<osg::Node> node = reader.node(0u);
+    if ( !reader._ok || reader.remaining() != 0u )
+    {
+        OE_WARN << LC << "Malformed tile data\n";
+        return 0L;
+    }
+
+    return node.release();
+}
@@ -185,17 +185,19 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
 
         // Each feature has its own embedded style data, so use that:
         osg::ref_ptr<FeatureCursor> cursor = _features->createFeatureCursor(defaultQuery);
+        FeatureList batch;
         while( cursor.valid() && cursor->hasMore() )
         {
-            osg::ref_ptr< Feature > feature = cursor->nextFeature();
-            if ( feature )
+            batch.clear();
+            cursor->nextBatch( batch );
+            for( FeatureList::iterator f = batch.begin(); f != batch.end(); ++f )
             {
                 FeatureList list;
-                list.push_back( feature );
+                list.push_back( f->get() );
 
                 renderFeaturesForStyle(
                     _session.get(),
-                    *feature->style(),
+                    *f->get()->style(),
                     list,
                     buildData.get(),
                     key.getExtent(),
@@ -342,24 +344,30 @@ FeatureTileSource::getFeatures(const Query& query, const GeoExtent& imageExtent,
             // query the feature source:
             osg::ref_ptr<FeatureCursor> cursor = _features->createFeatureCursor( localQuery );
 
+            FeatureList batch;
             while( cursor.valid() && cursor->hasMore() )
             {
-                Feature* feature = cursor->nextFeature();
-                Geometry* geom = feature->getGeometry();
-                if ( geom )
+                batch.clear();
+                cursor->nextBatch( batch );
+                for( FeatureList::iterator f = batch.begin(); f != batch.end(); ++f )
                 {
-                    // apply a type override if requested:
-                    if (_options.geometryTypeOverride().isSet() &&
-                        _options.geometryTypeOverride() != geom->getComponentType() )
+                    Feature* feature = f->get();
+                    Geometry* geom = feature->getGeometry();
+                    if ( geom )
                     {
-                        geom = geom->cloneAs( _options.geometryTypeOverride().value() );
-                        if ( geom )
-                            feature->setGeometry( geom );
+                        // apply a type override if requested:
+                        if (_options.geometryTypeOverride().isSet() &&
+                            _options.geometryTypeOverride() != geom->getComponentType() )
+                        {
+                            geom = geom->cloneAs( _options.geometryTypeOverride().value() );
+                            if ( geom )
+                                feature->setGeometry( geom );
+                        }
+                    }
+                    if ( geom )
+                    {
+                        features.push_back( feature );
                     }
-                }
-                if ( geom )
-                {
-                    features.push_back( feature );
                 }
             }
 
@@ -21,14 +21,17 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/GeoData>
+#include <osgEarth/StringUtils>
 #include <osgEarthFeatures/FeatureSource>
+#include <osgDB/Registry>
+#include <osgDB/ObjectWrapper>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 #include <list>
-#include <stdio.h>
-#include <stdlib.h>
-
-#ifdef OSGEARTH_HAVE_MVT
-#include "vector_tile.pb.h"
-#endif
+#include <map>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
@@ -40,14 +43,6 @@ using namespace osgEarth::Features;
 #define CMD_LINETO 2
 #define CMD_CLOSEPATH 7
 
-// https://github.com/mapbox/mapnik-vector-tile/blob/master/examples/c%2B%2B/tileinfo.cpp
-enum CommandType {
-    SEG_END    = 0,
-    SEG_MOVETO = 1,
-    SEG_LINETO = 2,
-    SEG_CLOSE = (0x40 | 0x0f)
-};
-
 enum eGeomType {
     Unknown = 0,
     Point = 1,
@@ -55,61 +50,245 @@ enum eGeomType {
     Polygon = 3
 };
 
-int zig_zag_decode(int n)
+// Field numbers from vector_tile.proto
+#define TILE_LAYERS      3
+
+#define LAYER_NAME       1
+#define LAYER_FEATURES   2
+#define LAYER_KEYS       3
+#define LAYER_VALUES     4
+#define LAYER_EXTENT     5
+#define LAYER_VERSION    15
+
+#define FEATURE_ID       1
+#define FEATURE_TAGS     2
+#define FEATURE_TYPE     3
+#define FEATURE_GEOMETRY 4
+
+#define VALUE_STRING     1
+#define VALUE_FLOAT      2
+#define VALUE_DOUBLE     3
+#define VALUE_INT        4
+#define VALUE_UINT       5
+#define VALUE_SINT       6
+#define VALUE_BOOL       7
+
+#define WIRE_VARINT      0
+#define WIRE_FIXED64     1
+#define WIRE_BYTES       2
+#define WIRE_FIXED32     5
+
+namespace
 {
-    return (n >> 1) ^ (-(n & 1));
-}
+    int zig_zag_decode(unsigned n)
+    {
+        return (int)(n >> 1) ^ (-(int)(n & 1));
+    }
 
-#ifdef OSGEARTH_HAVE_MVT
+    unsigned zig_zag_encode(int n)
+    {
+        return ((unsigned)n << 1) ^ (unsigned)(n >> 31);
+    }
 
-Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
-{
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
+    /**
+     * Reads protocol buffer fields straight out of a memory block. Nested
+     * messages and packed arrays are handed out as readers over their own
+     * byte range, so nothing is copied until a value is actually used.
+     */
+    struct PBFReader
+    {
+        const unsigned char* _ptr;
+        const unsigned char* _end;
+        unsigned             _field;
+        unsigned             _wireType;
+        bool                 _ok;
+
+        PBFReader() : _ptr(0L), _end(0L), _field(0), _wireType(0), _ok(true) { }
+
+        PBFReader(const char* data, unsigned size) :
+            _ptr((const unsigned char*)data), _end((const unsigned char*)data + size),
+            _field(0), _wireType(0), _ok(true) { }
+
+        /** Advances to the next field; false at the end of the message or on bad data. */
+        bool next()
+        {
+            if ( !_ok || _ptr >= _end )
+                return false;
+            unsigned long long key = varint();
+            _field    = (unsigned)(key >> 3);
+            _wireType = (unsigned)(key & 7u);
+            return _ok;
+        }
+
+        unsigned long long varint()
+        {
+            unsigned long long value = 0ull;
+            for(unsigned shift = 0; shift < 64u; shift += 7u)
+            {
+                if ( _ptr >= _end )
+                    break;
+                unsigned char b = *_ptr++;
+                value |= (unsigned long long)(b & 0x7f) << shift;
+                if ( (b & 0x80) == 0 )
+                    return value;
+            }
+            _ok = false;
+            return 0ull;
+        }
+
+        /** Reader over the current length-delimited field. */
+        PBFReader message()
+        {
+            unsigned long long len = varint();
+            PBFReader sub;
+            if ( !_ok || len > (unsigned long long)(_end - _ptr) )
+            {
+                _ok = false;
+                return sub;
+            }
+            sub._ptr = _ptr;
+            sub._end = _ptr + len;
+            _ptr += len;
+            return sub;
+        }
+
+        std::string string()
+        {
+            PBFReader sub = message();
+            if ( !_ok )
+                return std::string();
+            return std::string( (const char*)sub._ptr, sub._end - sub._ptr );
+        }
+
+        double fixed64()
+        {
+            double value = 0.0;
+            if ( _end - _ptr < 8 ) { _ok = false; return value; }
+            ::memcpy( &value, _ptr, 8 );
+            _ptr += 8;
+            return value;
+        }
+
+        float fixed32()
+        {
+            float value = 0.0f;
+            if ( _end - _ptr < 4 ) { _ok = false; return value; }
+            ::memcpy( &value, _ptr, 4 );
+            _ptr += 4;
+            return value;
+        }
+
+        /** Reads the next element of a packed uint32 array. */
+        bool packed(unsigned& value)
+        {
+            if ( !_ok || _ptr >= _end )
+                return false;
+            value = (unsigned)varint();
+            return _ok;
+        }
+
+        void skip()
+        {
+            switch( _wireType )
+            {
+            case WIRE_VARINT:  varint(); break;
+            case WIRE_FIXED64: if ( _end - _ptr < 8 ) _ok = false; else _ptr += 8; break;
+            case WIRE_BYTES:   message(); break;
+            case WIRE_FIXED32: if ( _end - _ptr < 4 ) _ok = false; else _ptr += 4; break;
+            default:           _ok = false;
+            }
+        }
+    };
+
+    /** A layer's attribute value, decoded once and shared by every feature that tags it. */
+    struct TileValue
+    {
+        AttributeType type;
+        std::string   stringValue;
+        double        doubleValue;
+        int           intValue;
+        bool          boolValue;
+
+        TileValue() : type(ATTRTYPE_UNSPECIFIED), doubleValue(0.0), intValue(0), boolValue(false) { }
+    };
+
+    void readValue(PBFReader value, TileValue& out)
+    {
+        while( value.next() )
+        {
+            switch( value._field )
+            {
+            case VALUE_STRING: out.type = ATTRTYPE_STRING; out.stringValue = value.string(); break;
+            case VALUE_FLOAT:  out.type = ATTRTYPE_DOUBLE; out.doubleValue = value.fixed32(); break;
+            case VALUE_DOUBLE: out.type = ATTRTYPE_DOUBLE; out.doubleValue = value.fixed64(); break;
+            case VALUE_INT:    out.type = ATTRTYPE_INT;    out.intValue = (int)(long long)value.varint(); break;
+            case VALUE_UINT:   out.type = ATTRTYPE_INT;    out.intValue = (int)value.varint(); break;
+            case VALUE_SINT:
+                {
+                    unsigned long long n = value.varint();
+                    out.type = ATTRTYPE_INT;
+                    out.intValue = (int)((long long)(n >> 1) ^ -(long long)(n & 1));
+                }
+                break;
+            case VALUE_BOOL:   out.type = ATTRTYPE_BOOL;   out.boolValue = value.varint() != 0; break;
+            default:           value.skip();
+            }
+        }
+    }
+
+    /** Maps integer tile coordinates into the tile key's extent. */
+    struct TileTransform
+    {
+        double _xMin, _yMax, _dx, _dy;
+
+        TileTransform(const TileKey& key, unsigned tileres)
+        {
+            const GeoExtent& extent = key.getExtent();
+            _xMin = extent.xMin();
+            _yMax = extent.yMax();
+            _dx   = extent.width()  / (double)tileres;
+            _dy   = extent.height() / (double)tileres;
+        }
 
+        double x(int tx) const { return _xMin + _dx * (double)tx; }
+        double y(int ty) const { return _yMax - _dy * (double)ty; }
+    };
+}
+
+Geometry* decodeLine(PBFReader geom, const TileTransform& xform)
+{
     int x = 0;
     int y = 0;
 
     std::vector< osg::ref_ptr< osgEarth::Symbology::LineString > > lines;
     osg::ref_ptr< osgEarth::Symbology::LineString > currentLine;
 
-    for (int k = 0; k < feature.geometry_size();)
+    unsigned cmd_length;
+    while (geom.packed(cmd_length))
     {
-        if (!length)
-        {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
-        }
-        if (length > 0)
-        {
-            length--;
+        unsigned cmd = cmd_length & ((1 << CMD_BITS) - 1);
+        unsigned length = cmd_length >> CMD_BITS;
 
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+        if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
+        {
+            for (unsigned i = 0; i < length; ++i)
             {
-                if (cmd == SEG_MOVETO)
+                if (cmd == CMD_MOVETO)
                 {
                     currentLine = new osgEarth::Symbology::LineString;
                     lines.push_back( currentLine.get() );
                 }
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
-
-                x += px;
-                y += py;
 
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
+                unsigned px, py;
+                if (!geom.packed(px) || !geom.packed(py))
+                    break;
 
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
+                x += zig_zag_decode(px);
+                y += zig_zag_decode(py);
 
                 if (currentLine.valid())
                 {
-                    currentLine->push_back(geoX, geoY, 0);
+                    currentLine->push_back(xform.x(x), xform.y(y), 0);
                 }
             }
         }
@@ -138,44 +317,31 @@ Geometry* decodeLine(const mapnik::vector::tile_feature& feature, const TileKey&
     }
 }
 
-Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey& key, unsigned int tileres)
+Geometry* decodePoint(PBFReader geom, const TileTransform& xform)
 {
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
-
     int x = 0;
     int y = 0;
 
     osgEarth::Symbology::PointSet *geometry = new osgEarth::Symbology::PointSet();
 
-    for (int k = 0; k < feature.geometry_size();)
+    unsigned cmd_length;
+    while (geom.packed(cmd_length))
     {
-        if (!length)
-        {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
-        }
-        if (length > 0)
+        unsigned cmd = cmd_length & ((1 << CMD_BITS) - 1);
+        unsigned length = cmd_length >> CMD_BITS;
+
+        if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
         {
-            length--;
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+            for (unsigned i = 0; i < length; ++i)
             {
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
-
-                x += px;
-                y += py;
+                unsigned px, py;
+                if (!geom.packed(px) || !geom.packed(py))
+                    break;
 
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
+                x += zig_zag_decode(px);
+                y += zig_zag_decode(py);
 
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                geometry->push_back(geoX, geoY, 0);
+                geometry->push_back(xform.x(x), xform.y(y), 0);
             }
         }
     }
@@ -183,7 +349,7 @@ Geometry* decodePoint(const mapnik::vector::tile_feature& feature, const TileKey
     return geometry;
 }
 
-Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  TileKey& key, unsigned int tileres)
+Geometry* decodePolygon(PBFReader geom, const TileTransform& xform)
 {
     /*
      https://github.com/mapbox/vector-tile-spec/tree/master/2.1
@@ -193,11 +359,6 @@ Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  Tile
      interior ring (inner polygon of the current polygon).
      */
 
-
-    unsigned int length = 0;
-    int cmd = -1;
-    const int cmd_bits = 3;
-
     int x = 0;
     int y = 0;
 
@@ -208,77 +369,68 @@ Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  Tile
 
     osg::ref_ptr< osgEarth::Symbology::Ring > currentRing;
 
-    for (int k = 0; k < feature.geometry_size();)
+    unsigned cmd_length;
+    while (geom.packed(cmd_length))
     {
-        if (!length)
-        {
-            unsigned int cmd_length = feature.geometry(k++);
-            cmd = cmd_length & ((1 << cmd_bits) - 1);
-            length = cmd_length >> cmd_bits;
-        }
-        if (length > 0)
+        unsigned cmd = cmd_length & ((1 << CMD_BITS) - 1);
+        unsigned length = cmd_length >> CMD_BITS;
+
+        if (cmd == CMD_MOVETO || cmd == CMD_LINETO)
         {
-            length--;
-            if (cmd == SEG_MOVETO || cmd == SEG_LINETO)
+            for (unsigned i = 0; i < length; ++i)
             {
                 if (!currentRing)
                 {
                     currentRing = new osgEarth::Symbology::Ring();
                 }
 
-                int px = feature.geometry(k++);
-                int py = feature.geometry(k++);
-                px = zig_zag_decode(px);
-                py = zig_zag_decode(py);
-
-                x += px;
-                y += py;
+                unsigned px, py;
+                if (!geom.packed(px) || !geom.packed(py))
+                    break;
 
-                double width = key.getExtent().width();
-                double height = key.getExtent().height();
+                x += zig_zag_decode(px);
+                y += zig_zag_decode(py);
 
-                double geoX = key.getExtent().xMin() + (width/(double)tileres) * (double)x;
-                double geoY = key.getExtent().yMax() - (height/(double)tileres) * (double)y;
-                currentRing->push_back(geoX, geoY, 0);
+                currentRing->push_back(xform.x(x), xform.y(y), 0);
             }
-            else if (cmd == (SEG_CLOSE & ((1 << cmd_bits) - 1)))
-            {
-                // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
+        }
+        else if (cmd == CMD_CLOSEPATH && currentRing.valid())
+        {
+            // The orientation is the opposite of what we want for features.  clockwise means exterior ring, counter clockwise means interior
+
+            // Figure out what to do with the ring based on the orientation of the ring
+            Geometry::Orientation orientation = currentRing->getOrientation();
+            // Close the ring.
+            currentRing->close();
 
-                // Figure out what to do with the ring based on the orientation of the ring
-                Geometry::Orientation orientation = currentRing->getOrientation();
-                // Close the ring.
-                currentRing->close();
+            // Clockwise means exterior ring.  Start a new polygon and add the ring.
+            if (orientation == Geometry::ORIENTATION_CW)
+            {
+                // osgearth orientations are reversed from mvt
+                currentRing->rewind(Geometry::ORIENTATION_CCW);
 
-                // Clockwise means exterior ring.  Start a new polygon and add the ring.
-                if (orientation == Geometry::ORIENTATION_CW)
+                currentPolygon = new osgEarth::Symbology::Polygon(&currentRing->asVector());
+                polygons.push_back(currentPolygon.get());
+            }
+            else if (orientation == Geometry::ORIENTATION_CCW)
+            // Counter clockwise means a hole, add it to the existing polygon.
+            {
+                if (currentPolygon.valid())
                 {
                     // osgearth orientations are reversed from mvt
-                    currentRing->rewind(Geometry::ORIENTATION_CCW);
-
-                    currentPolygon = new osgEarth::Symbology::Polygon(&currentRing->asVector());
-                    polygons.push_back(currentPolygon.get());
+                    currentRing->rewind(Geometry::ORIENTATION_CW);
+                    currentPolygon->getHoles().push_back( currentRing );
                 }
-                else if (orientation == Geometry::ORIENTATION_CCW)
-                // Counter clockwise means a hole, add it to the existing polygon.
+                else
                 {
-                    if (currentPolygon.valid())
-                    {
-                        // osgearth orientations are reversed from mvt
-                        currentRing->rewind(Geometry::ORIENTATION_CW);
-                        currentPolygon->getHoles().push_back( currentRing );
-                    }
-                    else
-                    {
-                        // this means we encountered a "hole" without a parent outer ring,
-                        // discard for now -gw
-                        OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
-                    }
+                    // this means we encountered a "hole" without a parent outer ring,
+                    // discard for now -gw
+                    OE_INFO << LC << "Discarding improperly wound polygon (hole without an outer ring)\n";
                 }
-
-                // Start a new ring
-                currentRing = 0;
             }
+
+            // Start a new ring
+            currentRing = 0;
         }
     }
 
@@ -306,150 +458,487 @@ Geometry* decodePolygon(const mapnik::vector::tile_feature& feature, const  Tile
     }
 }
 
-#endif
+namespace
+{
+    void readLayer(PBFReader layer, const TileKey& key, FeatureList& features)
+    {
+        // Keys, values and features may come in any order, so collect them
+        // before building anything. Each key and value is decoded once per
+        // layer no matter how many features refer to it.
+        std::string            name;
+        unsigned               extent = 4096u;
+        std::vector<std::string> keys;
+        std::vector<TileValue> values;
+        std::vector<PBFReader> featureMessages;
+
+        while( layer.next() )
+        {
+            switch( layer._field )
+            {
+            case LAYER_NAME:     name = layer.string(); break;
+            case LAYER_FEATURES: featureMessages.push_back( layer.message() ); break;
+            case LAYER_KEYS:     keys.push_back( layer.string() ); break;
+            case LAYER_VALUES:   values.push_back( TileValue() ); readValue( layer.message(), values.back() ); break;
+            case LAYER_EXTENT:   extent = (unsigned)layer.varint(); break;
+            default:             layer.skip();
+            }
+        }
+
+        if ( !layer._ok || extent == 0u )
+        {
+            OE_WARN << LC << "Malformed layer \"" << name << "\" in tile " << key.str() << std::endl;
+            return;
+        }
+
+        TileTransform xform(key, extent);
+
+        for(unsigned j = 0; j < featureMessages.size(); ++j)
+        {
+            PBFReader feature = featureMessages[j];
+            PBFReader tags, geom;
+            eGeomType geomType = Unknown;
+
+            while( feature.next() )
+            {
+                switch( feature._field )
+                {
+                case FEATURE_TAGS:     tags = feature.message(); break;
+                case FEATURE_TYPE:     geomType = static_cast<eGeomType>(feature.varint()); break;
+                case FEATURE_GEOMETRY: geom = feature.message(); break;
+                default:               feature.skip();
+                }
+            }
+            if ( !feature._ok )
+                continue;
+
+            osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
+
+            // Set the layer name as "mvt_layer" so we can filter it later
+            oeFeature->set("mvt_layer", name);
+
+            // Read attributes
+            unsigned k, v;
+            while (tags.packed(k) && tags.packed(v))
+            {
+                if (k >= keys.size() || v >= values.size())
+                    continue;
+
+                const std::string& attrName = keys[k];
+                const TileValue& value = values[v];
+
+                switch( value.type )
+                {
+                case ATTRTYPE_STRING: oeFeature->set(attrName, value.stringValue); break;
+                case ATTRTYPE_DOUBLE: oeFeature->set(attrName, value.doubleValue); break;
+                case ATTRTYPE_INT:    oeFeature->set(attrName, value.intValue); break;
+                case ATTRTYPE_BOOL:   oeFeature->set(attrName, value.boolValue); break;
+                default: break;
+                }
+
+                // Special path for getting heights from our test dataset.
+                if (attrName == "other_tags")
+                {
+                    StringTokenizer tok("=>");
+                    StringVector tized;
+                    tok.tokenize(value.stringValue, tized);
+                    if (tized.size() == 3)
+                    {
+                        if (tized[0] == "height")
+                        {
+                            // Remove quotes from the height
+                            float height = as<float>(tized[2], FLT_MAX);
+                            if (height != FLT_MAX)
+                            {
+                                oeFeature->set("height", height);
+                            }
+                        }
+                    }
+                }
+            }
+
+            osg::ref_ptr< osgEarth::Symbology::Geometry > geometry;
+
+            if (geomType == ::Polygon)
+            {
+                geometry = decodePolygon(geom, xform);
+            }
+            else if (geomType == ::Point)
+            {
+                geometry = decodePoint(geom, xform);
+            }
+            else
+            {
+                geometry = decodeLine(geom, xform);
+            }
+
+            if (geometry)
+            {
+                oeFeature->setGeometry( geometry );
+                features.push_back(oeFeature.get());
+            }
+        }
+    }
 
+    /** True if the buffer starts with a gzip or zlib header. */
+    bool isCompressed(const unsigned char* data, unsigned size)
+    {
+        if ( size < 2u )
+            return false;
+        if ( data[0] == 0x1f && data[1] == 0x8b )
+            return true;
+        return (data[0] & 0x0f) == 8 && ((data[0] << 8) | data[1]) % 31 == 0;
+    }
+}
+
+bool
+MVT::read(std::istream& in, const TileKey& key, FeatureList& features)
+{
+    std::string buffer((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return read(buffer.data(), buffer.size(), key, features);
+}
 
 bool
-    MVT::read(std::istream& in, const TileKey& key, FeatureList& features)
+MVT::read(const char* data, unsigned size, const TileKey& key, FeatureList& features)
 {
     features.clear();
 
-#ifdef OSGEARTH_HAVE_MVT
+    std::string inflated;
+    if (isCompressed((const unsigned char*)data, size))
+    {
+        // Get the compressor
+        osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
+        if (!compressor.valid())
+        {
+            return false;
+        }
+
+        std::istringstream in(std::string(data, size));
+        if (compressor->decompress(in, inflated))
+        {
+            data = inflated.data();
+            size = inflated.size();
+        }
+    }
 
-    // Get the compressor
-    osg::ref_ptr< osgDB::BaseCompressor> compressor = osgDB::Registry::instance()->getObjectWrapperManager()->findCompressor("zlib");
-    if (!compressor.valid())
+    PBFReader tile(data, size);
+    while (tile.next())
     {
-        return false;
+        if (tile._field == TILE_LAYERS)
+            readLayer(tile.message(), key, features);
+        else
+            tile.skip();
     }
 
-    // Decompress the tile
-    std::string original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    in.seekg (0, std::ios::beg);
-    std::string value;
-    if (!compressor->decompress(in, value))
+    if (!tile._ok)
     {
-        value = original;
+        OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
+        return false;
     }
 
+    return true;
+}
+
+//........................................................................
+
+namespace
+{
+    /** Appends protocol buffer fields to a string. */
+    struct PBFWriter
+    {
+        std::string _buf;
+
+        void varint(unsigned long long value)
+        {
+            while( value >= 0x80 )
+            {
+                _buf.push_back( (char)((value & 0x7f) | 0x80) );
+                value >>= 7;
+            }
+            _buf.push_back( (char)value );
+        }
+
+        void key(unsigned field, unsigned wireType)
+        {
+            varint( (field << 3) | wireType );
+        }
 
-    mapnik::vector::tile tile;
+        void uintField(unsigned field, unsigned long long value)
+        {
+            key( field, WIRE_VARINT );
+            varint( value );
+        }
+
+        void bytesField(unsigned field, const std::string& value)
+        {
+            key( field, WIRE_BYTES );
+            varint( value.size() );
+            _buf.append( value );
+        }
 
-    if (tile.ParseFromString(value))
+        void doubleField(unsigned field, double value)
+        {
+            key( field, WIRE_FIXED64 );
+            char bytes[8];
+            ::memcpy( bytes, &value, 8 );
+            _buf.append( bytes, 8 );
+        }
+
+        void packedField(unsigned field, const std::vector<unsigned>& values)
+        {
+            PBFWriter packed;
+            for(unsigned i=0; i<values.size(); ++i)
+                packed.varint( values[i] );
+            bytesField( field, packed._buf );
+        }
+    };
+
+    typedef std::vector< std::pair<int,int> > TilePoints;
+
+    /** Encodes geometry commands relative to a cursor that carries over between parts. */
+    struct GeometryEncoder
     {
-        for (unsigned int i = 0; i < tile.layers().size(); i++)
+        std::vector<unsigned>& _commands;
+        int _x, _y;
+
+        GeometryEncoder(std::vector<unsigned>& commands) : _commands(commands), _x(0), _y(0) { }
+
+        void command(unsigned cmd, unsigned count)
         {
-            const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
+            _commands.push_back( (count << CMD_BITS) | cmd );
+        }
 
+        void moveTo(const std::pair<int,int>& p)
+        {
+            _commands.push_back( zig_zag_encode(p.first - _x) );
+            _commands.push_back( zig_zag_encode(p.second - _y) );
+            _x = p.first;
+            _y = p.second;
+        }
 
-            for (unsigned int j = 0; j < layer.features().size(); j++)
+        void points(const TilePoints& pts)
+        {
+            if ( pts.empty() ) return;
+            command( CMD_MOVETO, pts.size() );
+            for(unsigned i=0; i<pts.size(); ++i)
+                moveTo( pts[i] );
+        }
+
+        void line(const TilePoints& pts)
+        {
+            if ( pts.size() < 2 ) return;
+            command( CMD_MOVETO, 1 );
+            moveTo( pts[0] );
+            command( CMD_LINETO, pts.size()-1 );
+            for(unsigned i=1; i<pts.size(); ++i)
+                moveTo( pts[i] );
+        }
+
+        /** Writes a ring wound so its area in tile space is positive for exteriors, negative for holes. */
+        void ring(TilePoints& pts, bool exterior)
+        {
+            if ( pts.size() > 1 && pts.front() == pts.back() )
+                pts.pop_back();
+            if ( pts.size() < 3 )
+                return;
+
+            long long area = 0;
+            for(unsigned i=0; i<pts.size(); ++i)
             {
-                const mapnik::vector::tile_feature &feature = layer.features().Get(j);
+                const std::pair<int,int>& a = pts[i];
+                const std::pair<int,int>& b = pts[(i+1) % pts.size()];
+                area += (long long)a.first * b.second - (long long)b.first * a.second;
+            }
+            if ( area == 0 )
+                return;
+            if ( (area > 0) != exterior )
+                std::reverse( pts.begin(), pts.end() );
 
+            line( pts );
+            command( CMD_CLOSEPATH, 1 );
+        }
+    };
 
-                osg::ref_ptr< Feature > oeFeature = new Feature(0, key.getProfile()->getSRS());
+    /** Converts a part's points into tile coordinates, dropping repeats. */
+    void toTile(const Geometry* part, const SpatialReference* fromSRS, const SpatialReference* toSRS,
+                const GeoExtent& extent, unsigned tileres, TilePoints& out)
+    {
+        std::vector<osg::Vec3d> points( part->begin(), part->end() );
+        if ( fromSRS && toSRS && !fromSRS->isHorizEquivalentTo(toSRS) )
+            fromSRS->transform( points, toSRS );
 
-                // Set the layer name as "mvt_layer" so we can filter it later
-                oeFeature->set("mvt_layer", layer.name());
+        double sx = (double)tileres / extent.width();
+        double sy = (double)tileres / extent.height();
 
-                // Read attributes
-                for (unsigned int k = 0; k < feature.tags().size(); k+=2)
-                {
-                    std::string key = layer.keys().Get(feature.tags().Get(k));
-                    mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
+        out.clear();
+        for(unsigned i=0; i<points.size(); ++i)
+        {
+            std::pair<int,int> p(
+                (int)floor((points[i].x() - extent.xMin()) * sx + 0.5),
+                (int)floor((extent.yMax() - points[i].y()) * sy + 0.5) );
+            if ( out.empty() || out.back() != p )
+                out.push_back( p );
+        }
+    }
 
-                    if (value.has_bool_value())
-                    {
-                        oeFeature->set(key, value.bool_value());
-                    }
-                    else if (value.has_double_value())
-                    {
-                        oeFeature->set(key, value.double_value());
-                    }
-                    else if (value.has_float_value())
-                    {
-                        oeFeature->set(key, value.float_value());
-                    }
-                    else if (value.has_int_value())
-                    {
-                        oeFeature->set(key, (int)value.int_value());
-                    }
-                    else if (value.has_sint_value())
-                    {
-                        oeFeature->set(key, (int)value.sint_value());
-                    }
-                    else if (value.has_string_value())
-                    {
-                        oeFeature->set(key, value.string_value());
-                    }
-                    else if (value.has_uint_value())
-                    {
-                        oeFeature->set(key, (int)value.uint_value());
-                    }
+    std::string encodeValue(const AttributeValue& value)
+    {
+        PBFWriter w;
+        switch( value.first )
+        {
+        case ATTRTYPE_STRING: w.bytesField( VALUE_STRING, value.getString() ); break;
+        case ATTRTYPE_DOUBLE: w.doubleField( VALUE_DOUBLE, value.getDouble() ); break;
+        case ATTRTYPE_INT:    w.uintField( VALUE_SINT, zig_zag_encode(value.getInt()) ); break;
+        case ATTRTYPE_BOOL:   w.uintField( VALUE_BOOL, value.getBool() ? 1u : 0u ); break;
+        default: break;
+        }
+        return w._buf;
+    }
 
-                    // Special path for getting heights from our test dataset.
-                    if (key == "other_tags")
-                    {
-                        std::string other_tags = value.string_value();
+    /** Builds one layer, interning its keys and values as features are added. */
+    struct LayerEncoder
+    {
+        std::string                     _name;
+        PBFWriter                       _features;
+        std::vector<std::string>        _keys;
+        std::map<std::string, unsigned> _keyIndex;
+        std::vector<std::string>        _values;
+        std::map<std::string, unsigned> _valueIndex;
+
+        unsigned intern(const std::string& s, std::vector<std::string>& list, std::map<std::string, unsigned>& index)
+        {
+            std::map<std::string, unsigned>::iterator i = index.find(s);
+            if ( i != index.end() )
+                return i->second;
+            index[s] = list.size();
+            list.push_back( s );
+            return list.size()-1;
+        }
 
-                        StringTokenizer tok("=>");
-                        StringVector tized;
-                        tok.tokenize(other_tags, tized);
-                        if (tized.size() == 3)
-                        {
-                            if (tized[0] == "height")
-                            {
-                                std::string value = tized[2];
-                                // Remove quotes from the height
-                                float height = as<float>(value, FLT_MAX);
-                                if (height != FLT_MAX)
-                                {
-                                    oeFeature->set("height", height);
-                                }
-                            }
-                        }
-                    }
-                }
+        void add(const Feature* feature, const TileKey& key, unsigned tileres)
+        {
+            const Geometry* geom = feature->getGeometry();
+            if ( !geom || !geom->isValid() )
+                return;
 
+            eGeomType type;
+            switch( geom->getComponentType() )
+            {
+            case Geometry::TYPE_POINTSET:   type = ::Point; break;
+            case Geometry::TYPE_LINESTRING: type = ::LineString; break;
+            case Geometry::TYPE_RING:
+            case Geometry::TYPE_POLYGON:    type = ::Polygon; break;
+            default: return;
+            }
 
+            const SpatialReference* fromSRS = feature->getSRS();
+            const SpatialReference* toSRS   = key.getProfile()->getSRS();
+            const GeoExtent&        extent  = key.getExtent();
 
-                osg::ref_ptr< osgEarth::Symbology::Geometry > geometry;
+            std::vector<unsigned> commands;
+            GeometryEncoder encoder(commands);
+            TilePoints pts;
 
-                eGeomType geomType = static_cast<eGeomType>(feature.type());
-                if (geomType == ::Polygon)
-                {
-                    geometry = decodePolygon(feature, key, layer.extent());
-                }
-                else if (geomType == ::LineString)
+            ConstGeometryIterator parts(geom, false);
+            while( parts.hasMore() )
+            {
+                const Geometry* part = parts.next();
+                toTile( part, fromSRS, toSRS, extent, tileres, pts );
+
+                if ( type == ::Point )
                 {
-                    geometry = decodeLine(feature, key, layer.extent());
+                    encoder.points( pts );
                 }
-                else if (geomType == ::Point)
+                else if ( type == ::LineString )
                 {
-                    geometry = decodePoint(feature, key, layer.extent());
+                    encoder.line( pts );
                 }
                 else
                 {
-                    geometry = decodeLine(feature, key, layer.extent());
+                    encoder.ring( pts, true );
+                    const Symbology::Polygon* poly = dynamic_cast<const Symbology::Polygon*>(part);
+                    if ( poly )
+                    {
+                        for(RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h)
+                        {
+                            toTile( h->get(), fromSRS, toSRS, extent, tileres, pts );
+                            encoder.ring( pts, false );
+                        }
+                    }
                 }
+            }
 
-                if (geometry)
-                {
-                    oeFeature->setGeometry( geometry );
-                    features.push_back(oeFeature.get());
-                }
+            if ( commands.empty() )
+                return;
+
+            std::vector<unsigned> tags;
+            const AttributeTable& attrs = feature->getAttrs();
+            for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+            {
+                if ( !a->second.second.set || a->first == "mvt_layer" )
+                    continue;
+                std::string value = encodeValue(a->second);
+                if ( value.empty() )
+                    continue;
+                tags.push_back( intern(a->first, _keys, _keyIndex) );
+                tags.push_back( intern(value, _values, _valueIndex) );
             }
+
+            PBFWriter f;
+            if ( feature->getFID() != 0 )
+                f.uintField( FEATURE_ID, feature->getFID() );
+            if ( !tags.empty() )
+                f.packedField( FEATURE_TAGS, tags );
+            f.uintField( FEATURE_TYPE, type );
+            f.packedField( FEATURE_GEOMETRY, commands );
+
+            _features.bytesField( LAYER_FEATURES, f._buf );
         }
-    }
-    else
-    {
-        OE_WARN << "Failed to parse mvt" << key.str() << std::endl;
+
+        std::string finish(unsigned tileres)
+        {
+            PBFWriter layer;
+            layer.uintField( LAYER_VERSION, 2u );
+            layer.bytesField( LAYER_NAME, _name );
+            layer._buf.append( _features._buf );
+            for(unsigned i=0; i<_keys.size(); ++i)
+                layer.bytesField( LAYER_KEYS, _keys[i] );
+            for(unsigned i=0; i<_values.size(); ++i)
+                layer.bytesField( LAYER_VALUES, _values[i] );
+            layer.uintField( LAYER_EXTENT, tileres );
+            return layer._buf;
+        }
+    };
+}
+
+bool
+MVT::write(std::ostream& out, const TileKey& key, const FeatureList& features, unsigned extent)
+{
+    if ( !key.valid() || extent == 0u )
         return false;
+
+    // layers in the order their names first appear:
+    std::list<LayerEncoder> layers;
+    std::map<std::string, LayerEncoder*> layerIndex;
+
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        const Feature* feature = i->get();
+        std::string name = feature->hasAttr("mvt_layer") ? feature->getString("mvt_layer") : "features";
+
+        LayerEncoder*& layer = layerIndex[name];
+        if ( !layer )
+        {
+            layers.push_back( LayerEncoder() );
+            layer = &layers.back();
+            layer->_name = name;
+        }
+        layer->add( feature, key, extent );
     }
 
-    return true;
-#else
-    OE_NOTICE << "Mapnik Vector Tiles NOT SUPPORTED - please compile osgEarth with protobuf to enable." << std::endl;
-    return false;
-#endif
+    PBFWriter tile;
+    for(std::list<LayerEncoder>::iterator i = layers.begin(); i != layers.end(); ++i)
+        tile.bytesField( TILE_LAYERS, i->finish(extent) );
+
+    out.write( tile._buf.data(), tile._buf.size() );
+    return out.good();
 }
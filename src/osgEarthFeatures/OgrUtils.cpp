@@ -272,7 +272,7 @@ OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile)
     Feature* f = 0L;
     if ( profile )
     {
-        f = createFeature( handle, profile->getSRS() );
+        f = createFeature( handle, profile->getSRS(), profile->getSchemaIndex() );
         if ( f && profile->geoInterp().isSet() )
             f->geoInterp() = profile->geoInterp().get();
     }
@@ -284,7 +284,7 @@ OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile)
 }            
 
 Feature*
-OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
+OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, FeatureSchemaIndex* schemaIndex )
 {
     long fid = OGR_F_GetFID( handle );
 
@@ -298,6 +298,8 @@ OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
     }
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
+    if ( schemaIndex )
+        feature->setSchemaIndex( schemaIndex );
 
     int numAttrs = OGR_F_GetFieldCount(handle); 
     for (int i = 0; i < numAttrs; ++i) 
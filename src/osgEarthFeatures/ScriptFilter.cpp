@@ -87,10 +87,25 @@ ScriptFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
+    // features without geometry are dropped without running the script,
+    // as in push(Feature*).
     for( FeatureList::iterator i = input.begin(); i != input.end(); )
     {
-        if ( push( i->get(), context ) )
+        if ( i->get() && i->get()->getGeometry() )
+            ++i;
+        else
+            i = input.erase(i);
+    }
+
+    // run the expression over the whole list at once, so the engine
+    // only has to prepare it one time.
+    std::vector<ScriptResult> results;
+    _engine->run(_expression.get(), input, results, &context);
+
+    unsigned n = 0;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++n )
+    {
+        if ( n < results.size() && results[n].asBool() )
         {
             ++i;
         }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/SubstituteModelFilter>
+#include <osgEarthFeatures/CompiledExpression>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
 #include <osgEarthFeatures/Session>
 #include <osgEarthFeatures/GeometryUtils>
@@ -137,25 +138,38 @@ SubstituteModelFilter::process(const FeatureList&           features,
     // keep track of failed URIs so we don't waste time or warning messages on them
     std::set< URI > missing;
 
-    StringExpression  uriEx    = *symbol->url();
-    NumericExpression scaleEx  = *symbol->scale();
+    // compile the symbol's expressions once for all the features.
+    const FeatureSchemaIndex* schemaIndex = context.profile() ? context.profile()->getSchemaIndex() : 0L;
+
+    CompiledStringExpression  uriEx  ( *symbol->url(), schemaIndex );
+    CompiledNumericExpression scaleEx( *symbol->scale(), schemaIndex );
+
+    CompiledStringExpression scriptEx;
+    if ( symbol->script().isSet() )
+        scriptEx = CompiledStringExpression( *symbol->script(), schemaIndex );
+
+    CompiledStringExpression featureNameEx;
+    if ( !_featureNameExpr.empty() )
+        featureNameEx = CompiledStringExpression( _featureNameExpr, schemaIndex );
 
     const ModelSymbol* modelSymbol = dynamic_cast<const ModelSymbol*>(symbol);
     const IconSymbol*  iconSymbol  = dynamic_cast<const IconSymbol*> (symbol);
 
-    NumericExpression headingEx;    
-    NumericExpression scaleXEx;
-    NumericExpression scaleYEx;
-    NumericExpression scaleZEx;
+    CompiledNumericExpression headingEx;
+    CompiledNumericExpression scaleXEx;
+    CompiledNumericExpression scaleYEx;
+    CompiledNumericExpression scaleZEx;
 
     if ( modelSymbol )
     {
-        headingEx = *modelSymbol->heading();
-        scaleXEx  = *modelSymbol->scaleX();
-        scaleYEx  = *modelSymbol->scaleY();
-        scaleZEx  = *modelSymbol->scaleZ();
+        headingEx = CompiledNumericExpression( *modelSymbol->heading(), schemaIndex );
+        scaleXEx  = CompiledNumericExpression( *modelSymbol->scaleX(), schemaIndex );
+        scaleYEx  = CompiledNumericExpression( *modelSymbol->scaleY(), schemaIndex );
+        scaleZEx  = CompiledNumericExpression( *modelSymbol->scaleZ(), schemaIndex );
     }
 
+    std::string st, scriptResult;
+
     for( FeatureList::const_iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -163,16 +177,15 @@ SubstituteModelFilter::process(const FeatureList&           features,
         // Run a feature pre-processing script.
         if ( symbol->script().isSet() )
         {
-            StringExpression scriptExpr(symbol->script().get());
-            input->eval( scriptExpr, &context );
+            scriptEx.eval( input, scriptResult, &context );
         }
 
 		// evaluate the instance URI expression:
-		const std::string& st = input->eval(uriEx, &context);
+		uriEx.eval( input, st, &context );
 		URI& instanceURI = uriCache[st];
 		if(instanceURI.empty()) // Create a map, to reuse URI's, since they take a long time to create
 		{
-			instanceURI = URI( st, uriEx.uriContext() );
+			instanceURI = URI( st, uriEx.expression().uriContext() );
 		}
 
         // find the corresponding marker in the cache
@@ -186,22 +199,22 @@ SubstituteModelFilter::process(const FeatureList&           features,
         osg::Matrixd scaleMatrix;
         if ( symbol->scale().isSet() )
         {
-            scale = input->eval( scaleEx, &context );
+            scale = scaleEx.eval( input, &context );
             scaleVec.set(scale, scale, scale);
         }
         if ( modelSymbol )
         {
             if ( modelSymbol->scaleX().isSet() )
             {
-                scaleVec.x() *= input->eval( scaleXEx, &context );
+                scaleVec.x() *= scaleXEx.eval( input, &context );
             }
             if ( modelSymbol->scaleY().isSet() )
             {
-                scaleVec.y() *= input->eval( scaleYEx, &context );
+                scaleVec.y() *= scaleYEx.eval( input, &context );
             }
             if ( modelSymbol->scaleZ().isSet() )
             {
-                scaleVec.z() *= input->eval( scaleZEx, &context );
+                scaleVec.z() *= scaleZEx.eval( input, &context );
             }
         }
 
@@ -214,7 +227,7 @@ SubstituteModelFilter::process(const FeatureList&           features,
         osg::Matrixd rotationMatrix;
         if ( modelSymbol && modelSymbol->heading().isSet() )
         {
-            float heading = input->eval(headingEx, &context);
+            float heading = headingEx.eval( input, &context );
             rotationMatrix.makeRotate( osg::Quat(osg::DegreesToRadians(heading), osg::Vec3(0,0,1)) );
         }
 
@@ -270,22 +283,22 @@ SubstituteModelFilter::process(const FeatureList&           features,
                     osg::Matrixd scaleMatrix;
                     if ( symbol->scale().isSet() )
                     {
-                        scale = input->eval( scaleEx, &context );
+                        scale = scaleEx.eval( input, &context );
                         scaleVec.set(scale, scale, scale);
                     }
                     if ( modelSymbol )
                     {
                         if ( modelSymbol->scaleX().isSet() )
                         {
-                            scaleVec.x() *= input->eval( scaleXEx, &context );
+                            scaleVec.x() *= scaleXEx.eval( input, &context );
                         }
                         if ( modelSymbol->scaleY().isSet() )
                         {
-                            scaleVec.y() *= input->eval( scaleYEx, &context );
+                            scaleVec.y() *= scaleYEx.eval( input, &context );
                         }
                         if ( modelSymbol->scaleZ().isSet() )
                         {
-                            scaleVec.z() *= input->eval( scaleZEx, &context );
+                            scaleVec.z() *= scaleZEx.eval( input, &context );
                         }
                     }
 
@@ -297,7 +310,7 @@ SubstituteModelFilter::process(const FeatureList&           features,
 
                     if ( modelSymbol->heading().isSet() )
                     {
-                        float heading = input->eval(headingEx, &context);
+                        float heading = headingEx.eval( input, &context );
                         rotationMatrix.makeRotate( osg::Quat(osg::DegreesToRadians(heading), osg::Vec3(0,0,1)) );
                     }
 
@@ -331,7 +344,8 @@ SubstituteModelFilter::process(const FeatureList&           features,
                     // name the feature if necessary
                     if ( !_featureNameExpr.empty() )
                     {
-                        const std::string& name = input->eval( _featureNameExpr, &context);
+                        std::string name;
+                        featureNameEx.eval( input, name, &context );
                         if ( !name.empty() )
                             xform->setName( name );
                     }
@@ -54,6 +54,37 @@ namespace
             return _lastFeatureReturned.get();
         }
 
+        unsigned nextBatch( FeatureList& output, unsigned max )
+        {
+            unsigned count = 0;
+            FeatureList batch;
+
+            while ( count < max && _nextFeature.valid() )
+            {
+                output.push_back( _nextFeature.get() );
+                ++count;
+                _nextFeature = 0L;
+
+                // drain the current source in batches, then look ahead again:
+                while ( count < max && _si_cursor.valid() && _si_cursor->hasMore() )
+                {
+                    batch.clear();
+                    _si_cursor->nextBatch( batch, max - count );
+                    for( FeatureList::iterator i = batch.begin(); i != batch.end(); ++i )
+                    {
+                        if ( !_si->_predicate.valid() || _si->_predicate->acceptFeature( i->get() ) )
+                        {
+                            output.push_back( i->get() );
+                            ++count;
+                        }
+                    }
+                }
+
+                advance();
+            }
+            return count;
+        }
+
     private:
         // pulls the next feature (in advance) in preparation for the next
         // call to nextFeature.
@@ -30,7 +30,8 @@ using namespace osgEarth::Symbology;
 
 NumericExpression::NumericExpression() :
 _value(0.0),
-_dirty(true)
+_dirty(true),
+_stackSize(0u)
 {
     //nop
 }
@@ -38,7 +39,8 @@ _dirty(true)
 NumericExpression::NumericExpression( const std::string& expr ) : 
 _src  ( expr ),
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_stackSize( 0u )
 {
     init();
 }
@@ -48,14 +50,16 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_stackSize( rhs._stackSize )
 {
     //nop
 }
 
 NumericExpression::NumericExpression( double staticValue ) :
 _value( staticValue ),
-_dirty( false )
+_dirty( false ),
+_stackSize( 0u )
 {
     _src = Stringify() << staticValue;
     init();
@@ -63,7 +67,8 @@ _dirty( false )
 
 NumericExpression::NumericExpression( const Config& conf ) :
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_stackSize( 0u )
 {
     mergeConfig( conf );
     init();
@@ -264,6 +269,17 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    // size the evaluation stack once, so eval() never has to grow it.
+    unsigned depth = 0u;
+    _stackSize = 0u;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        if ( _rpn[i].first == OPERAND || _rpn[i].first == VARIABLE )
+            _stackSize = std::max( _stackSize, ++depth );
+        else if ( depth >= 2u )
+            --depth;
+    }
 }
 
 void 
@@ -282,86 +298,71 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
+        const_cast<NumericExpression*>(this)->_value = evalRPN( 0L );
+        const_cast<NumericExpression*>(this)->_dirty = false;
+    }
+
+    return !osg::isNaN( _value ) ? _value : 0.0;
+}
+
+double
+NumericExpression::eval( const double* values ) const
+{
+    double value = evalRPN( values );
+    return !osg::isNaN( value ) ? value : 0.0;
+}
+
+#define MAX_FIXED_STACK 32u
+
+double
+NumericExpression::evalRPN( const double* values ) const
+{
+    // short expressions evaluate on a fixed array; only very long ones need the heap.
+    double fixed[MAX_FIXED_STACK];
+    std::vector<double> heap;
+    double* s = fixed;
+    if ( _stackSize > MAX_FIXED_STACK )
+    {
+        heap.resize( _stackSize );
+        s = &heap[0];
+    }
+
+    unsigned n = 0u;   // stack depth
+    unsigned v = 0u;   // next variable, in the order of _vars
 
-        for( unsigned i=0; i<_rpn.size(); ++i )
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        const Atom& a = _rpn[i];
+
+        if ( a.first == OPERAND )
+        {
+            s[n++] = a.second;
+        }
+        else if ( a.first == VARIABLE )
+        {
+            s[n++] = values ? values[v] : a.second;
+            ++v;
+        }
+        else if ( n >= 2u )
         {
-            const Atom& a = _rpn[i];
+            double  op2 = s[--n];
+            double& op1 = s[n-1];
 
-            if ( a.first == ADD )
+            switch( a.first )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::min(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::max(op1, op2) );
-                }
-            }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
+            case ADD:  op1 = op1 + op2; break;
+            case SUB:  op1 = op1 - op2; break;
+            case MULT: op1 = op1 * op2; break;
+            case DIV:  op1 = op1 / op2; break;
+            case MOD:  op1 = fmod(op1, op2); break;
+            case MIN:  op1 = std::min(op1, op2); break;
+            case MAX:  op1 = std::max(op1, op2); break;
+            default:   break;
             }
         }
-
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
-        const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
-    return !osg::isNaN( _value ) ? _value : 0.0;
+    return n > 0u ? s[n-1] : 0.0;
 }
 
 //------------------------------------------------------------------------
@@ -413,6 +414,9 @@ StringExpression::setLiteral( const std::string& expr )
     _src = "\"" + expr + "\"";
     _value = expr;
     _dirty = false;
+    _vars.clear();
+    _infix.clear();
+    _infix.push_back( Atom(OPERAND, expr) );
 }
 
 StringExpression::StringExpression( const Config& conf )
@@ -440,6 +444,9 @@ StringExpression::getConfig() const
 void
 StringExpression::init()
 {
+    _vars.clear();
+    _infix.clear();
+
     bool inQuotes = false;
     int inVar = 0;
     int startPos = 0;
@@ -550,17 +557,31 @@ StringExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stringstream buf;
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
     return _value;
 }
 
+void
+StringExpression::eval( const std::string* values, std::string& output ) const
+{
+    output.clear();
+    unsigned v = 0u;
+    for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
+    {
+        if ( i->first == VARIABLE )
+            output.append( values[v++] );
+        else
+            output.append( i->second );
+    }
+}
+
 URI
 StringExpression::evalURI() const
 {
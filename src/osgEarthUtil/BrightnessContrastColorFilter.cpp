@@ -129,3 +129,24 @@ BrightnessContrastColorFilter::getConfig() const
     conf.add( "c", val[1] );
     return conf;
 }
+
+void
+BrightnessContrastColorFilter::applyToSpan(osg::Vec4f* pixels, unsigned count) const
+{
+    // ((color - 0.5) * contrast + 0.5) * brightness, folded into a single
+    // multiply-add per component. Alpha passes through with scale 1, bias 0.
+    const osg::Vec2f bc = getBrightnessContrast();
+    const float b = bc[0], c = bc[1];
+    const float scale[4] = { c*b, c*b, c*b, 1.0f };
+    const float bias[4]  = { (0.5f-0.5f*c)*b, (0.5f-0.5f*c)*b, (0.5f-0.5f*c)*b, 0.0f };
+
+    float* p = count > 0 ? pixels->ptr() : 0L;
+    for (unsigned i = 0; i < count; ++i, p += 4)
+    {
+        for (unsigned k = 0; k < 4; ++k)
+        {
+            float v = p[k]*scale[k] + bias[k];
+            p[k] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+        }
+    }
+}
@@ -190,3 +190,22 @@ CMYKColorFilter::getConfig() const
     conf.add( "k", val[3] );
     return conf;
 }
+
+void
+CMYKColorFilter::applyToSpan(osg::Vec4f* pixels, unsigned count) const
+{
+    // color.rgb = clamp(color.rgb - cmy - k, 0, 1). The alpha lane gets a zero
+    // offset so the loop runs branch-free over every component.
+    const osg::Vec4f cmyk = getCMYKOffset();
+    const float offset[4] = { -cmyk[0]-cmyk[3], -cmyk[1]-cmyk[3], -cmyk[2]-cmyk[3], 0.0f };
+
+    float* p = count > 0 ? pixels->ptr() : 0L;
+    for (unsigned i = 0; i < count; ++i, p += 4)
+    {
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            float v = p[c] + offset[c];
+            p[c] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+        }
+    }
+}
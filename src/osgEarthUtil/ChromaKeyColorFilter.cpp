@@ -161,3 +161,21 @@ ChromaKeyColorFilter::getConfig() const
 
     return conf;
 }
+
+void
+ChromaKeyColorFilter::applyToSpan(osg::Vec4f* pixels, unsigned count) const
+{
+    // if (distance(color.rgb, key) <= threshold) color.a = 0; compared
+    // squared to keep the square root out of the loop.
+    const osg::Vec3f key = getColor();
+    const float threshold = getDistance();
+    const float threshold2 = threshold * threshold;
+
+    float* p = count > 0 ? pixels->ptr() : 0L;
+    for (unsigned i = 0; i < count; ++i, p += 4)
+    {
+        float dr = p[0]-key[0], dg = p[1]-key[1], db = p[2]-key[2];
+        float d2 = dr*dr + dg*dg + db*db;
+        p[3] = (threshold >= 0.0f && d2 <= threshold2) ? 0.0f : p[3];
+    }
+}
@@ -27,6 +27,7 @@
 #include <osgEarth/ThreadingUtils>
 #include <osg/Program>
 #include <OpenThreads/Atomic>
+#include <cmath>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -151,3 +152,23 @@ GammaColorFilter::getConfig() const
     }
     return conf;
 }
+
+void
+GammaColorFilter::applyToSpan(osg::Vec4f* pixels, unsigned count) const
+{
+    // color.rgb = pow(color.rgb, 1/gamma); channels with unit gamma are skipped.
+    const osg::Vec3f gamma = getGamma();
+
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        if (gamma[c] == 1.0f || count == 0)
+            continue;
+
+        const float inv = 1.0f / gamma[c];
+        float* p = pixels->ptr() + c;
+        for (unsigned i = 0; i < count; ++i, p += 4)
+        {
+            *p = *p > 0.0f ? powf(*p, inv) : 0.0f;
+        }
+    }
+}
@@ -25,6 +25,7 @@
 #include <osgEarth/ThreadingUtils>
 #include <osg/Program>
 #include <OpenThreads/Atomic>
+#include <osg/Math>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -263,3 +264,81 @@ HSLColorFilter::getConfig() const
     conf.add( "l", hsl[2] );
     return conf;
 }
+
+namespace
+{
+    // CPU ports of the oe_hsl_* shader functions above.
+    void RGB_2_HSL(float r, float g, float b, float& h, float& s, float& l)
+    {
+        float var_Min = osg::minimum(r, osg::minimum(g, b));
+        float var_Max = osg::maximum(r, osg::maximum(g, b));
+        float del_Max = var_Max - var_Min;
+
+        l = (var_Max + var_Min) / 2.0f;
+
+        if (del_Max == 0.0f)
+        {
+            h = 0.0f;
+            s = 0.0f;
+        }
+        else
+        {
+            if (l < 0.5f) s = del_Max / (var_Max + var_Min);
+            else          s = del_Max / (2.0f - var_Max - var_Min);
+
+            float del_R = (((var_Max - r) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+            float del_G = (((var_Max - g) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+            float del_B = (((var_Max - b) / 6.0f) + (del_Max / 2.0f)) / del_Max;
+            if      (r == var_Max) h = del_B - del_G;
+            else if (g == var_Max) h = (1.0f / 3.0f) + del_R - del_B;
+            else                   h = (2.0f / 3.0f) + del_G - del_R;
+            if (h < 0.0f) h += 1.0f;
+            if (h > 1.0f) h -= 1.0f;
+        }
+    }
+
+    float Hue_2_RGB(float v1, float v2, float vH)
+    {
+        if (vH < 0.0f) vH += 1.0f;
+        if (vH > 1.0f) vH -= 1.0f;
+        if ((6.0f * vH) < 1.0f) return v1 + (v2 - v1) * 6.0f * vH;
+        if ((2.0f * vH) < 1.0f) return v2;
+        if ((3.0f * vH) < 2.0f) return v1 + (v2 - v1) * ((2.0f / 3.0f) - vH) * 6.0f;
+        return v1;
+    }
+
+    void HSL_2_RGB(float h, float s, float l, float& r, float& g, float& b)
+    {
+        if (s == 0.0f)
+        {
+            r = g = b = l;
+        }
+        else
+        {
+            float var_2 = l < 0.5f ? l * (1.0f + s) : (l + s) - (s * l);
+            float var_1 = 2.0f * l - var_2;
+            r = Hue_2_RGB(var_1, var_2, h + (1.0f / 3.0f));
+            g = Hue_2_RGB(var_1, var_2, h);
+            b = Hue_2_RGB(var_1, var_2, h - (1.0f / 3.0f));
+        }
+    }
+}
+
+void
+HSLColorFilter::applyToSpan( osg::Vec4f* pixels, unsigned count ) const
+{
+    const osg::Vec3f offset = getHSLOffset();
+    if ( offset.x() == 0.0f && offset.y() == 0.0f && offset.z() == 0.0f )
+        return;
+
+    for( unsigned i=0; i<count; ++i )
+    {
+        osg::Vec4f& color = pixels[i];
+        float h, s, l;
+        RGB_2_HSL( color.r(), color.g(), color.b(), h, s, l );
+        h = osg::clampBetween( h + offset.x(), 0.0f, 1.0f );
+        s = osg::clampBetween( s + offset.y(), 0.0f, 1.0f );
+        l = osg::clampBetween( l + offset.z(), 0.0f, 1.0f );
+        HSL_2_RGB( h, s, l, color.r(), color.g(), color.b() );
+    }
+}
@@ -131,3 +131,22 @@ RGBColorFilter::getConfig() const
     conf.add( "b", val[2] );
     return conf;
 }
+
+void
+RGBColorFilter::applyToSpan(osg::Vec4f* pixels, unsigned count) const
+{
+    // color.rgb = clamp(color.rgb + offset, 0, 1). The alpha lane gets a zero
+    // offset so the loop runs branch-free over every component.
+    const osg::Vec3f rgb = getRGBOffset();
+    const float offset[4] = { rgb[0], rgb[1], rgb[2], 0.0f };
+
+    float* p = count > 0 ? pixels->ptr() : 0L;
+    for (unsigned i = 0; i < count; ++i, p += 4)
+    {
+        for (unsigned c = 0; c < 4; ++c)
+        {
+            float v = p[c] + offset[c];
+            p[c] = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+        }
+    }
+}
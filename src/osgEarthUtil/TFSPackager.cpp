@@ -25,6 +25,7 @@
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 #include <osgEarth/FileUtils>
+#include <osgEarthFeatures/MVT>
 
 #define LC "[TFSPackager] "
 
@@ -214,11 +215,12 @@ public:
 class WriteFeaturesVisitor : public FeatureTileVisitor
 {
 public:
-    WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
+    WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs, const std::string& format):
       _dest( dest ),
           _features( features ),
           _cropMethod( cropMethod ),
-          _srs( srs )
+          _srs( srs ),
+          _format( format )
       {
 
       }
@@ -254,14 +256,13 @@ public:
               context.extent() = tile->getExtent();
               cropFilter.push( features, context );
 
-              std::string contents = Feature::featuresToGeoJSON( features );
               std::stringstream buf;
               int x =  tile->getKey().getTileX();
               unsigned int numRows, numCols;
               tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
               int y  = numRows - tile->getKey().getTileY() - 1;
 
-              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
+              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << "." << _format;
               std::string filename = buf.str();
               //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
 
@@ -269,10 +270,13 @@ public:
                   osgEarth::makeDirectoryForFile( filename );
 
 
-              std::fstream output( filename.c_str(), std::ios_base::out );
+              std::fstream output( filename.c_str(), std::ios_base::out | std::ios_base::binary );
               if ( output.is_open() )
               {
-                  output << contents;
+                  if ( _format == "pbf" )
+                      MVT::write( output, tile->getKey(), features );
+                  else
+                      output << Feature::featuresToGeoJSON( features );
                   output.flush();
                   output.close();                
               }            
@@ -284,6 +288,7 @@ public:
       std::string _dest;      
       CropFilter::Method _cropMethod;
       osg::ref_ptr< const SpatialReference > _srs;
+      std::string _format;
 };
 
 
@@ -294,7 +299,8 @@ TFSPackager::TFSPackager():
 _firstLevel( 0 ),
     _maxLevel( 10 ),
     _maxFeatures( 300 ),
-    _method( CropFilter::METHOD_CENTROID )
+    _method( CropFilter::METHOD_CENTROID ),
+    _format( "json" )
 {
 }
 
@@ -382,7 +388,7 @@ void
     }
 #endif
 
-    WriteFeaturesVisitor write(features, destination, _method, _srs);
+    WriteFeaturesVisitor write(features, destination, _method, _srs, _format);
     root->accept( &write );
 
     //Write out the meta doc
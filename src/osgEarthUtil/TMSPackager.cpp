@@ -22,12 +22,15 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/TaskService>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ElevationLayer>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/WriteFile>
+#include <osgDB/Registry>
+#include <fstream>
 
 
 #define LC "[TMSPackager] "
@@ -40,6 +43,12 @@ WriteTMSTileHandler::WriteTMSTileHandler(TerrainLayer* layer,  Map* map, TMSPack
     _map(map),
     _packager(packager)
 {
+    // the plugin that writes the output, to recognize tiles already encoded for it
+    std::string extension = _packager->getTileSource() ?
+        _packager->getTileSource()->getExtension() :
+        _packager->getExtension();
+
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension( extension );
 }
 
 std::string WriteTMSTileHandler::getPathForTile( const TileKey &key )
@@ -77,16 +86,72 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
 
     if (imageLayer)
     {
+        // Nothing to do to the pixels: copy the source's bytes without decoding
+        // them, provided they're in the output format. (Dropping empty tiles
+        // needs the pixels.)
+        bool encodingOptions =
+            _packager->getOptions() && !_packager->getOptions()->getOptionString().empty();
+
+        if (!tileSource &&
+            _packager->getKeepEmpties() &&
+            !_packager->getApplyAlphaMask() &&
+            _packager->getCompressionMethod().empty() &&
+            !encodingOptions &&
+            _rw.valid())
+        {
+            std::string data, mimeType;
+            if (imageLayer->readEncodedImage(key, data, mimeType) &&
+                osgDB::Registry::instance()->getReaderWriterForMimeType(trim(mimeType.substr(0, mimeType.find(';')))) == _rw.get())
+            {
+                ++_packager->_numTilesCopied;
+                osgEarth::makeDirectoryForFile( path );
+                return writeFile(data, path);
+            }
+        }
+
         GeoImage geoImage = imageLayer->createImage( key );
 
         if (geoImage.valid())
         {
-            if (!_packager->getKeepEmpties() && ImageUtils::isEmptyImage(geoImage.getImage()))
+            // only scan the pixels if empty tiles are to be dropped.
+            if (!_packager->getKeepEmpties())
             {
-                OE_INFO << "Not writing completely transparent image for key " << key.str() << std::endl;
-                return false;
+                ImageUtils::ImageClassification info;
+                ImageUtils::classifyImage(geoImage.getImage(), info, 0.01f, ImageUtils::CLASSIFY_EMPTY);
+                if (info.empty)
+                {
+                    OE_INFO << "Not writing completely transparent image for key " << key.str() << std::endl;
+                    return false;
+                }
             }
 
+            // A reprojected or mosaicked tile is a new image, and a modified one no
+            // longer matches its payload, so a payload in the output format means
+            // the source bytes can be copied as-is unless we're about to change them
+            // or were given options (e.g. quality) for encoding them.
+            std::string payload;
+            if (!_packager->getApplyAlphaMask() &&
+                _packager->getCompressionMethod().empty() &&
+                !encodingOptions &&
+                ImageUtils::getEncodedPayload(geoImage.getImage(), _rw.get(), payload))
+            {
+                ++_packager->_numTilesCopied;
+
+                // the tile source stores the payload it finds on the image
+                if (tileSource)
+                {
+                    tileSource->storeImage(key, geoImage.getImage(), 0L);
+                    return true;
+                }
+                else
+                {
+                    osgEarth::makeDirectoryForFile( path );
+                    return writeFile(payload, path);
+                }
+            }
+
+            ++_packager->_numTilesEncoded;
+
             if (_packager->getApplyAlphaMask())
             {
                 // Convert the image to RGBA if necessary
@@ -114,6 +179,18 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
                 final = ImageUtils::convertToRGB8( final );
             }
 
+            // block-compress the tile so it can be uploaded as-is
+            if ( !_packager->getCompressionMethod().empty() )
+            {
+                osg::Texture::InternalFormatMode mode;
+                if ( ImageUtils::computeCPUCompressionMode(final.get(), mode) )
+                {
+                    // compress a copy since the layer may still hold the original
+                    final = ImageUtils::cloneImage( final.get() );
+                    ImageUtils::compressImage( final.get(), mode, _packager->getCompressionMethod() );
+                }
+            }
+
             // use the TileSource provided if set, else use writeImageFile
             if (tileSource)
             {
@@ -124,7 +201,7 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             {
                 // attempt to create the output folder:
                 osgEarth::makeDirectoryForFile( path );
-                return osgDB::writeImageFile(*final, path, _packager->getOptions());
+                return writeImageFile(*final, path);
             }
         }
     }
@@ -147,7 +224,7 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             {
                 // attempt to create the output folder:
                 osgEarth::makeDirectoryForFile( path );
-                return osgDB::writeImageFile(*image.get(), path, _packager->getOptions());
+                return writeImageFile(*image.get(), path);
             }
         }
     }
@@ -161,6 +238,38 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     return false;
 }
 
+bool WriteTMSTileHandler::writeImageFile( const osg::Image& image, const std::string& path )
+{
+    if (_packager->getDeduplicate())
+    {
+        // encode in memory so that a tile identical to an earlier one
+        // (ocean, empty land, nodata) becomes a link to it.
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension( _packager->getExtension() );
+        if (rw)
+        {
+            std::stringstream buf;
+            if (rw->writeImage(image, buf, _packager->getOptions()).success())
+            {
+                return _packager->getDeduplicator().write(path, buf.str());
+            }
+        }
+    }
+
+    return osgDB::writeImageFile(image, path, _packager->getOptions());
+}
+
+bool WriteTMSTileHandler::writeFile( const std::string& data, const std::string& path )
+{
+    if (_packager->getDeduplicate())
+    {
+        return _packager->getDeduplicator().write(path, data);
+    }
+
+    std::ofstream out( path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    out.write( data.c_str(), data.size() );
+    return out.good();
+}
+
 bool WriteTMSTileHandler::hasData( const TileKey& key ) const
 {
     TileSource* ts = _layer->getTileSource();
@@ -239,7 +348,8 @@ _visitor(new TileVisitor()),
     _overwrite(false),
     _keepEmpties(false),
     _applyAlphaMask(false),
-    _tileSource(0L)
+    _tileSource(0L),
+    _deduplicate(true)
 {
 }
 
@@ -323,6 +433,16 @@ void TMSPackager::setKeepEmpties(bool keepEmpties)
     _keepEmpties = keepEmpties;
 }
 
+const std::string& TMSPackager::getCompressionMethod() const
+{
+    return _compressionMethod;
+}
+
+void TMSPackager::setCompressionMethod(const std::string& method)
+{
+    _compressionMethod = method;
+}
+
 bool TMSPackager::getApplyAlphaMask() const
 {
     return _applyAlphaMask;
@@ -343,6 +463,41 @@ void TMSPackager::setVisitor(TileVisitor* visitor)
     _visitor = visitor;
 }
 
+const std::string& TMSPackager::getJournalFolder() const
+{
+    return _journalFolder;
+}
+
+void TMSPackager::setJournalFolder( const std::string& folder )
+{
+    _journalFolder = folder;
+}
+
+bool TMSPackager::getDeduplicate() const
+{
+    return _deduplicate;
+}
+
+void TMSPackager::setDeduplicate(bool deduplicate)
+{
+    _deduplicate = deduplicate;
+}
+
+FileDeduplicator& TMSPackager::getDeduplicator()
+{
+    return _deduplicator;
+}
+
+unsigned TMSPackager::getNumTilesCopied() const
+{
+    return _numTilesCopied;
+}
+
+unsigned TMSPackager::getNumTilesEncoded() const
+{
+    return _numTilesEncoded;
+}
+
 void TMSPackager::run( TerrainLayer* layer,  Map* map  )
 {
     // fetch one tile to see what the image size should be
@@ -430,9 +585,41 @@ void TMSPackager::run( TerrainLayer* layer,  Map* map  )
     }
 
 
+    osg::ref_ptr<TileJournal> journal;
+    if (!_journalFolder.empty())
+    {
+        journal = new TileJournal( TileJournal::getPathForLayer(_journalFolder, layer) );
+        if (!journal->open())
+            journal = 0L;
+    }
+
+    // hold on to the bytes each tile was read from, so tiles that need no
+    // processing can be copied instead of re-encoded:
+    bool keepEncodedPayloads = false;
+    if (imageLayer)
+    {
+        keepEncodedPayloads = imageLayer->getKeepEncodedPayloads();
+        imageLayer->setKeepEncodedPayloads(true);
+    }
+
     _handler = new WriteTMSTileHandler(layer, map, this);
+    _visitor->setJournal( journal.get() );
     _visitor->setTileHandler( _handler );
     _visitor->run( map->getProfile() );
+    _visitor->setJournal( 0L );
+
+    if (imageLayer)
+    {
+        imageLayer->setKeepEncodedPayloads(keepEncodedPayloads);
+
+        OE_INFO << LC << "Tiles copied as-is: " << (unsigned)_numTilesCopied
+            << ", re-encoded: " << (unsigned)_numTilesEncoded << std::endl;
+    }
+
+    if (_deduplicate)
+    {
+        OE_INFO << LC << "Identical tiles saved " << _deduplicator.getBytesSaved() << " bytes" << std::endl;
+    }
 }
 
 void TMSPackager::writeXML( TerrainLayer* layer, Map* map)
@@ -0,0 +1,126 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/CacheEstimator>
+#include <osgEarth/Registry>
+
+using namespace osgEarth;
+
+namespace CacheEstimatorTest
+{
+    /** A quarter of the tiles are empty; the rest encode to a quarter MB. */
+    class PatternSampler : public TileSampler
+    {
+    public:
+        bool sample(const TileKey& key, unsigned& bytes, ProgressCallback* progress)
+        {
+            if ( (key.getTileX() + key.getTileY()) % 4u == 0u )
+                return false;
+            bytes = 256u * 1024u;
+            return true;
+        }
+    };
+
+    /** Checks that every sampled key lies inside its level. */
+    class BoundsSampler : public TileSampler
+    {
+    public:
+        BoundsSampler() : outOfBounds(0u) { }
+        bool sample(const TileKey& key, unsigned& bytes, ProgressCallback* progress)
+        {
+            unsigned w, h;
+            key.getProfile()->getNumTiles(key.getLevelOfDetail(), w, h);
+            if (key.getTileX() >= w || key.getTileY() >= h)
+                ++outOfBounds;
+            bytes = 1024u;
+            return true;
+        }
+        unsigned outOfBounds;
+    };
+}
+
+TEST_CASE( "CacheEstimator extrapolates sampled tiles" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    CacheEstimator est;
+    est.setProfile(profile);
+    est.setMinLevel(0);
+    est.setMaxLevel(6);
+
+    osg::ref_ptr<TileSampler> sampler = new CacheEstimatorTest::PatternSampler();
+    REQUIRE(est.sample(sampler.get()));
+    REQUIRE(est.isSampled());
+
+    const std::vector<CacheEstimator::LevelEstimate>& levels = est.getLevelEstimates();
+    REQUIRE(levels.size() == 7u);
+
+    // small levels are sampled completely, so their estimates are exact:
+    REQUIRE(levels[1].numTiles == 8u);
+    REQUIRE(levels[1].numSampled == 8u);
+    REQUIRE(levels[1].numEmpty == 2u);
+    REQUIRE(levels[1].emptyRatio.value == Approx(0.25));
+    REQUIRE(levels[1].sizeInMB.value == Approx(1.5));
+    REQUIRE(levels[1].sizeInMB.low == Approx(1.5));
+    REQUIRE(levels[1].sizeInMB.high == Approx(1.5));
+
+    // large ones are not:
+    REQUIRE(levels[6].numTiles == 8192u);
+    REQUIRE(levels[6].numSampled <= est.getMaxSamplesPerLevel());
+
+    // level 0 has one empty tile of two; every level after that a quarter.
+    double expected = 0.25;
+    for(unsigned lod=1; lod<=6; ++lod)
+        expected += 0.75 * levels[lod].numTiles * 0.25;
+
+    CacheEstimator::Interval size = est.getSizeInMBInterval();
+    REQUIRE(size.low <= size.value);
+    REQUIRE(size.value <= size.high);
+    REQUIRE(size.value == Approx(expected).epsilon(0.25));
+    REQUIRE(est.getSizeInMB() == Approx(size.value));
+}
+
+TEST_CASE( "CacheEstimator counts deep global levels without overflowing" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    CacheEstimator est;
+    est.setProfile(profile);
+    est.setMinLevel(17);
+    est.setMaxLevel(17);
+    est.setMaxSamplesPerLevel(64);
+
+    // 2^18 x 2^17 tiles, well past 32 bits:
+    REQUIRE(est.getNumTiles() == (1ull << 35));
+
+    osg::ref_ptr<CacheEstimatorTest::BoundsSampler> sampler = new CacheEstimatorTest::BoundsSampler();
+    REQUIRE(est.sample(sampler.get()));
+
+    const std::vector<CacheEstimator::LevelEstimate>& levels = est.getLevelEstimates();
+    REQUIRE(levels[17].numTiles == (1ull << 35));
+    REQUIRE(levels[17].numSampled == 64u);
+    REQUIRE(sampler->outOfBounds == 0u);
+    REQUIRE(est.getSizeInMB() == Approx((double)(1ull << 35) / 1024.0));
+}
@@ -0,0 +1,176 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/FileUtils>
+#include <osgEarthDrivers/cache_leveldb/LevelDBCacheOptions>
+#include <osgDB/FileNameUtils>
+#include <OpenThreads/Thread>
+#include <sstream>
+#include <iomanip>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::LevelDBCache;
+
+namespace CacheTests
+{
+    /** Bytes that don't compress, so the database really grows by their size. */
+    std::string noise(unsigned size, unsigned seed)
+    {
+        std::string s(size, '\0');
+        unsigned x = seed * 2654435761u + 1u;
+        for(unsigned i=0; i<size; ++i)
+        {
+            x = x * 1664525u + 1013904223u;
+            s[i] = (char)(x >> 24);
+        }
+        return s;
+    }
+
+    std::string keyName(unsigned i)
+    {
+        std::stringstream buf;
+        buf << "key_" << std::setw(4) << std::setfill('0') << i;
+        return buf.str();
+    }
+
+    /** Rewrites one record over and over, numbering each generation. */
+    class Writer : public OpenThreads::Thread
+    {
+    public:
+        Writer(CacheBin* bin, unsigned count) : _bin(bin), _count(count) { }
+        void run()
+        {
+            for(unsigned i=0; i<_count; ++i)
+            {
+                Config meta;
+                meta.set("generation", i);
+                osg::ref_ptr<StringObject> data = new StringObject(noise(256, i));
+                _bin->write("contended", data.get(), meta, 0L);
+            }
+        }
+        CacheBin* _bin;
+        unsigned  _count;
+    };
+
+    /** Reads the same record so that its accesses keep getting flushed. */
+    class Reader : public OpenThreads::Thread
+    {
+    public:
+        Reader(CacheBin* bin, Writer* writer) : _bin(bin), _writer(writer) { }
+        void run()
+        {
+            while( _writer->isRunning() )
+            {
+                _bin->readString("contended", 0L);
+                OpenThreads::Thread::YieldCurrentThread();
+            }
+        }
+        CacheBin* _bin;
+        Writer*   _writer;
+    };
+
+    osg::ref_ptr<Cache> createCache(const std::string& name, unsigned maxSizeMB)
+    {
+        LevelDBCacheOptions options;
+        options.rootPath() = getTempName(osgDB::concatPaths(getTempPath(), name));
+        options.maxSizeMB() = maxSizeMB;
+        options.accessTimeResolution() = 0u;
+        options.maintenancePeriod() = 1u;
+        options.sizeCheckPeriod() = 1u;
+        return CacheFactory::create(options);
+    }
+}
+
+using namespace CacheTests;
+
+TEST_CASE( "LevelDB cache access times don't overwrite concurrent writes" ) {
+
+    osg::ref_ptr<Cache> cache = createCache("oe_leveldb_access", 1024u);
+    if ( !cache.valid() )
+    {
+        WARN("LevelDB cache driver not available; skipping");
+        return;
+    }
+
+    CacheBin* bin = cache->addBin("tracked");
+    REQUIRE(bin != 0L);
+
+    const unsigned count = 2000u;
+    Writer writer(bin, count);
+    Reader reader(bin, &writer);
+    writer.start();
+    reader.start();
+    writer.join();
+    reader.join();
+
+    // let the maintenance thread flush whatever the reader left pending
+    OpenThreads::Thread::microSleep(2500000);
+
+    // the last write wins; a flush must not bring back an older generation.
+    ReadResult rr = bin->readString("contended", 0L);
+    REQUIRE(rr.succeeded());
+    REQUIRE(rr.metadata().value<unsigned>("generation", 0u) == count-1u);
+    REQUIRE(rr.getString() == noise(256, count-1u));
+
+    cache->clear();
+}
+
+TEST_CASE( "LevelDB cache evicts the least recently used records of named bins" ) {
+
+    osg::ref_ptr<Cache> cache = createCache("oe_leveldb_evict", 2u);
+    if ( !cache.valid() )
+    {
+        WARN("LevelDB cache driver not available; skipping");
+        return;
+    }
+
+    // a named bin, not the default one:
+    CacheBin* bin = cache->addBin("named");
+    REQUIRE(bin != 0L);
+
+    // well past the limit, and past the database's write buffer so the
+    // size shows up in its table files:
+    const unsigned count = 160u;
+    for(unsigned i=0; i<count; ++i)
+    {
+        osg::ref_ptr<StringObject> data = new StringObject(noise(65536, i));
+        REQUIRE(bin->write(keyName(i), data.get(), Config(), 0L));
+    }
+
+    // eviction runs in the background; give it a few periods.
+    bool evicted = false;
+    for(unsigned t=0; t<100u && !evicted; ++t)
+    {
+        evicted = bin->getRecordStatus(keyName(0)) == CacheBin::STATUS_NOT_FOUND;
+        if ( !evicted )
+            OpenThreads::Thread::microSleep(100000);
+    }
+
+    REQUIRE(evicted);
+    REQUIRE(bin->getRecordStatus(keyName(count-1u)) == CacheBin::STATUS_OK);
+
+    cache->clear();
+}
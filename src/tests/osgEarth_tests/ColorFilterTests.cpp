@@ -0,0 +1,315 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ImageLayer>
+#include <osgEarth/Registry>
+#include <osgEarthUtil/RGBColorFilter>
+#include <osgEarthUtil/CMYKColorFilter>
+#include <osgEarthUtil/BrightnessContrastColorFilter>
+#include <osgEarthUtil/GammaColorFilter>
+#include <osgEarthUtil/ChromaKeyColorFilter>
+#include <osgEarthUtil/HSLColorFilter>
+#include <vector>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace ColorFilterTests
+{
+    // The shader code of each filter, written out per pixel, to check the
+    // CPU kernels against.
+    float clamp01(float v) { return v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v; }
+
+    osg::Vec4f glslRGB(osg::Vec4f c, const osg::Vec3f& rgb)
+    {
+        // color.rgb = clamp(color.rgb + rgb, 0.0, 1.0);
+        for(unsigned i=0; i<3; ++i) c[i] = clamp01(c[i] + rgb[i]);
+        return c;
+    }
+
+    osg::Vec4f glslCMYK(osg::Vec4f c, const osg::Vec4f& cmyk)
+    {
+        // color.rgb -= cmyk.xyz; color.rgb -= cmyk.w; color.rgb = clamp(color.rgb, 0.0, 1.0);
+        for(unsigned i=0; i<3; ++i) c[i] = clamp01(c[i] - cmyk[i] - cmyk[3]);
+        return c;
+    }
+
+    osg::Vec4f glslBrightnessContrast(osg::Vec4f c, const osg::Vec2f& bc)
+    {
+        // color.rgb = ((color.rgb - 0.5) * bc.y + 0.5) * bc.x; color.rgb = clamp(color.rgb, 0.0, 1.0);
+        for(unsigned i=0; i<3; ++i) c[i] = clamp01(((c[i] - 0.5f) * bc[1] + 0.5f) * bc[0]);
+        return c;
+    }
+
+    osg::Vec4f glslGamma(osg::Vec4f c, const osg::Vec3f& gamma)
+    {
+        // color.rgb = pow(color.rgb, 1.0 / gamma.rgb);
+        for(unsigned i=0; i<3; ++i) c[i] = powf(c[i], 1.0f / gamma[i]);
+        return c;
+    }
+
+    osg::Vec4f glslChromaKey(osg::Vec4f c, const osg::Vec3f& key, float distance)
+    {
+        // if (distance(color.rgb, key) <= distance) color.a = 0.0;
+        osg::Vec3f rgb(c[0], c[1], c[2]);
+        if ( (rgb - key).length() <= distance ) c[3] = 0.0f;
+        return c;
+    }
+
+    /** Every combination of a few levels per channel, with two alphas. */
+    std::vector<osg::Vec4f> samples()
+    {
+        const float levels[] = { 0.0f, 0.1f, 0.25f, 0.5f, 0.75f, 0.9f, 1.0f };
+        const unsigned n = sizeof(levels)/sizeof(levels[0]);
+        std::vector<osg::Vec4f> out;
+        for(unsigned r=0; r<n; ++r)
+            for(unsigned g=0; g<n; ++g)
+                for(unsigned b=0; b<n; ++b)
+                    out.push_back( osg::Vec4f(levels[r], levels[g], levels[b], (r+g+b)%2 ? 0.5f : 1.0f) );
+        return out;
+    }
+
+    bool closeTo(const osg::Vec4f& a, const osg::Vec4f& b, float eps)
+    {
+        for(unsigned i=0; i<4; ++i)
+            if ( fabs(a[i] - b[i]) > eps )
+                return false;
+        return true;
+    }
+
+    /** Runs the filter over the samples and counts the pixels that differ from the reference. */
+    template<typename REF>
+    unsigned countMismatches(const ColorFilter& filter, REF ref)
+    {
+        std::vector<osg::Vec4f> in = samples();
+        std::vector<osg::Vec4f> out = in;
+        filter.applyToSpan( &out[0], out.size() );
+
+        unsigned bad = 0u;
+        for(unsigned i=0; i<in.size(); ++i)
+        {
+            if ( !closeTo(out[i], ref(in[i]), 1e-5f) )
+                ++bad;
+        }
+        return bad;
+    }
+
+    struct RGBRef {
+        osg::Vec3f _v;
+        osg::Vec4f operator()(const osg::Vec4f& c) const { return glslRGB(c, _v); } };
+    struct CMYKRef {
+        osg::Vec4f _v;
+        osg::Vec4f operator()(const osg::Vec4f& c) const { return glslCMYK(c, _v); } };
+    struct BCRef {
+        osg::Vec2f _v;
+        osg::Vec4f operator()(const osg::Vec4f& c) const { return glslBrightnessContrast(c, _v); } };
+    struct GammaRef {
+        osg::Vec3f _v;
+        osg::Vec4f operator()(const osg::Vec4f& c) const { return glslGamma(c, _v); } };
+    struct ChromaKeyRef {
+        osg::Vec3f _key; float _distance;
+        osg::Vec4f operator()(const osg::Vec4f& c) const { return glslChromaKey(c, _key, _distance); } };
+
+    /** A filter that only runs in a shader. */
+    class ShaderOnlyColorFilter : public ColorFilter
+    {
+    public:
+        std::string getEntryPointFunctionName() const { return "shader_only"; }
+        void install(osg::StateSet* stateSet) const { }
+    };
+
+    /** Serves the same RGBA8 ramp for every tile. */
+    class RampTileSource : public TileSource
+    {
+    public:
+        RampTileSource() : TileSource(TileSourceOptions()) { }
+
+        Status initialize(const osgDB::Options* readOptions)
+        {
+            setProfile( Registry::instance()->getGlobalGeodeticProfile() );
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            return createRamp();
+        }
+
+        static osg::Image* createRamp()
+        {
+            osg::Image* image = new osg::Image();
+            image->allocateImage(256, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            for(int t=0; t<image->t(); ++t)
+            {
+                for(int s=0; s<image->s(); ++s)
+                {
+                    unsigned char* p = image->data(s, t);
+                    p[0] = (unsigned char)s;
+                    p[1] = (unsigned char)t;
+                    p[2] = (unsigned char)((s+t)/2);
+                    p[3] = 255;
+                }
+            }
+            return image;
+        }
+    };
+}
+
+using namespace ColorFilterTests;
+
+TEST_CASE( "Color filter CPU kernels match their shaders" ) {
+
+    SECTION("RGB") {
+        osg::ref_ptr<RGBColorFilter> filter = new RGBColorFilter();
+        filter->setRGBOffset( osg::Vec3f(0.3f, -0.2f, 0.0f) );
+        REQUIRE(filter->supportsCPU());
+        RGBRef ref; ref._v = filter->getRGBOffset();
+        REQUIRE(countMismatches(*filter.get(), ref) == 0u);
+    }
+
+    SECTION("CMYK") {
+        osg::ref_ptr<CMYKColorFilter> filter = new CMYKColorFilter();
+        filter->setCMYKOffset( osg::Vec4f(0.1f, -0.3f, 0.2f, 0.05f) );
+        REQUIRE(filter->supportsCPU());
+        CMYKRef ref; ref._v = filter->getCMYKOffset();
+        REQUIRE(countMismatches(*filter.get(), ref) == 0u);
+    }
+
+    SECTION("Brightness/contrast") {
+        osg::ref_ptr<BrightnessContrastColorFilter> filter = new BrightnessContrastColorFilter();
+        filter->setBrightnessContrast( osg::Vec2f(1.2f, 0.7f) );
+        REQUIRE(filter->supportsCPU());
+        BCRef ref; ref._v = filter->getBrightnessContrast();
+        REQUIRE(countMismatches(*filter.get(), ref) == 0u);
+    }
+
+    SECTION("Gamma") {
+        osg::ref_ptr<GammaColorFilter> filter = new GammaColorFilter();
+        filter->setGamma( osg::Vec3f(2.2f, 1.0f, 0.5f) );
+        REQUIRE(filter->supportsCPU());
+        GammaRef ref; ref._v = filter->getGamma();
+        REQUIRE(countMismatches(*filter.get(), ref) == 0u);
+    }
+
+    SECTION("Chroma key") {
+        osg::ref_ptr<ChromaKeyColorFilter> filter = new ChromaKeyColorFilter();
+        filter->setColor( osg::Vec3f(0.5f, 0.5f, 0.25f) );
+        filter->setDistance( 0.3f );
+        REQUIRE(filter->supportsCPU());
+        ChromaKeyRef ref; ref._key = filter->getColor(); ref._distance = filter->getDistance();
+        REQUIRE(countMismatches(*filter.get(), ref) == 0u);
+    }
+
+    SECTION("HSL") {
+        osg::ref_ptr<HSLColorFilter> filter = new HSLColorFilter();
+        REQUIRE(filter->supportsCPU());
+
+        osg::Vec4f span[3] = {
+            osg::Vec4f(1.0f, 0.0f, 0.0f, 1.0f),   // red
+            osg::Vec4f(0.5f, 0.5f, 0.5f, 0.5f),   // gray
+            osg::Vec4f(0.0f, 0.0f, 1.0f, 1.0f) }; // blue
+
+        // a third of the way around the hue circle; the shader clamps the
+        // hue, so blue stops at 1.0, which is red again.
+        filter->setHSLOffset( osg::Vec3f(1.0f/3.0f, 0.0f, 0.0f) );
+        filter->applyToSpan( span, 3u );
+        REQUIRE(closeTo(span[0], osg::Vec4f(0.0f, 1.0f, 0.0f, 1.0f), 1e-5f));
+        REQUIRE(closeTo(span[1], osg::Vec4f(0.5f, 0.5f, 0.5f, 0.5f), 1e-5f));
+        REQUIRE(closeTo(span[2], osg::Vec4f(1.0f, 0.0f, 0.0f, 1.0f), 1e-5f));
+
+        // lighter, with the saturation gone:
+        filter->setHSLOffset( osg::Vec3f(0.0f, -1.0f, 0.25f) );
+        filter->applyToSpan( span, 3u );
+        REQUIRE(closeTo(span[0], osg::Vec4f(0.75f, 0.75f, 0.75f, 1.0f), 1e-5f));
+        REQUIRE(closeTo(span[1], osg::Vec4f(0.75f, 0.75f, 0.75f, 0.5f), 1e-5f));
+    }
+
+    SECTION("Shader-only filters say so") {
+        ShaderOnlyColorFilter filter;
+        REQUIRE(!filter.supportsCPU());
+    }
+}
+
+TEST_CASE( "ImageLayers bake CPU color filters into their tiles" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(1, 0, 0, profile);
+
+    osg::ref_ptr<RGBColorFilter> rgb = new RGBColorFilter();
+    rgb->setRGBOffset( osg::Vec3f(0.25f, -0.5f, 0.0f) );
+
+    osg::ref_ptr<BrightnessContrastColorFilter> bc = new BrightnessContrastColorFilter();
+    bc->setBrightnessContrast( osg::Vec2f(1.1f, 0.8f) );
+
+    ImageLayerOptions options("baked");
+    options.bakeColorFilters() = true;
+    options.colorFilters().push_back( rgb.get() );
+    options.colorFilters().push_back( bc.get() );
+
+    osg::ref_ptr<ImageLayer> layer = new ImageLayer(options, new RampTileSource());
+    REQUIRE(layer->open().isOK());
+
+    SECTION("The filters are applied in order to every pixel") {
+        REQUIRE(layer->getColorFiltersBaked());
+
+        GeoImage image = layer->createImage(key);
+        REQUIRE(image.valid());
+
+        osg::ref_ptr<osg::Image> ramp = RampTileSource::createRamp();
+        const osg::Image* baked = image.getImage();
+        REQUIRE(baked->s() == ramp->s());
+        REQUIRE(baked->t() == ramp->t());
+
+        unsigned bad = 0u;
+        for(int t=0; t<ramp->t(); ++t)
+        {
+            for(int s=0; s<ramp->s(); ++s)
+            {
+                const unsigned char* in = ramp->data(s, t);
+                osg::Vec4f c(in[0]/255.0f, in[1]/255.0f, in[2]/255.0f, in[3]/255.0f);
+                c = glslBrightnessContrast( glslRGB(c, rgb->getRGBOffset()), bc->getBrightnessContrast() );
+
+                // within the rounding of the 8-bit output:
+                const unsigned char* out = baked->data(s, t);
+                osg::Vec4f o(out[0]/255.0f, out[1]/255.0f, out[2]/255.0f, out[3]/255.0f);
+                if ( !closeTo(o, c, 0.5f/255.0f + 1e-5f) )
+                    ++bad;
+            }
+        }
+        REQUIRE(bad == 0u);
+    }
+
+    SECTION("A filter without a CPU kernel sends the whole chain back to the shaders") {
+        layer->addColorFilter( new ShaderOnlyColorFilter() );
+        REQUIRE(!layer->getColorFiltersBaked());
+
+        GeoImage image = layer->createImage(key);
+        REQUIRE(image.valid());
+
+        // untouched ramp:
+        REQUIRE(image.getImage()->data(200, 10)[0] == 200);
+        REQUIRE(image.getImage()->data(200, 10)[1] == 10);
+    }
+}
@@ -0,0 +1,125 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthFeatures/FeatureListSource>
+#include <osgEarthSymbology/Geometry>
+#include <osgEarth/SpatialReference>
+#include <set>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace FeatureListSourceTest
+{
+    // counts the features a query returns, and checks they are copies
+    unsigned count(FeatureListSource* source, const Bounds& bounds)
+    {
+        Query query;
+        query.bounds() = bounds;
+
+        unsigned n = 0;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query);
+        while( cursor->hasMore() )
+        {
+            osg::ref_ptr<Feature> f = cursor->nextFeature();
+            if ( f.get() != source->getFeature(f->getFID()) )
+                ++n;
+        }
+        return n;
+    }
+}
+
+TEST_CASE( "FeatureListSource returns only the features a query touches" ) {
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    // a 100x100 grid of points, one per degree
+    osg::ref_ptr<FeatureListSource> source = new FeatureListSource();
+    for(int y=0; y<100; ++y)
+    {
+        for(int x=0; x<100; ++x)
+        {
+            PointSet* point = new PointSet();
+            point->push_back( osg::Vec3d(x, y, 0) );
+            source->insertFeature( new Feature(point, wgs84, Style(), y*100+x) );
+        }
+    }
+
+    REQUIRE(FeatureListSourceTest::count(source.get(), Bounds(10.5, 10.5, 20.5, 15.5)) == 50u);
+    REQUIRE(source->getFeature(1234)->getGeometry()->front() == osg::Vec3d(34, 12, 0));
+
+    // inserted after the index was built
+    PointSet* point = new PointSet();
+    point->push_back( osg::Vec3d(15, 12.8, 0) );
+    source->insertFeature( new Feature(point, wgs84, Style(), 100000) );
+    REQUIRE(FeatureListSourceTest::count(source.get(), Bounds(10.5, 10.5, 20.5, 15.5)) == 51u);
+
+    REQUIRE(source->deleteFeature(1215));
+    REQUIRE(source->deleteFeature(100000));
+    REQUIRE(source->getFeature(1215) == 0L);
+    REQUIRE(FeatureListSourceTest::count(source.get(), Bounds(10.5, 10.5, 20.5, 15.5)) == 49u);
+
+    // moving a feature takes a dirty() to reindex it
+    source->getFeature(0)->getGeometry()->front().set(11, 11, 0);
+    source->dirty();
+    REQUIRE(FeatureListSourceTest::count(source.get(), Bounds(10.5, 10.5, 20.5, 15.5)) == 50u);
+
+    // an unbounded query returns everything
+    REQUIRE(FeatureListSourceTest::count(source.get(), Bounds()) == 9999u);
+}
+
+TEST_CASE( "FeatureListSource cursors copy geometry only when it is modified" ) {
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    osg::ref_ptr<FeatureListSource> source = new FeatureListSource();
+    for(int i=0; i<2; ++i)
+    {
+        LineString* line = new LineString();
+        line->push_back( osg::Vec3d(i, 0, 0) );
+        line->push_back( osg::Vec3d(i, 1, 0) );
+        source->insertFeature( new Feature(line, wgs84, Style(), i) );
+    }
+
+    FeatureList features;
+    osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(Query());
+    cursor->fill( features );
+    REQUIRE(features.size() == 2u);
+
+    // reading shares the original geometry:
+    const Feature* reader = features.front().get();
+    REQUIRE(reader->getGeometry() == source->getFeature(0)->getGeometry());
+
+    // writing copies it first, and leaves the original alone:
+    Feature* writer = features.back().get();
+    writer->getGeometry()->front().set(5, 5, 0);
+    REQUIRE(writer->getGeometry() != source->getFeature(1)->getGeometry());
+    REQUIRE(source->getFeature(1)->getGeometry()->front() == osg::Vec3d(1, 0, 0));
+
+    // attributes are copied with the feature:
+    writer->set("name", std::string("changed"));
+    REQUIRE(source->getFeature(1)->hasAttr("name") == false);
+}
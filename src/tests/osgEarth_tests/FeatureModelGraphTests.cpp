@@ -0,0 +1,187 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/FeatureListSource>
+#include <osgEarthSymbology/PolygonSymbol>
+#include <osgEarthSymbology/ExtrusionSymbol>
+#include <osgEarth/Map>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/StringUtils>
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Timer>
+#include <sstream>
+#include <iomanip>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace FeatureModelGraphTests
+{
+    /**
+     * Writes out the shape of a graph in traversal order: every node's class
+     * and child count, and every geometry's vertex count and coordinate sum.
+     */
+    class Signature : public osg::NodeVisitor
+    {
+    public:
+        Signature() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN) { }
+
+        void apply(osg::Node& node)
+        {
+            _buf << node.className() << ";";
+            traverse(node);
+        }
+
+        void apply(osg::Group& group)
+        {
+            _buf << group.className() << "(" << group.getNumChildren() << ");";
+            traverse(group);
+        }
+
+        void apply(osg::Geode& geode)
+        {
+            _buf << "Geode(" << geode.getNumDrawables() << ");";
+            for(unsigned i=0; i<geode.getNumDrawables(); ++i)
+            {
+                const osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+                const osg::Vec3Array* verts = geom ? dynamic_cast<const osg::Vec3Array*>(geom->getVertexArray()) : 0L;
+                if ( verts )
+                {
+                    osg::Vec3d sum;
+                    for(unsigned v=0; v<verts->size(); ++v)
+                        sum += osg::Vec3d((*verts)[v]);
+                    _buf << "Geometry(" << verts->size() << "," << geom->getNumPrimitiveSets() << ","
+                        << std::fixed << std::setprecision(3) << sum.x() << "," << sum.y() << "," << sum.z() << ");";
+                }
+            }
+            traverse(geode);
+        }
+
+        std::stringstream _buf;
+    };
+
+    unsigned countOf(const std::string& str, const std::string& token)
+    {
+        unsigned n = 0u;
+        for(std::string::size_type i = str.find(token); i != std::string::npos; i = str.find(token, i+1))
+            ++n;
+        return n;
+    }
+
+    /** A grid of building footprints, sorted into five styles by their "kind". */
+    FeatureListSource* createBuildings(unsigned grid)
+    {
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        FeatureListSource* source = new FeatureListSource();
+        const double x0 = -77.05, y0 = 38.88, d = 0.0005;
+        for(unsigned j=0; j<grid; ++j)
+        {
+            for(unsigned i=0; i<grid; ++i)
+            {
+                double x = x0 + d*i, y = y0 + d*j;
+                Symbology::Polygon* footprint = new Symbology::Polygon();
+                footprint->push_back(x, y);
+                footprint->push_back(x + 0.6*d, y);
+                footprint->push_back(x + 0.6*d, y + 0.4*d);
+                footprint->push_back(x + 0.3*d, y + 0.6*d);
+                footprint->push_back(x, y + 0.4*d);
+                Feature* f = new Feature(footprint, wgs84, Style(), j*grid + i);
+                f->set("kind", (int)((i*7 + j*3) % 5));
+                source->insertFeature(f);
+            }
+        }
+        source->setFeatureProfile(new FeatureProfile(GeoExtent(wgs84, x0, y0, x0 + d*grid, y0 + d*grid)));
+        return source;
+    }
+
+    StyleSheet* createStyles()
+    {
+        StyleSheet* styles = new StyleSheet();
+        for(unsigned k=0; k<5u; ++k)
+        {
+            Style style(Stringify() << "kind_" << k);
+            style.getOrCreate<PolygonSymbol>()->fill()->color() = Color(0.2f*k, 0.5f, 1.0f - 0.2f*k, 1.0f);
+            style.getOrCreate<ExtrusionSymbol>()->height() = 10.0f + 5.0f*k;
+            styles->addStyle(style);
+        }
+
+        StyleSelector selector;
+        selector.name() = "buildings";
+        selector.styleExpression() = StringExpression("kind_[kind]");
+        styles->selectors().push_back(selector);
+        return styles;
+    }
+
+    /** Builds the whole source into one graph, and returns its signature and build time. */
+    std::string build(Map* map, FeatureSource* source, unsigned threads, double& seconds)
+    {
+        FeatureModelSourceOptions options;
+        options.buildThreads() = threads;
+
+        osg::ref_ptr<StyleSheet> styles = createStyles();
+        osg::ref_ptr<Session> session = new Session(map, styles.get(), source);
+
+        osg::Timer_t t0 = osg::Timer::instance()->tick();
+        osg::ref_ptr<FeatureModelGraph> graph = new FeatureModelGraph(
+            session.get(), options, new GeomFeatureNodeFactory(GeometryCompilerOptions()));
+        seconds = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+
+        Signature sig;
+        graph->accept(sig);
+        return sig._buf.str();
+    }
+}
+
+using namespace FeatureModelGraphTests;
+
+TEST_CASE( "FeatureModelGraph builds the same graph with one thread or several" ) {
+
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<FeatureListSource> source = createBuildings(30u);
+
+    double s1, s4;
+    std::string one  = build(map.get(), source.get(), 1u, s1);
+    std::string four = build(map.get(), source.get(), 4u, s4);
+
+    // five style groups, each with geometry:
+    REQUIRE(countOf(one, "Geometry(") >= 5u);
+    REQUIRE(one == four);
+}
+
+TEST_CASE( "Benchmark: FeatureModelGraph style group build threads", "[.benchmark]" ) {
+
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<FeatureListSource> source = createBuildings(200u);
+
+    double s1, s4;
+    std::string one  = build(map.get(), source.get(), 1u, s1);
+    std::string four = build(map.get(), source.get(), 4u, s4);
+    REQUIRE(one == four);
+
+    WARN(source->getFeatureCount() << " features in 5 style groups: 1 thread " << s1 << " s, 4 threads " << s4 << " s");
+}
@@ -0,0 +1,576 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthFeatures/CompiledExpression>
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/FeatureTileCodec>
+#include <osgEarthFeatures/MVT>
+#include <osgEarth/Registry>
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/FileUtils>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osgEarthSymbology/Expression>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/LineWidth>
+#include <osg/Timer>
+#include <osgDB/FileNameUtils>
+#include <sstream>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Drivers;
+
+TEST_CASE( "Feature attributes in schema slots" ) {
+
+    FeatureSchema schema;
+    schema["name"]  = ATTRTYPE_STRING;
+    schema["lanes"] = ATTRTYPE_INT;
+    schema["width"] = ATTRTYPE_DOUBLE;
+    osg::ref_ptr<FeatureSchemaIndex> index = new FeatureSchemaIndex(schema);
+    REQUIRE(index->getNumSlots() == 3u);
+    REQUIRE(index->getSlot("NAME") == index->getSlot("name"));
+    REQUIRE(index->getSlot("other") == -1);
+
+    osg::ref_ptr<Feature> a = new Feature(0L, 0L);
+    a->set("name", std::string("Main St"));
+    a->setSchemaIndex(index.get());
+    a->set("Lanes", 4);
+    a->setNull("width", ATTRTYPE_DOUBLE);
+    a->set("other", std::string("x"));
+
+    osg::ref_ptr<Feature> b = new Feature(0L, 0L);
+    b->setSchemaIndex(index.get());
+    b->set("name", std::string("Main St"));
+
+    // string values are shared through the index:
+    unsigned nameSlot = index->getSlot("name");
+    REQUIRE(index->intern(nameSlot, "Main St") == index->intern(nameSlot, std::string("Main St")));
+    REQUIRE(index->getNumStrings(nameSlot) == 1u);
+
+    REQUIRE(a->getString("name") == "Main St");
+    REQUIRE(a->getInt("lanes") == 4);
+    REQUIRE(a->getDouble("LANES") == 4.0);
+    REQUIRE(a->hasAttr("width"));
+    REQUIRE(!a->isSet("width"));
+    REQUIRE(a->getString("other") == "x");
+    REQUIRE(!b->hasAttr("lanes"));
+
+    REQUIRE(a->getAttrs().size() == 4u);
+    REQUIRE(b->getAttrs().size() == 1u);
+    a->set("lanes", 2);
+    REQUIRE(a->getAttrs().find("lanes")->second.getInt() == 2);
+
+    // getAttrs() is a copy, so a later set() leaves it alone
+    AttributeTable snapshot = a->getAttrs();
+    a->set("lanes", 3);
+    REQUIRE(snapshot.find("lanes")->second.getInt() == 2);
+    REQUIRE(a->getInt("lanes") == 3);
+    a->set("lanes", 2);
+
+    osg::ref_ptr<Feature> c = new Feature(*a);
+    REQUIRE(c->getInt("lanes") == 2);
+
+    NumericExpression expr("[lanes] * 2");
+    REQUIRE(a->eval(expr) == 4.0);
+    StringExpression sexpr("[name]");
+    REQUIRE(a->eval(sexpr) == "Main St");
+}
+
+TEST_CASE( "Schema slots keep only a bounded number of strings per field" ) {
+
+    FeatureSchema schema;
+    schema["name"]  = ATTRTYPE_STRING;
+    schema["class"] = ATTRTYPE_STRING;
+    osg::ref_ptr<FeatureSchemaIndex> index = new FeatureSchemaIndex(schema, 4u);
+    unsigned nameSlot = index->getSlot("name"), classSlot = index->getSlot("class");
+
+    std::vector< osg::ref_ptr<Feature> > features;
+    for(int i=0; i<10; ++i)
+    {
+        osg::ref_ptr<Feature> f = new Feature(0L, 0L);
+        f->setSchemaIndex(index.get());
+        f->set("name", std::string(Stringify() << "street " << i));
+        f->set("class", std::string(i % 2 ? "major" : "minor"));
+        features.push_back(f);
+    }
+
+    REQUIRE(index->getNumStrings(nameSlot) == 4u);
+    REQUIRE(index->getNumStrings(classSlot) == 2u);
+    REQUIRE(index->intern(nameSlot, "street 9") == 0L);
+    REQUIRE(index->intern(nameSlot, "street 3") != 0L);
+
+    // values past the limit live in the feature's table, and read the same:
+    Feature* last = features.back().get();
+    REQUIRE(last->getSlot(nameSlot)->present == false);
+    REQUIRE(last->getString("NAME") == "street 9");
+    REQUIRE(last->hasAttr("name"));
+    REQUIRE(last->getAttrs().size() == 2u);
+    StringExpression sexpr("[name]/[class]");
+    REQUIRE(last->eval(sexpr) == "street 9/major");
+    CompiledStringExpression compiled(sexpr, index.get());
+    std::string result;
+    compiled.eval(last, result);
+    REQUIRE(result == "street 9/major");
+
+    // setting a kept value moves it back into the slot:
+    last->set("name", std::string("street 0"));
+    REQUIRE(last->getSlot(nameSlot)->present);
+    REQUIRE(last->getString("name") == "street 0");
+    REQUIRE(last->getAttrs().size() == 2u);
+}
+
+TEST_CASE( "FeatureCursor hands out features in batches" ) {
+
+    FeatureList input;
+    for(unsigned i=0; i<10; ++i)
+        input.push_back(new Feature(0L, 0L, Style(), i));
+
+    osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor(input);
+
+    FeatureList output;
+    REQUIRE(cursor->nextBatch(output, 4u) == 4u);
+    REQUIRE(cursor->nextBatch(output, 4u) == 4u);
+    REQUIRE(cursor->nextBatch(output, 4u) == 2u);
+    REQUIRE(!cursor->hasMore());
+    REQUIRE(cursor->nextBatch(output, 4u) == 0u);
+    REQUIRE(output.size() == 10u);
+    REQUIRE(output.back()->getFID() == 9u);
+}
+
+namespace
+{
+    // The FID, vertex count and first vertex of every feature a cursor
+    // returns, in order, reading up to "max" at a time (0 for one by one).
+    std::string readAll(FeatureSource* source, unsigned max)
+    {
+        std::stringstream buf;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(Query());
+        FeatureList batch;
+        while( cursor.valid() && cursor->hasMore() )
+        {
+            batch.clear();
+            if ( max > 0u )
+                cursor->nextBatch(batch, max);
+            else
+                batch.push_back(cursor->nextFeature());
+
+            for(FeatureList::const_iterator i = batch.begin(); i != batch.end(); ++i)
+            {
+                const Feature* f = i->get();
+                if ( !f ) continue;
+                const Geometry* geom = f->getGeometry();
+                buf << f->getFID() << ":" << f->getAttrs().size();
+                if ( geom )
+                    buf << ":" << geom->getTotalPointCount();
+                if ( geom && !geom->empty() )
+                    buf << ":" << geom->front().x();
+                buf << ";";
+            }
+        }
+        return buf.str();
+    }
+}
+
+TEST_CASE( "OGR cursors return the same features in batches as one by one" ) {
+
+    OGRFeatureOptions options;
+    options.url() = "../data/dcbuildings.shp";
+
+    osg::ref_ptr<FeatureSource> source = FeatureSourceFactory::create(options);
+    REQUIRE(source.valid());
+    REQUIRE(source->open().isOK());
+
+    std::string single = readAll(source.get(), 0u);
+    REQUIRE(!single.empty());
+
+    // batch sizes that do and don't line up with the driver's chunks:
+    REQUIRE(readAll(source.get(), 7u) == single);
+    REQUIRE(readAll(source.get(), 256u) == single);
+    REQUIRE(readAll(source.get(), 1000u) == single);
+
+    SECTION("With chunks prefetched on a reader thread") {
+        options.prefetch() = true;
+        osg::ref_ptr<FeatureSource> prefetching = FeatureSourceFactory::create(options);
+        REQUIRE(prefetching.valid());
+        REQUIRE(prefetching->open().isOK());
+
+        REQUIRE(readAll(prefetching.get(), 0u) == single);
+        REQUIRE(readAll(prefetching.get(), 7u) == single);
+        REQUIRE(readAll(prefetching.get(), 256u) == single);
+    }
+}
+
+TEST_CASE( "Compiled expressions read schema slots and evaluate in batches" ) {
+
+    FeatureSchema schema;
+    schema["name"]  = ATTRTYPE_STRING;
+    schema["lanes"] = ATTRTYPE_INT;
+    osg::ref_ptr<FeatureSchemaIndex> index = new FeatureSchemaIndex(schema);
+
+    FeatureList features;
+    for(int i=0; i<3; ++i)
+    {
+        Feature* f = new Feature(0L, 0L);
+        f->setSchemaIndex(index.get());
+        f->set("name", std::string(i == 1 ? "B" : "A"));
+        f->set("lanes", i+1);
+        features.push_back(f);
+    }
+
+    // a feature without the index goes through the lookup by name:
+    Feature* loose = new Feature(0L, 0L);
+    loose->set("lanes", 10);
+    features.push_back(loose);
+
+    CompiledNumericExpression width(NumericExpression("([lanes] + 1) * 3.5 - [lanes]"), index.get());
+    REQUIRE(width.eval(features.front().get()) == 6.0);
+
+    std::vector<double> widths;
+    width.eval(features, widths);
+    REQUIRE(widths.size() == 4u);
+    REQUIRE(widths[1] == 8.5);
+    REQUIRE(widths[3] == 28.5);
+
+    CompiledStringExpression style(StringExpression("road_[name]_[lanes]"), index.get());
+    std::vector<std::string> styles;
+    style.eval(features, styles);
+    REQUIRE(styles[0] == "road_A_1");
+    REQUIRE(styles[1] == "road_B_2");
+    REQUIRE(styles[3] == "road__10");
+
+    // NULL entries are skipped over, not dereferenced:
+    features.insert(features.begin() + 1, osg::ref_ptr<Feature>());
+    width.eval(features, widths);
+    REQUIRE(widths.size() == 5u);
+    REQUIRE(widths[1] == 3.5);
+    REQUIRE(widths[2] == 8.5);
+    style.eval(features, styles);
+    REQUIRE(styles[1] == "road__");
+    REQUIRE(styles[2] == "road_B_2");
+}
+
+TEST_CASE( "Benchmark: compiled expressions against Feature::eval", "[.benchmark]" ) {
+
+    FeatureSchema schema;
+    schema["name"]  = ATTRTYPE_STRING;
+    schema["lanes"] = ATTRTYPE_INT;
+    schema["width"] = ATTRTYPE_DOUBLE;
+    osg::ref_ptr<FeatureSchemaIndex> index = new FeatureSchemaIndex(schema);
+
+    const unsigned numFeatures = 200000u;
+    FeatureList features;
+    for(unsigned i=0; i<numFeatures; ++i)
+    {
+        Feature* f = new Feature(0L, 0L);
+        f->setSchemaIndex(index.get());
+        f->set("name", std::string(i % 3 == 0 ? "primary" : "secondary"));
+        f->set("lanes", (int)(i % 6) + 1);
+        f->set("width", 3.5 + (double)(i % 5));
+        features.push_back(f);
+    }
+
+    NumericExpression numeric("([lanes] * [width]) + 2.0 * [lanes]");
+    StringExpression  text("road_[name]_[lanes]");
+    osg::Timer_t t0, t1;
+
+    double sum0 = 0.0;
+    std::string style;
+    t0 = osg::Timer::instance()->tick();
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        sum0 += (*i)->eval(numeric);
+        style = (*i)->eval(text);
+    }
+    t1 = osg::Timer::instance()->tick();
+    double byName = osg::Timer::instance()->delta_s(t0, t1);
+
+    CompiledNumericExpression compiledNumeric(numeric, index.get());
+    CompiledStringExpression  compiledText(text, index.get());
+    std::vector<double> values;
+    std::vector<std::string> styles;
+    t0 = osg::Timer::instance()->tick();
+    compiledNumeric.eval(features, values);
+    compiledText.eval(features, styles);
+    t1 = osg::Timer::instance()->tick();
+    double compiled = osg::Timer::instance()->delta_s(t0, t1);
+
+    double sum1 = 0.0;
+    for(unsigned i=0; i<values.size(); ++i)
+        sum1 += values[i];
+    REQUIRE(sum1 == Approx(sum0));
+    REQUIRE(styles.back() == style);
+
+    WARN(numFeatures << " features: Feature::eval " << byName << " s, compiled batch " << compiled << " s");
+}
+
+TEST_CASE( "FeatureTileCodec round-trips a compiled tile" ) {
+
+    osg::Geometry* geom = new osg::Geometry();
+    osg::Vec3Array* verts = new osg::Vec3Array();
+    verts->push_back(osg::Vec3(0,0,0));
+    verts->push_back(osg::Vec3(1,0,0));
+    verts->push_back(osg::Vec3(1,1,0));
+    geom->setVertexArray(verts);
+    osg::UIntArray* oids = new osg::UIntArray(3);
+    (*oids)[0] = (*oids)[1] = (*oids)[2] = 7u;
+    oids->setBinding(osg::Array::BIND_PER_VERTEX);
+    oids->setPreserveDataType(true);
+    geom->setVertexAttribArray(5, oids);
+    osg::DrawElementsUShort* tris = new osg::DrawElementsUShort(GL_TRIANGLES);
+    tris->push_back(0); tris->push_back(1); tris->push_back(2);
+    geom->addPrimitiveSet(tris);
+
+    osg::Geode* geode = new osg::Geode();
+    geode->setName("buildings");
+    geode->addDrawable(geom);
+    geode->getOrCreateStateSet()->addUniform(new osg::Uniform("oe_index_objectid", 7u));
+    geode->getOrCreateStateSet()->setMode(GL_LIGHTING, 0);
+
+    osg::ref_ptr<FeatureSourceIndexNode> root = new FeatureSourceIndexNode();
+    FeatureSourceIndexNode::FIDMap fids;
+    fids[42] = new RefIDPair(42, 7u);
+    root->setFIDMap(fids);
+    root->addChild(geode);
+
+    std::string buffer;
+    REQUIRE(FeatureTileCodec::encode(root.get(), buffer));
+    REQUIRE(FeatureTileCodec::isEncoded(buffer.data(), buffer.size()));
+
+    osg::ref_ptr<osg::Node> node = FeatureTileCodec::decode(buffer.data(), buffer.size());
+    FeatureSourceIndexNode* index = dynamic_cast<FeatureSourceIndexNode*>(node.get());
+    REQUIRE(index != 0L);
+    REQUIRE(index->getFIDMap().size() == 1u);
+    REQUIRE(index->getFIDMap().begin()->second->_oid == 7u);
+
+    osg::Geode* outGeode = index->getChild(0)->asGeode();
+    REQUIRE(outGeode != 0L);
+    REQUIRE(outGeode->getName() == "buildings");
+    unsigned oid = 0u;
+    REQUIRE(outGeode->getStateSet()->getUniform("oe_index_objectid")->get(oid));
+    REQUIRE(oid == 7u);
+
+    osg::Geometry* outGeom = outGeode->getDrawable(0)->asGeometry();
+    REQUIRE(outGeom->getVertexArray()->getNumElements() == 3u);
+    osg::UIntArray* outOids = dynamic_cast<osg::UIntArray*>(outGeom->getVertexAttribArray(5));
+    REQUIRE(outOids != 0L);
+    REQUIRE(outOids->getPreserveDataType());
+    REQUIRE((*outOids)[2] == 7u);
+    REQUIRE(outGeom->getPrimitiveSet(0)->getNumIndices() == 3u);
+
+    // truncated data decodes to nothing rather than a partial graph:
+    REQUIRE(FeatureTileCodec::decode(buffer.data(), buffer.size()-4) == 0L);
+
+    // so do primitives that refer to vertices past the end of the array:
+    (*tris)[2] = 3;
+    REQUIRE(FeatureTileCodec::encode(root.get(), buffer));
+    REQUIRE(FeatureTileCodec::decode(buffer.data(), buffer.size()) == 0L);
+    (*tris)[2] = 2;
+
+    osg::ref_ptr<osg::DrawArrays> strip = new osg::DrawArrays(GL_LINE_STRIP, 1, 3);
+    geom->addPrimitiveSet(strip.get());
+    REQUIRE(FeatureTileCodec::encode(root.get(), buffer));
+    REQUIRE(FeatureTileCodec::decode(buffer.data(), buffer.size()) == 0L);
+    strip->setCount(2);
+    REQUIRE(FeatureTileCodec::encode(root.get(), buffer));
+    node = FeatureTileCodec::decode(buffer.data(), buffer.size());
+    REQUIRE(node.valid());
+    geom->removePrimitiveSet(1);
+
+    // state attributes are not carried, so such graphs are left to osgb:
+    geode->getOrCreateStateSet()->setAttribute(new osg::LineWidth(2.0f));
+    REQUIRE(!FeatureTileCodec::encode(root.get(), buffer));
+}
+
+TEST_CASE( "Encoded feature tiles are cached as raw codec bytes" ) {
+
+    osg::Geometry* geom = new osg::Geometry();
+    osg::Vec3Array* verts = new osg::Vec3Array();
+    verts->push_back(osg::Vec3(0,0,0));
+    verts->push_back(osg::Vec3(1,0,0));
+    verts->push_back(osg::Vec3(1,1,0));
+    geom->setVertexArray(verts);
+    geom->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, 3));
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+    geode->addDrawable(geom);
+
+    std::string buffer;
+    REQUIRE(FeatureTileCodec::encode(geode.get(), buffer));
+
+    FileSystemCacheOptions options;
+    options.rootPath() = getTempName(osgDB::concatPaths(getTempPath(), "oe_tilecodec"));
+    osg::ref_ptr<Cache> cache = CacheFactory::create(options);
+    REQUIRE(cache.valid());
+    CacheBin* bin = cache->addBin("feature_tiles");
+    REQUIRE(bin != 0L);
+
+    osg::ref_ptr<StringObject> encoded = new StringObject(buffer);
+    REQUIRE(bin->write("tile", encoded.get(), Config(), 0L));
+
+    // the record holds the codec bytes themselves, not an osgb stream:
+    ReadResult rr = bin->readString("tile", 0L);
+    REQUIRE(rr.succeeded());
+    REQUIRE(rr.metadata().hasValue("payload_mime_type"));
+    REQUIRE(rr.getString() == buffer);
+
+    osg::ref_ptr<osg::Node> node = FeatureTileCodec::decode(rr.getString().data(), rr.getString().size());
+    REQUIRE(node.valid());
+    osg::Geode* outGeode = node->asGeode();
+    REQUIRE(outGeode != 0L);
+    REQUIRE(outGeode->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements() == 3u);
+
+    cache->clear();
+}
+
+TEST_CASE( "MVT writes tiles that read back" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(2, 3, 1, profile);
+    const GeoExtent& e = key.getExtent();
+
+    // polygon with a hole, in osgEarth winding (CCW outer, CW hole):
+    Symbology::Polygon* poly = new Symbology::Polygon();
+    poly->push_back(e.xMin()+1, e.yMin()+1);
+    poly->push_back(e.xMax()-1, e.yMin()+1);
+    poly->push_back(e.xMax()-1, e.yMax()-1);
+    poly->push_back(e.xMin()+1, e.yMax()-1);
+    Ring* hole = new Ring();
+    hole->push_back(e.xMin()+5, e.yMin()+5);
+    hole->push_back(e.xMin()+5, e.yMin()+10);
+    hole->push_back(e.xMin()+10, e.yMin()+10);
+    hole->push_back(e.xMin()+10, e.yMin()+5);
+    poly->getHoles().push_back(hole);
+
+    osg::ref_ptr<Feature> feature = new Feature(poly, profile->getSRS());
+    feature->set("mvt_layer", std::string("parcels"));
+    feature->set("name", std::string("lot 1"));
+    feature->set("floors", 3);
+    feature->set("area", 12.5);
+
+    FeatureList output;
+    output.push_back(feature.get());
+
+    std::stringstream buf;
+    REQUIRE(MVT::write(buf, key, output));
+
+    std::string data = buf.str();
+    FeatureList input;
+    REQUIRE(MVT::read(data.data(), data.size(), key, input));
+    REQUIRE(input.size() == 1u);
+
+    Feature* f = input.front().get();
+    REQUIRE(f->getString("mvt_layer") == "parcels");
+    REQUIRE(f->getString("name") == "lot 1");
+    REQUIRE(f->getInt("floors") == 3);
+    REQUIRE(f->getDouble("area") == 12.5);
+
+    Symbology::Polygon* inPoly = dynamic_cast<Symbology::Polygon*>(f->getGeometry());
+    REQUIRE(inPoly != 0L);
+    REQUIRE(inPoly->getHoles().size() == 1u);
+    REQUIRE(inPoly->getBounds().width() == Approx(poly->getBounds().width()).epsilon(0.01));
+}
+
+TEST_CASE( "Benchmark: MVT encode and decode", "[.benchmark]" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(12, 2100, 700, profile);
+    const GeoExtent& e = key.getExtent();
+
+    // a busy street-level tile: building footprints, roads and labels,
+    // with a handful of attributes each.
+    const unsigned grid = 40u;
+    const double dx = e.width() / grid, dy = e.height() / grid;
+    FeatureList features;
+    for(unsigned j=0; j<grid; ++j)
+    {
+        for(unsigned i=0; i<grid; ++i)
+        {
+            double x = e.xMin() + dx*i, y = e.yMin() + dy*j;
+
+            Symbology::Polygon* building = new Symbology::Polygon();
+            building->push_back(x + 0.1*dx, y + 0.1*dy);
+            building->push_back(x + 0.6*dx, y + 0.1*dy);
+            building->push_back(x + 0.6*dx, y + 0.5*dy);
+            building->push_back(x + 0.3*dx, y + 0.6*dy);
+            building->push_back(x + 0.1*dx, y + 0.5*dy);
+            Feature* f = new Feature(building, profile->getSRS());
+            f->set("mvt_layer", std::string("buildings"));
+            f->set("height", 3.0 * (1 + (i+j) % 10));
+            f->set("type", std::string((i+j) % 3 ? "residential" : "commercial"));
+            features.push_back(f);
+
+            Symbology::LineString* road = new Symbology::LineString();
+            for(unsigned k=0; k<8u; ++k)
+                road->push_back(x + dx*k/7.0, y + 0.8*dy + 0.05*dy*(k%2));
+            f = new Feature(road, profile->getSRS());
+            f->set("mvt_layer", std::string("roads"));
+            f->set("lanes", (int)(1 + j % 4));
+            f->set("name", std::string(Stringify() << "Street " << j));
+            features.push_back(f);
+
+            Symbology::PointSet* label = new Symbology::PointSet();
+            label->push_back(x + 0.35*dx, y + 0.35*dy);
+            f = new Feature(label, profile->getSRS());
+            f->set("mvt_layer", std::string("labels"));
+            f->set("name", std::string(Stringify() << "No. " << (i + j*grid)));
+            features.push_back(f);
+        }
+    }
+
+    const unsigned passes = 20u;
+    osg::Timer_t t0, t1;
+
+    std::string data;
+    t0 = osg::Timer::instance()->tick();
+    for(unsigned p=0; p<passes; ++p)
+    {
+        std::stringstream buf;
+        REQUIRE(MVT::write(buf, key, features));
+        data = buf.str();
+    }
+    t1 = osg::Timer::instance()->tick();
+    double encode = osg::Timer::instance()->delta_s(t0, t1) / passes;
+
+    unsigned count = 0u;
+    t0 = osg::Timer::instance()->tick();
+    for(unsigned p=0; p<passes; ++p)
+    {
+        FeatureList input;
+        REQUIRE(MVT::read(data.data(), data.size(), key, input));
+        count = input.size();
+    }
+    t1 = osg::Timer::instance()->tick();
+    double decode = osg::Timer::instance()->delta_s(t0, t1) / passes;
+
+    REQUIRE(count == features.size());
+
+    WARN(features.size() << " features, " << data.size() << " bytes: encode "
+        << 1000.0*encode << " ms, decode " << 1000.0*decode << " ms per tile");
+}
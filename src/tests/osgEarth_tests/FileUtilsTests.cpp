@@ -0,0 +1,91 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgDB/FileNameUtils>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+using namespace osgEarth;
+
+namespace
+{
+    std::string readAll(const std::string& path)
+    {
+        std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+        std::stringstream buf;
+        buf << in.rdbuf();
+        return buf.str();
+    }
+}
+
+TEST_CASE( "contentHash is the SHA-256 digest of the data" ) {
+    REQUIRE(contentHash("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    REQUIRE(contentHash("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST_CASE( "FileDeduplicator links identical files" ) {
+
+    std::string base = getTempName(osgDB::concatPaths(getTempPath(), "oe_dedup"));
+    std::string a = base + "_a", b = base + "_b", c = base + "_c";
+
+    std::string tile(1024, 'x'), other(1024, 'y');
+
+    FileDeduplicator dedup;
+    REQUIRE(dedup.write(a, tile));
+    REQUIRE(dedup.write(b, tile));
+    REQUIRE(dedup.write(c, other));
+
+    if (getLinkCount(a) == 2u) // skip where the file system has no hard links
+    {
+        REQUIRE(getLinkCount(b) == 2u);
+        REQUIRE(getLinkCount(c) == 1u);
+        REQUIRE(dedup.getBytesSaved() == tile.size());
+
+        SECTION("rewriting one file leaves its twin alone") {
+            REQUIRE(dedup.write(a, other));
+            REQUIRE(readAll(a) == other);
+            REQUIRE(readAll(b) == tile);
+            REQUIRE(getLinkCount(b) == 1u);
+        }
+
+        SECTION("existing files can be added after the fact") {
+            FileDeduplicator retrofit;
+            REQUIRE(retrofit.add(c) == 0ull);
+            ::remove(b.c_str());
+            std::ofstream out(b.c_str(), std::ios::out | std::ios::binary);
+            out << other;
+            out.close();
+            REQUIRE(retrofit.add(b) == other.size());
+            REQUIRE(getLinkCount(c) == 2u);
+            REQUIRE(readAll(b) == other);
+        }
+    }
+
+    ::remove(a.c_str());
+    ::remove(b.c_str());
+    ::remove(c.c_str());
+}
@@ -0,0 +1,399 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/HTTPClient>
+#include <osgEarth/URI>
+#include <osgEarth/CachePolicy>
+#include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Progress>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+#include <osgDB/FileNameUtils>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Barrier>
+#include <vector>
+
+// The stand-in server below uses BSD sockets.
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+
+using namespace osgEarth;
+
+namespace HTTPClientTest
+{
+    /**
+     * Minimal keep-alive HTTP/1.1 server on 127.0.0.1 that answers every
+     * GET with a short text body after a small delay, or a longer one for
+     * paths under /slow. The body carries entity tag "v1"; requests that
+     * present any tag get a 304 that moves it on to "v2".
+     */
+    class Server : public OpenThreads::Thread
+    {
+    public:
+        Server() : _fd(-1), _port(0), _done(false)
+        {
+            _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            int on = 1;
+            ::setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+            sockaddr_in addr;
+            ::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+            addr.sin_port = 0;
+            ::bind(_fd, (sockaddr*)&addr, sizeof(addr));
+            ::listen(_fd, 16);
+
+            socklen_t len = sizeof(addr);
+            ::getsockname(_fd, (sockaddr*)&addr, &len);
+            _port = ntohs(addr.sin_port);
+        }
+
+        ~Server()
+        {
+            _done = true;
+            join();
+            for(unsigned i=0; i<_connections.size(); ++i)
+            {
+                _connections[i]->join();
+                delete _connections[i];
+            }
+            ::close(_fd);
+        }
+
+        unsigned short getPort() const { return _port; }
+
+        unsigned getNumRequests() const { return _numRequests; }
+
+        unsigned getNumNotModified() const { return _numNotModified; }
+
+        unsigned getNumCurrentTags() const { return _numCurrentTags; }
+
+        void run()
+        {
+            while( !_done )
+            {
+                pollfd p = { _fd, POLLIN, 0 };
+                if ( ::poll(&p, 1, 50) > 0 )
+                {
+                    int client = ::accept(_fd, 0L, 0L);
+                    if ( client >= 0 )
+                    {
+                        Connection* c = new Connection(client, _done, _numRequests, _numNotModified, _numCurrentTags);
+                        _connections.push_back(c);
+                        c->start();
+                    }
+                }
+            }
+        }
+
+    private:
+        struct Connection : public OpenThreads::Thread
+        {
+            Connection(int fd, volatile bool& done, OpenThreads::Atomic& numRequests, OpenThreads::Atomic& numNotModified, OpenThreads::Atomic& numCurrentTags) :
+                _fd(fd), _done(done), _numRequests(numRequests), _numNotModified(numNotModified), _numCurrentTags(numCurrentTags) { }
+
+            void run()
+            {
+                std::string buffer;
+                char chunk[1024];
+                while( !_done )
+                {
+                    pollfd p = { _fd, POLLIN, 0 };
+                    if ( ::poll(&p, 1, 50) <= 0 )
+                        continue;
+
+                    ssize_t n = ::recv(_fd, chunk, sizeof(chunk), 0);
+                    if ( n <= 0 )
+                        break;
+
+                    buffer.append(chunk, n);
+                    std::string::size_type end;
+                    while( (end = buffer.find("\r\n\r\n")) != std::string::npos )
+                    {
+                        std::string request = buffer.substr(0, end);
+                        buffer.erase(0, end+4);
+                        ++_numRequests;
+                        OpenThreads::Thread::microSleep(request.find("GET /slow") == 0 ? 300000 : 20000);
+
+                        const char* response;
+                        if ( request.find("If-None-Match: \"v") != std::string::npos )
+                        {
+                            ++_numNotModified;
+                            if ( request.find("If-None-Match: \"v2\"") != std::string::npos )
+                                ++_numCurrentTags;
+                            response =
+                                "HTTP/1.1 304 Not Modified\r\n"
+                                "ETag: \"v2\"\r\n"
+                                "\r\n";
+                        }
+                        else
+                        {
+                            response =
+                                "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/plain\r\n"
+                                "ETag: \"v1\"\r\n"
+                                "Last-Modified: Tue, 15 Nov 1994 08:12:31 GMT\r\n"
+                                "Content-Length: 5\r\n"
+                                "\r\n"
+                                "hello";
+                        }
+                        ::send(_fd, response, ::strlen(response), 0);
+                    }
+                }
+                ::close(_fd);
+            }
+
+            int                  _fd;
+            volatile bool&       _done;
+            OpenThreads::Atomic& _numRequests;
+            OpenThreads::Atomic& _numNotModified;
+            OpenThreads::Atomic& _numCurrentTags;
+        };
+
+        int                      _fd;
+        unsigned short           _port;
+        volatile bool            _done;
+        std::vector<Connection*> _connections;
+        OpenThreads::Atomic      _numRequests;
+        OpenThreads::Atomic      _numNotModified;
+        OpenThreads::Atomic      _numCurrentTags;
+    };
+
+    /** Issues a series of GETs against the server. */
+    class Client : public OpenThreads::Thread
+    {
+    public:
+        Client(const std::string& baseURL, unsigned count, OpenThreads::Atomic& ok) :
+            _baseURL(baseURL), _count(count), _ok(ok) { }
+
+        void run()
+        {
+            for(unsigned i=0; i<_count; ++i)
+            {
+                HTTPResponse response = HTTPClient::get(Stringify() << _baseURL << "/tile/" << i);
+                if ( response.isOK() && response.getPartAsString(0) == "hello" )
+                    ++_ok;
+            }
+        }
+
+    private:
+        std::string          _baseURL;
+        unsigned             _count;
+        OpenThreads::Atomic& _ok;
+    };
+
+    /** Reads one URI as a string, optionally waiting on a barrier first. */
+    class Reader : public OpenThreads::Thread
+    {
+    public:
+        Reader(const URI& uri, OpenThreads::Barrier* barrier, ProgressCallback* progress) :
+            _uri(uri), _barrier(barrier), _progress(progress) { }
+
+        void run()
+        {
+            if ( _barrier )
+                _barrier->block();
+            _result = _uri.readString(0L, _progress.get());
+        }
+
+        ReadResult _result;
+
+    private:
+        URI                              _uri;
+        OpenThreads::Barrier*            _barrier;
+        osg::ref_ptr<ProgressCallback>   _progress;
+    };
+}
+
+TEST_CASE( "HTTPClient shares connections across threads and reports per-host metrics" ) {
+
+    HTTPClient::globalInit();
+
+    HTTPClientTest::Server server;
+    server.start();
+
+    std::string host = Stringify() << "http://127.0.0.1:" << server.getPort();
+
+    // the metrics accumulate over the life of the process; compare to a snapshot.
+    HTTPHostMetricsMap before;
+    HTTPClient::getHostMetrics(before);
+    HTTPHostMetrics m0 = before[host];
+
+    unsigned oldMax = HTTPClient::getMaxConnectionsPerHost();
+    HTTPClient::setMaxConnectionsPerHost(2u);
+
+    const unsigned numClients = 4u, numRequests = 10u;
+    OpenThreads::Atomic ok;
+    std::vector<HTTPClientTest::Client*> clients;
+    for(unsigned i=0; i<numClients; ++i)
+    {
+        clients.push_back(new HTTPClientTest::Client(host, numRequests, ok));
+        clients.back()->start();
+    }
+    for(unsigned i=0; i<numClients; ++i)
+    {
+        clients[i]->join();
+        delete clients[i];
+    }
+
+    HTTPClient::setMaxConnectionsPerHost(oldMax);
+
+    REQUIRE((unsigned)ok == numClients*numRequests);
+
+    HTTPHostMetricsMap metrics;
+    HTTPClient::getHostMetrics(metrics);
+    REQUIRE(metrics.find(host) != metrics.end());
+
+    const HTTPHostMetrics& m = metrics[host];
+    unsigned completed = m.completed - m0.completed;
+    unsigned newConnections = m.newConnections - m0.newConnections;
+    REQUIRE(completed == numClients*numRequests);
+    REQUIRE(m.inFlight == 0u);
+    REQUIRE(m.queued == 0u);
+
+    // four threads share two pooled connections:
+    REQUIRE(newConnections <= 2u);
+    REQUIRE((double)(completed - newConnections) / (double)completed >= 0.9);
+    REQUIRE(m.latencyP50 > 0.0);
+    REQUIRE(m.latencyP50 <= m.latencyP90);
+    REQUIRE(m.latencyP90 <= m.latencyP99);
+
+    // an explicit shutdown stops the transfer thread; the next request starts it again.
+    HTTPClient::globalShutdown();
+    HTTPResponse response = HTTPClient::get(host + "/tile/0");
+    REQUIRE(response.isOK());
+    REQUIRE(response.getPartAsString(0) == "hello");
+}
+
+TEST_CASE( "URI revalidates expired cache records with a conditional GET" ) {
+
+    HTTPClient::globalInit();
+
+    HTTPClientTest::Server server;
+    server.start();
+
+    // a cache that keeps the time each record was written:
+    Drivers::FileSystemCacheOptions cacheOptions;
+    cacheOptions.rootPath() = getTempName(osgDB::concatPaths(getTempPath(), "oe_revalidation"));
+    osg::ref_ptr<Cache> cache = CacheFactory::create(cacheOptions);
+    REQUIRE(cache.valid());
+
+    osg::ref_ptr<CacheSettings> cacheSettings = new CacheSettings();
+    cacheSettings->setCache(cache.get());
+    cacheSettings->setCacheBin(cache->addBin("revalidation_test"));
+    cacheSettings->cachePolicy() = CachePolicy(CachePolicy::USAGE_READ_WRITE);
+    cacheSettings->cachePolicy()->maxAge() = 1;
+
+    osg::ref_ptr<osgDB::Options> options = new osgDB::Options();
+    cacheSettings->store(options.get());
+
+    URI uri(Stringify() << "http://127.0.0.1:" << server.getPort() << "/validated.txt");
+
+    ReadResult first = uri.readString(options.get());
+    REQUIRE(first.succeeded());
+    REQUIRE(!first.isFromCache());
+    REQUIRE(first.getString() == "hello");
+
+    // still fresh, so the server doesn't hear about it:
+    ReadResult fresh = uri.readString(options.get());
+    REQUIRE(fresh.succeeded());
+    REQUIRE(fresh.isFromCache());
+    REQUIRE(server.getNumRequests() == 1u);
+
+    // once expired, a conditional GET comes back 304 with a new tag:
+    OpenThreads::Thread::microSleep(2500000);
+    ReadResult second = uri.readString(options.get());
+    REQUIRE(second.succeeded());
+    REQUIRE(second.isFromCache());
+    REQUIRE(second.getString() == "hello");
+    REQUIRE(server.getNumRequests() == 2u);
+    REQUIRE(server.getNumNotModified() == 1u);
+
+    // the next revalidation presents the tag the 304 gave us:
+    OpenThreads::Thread::microSleep(2500000);
+    ReadResult third = uri.readString(options.get());
+    REQUIRE(third.succeeded());
+    REQUIRE(third.isFromCache());
+    REQUIRE(third.getString() == "hello");
+    REQUIRE(server.getNumNotModified() == 2u);
+    REQUIRE(server.getNumCurrentTags() == 1u);
+
+    cache->clear();
+}
+
+TEST_CASE( "URI coalesces concurrent reads of the same remote URI" ) {
+
+    HTTPClient::globalInit();
+
+    HTTPClientTest::Server server;
+    server.start();
+
+    URI uri(Stringify() << "http://127.0.0.1:" << server.getPort() << "/slow/coalesced.txt");
+
+    const unsigned coalescedBefore = URI::getNumCoalescedRequests();
+
+    const unsigned numReaders = 4u;
+    OpenThreads::Barrier barrier(numReaders);
+    std::vector<HTTPClientTest::Reader*> readers;
+    for(unsigned i=0; i<numReaders; ++i)
+    {
+        readers.push_back(new HTTPClientTest::Reader(uri, &barrier, 0L));
+        readers.back()->start();
+    }
+
+    // A late reader joins the request in flight and then gives up on it.
+    OpenThreads::Thread::microSleep(100000);
+    osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+    HTTPClientTest::Reader canceled(uri, 0L, progress.get());
+    canceled.start();
+    OpenThreads::Thread::microSleep(50000);
+    progress->cancel();
+    canceled.join();
+
+    for(unsigned i=0; i<numReaders; ++i)
+    {
+        readers[i]->join();
+        REQUIRE(readers[i]->_result.succeeded());
+        REQUIRE(readers[i]->_result.getString() == "hello");
+        delete readers[i];
+    }
+
+    REQUIRE(canceled._result.code() == ReadResult::RESULT_CANCELED);
+    REQUIRE(server.getNumRequests() == 1u);
+
+    // every reader but the one that made the request waited for it; the
+    // canceled one gave up instead.
+    REQUIRE(URI::getNumCoalescedRequests() - coalescedBefore == numReaders - 1u);
+}
+
+#endif // _WIN32
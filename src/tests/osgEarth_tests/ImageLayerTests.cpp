@@ -24,12 +24,57 @@
 
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Registry>
+#include <osgEarth/MemCache>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Progress>
 
 #include <osgEarthDrivers/gdal/GDALOptions>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
 
+namespace
+{
+    // Returns a tile with one transparent pixel, carrying a made-up payload
+    // whenever the caller asks for one.
+    class PayloadTileSource : public TileSource
+    {
+    public:
+        PayloadTileSource() : TileSource(TileSourceOptions()), _numDecoded(0u) { }
+
+        Status initialize(const osgDB::Options* readOptions)
+        {
+            setProfile( Registry::instance()->getGlobalGeodeticProfile() );
+            _dbOptions = Registry::instance()->cloneOrCreateOptions(readOptions);
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            ++_numDecoded;
+            osg::Image* image = new osg::Image();
+            image->allocateImage(256, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            ::memset(image->data(), 255, image->getTotalSizeInBytes());
+            image->data(0, 0)[3] = 0;
+
+            if ( ImageUtils::getKeepEncodedPayloads(_dbOptions.get()) )
+                ImageUtils::setEncodedPayload(image, "source bytes", "image/png");
+
+            return image;
+        }
+
+        bool readEncodedImage(const TileKey& key, std::string& data, std::string& mimeType, ProgressCallback* progress)
+        {
+            data = "source bytes";
+            mimeType = "image/png";
+            return true;
+        }
+
+        unsigned _numDecoded;
+        osg::ref_ptr<osgDB::Options> _dbOptions;
+    };
+}
+
 TEST_CASE( "ImageLayers can be created from TileSourceOptions" ) {
 
     GDALOptions opt;
@@ -56,4 +101,144 @@ TEST_CASE( "ImageLayers can be created from TileSourceOptions" ) {
         REQUIRE(image.getImage()->t() == 256);
         REQUIRE(image.getExtent() == key.getExtent());
     }
+
+    SECTION("Tiles past the data's resolution are reported as missing") {
+        TileKey key(20,0,0,layer->getProfile());
+        ReadResult r = layer->getTileSource()->readImage(key, 0L, 0L);
+        REQUIRE(r.failed());
+        REQUIRE(r.code() == ReadResult::RESULT_NOT_FOUND);
+    }
+}
+
+TEST_CASE( "TileBlacklist keeps tiles across sessions in a cache bin" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    CacheBin* bin = cache->addBin("blacklist_test");
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    TileKey empty(10, 100, 200, profile), other(10, 101, 200, profile);
+
+    {
+        osg::ref_ptr<TileBlacklist> session = new TileBlacklist(1000u, 3600);
+        session->setCacheBin(bin);
+        session->add(empty, true);
+        session->add(other);
+        session->flush();
+    }
+
+    SECTION("A later session finds only the tiles added as persistent") {
+        osg::ref_ptr<TileBlacklist> later = new TileBlacklist(1000u, 3600);
+        later->setCacheBin(bin);
+        REQUIRE(later->contains(empty));
+        REQUIRE(!later->contains(other));
+        REQUIRE(!later->contains(TileKey(10, 100, 200, Registry::instance()->getSphericalMercatorProfile())));
+    }
+
+    SECTION("Removed tiles are forgotten") {
+        osg::ref_ptr<TileBlacklist> later = new TileBlacklist(1000u, 3600);
+        later->setCacheBin(bin);
+        later->remove(empty);
+        later->flush();
+
+        osg::ref_ptr<TileBlacklist> last = new TileBlacklist(1000u, 3600);
+        last->setCacheBin(bin);
+        REQUIRE(!last->contains(empty));
+    }
+
+    SECTION("The blacklist is kept in the bin's metadata, out of reach of eviction") {
+        REQUIRE(bin->readMetadata().hasChild("blacklist"));
+        REQUIRE(bin->getRecordStatus("blacklist") == CacheBin::STATUS_NOT_FOUND);
+    }
+}
+
+TEST_CASE( "TileBlacklist starts over once it holds its capacity" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    CacheBin* bin = cache->addBin("blacklist_capacity_test");
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    {
+        osg::ref_ptr<TileBlacklist> session = new TileBlacklist(4u, 3600);
+        session->setCacheBin(bin);
+        for(unsigned x=0; x<5u; ++x)
+            session->add(TileKey(10, x, 0, profile), true);
+
+        // this session still knows all of them exactly:
+        for(unsigned x=0; x<5u; ++x)
+            REQUIRE(session->contains(TileKey(10, x, 0, profile)));
+
+        session->flush();
+    }
+
+    osg::ref_ptr<TileBlacklist> later = new TileBlacklist(4u, 3600);
+    later->setCacheBin(bin);
+    REQUIRE(later->contains(TileKey(10, 4, 0, profile)));
+    REQUIRE(!later->contains(TileKey(10, 0, 0, profile)));
+}
+
+TEST_CASE( "ImageLayers hand out encoded payloads only for unmodified tiles" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(1, 0, 0, profile);
+    std::string data, mimeType;
+
+    SECTION("Payloads are not kept unless something will use them") {
+        osg::ref_ptr<ImageLayer> layer = new ImageLayer(ImageLayerOptions("payloads"), new PayloadTileSource());
+        REQUIRE(layer->open().isOK());
+
+        GeoImage image = layer->createImage(key);
+        REQUIRE(image.valid());
+        REQUIRE(!ImageUtils::getEncodedPayload(image.getImage(), data, mimeType));
+    }
+
+    SECTION("An untouched tile keeps its payload for packaging") {
+        osg::ref_ptr<ImageLayer> layer = new ImageLayer(ImageLayerOptions("payloads"), new PayloadTileSource());
+        REQUIRE(layer->open().isOK());
+        layer->setKeepEncodedPayloads(true);
+
+        GeoImage image = layer->createImage(key);
+        REQUIRE(image.valid());
+        REQUIRE(ImageUtils::getEncodedPayload(image.getImage(), data, mimeType));
+        REQUIRE(data == "source bytes");
+    }
+
+    SECTION("A tile the layer modified is not copied as-is") {
+        ImageLayerOptions options("payloads");
+        options.featherPixels() = true;
+        osg::ref_ptr<ImageLayer> layer = new ImageLayer(options, new PayloadTileSource());
+        REQUIRE(layer->open().isOK());
+        layer->setKeepEncodedPayloads(true);
+
+        GeoImage image = layer->createImage(key);
+        REQUIRE(image.valid());
+        REQUIRE(image.getImage()->data(0, 0)[3] == 255);
+        REQUIRE(!ImageUtils::getEncodedPayload(image.getImage(), data, mimeType));
+    }
+}
+
+TEST_CASE( "ImageLayers copy source bytes without decoding them" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    TileKey key(1, 0, 0, profile);
+    std::string data, mimeType;
+
+    SECTION("A layer with no pixel processing reads the bytes directly") {
+        osg::ref_ptr<PayloadTileSource> source = new PayloadTileSource();
+        osg::ref_ptr<ImageLayer> layer = new ImageLayer(ImageLayerOptions("encoded"), source.get());
+        REQUIRE(layer->open().isOK());
+
+        REQUIRE(layer->readEncodedImage(key, data, mimeType));
+        REQUIRE(data == "source bytes");
+        REQUIRE(mimeType == "image/png");
+        REQUIRE(source->_numDecoded == 0u);
+    }
+
+    SECTION("A layer that processes the pixels does not") {
+        ImageLayerOptions options("encoded");
+        options.featherPixels() = true;
+        osg::ref_ptr<ImageLayer> layer = new ImageLayer(options, new PayloadTileSource());
+        REQUIRE(layer->open().isOK());
+
+        REQUIRE(!layer->readEncodedImage(key, data, mimeType));
+    }
 }
@@ -0,0 +1,166 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ImageUtils>
+
+using namespace osgEarth;
+
+namespace
+{
+    osg::Image* makeRGBA(unsigned s, unsigned t, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        for(unsigned i=0; i<s*t; ++i)
+        {
+            unsigned char* p = image->data() + i*4;
+            p[0] = r; p[1] = g; p[2] = b; p[3] = a;
+        }
+        return image;
+    }
+}
+
+TEST_CASE( "ImageUtils classifies images in a single pass" ) {
+
+    SECTION("Transparent images are empty and single-colored") {
+        osg::ref_ptr<osg::Image> image = makeRGBA(256, 256, 10, 20, 30, 0);
+        ImageUtils::ImageClassification info;
+        REQUIRE(ImageUtils::classifyImage(image.get(), info));
+        REQUIRE(info.empty);
+        REQUIRE(info.singleColor);
+        REQUIRE(info.hasAlpha);
+        REQUIRE(!info.opaque);
+        REQUIRE(ImageUtils::isEmptyImage(image.get()));
+        REQUIRE(ImageUtils::isSingleColorImage(image.get()));
+        REQUIRE(ImageUtils::hasTransparency(image.get()));
+    }
+
+    SECTION("One differing pixel breaks uniformity and emptiness") {
+        osg::ref_ptr<osg::Image> image = makeRGBA(255, 7, 10, 20, 30, 0);
+        unsigned char* last = image->data(254, 6);
+        last[1] = 200; last[3] = 255;
+        ImageUtils::ImageClassification info;
+        REQUIRE(ImageUtils::classifyImage(image.get(), info));
+        REQUIRE(!info.empty);
+        REQUIRE(!info.singleColor);
+        REQUIRE(!info.opaque);
+        REQUIRE(!ImageUtils::isEmptyImage(image.get()));
+        REQUIRE(!ImageUtils::isSingleColorImage(image.get()));
+    }
+
+    SECTION("Differences within the threshold are ignored") {
+        osg::ref_ptr<osg::Image> image = makeRGBA(64, 64, 100, 100, 100, 255);
+        image->data(33, 12)[0] = 101;
+        ImageUtils::ImageClassification info;
+        REQUIRE(ImageUtils::classifyImage(image.get(), info));
+        REQUIRE(info.singleColor);
+        REQUIRE(info.opaque);
+        REQUIRE(!info.empty);
+        REQUIRE(!ImageUtils::hasTransparency(image.get()));
+    }
+
+    SECTION("Images without alpha are opaque and never empty") {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(17, 3, 1, GL_LUMINANCE, GL_FLOAT);
+        float* data = reinterpret_cast<float*>(image->data());
+        for(unsigned i=0; i<17*3; ++i)
+            data[i] = 42.0f;
+        ImageUtils::ImageClassification info;
+        REQUIRE(ImageUtils::classifyImage(image.get(), info));
+        REQUIRE(info.singleColor);
+        REQUIRE(info.opaque);
+        REQUIRE(!info.hasAlpha);
+        REQUIRE(!info.empty);
+
+        data[16] = 43.0f;
+        REQUIRE(!ImageUtils::isSingleColorImage(image.get()));
+    }
+
+    SECTION("Only the requested properties are computed") {
+        osg::ref_ptr<osg::Image> image = makeRGBA(32, 32, 10, 20, 30, 0);
+        ImageUtils::ImageClassification info;
+        REQUIRE(ImageUtils::classifyImage(image.get(), info, 0.01f, ImageUtils::CLASSIFY_EMPTY));
+        REQUIRE(info.empty);
+        REQUIRE(info.hasAlpha);
+        REQUIRE(!info.singleColor);
+        REQUIRE(!info.opaque);
+    }
+}
+
+TEST_CASE( "ImageUtils tracks whether an encoded payload still matches its image" ) {
+
+    const std::string bytes("not really a png");
+
+    SECTION("An untouched image reports its payload") {
+        osg::ref_ptr<osg::Image> image = makeRGBA(8, 8, 1, 2, 3, 255);
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        std::string data, mimeType;
+        REQUIRE(ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+        REQUIRE(data == bytes);
+        REQUIRE(mimeType == "image/png");
+
+        // normalizing the internal format doesn't change the pixels
+        ImageUtils::fixInternalFormat(image.get());
+        REQUIRE(ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+
+        ImageUtils::removeEncodedPayload(image.get());
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+    }
+
+    SECTION("Modified or annotated images drop the payload") {
+        std::string data, mimeType;
+
+        osg::ref_ptr<osg::Image> image = makeRGBA(8, 8, 1, 2, 3, 255);
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        image->data(0, 0)[0] = 9;
+        image->dirty();
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+
+        image = makeRGBA(8, 8, 1, 2, 3, 255);
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        ImageUtils::markAsUnNormalized(image.get(), true);
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+    }
+
+    SECTION("In-place ImageUtils edits drop the payload") {
+        std::string data, mimeType;
+
+        osg::ref_ptr<osg::Image> image = makeRGBA(8, 8, 1, 2, 3, 255);
+        image->data(0, 0)[3] = 0;
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        REQUIRE(ImageUtils::featherAlphaRegions(image.get()));
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+
+        image = makeRGBA(8, 8, 1, 2, 3, 128);
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        REQUIRE(ImageUtils::convertToPremultipliedAlpha(image.get()));
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+
+        image = makeRGBA(8, 8, 1, 2, 3, 255);
+        osg::ref_ptr<osg::Image> other = makeRGBA(8, 8, 9, 9, 9, 255);
+        ImageUtils::setEncodedPayload(image.get(), bytes, "image/png");
+        REQUIRE(ImageUtils::mix(image.get(), other.get(), 0.5f));
+        REQUIRE(!ImageUtils::getEncodedPayload(image.get(), data, mimeType));
+    }
+}
@@ -0,0 +1,279 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/MetaTiler>
+#include <osgEarth/Registry>
+#include <osgEarth/Progress>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
+#include <osg/Timer>
+#include <string.h>
+
+using namespace osgEarth;
+
+namespace MetaTilerTest
+{
+    /**
+     * Returns a metatile whose pixels record the column (red) and row from
+     * the top (green) of the tile they belong to.
+     */
+    class GridFetcher : public MetaTiler::Fetcher
+    {
+    public:
+        GridFetcher(unsigned tileSize, unsigned overlap) :
+            _tileSize(tileSize), _overlap(overlap), _width(0u), _height(0u) { }
+
+        osg::Image* fetchMetaTile(const GeoExtent& extent, unsigned width, unsigned height, ProgressCallback* progress)
+        {
+            _extent = extent;
+            _width  = width;
+            _height = height;
+
+            const unsigned stride = _tileSize - _overlap;
+            const unsigned rows = (height - _overlap) / stride;
+
+            osg::Image* image = new osg::Image();
+            image->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+            for(unsigned t=0; t<height; ++t)
+            {
+                for(unsigned s=0; s<width; ++s)
+                {
+                    unsigned char* p = image->data(s, t);
+                    p[0] = (unsigned char)osg::minimum(s / stride, (width - _overlap) / stride - 1u);
+                    p[1] = (unsigned char)(rows - 1u - osg::minimum(t / stride, rows - 1u));
+                    p[2] = 0;
+                    p[3] = 255;
+                }
+            }
+            return image;
+        }
+
+        unsigned  _tileSize, _overlap;
+        GeoExtent _extent;
+        unsigned  _width, _height;
+    };
+
+    /** Takes its time, like a real server, and counts the requests. */
+    class SlowFetcher : public GridFetcher
+    {
+    public:
+        SlowFetcher(unsigned tileSize, unsigned delay_ms) :
+            GridFetcher(tileSize, 0u), _delay_ms(delay_ms) { }
+
+        osg::Image* fetchMetaTile(const GeoExtent& extent, unsigned width, unsigned height, ProgressCallback* progress)
+        {
+            ++_calls;
+            OpenThreads::Thread::microSleep(_delay_ms * 1000u);
+            return GridFetcher::fetchMetaTile(extent, width, height, progress);
+        }
+
+        unsigned            _delay_ms;
+        OpenThreads::Atomic _calls;
+    };
+
+    /** Requests one tile on its own thread. */
+    class Requester : public OpenThreads::Thread
+    {
+    public:
+        Requester(MetaTiler* metaTiler, const TileKey& key, MetaTiler::Fetcher* fetcher, ProgressCallback* progress =0L) :
+            _metaTiler(metaTiler), _key(key), _fetcher(fetcher), _progress(progress) { }
+
+        void run()
+        {
+            _result = _metaTiler->createImage(_key, _fetcher, 0L, _progress.get());
+        }
+
+        osg::ref_ptr<MetaTiler>        _metaTiler;
+        TileKey                        _key;
+        MetaTiler::Fetcher*            _fetcher;
+        osg::ref_ptr<ProgressCallback> _progress;
+        osg::ref_ptr<osg::Image>       _result;
+    };
+
+    /** Rejects one tile, the way a nodata check would. */
+    struct RejectOperation : public TileSource::ImageOperation
+    {
+        RejectOperation(unsigned col, unsigned row) : _col(col), _row(row) { }
+        void operator()(osg::ref_ptr<osg::Image>& image) {
+            if ( image.valid() && belongsTo(image.get(), _col, _row) )
+                image = 0L;
+        }
+        static bool belongsTo(const osg::Image* image, unsigned col, unsigned row) {
+            return image->data(0, 0)[0] == col && image->data(0, 0)[1] == row;
+        }
+        unsigned _col, _row;
+    };
+
+    /** Counts the tiles it is applied to. */
+    struct CountingOperation : public TileSource::ImageOperation
+    {
+        CountingOperation() : _count(0u) { }
+        void operator()(osg::ref_ptr<osg::Image>& image) { ++_count; }
+        unsigned _count;
+    };
+
+    /** Whether every pixel of the tile belongs to the given column and row. */
+    bool isTile(const osg::Image* image, unsigned col, unsigned row)
+    {
+        for(int t=0; t<image->t(); ++t)
+            for(int s=0; s<image->s(); ++s)
+                if (image->data(s, t)[0] != col || image->data(s, t)[1] != row)
+                    return false;
+        return true;
+    }
+}
+
+TEST_CASE( "MetaTiler splits a metatile into its tiles" ) {
+
+    // level 1 of the global geodetic profile is 4x2 tiles.
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    SECTION("Each tile gets its own block of the metatile") {
+        osg::ref_ptr<MetaTiler> metaTiler = new MetaTiler(2u, 2u, 4u);
+        MetaTilerTest::GridFetcher fetcher(4u, 0u);
+        osg::ref_ptr<MetaTilerTest::CountingOperation> op = new MetaTilerTest::CountingOperation();
+
+        osg::ref_ptr<osg::Image> tile = metaTiler->createImage(TileKey(1, 3, 1, profile), &fetcher, op.get(), 0L);
+        REQUIRE(tile.valid());
+        REQUIRE(fetcher._width == 8u);
+        REQUIRE(fetcher._height == 8u);
+        REQUIRE(fetcher._extent.xMin() == Approx(0.0));
+        REQUIRE(fetcher._extent.xMax() == Approx(180.0));
+        REQUIRE(fetcher._extent.yMin() == Approx(-90.0));
+        REQUIRE(fetcher._extent.yMax() == Approx(90.0));
+        REQUIRE(tile->s() == 4);
+        REQUIRE(tile->t() == 4);
+        REQUIRE(MetaTilerTest::isTile(tile.get(), 1u, 1u));
+
+        // the operation runs once per tile in the metatile:
+        REQUIRE(op->_count == 4u);
+
+        // siblings come from the same request:
+        tile = metaTiler->createImage(TileKey(1, 2, 0, profile), &fetcher, op.get(), 0L);
+        REQUIRE(tile.valid());
+        REQUIRE(MetaTilerTest::isTile(tile.get(), 0u, 0u));
+        REQUIRE(metaTiler->getNumRequests() == 1u);
+        REQUIRE(metaTiler->getNumSharedTiles() == 1u);
+        REQUIRE(op->_count == 4u);
+    }
+
+    SECTION("Adjacent tiles share the overlapping pixels") {
+        osg::ref_ptr<MetaTiler> metaTiler = new MetaTiler(2u, 2u, 5u, 1u);
+        MetaTilerTest::GridFetcher fetcher(5u, 1u);
+
+        osg::ref_ptr<osg::Image> tile = metaTiler->createImage(TileKey(1, 0, 0, profile), &fetcher, 0L, 0L);
+        REQUIRE(tile.valid());
+        REQUIRE(fetcher._width == 9u);
+        REQUIRE(fetcher._height == 9u);
+        REQUIRE(tile->s() == 5);
+        REQUIRE(tile->t() == 5);
+
+        // the eastern column of the NW tile is the western column of the NE tile:
+        REQUIRE(tile->data(3, 1)[0] == 0u);
+        REQUIRE(tile->data(4, 1)[0] == 1u);
+
+        // and its southern row is the northern row of the SW tile:
+        osg::ref_ptr<osg::Image> below = metaTiler->createImage(TileKey(1, 0, 1, profile), &fetcher, 0L, 0L);
+        REQUIRE(below.valid());
+        REQUIRE(below->data(1, 3)[1] == 1u);
+        REQUIRE(::memcmp(below->data(0, 4), tile->data(0, 0), 5*4) == 0);
+        REQUIRE(metaTiler->getNumRequests() == 1u);
+    }
+}
+
+TEST_CASE( "MetaTiler shares one fetch between concurrent requests" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    SECTION("All the tiles of a metatile requested at once") {
+        osg::ref_ptr<MetaTiler> metaTiler = new MetaTiler(2u, 2u, 4u);
+        MetaTilerTest::SlowFetcher fetcher(4u, 200u);
+
+        std::vector<MetaTilerTest::Requester*> requesters;
+        for(unsigned r=0; r<2u; ++r)
+            for(unsigned c=0; c<2u; ++c)
+                requesters.push_back(new MetaTilerTest::Requester(metaTiler.get(), TileKey(1, 2+c, r, profile), &fetcher));
+
+        for(unsigned i=0; i<requesters.size(); ++i)
+            requesters[i]->start();
+        for(unsigned i=0; i<requesters.size(); ++i)
+            requesters[i]->join();
+
+        REQUIRE((unsigned)fetcher._calls == 1u);
+        REQUIRE(metaTiler->getNumRequests() == 1u);
+        REQUIRE(metaTiler->getNumSharedTiles() == 3u);
+
+        for(unsigned i=0; i<requesters.size(); ++i)
+        {
+            REQUIRE(requesters[i]->_result.valid());
+            REQUIRE(MetaTilerTest::isTile(requesters[i]->_result.get(), i%2u, i/2u));
+        }
+
+        for(unsigned i=0; i<requesters.size(); ++i)
+            delete requesters[i];
+    }
+
+    SECTION("A waiting request gives up when it is canceled") {
+        osg::ref_ptr<MetaTiler> metaTiler = new MetaTiler(2u, 2u, 4u);
+        MetaTilerTest::SlowFetcher fetcher(4u, 1000u);
+
+        MetaTilerTest::Requester owner(metaTiler.get(), TileKey(1, 0, 0, profile), &fetcher);
+        owner.start();
+        OpenThreads::Thread::microSleep(100000);
+
+        osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+        progress->cancel();
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        osg::ref_ptr<osg::Image> tile = metaTiler->createImage(TileKey(1, 1, 0, profile), &fetcher, 0L, progress.get());
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+        REQUIRE(!tile.valid());
+        REQUIRE(seconds < 0.5);
+
+        // the owner's request is unaffected:
+        owner.join();
+        REQUIRE(owner._result.valid());
+        REQUIRE((unsigned)fetcher._calls == 1u);
+    }
+}
+
+TEST_CASE( "MetaTiler blacklists siblings the image operation rejects" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<MetaTiler> metaTiler = new MetaTiler(2u, 2u, 4u);
+    osg::ref_ptr<TileBlacklist> blacklist = new TileBlacklist();
+    metaTiler->setBlacklist(blacklist.get());
+
+    MetaTilerTest::GridFetcher fetcher(4u, 0u);
+    osg::ref_ptr<MetaTilerTest::RejectOperation> op = new MetaTilerTest::RejectOperation(1u, 0u);
+
+    osg::ref_ptr<osg::Image> tile = metaTiler->createImage(TileKey(1, 2, 0, profile), &fetcher, op.get(), 0L);
+    REQUIRE(tile.valid());
+    REQUIRE(blacklist->contains(TileKey(1, 3, 0, profile)));
+    REQUIRE(!blacklist->contains(TileKey(1, 2, 1, profile)));
+    REQUIRE(!blacklist->contains(TileKey(1, 2, 0, profile)));
+}
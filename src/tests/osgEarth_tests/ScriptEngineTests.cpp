@@ -0,0 +1,122 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/ScriptFilter>
+#include <osgEarthSymbology/Geometry>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace ScriptEngineTest
+{
+    Feature* makeRoad(const std::string& name, int lanes)
+    {
+        PointSet* point = new PointSet();
+        point->push_back(osg::Vec3d(1, 2, 0));
+        Feature* f = new Feature(point, 0L);
+        f->set("name", name);
+        f->set("lanes", lanes);
+        return f;
+    }
+}
+
+TEST_CASE( "The JavaScript engine binds features natively" ) {
+
+    osg::ref_ptr<ScriptEngine> engine = ScriptEngineFactory::create("javascript");
+    REQUIRE(engine.valid());
+    engine->setProfile("full");
+
+    osg::ref_ptr<Feature> road = ScriptEngineTest::makeRoad("Main St", 4);
+
+    SECTION("Scripts read properties") {
+        REQUIRE(engine->run("feature.properties.name", road.get()).asString() == "Main St");
+        REQUIRE(engine->run("feature.properties.lanes * 2", road.get()).asDouble() == 8.0);
+        REQUIRE(engine->run("feature.attributes.lanes", road.get()).asDouble() == 4.0);
+    }
+
+    SECTION("The in operator sees the feature's attributes") {
+        REQUIRE(engine->run("'lanes' in feature.properties", road.get()).asBool());
+        REQUIRE(!engine->run("'width' in feature.properties", road.get()).asBool());
+        REQUIRE(!engine->run("'toString' in feature.properties", road.get()).asBool());
+    }
+
+    SECTION("Attributes named like Object built-ins read as attributes") {
+        road->set("constructor", std::string("bridge"));
+        REQUIRE(engine->run("feature.properties.constructor", road.get()).asString() == "bridge");
+        REQUIRE(engine->run("'constructor' in feature.properties", road.get()).asBool());
+        REQUIRE(engine->run("feature.properties.valueOf === undefined", road.get()).asBool());
+    }
+
+    SECTION("save() writes properties back to the feature") {
+        ScriptResult r = engine->run(
+            "feature.properties.lanes = 6; feature.properties.kind = 'road'; feature.save(); true",
+            road.get());
+        REQUIRE(r.success());
+        REQUIRE(road->getInt("lanes") == 6);
+        REQUIRE(road->getString("kind") == "road");
+        REQUIRE(road->getString("name") == "Main St");
+    }
+
+    SECTION("A batch run returns one result per feature") {
+        FeatureList features;
+        for(int i=1; i<=3; ++i)
+            features.push_back(ScriptEngineTest::makeRoad("road", i));
+
+        std::vector<ScriptResult> results;
+        engine->run("feature.properties.lanes > 1", features, results);
+        REQUIRE(results.size() == 3u);
+        REQUIRE(!results[0].asBool());
+        REQUIRE(results[1].asBool());
+        REQUIRE(results[2].asBool());
+
+        // each feature is bound in turn; none leaks into the next
+        engine->run("feature.properties.lanes * 10", features, results);
+        REQUIRE(results[2].asDouble() == 30.0);
+    }
+}
+
+TEST_CASE( "ScriptFilter drops features without geometry before running the script" ) {
+
+    osg::ref_ptr<ScriptFilter> filter = new ScriptFilter(Config("script", "feature.properties.lanes > 1"));
+
+    FeatureList features;
+    features.push_back(ScriptEngineTest::makeRoad("one", 1));
+    features.push_back(ScriptEngineTest::makeRoad("two", 2));
+    features.push_back(0L);
+    Feature* empty = new Feature(0L, 0L);
+    empty->set("lanes", 5);
+    features.push_back(empty);
+    features.push_back(ScriptEngineTest::makeRoad("three", 3));
+
+    FilterContext context;
+    filter->push(features, context);
+
+    REQUIRE(features.size() == 2u);
+    REQUIRE(features.front()->getString("name") == "two");
+    REQUIRE(features.back()->getString("name") == "three");
+}
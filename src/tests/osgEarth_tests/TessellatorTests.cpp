@@ -0,0 +1,218 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Tessellator>
+#include <osgEarthFeatures/FeatureSource>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osgUtil/Tessellator>
+#include <osg/Timer>
+#include <math.h>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    double triangleArea(const osg::Vec3Array& v, const osg::DrawElementsUInt& tris)
+    {
+        double sum = 0.0;
+        for(unsigned i=0; i+2<tris.size(); i+=3)
+        {
+            const osg::Vec3& a = v[tris[i]];
+            const osg::Vec3& b = v[tris[i+1]];
+            const osg::Vec3& c = v[tris[i+2]];
+            sum += 0.5 * fabs((b.x()-a.x())*(c.y()-a.y()) - (c.x()-a.x())*(b.y()-a.y()));
+        }
+        return sum;
+    }
+
+    void addRing(const Ring* ring, Geometry::Orientation winding, osg::Vec3Array* verts, osg::Geometry* geom)
+    {
+        osg::ref_ptr<Ring> copy = new Ring(*ring);
+        copy->rewind(winding);
+        unsigned first = verts->size();
+        for(Ring::const_iterator i = copy->begin(); i != copy->end(); ++i)
+            verts->push_back(osg::Vec3(*i));
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, first, verts->size()-first));
+    }
+
+    /** One geometry per feature: each part's outer ring (CCW) followed by its holes (CW). */
+    void readPolygons(const std::string& url, std::vector< osg::ref_ptr<osg::Geometry> >& out)
+    {
+        OGRFeatureOptions options;
+        options.url() = url;
+        osg::ref_ptr<FeatureSource> source = FeatureSourceFactory::create(options);
+        if ( !source.valid() || source->open().isError() )
+            return;
+
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(Query());
+        while( cursor.valid() && cursor->hasMore() )
+        {
+            osg::ref_ptr<Feature> f = cursor->nextFeature();
+            if ( !f.valid() || !f->getGeometry() )
+                continue;
+
+            osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+            osg::ref_ptr<osg::Vec3Array> verts = new osg::Vec3Array();
+            geom->setVertexArray(verts.get());
+
+            GeometryIterator parts(f->getGeometry(), false);
+            while( parts.hasMore() )
+            {
+                const Symbology::Polygon* poly = dynamic_cast<const Symbology::Polygon*>(parts.next());
+                if ( !poly || poly->size() < 3 )
+                    continue;
+                addRing(poly, Geometry::ORIENTATION_CCW, verts.get(), geom.get());
+                for(RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h)
+                {
+                    if ( h->get()->size() >= 3 )
+                        addRing(h->get(), Geometry::ORIENTATION_CW, verts.get(), geom.get());
+                }
+            }
+
+            if ( geom->getNumPrimitiveSets() > 0 )
+                out.push_back(geom.get());
+        }
+    }
+
+    osg::Geometry* copyOf(const osg::Geometry* geom)
+    {
+        return new osg::Geometry(*geom, osg::CopyOp::DEEP_COPY_PRIMITIVES);
+    }
+}
+
+TEST_CASE( "Tessellator triangulates polygons with holes" ) {
+
+    // 10x10 square, then a 4x4 hole wound the other way
+    osg::ref_ptr<osg::Vec3Array> v = new osg::Vec3Array();
+    v->push_back(osg::Vec3(0,0,0));  v->push_back(osg::Vec3(10,0,0));
+    v->push_back(osg::Vec3(10,10,0)); v->push_back(osg::Vec3(0,10,0));
+    v->push_back(osg::Vec3(3,3,0));  v->push_back(osg::Vec3(3,7,0));
+    v->push_back(osg::Vec3(7,7,0));  v->push_back(osg::Vec3(7,3,0));
+
+    SECTION("Hole rings that follow their outer ring are cut out") {
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+        geom->setVertexArray(v.get());
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, 0, 4));
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, 4, 4));
+
+        Tessellator tess;
+        REQUIRE(tess.tessellateGeometry(*geom.get()));
+        REQUIRE(geom->getNumPrimitiveSets() == 1u);
+
+        osg::DrawElementsUInt* tris = dynamic_cast<osg::DrawElementsUInt*>(geom->getPrimitiveSet(0));
+        REQUIRE(tris != 0L);
+        REQUIRE(tris->getMode() == GL_TRIANGLES);
+        REQUIRE(fabs(triangleArea(*v.get(), *tris) - 84.0) < 1e-6);
+    }
+
+    SECTION("Hole-wound rings outside their outer ring are left to the fallback") {
+        osg::ref_ptr<osg::Vec3Array> v2 = new osg::Vec3Array(*v.get());
+        v2->push_back(osg::Vec3(20,20,0)); v2->push_back(osg::Vec3(20,24,0));
+        v2->push_back(osg::Vec3(24,24,0)); v2->push_back(osg::Vec3(24,20,0));
+
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+        geom->setVertexArray(v2.get());
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, 0, 4));
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_LOOP, 8, 4));
+
+        // filling it would cover a hole that belongs somewhere else:
+        Tessellator tess;
+        REQUIRE(!tess.tessellateGeometry(*geom.get()));
+        REQUIRE(geom->getNumPrimitiveSets() == 2u);
+        REQUIRE(geom->getPrimitiveSet(0)->getMode() == GL_LINE_LOOP);
+        REQUIRE(geom->getPrimitiveSet(1)->getMode() == GL_LINE_LOOP);
+    }
+
+    SECTION("Large rings triangulate completely") {
+        osg::ref_ptr<osg::Vec3Array> star = new osg::Vec3Array();
+        const unsigned n = 1000u;
+        for(unsigned i=0; i<n; ++i)
+        {
+            double a = 2.0*osg::PI*(double)i/(double)n;
+            double r = (i%2) ? 5.0 : 10.0;
+            star->push_back(osg::Vec3(r*cos(a), r*sin(a), 0));
+        }
+
+        Tessellator tess;
+        osg::ref_ptr<osg::DrawElementsUInt> tris = tess.tessellatePolygon(*star.get(), 0, n, std::vector< std::pair<unsigned,unsigned> >());
+        REQUIRE(tris.valid());
+        REQUIRE(tris->size() == 3u*(n-2u));
+    }
+
+    SECTION("Self-intersecting rings are rejected") {
+        osg::ref_ptr<osg::Vec3Array> bowtie = new osg::Vec3Array();
+        bowtie->push_back(osg::Vec3(0,0,0));  bowtie->push_back(osg::Vec3(10,10,0));
+        bowtie->push_back(osg::Vec3(10,0,0)); bowtie->push_back(osg::Vec3(0,10,0));
+
+        Tessellator tess;
+        osg::ref_ptr<osg::DrawElementsUInt> tris = tess.tessellatePolygon(*bowtie.get(), 0, 4, std::vector< std::pair<unsigned,unsigned> >());
+        REQUIRE(!tris.valid());
+    }
+}
+
+TEST_CASE( "Benchmark: Tessellator on the bundled coastlines", "[.benchmark]" ) {
+
+    const char* urls[2] = { "../data/usa.shp", "../data/world.shp" };
+    for(unsigned u=0; u<2; ++u)
+    {
+        std::vector< osg::ref_ptr<osg::Geometry> > polygons;
+        readPolygons(urls[u], polygons);
+        REQUIRE(!polygons.empty());
+
+        std::vector< osg::ref_ptr<osg::Geometry> > ours, theirs;
+        for(unsigned i=0; i<polygons.size(); ++i)
+        {
+            ours.push_back(copyOf(polygons[i].get()));
+            theirs.push_back(copyOf(polygons[i].get()));
+        }
+
+        unsigned tessellated = 0u;
+        osg::Timer_t t0 = osg::Timer::instance()->tick();
+        for(unsigned i=0; i<ours.size(); ++i)
+        {
+            Tessellator tess;
+            if ( tess.tessellateGeometry(*ours[i].get()) )
+                ++tessellated;
+        }
+        double s = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+
+        t0 = osg::Timer::instance()->tick();
+        for(unsigned i=0; i<theirs.size(); ++i)
+        {
+            osgUtil::Tessellator tess;
+            tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
+            tess.setWindingType( osgUtil::Tessellator::TESS_WINDING_POSITIVE );
+            tess.retessellatePolygons( *theirs[i].get() );
+        }
+        double sUtil = osg::Timer::instance()->delta_s(t0, osg::Timer::instance()->tick());
+
+        REQUIRE(tessellated > 0u);
+        WARN(urls[u] << ": " << tessellated << " of " << polygons.size() << " features tessellated in " << s
+            << " s; osgUtil::Tessellator " << sUtil << " s");
+    }
+}
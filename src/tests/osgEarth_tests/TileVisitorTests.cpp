@@ -0,0 +1,298 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/TileVisitor>
+#include <osgEarth/Registry>
+#include <osgEarth/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <OpenThreads/Atomic>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace TileVisitorTest
+{
+    /** Counts the tiles it is asked to handle. */
+    class CountingHandler : public TileHandler
+    {
+    public:
+        bool handleTile(const TileKey& key, const TileVisitor& tv)
+        {
+            ++_count;
+            return true;
+        }
+
+        bool hasData(const TileKey& key) const
+        {
+            return true;
+        }
+
+        OpenThreads::Atomic _count;
+    };
+
+    /** Fails one tile until told otherwise; counts the tiles it is asked to handle. */
+    class FailingHandler : public CountingHandler
+    {
+    public:
+        FailingHandler(const TileKey& failing) : _failing(failing), _fail(true) { }
+
+        bool handleTile(const TileKey& key, const TileVisitor& tv)
+        {
+            CountingHandler::handleTile(key, tv);
+            return !(_fail && key == _failing);
+        }
+
+        TileKey _failing;
+        bool    _fail;
+    };
+
+    /** Records the order in which tiles are handled; one subtree has no data. */
+    class RecordingHandler : public TileHandler
+    {
+    public:
+        RecordingHandler(const TileKey& empty) : _empty(empty) { }
+
+        bool handleTile(const TileKey& key, const TileVisitor& tv)
+        {
+            _keys.push_back(key);
+            return true;
+        }
+
+        bool hasData(const TileKey& key) const
+        {
+            return !_empty.valid() ||
+                key.getLevelOfDetail() < _empty.getLevelOfDetail() ||
+                key.createAncestorKey(_empty.getLevelOfDetail()) != _empty;
+        }
+
+        TileKey              _empty;
+        std::vector<TileKey> _keys;
+    };
+
+    /** Number of times consecutive tiles are on different levels. */
+    unsigned levelSwitches(const std::vector<TileKey>& keys)
+    {
+        unsigned count = 0;
+        for(unsigned i=1; i<keys.size(); ++i)
+            if ( keys[i].getLevelOfDetail() != keys[i-1].getLevelOfDetail() )
+                ++count;
+        return count;
+    }
+
+    /** Largest distance (in tiles) between consecutive tiles on the given level. */
+    unsigned maxStep(const std::vector<TileKey>& keys, unsigned lod)
+    {
+        unsigned result = 0;
+        const TileKey* prev = 0L;
+        for(unsigned i=0; i<keys.size(); ++i)
+        {
+            if ( keys[i].getLevelOfDetail() != lod )
+                continue;
+            if ( prev )
+            {
+                int dx = (int)keys[i].getTileX() - (int)prev->getTileX();
+                int dy = (int)keys[i].getTileY() - (int)prev->getTileY();
+                result = osg::maximum(result, (unsigned)(::abs(dx) + ::abs(dy)));
+            }
+            prev = &keys[i];
+        }
+        return result;
+    }
+}
+
+TEST_CASE( "TileVisitor resumes from a journal" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    std::string filename = getTempName(osgDB::concatPaths(getTempPath(), "tilevisitor"), ".journal");
+
+    // two root tiles, and three levels: 2 + 8 + 32
+    const unsigned numTiles = 42u;
+
+    osg::ref_ptr<TileVisitorTest::CountingHandler> handler = new TileVisitorTest::CountingHandler();
+    osg::ref_ptr<TileVisitor> visitor = new TileVisitor(handler.get());
+    visitor->setMinLevel(0);
+    visitor->setMaxLevel(2);
+
+    {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(filename);
+        REQUIRE(journal->open());
+        REQUIRE(journal->getNumResumed() == 0u);
+        visitor->setJournal(journal.get());
+        visitor->run(profile);
+        visitor->setJournal(0L);
+    }
+    REQUIRE((unsigned)handler->_count == numTiles);
+
+    // simulate a crash in the middle of writing a record:
+    {
+        std::ofstream out(filename.c_str(), std::ios::app);
+        out << "2, 1";
+    }
+
+    SECTION("Finished tiles are not handled again") {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(filename);
+        REQUIRE(journal->open());
+        REQUIRE(journal->getNumResumed() == numTiles);
+
+        REQUIRE(journal->find(TileKey(2, 3, 1, profile)));
+        REQUIRE(!journal->find(TileKey(3, 0, 0, profile)));
+
+        visitor->setJournal(journal.get());
+        visitor->run(profile);
+        visitor->setJournal(0L);
+        REQUIRE((unsigned)handler->_count == numTiles);
+    }
+
+    SECTION("New levels are handled after resuming") {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(filename);
+        REQUIRE(journal->open());
+
+        visitor->setMaxLevel(3);
+        visitor->setJournal(journal.get());
+        visitor->run(profile);
+        visitor->setJournal(0L);
+        REQUIRE((unsigned)handler->_count == numTiles + 128u);
+    }
+
+    ::remove(filename.c_str());
+}
+
+TEST_CASE( "A resumed MultithreadedTileVisitor retries failed tiles only" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+    std::string filename = getTempName(osgDB::concatPaths(getTempPath(), "tilevisitor_mt"), ".journal");
+    const unsigned numTiles = 2u + 8u + 32u;
+    TileKey failing(1, 0, 0, profile);
+
+    osg::ref_ptr<TileVisitorTest::FailingHandler> handler = new TileVisitorTest::FailingHandler(failing);
+    osg::ref_ptr<MultithreadedTileVisitor> visitor = new MultithreadedTileVisitor(handler.get());
+    visitor->setNumThreads(4);
+    visitor->setMinLevel(0);
+    visitor->setMaxLevel(2);
+
+    {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(filename);
+        REQUIRE(journal->open());
+        visitor->setJournal(journal.get());
+        visitor->run(profile);
+        visitor->setJournal(0L);
+    }
+
+    // the live run queues the children of the failed tile regardless
+    REQUIRE((unsigned)handler->_count == numTiles);
+
+    {
+        osg::ref_ptr<TileJournal> journal = new TileJournal(filename);
+        REQUIRE(journal->open());
+        REQUIRE(journal->getNumResumed() == numTiles - 1u);
+        REQUIRE(!journal->find(failing));
+        REQUIRE(journal->find(failing.createChildKey(0)));
+
+        handler->_fail = false;
+        visitor->setJournal(journal.get());
+        visitor->run(profile);
+        visitor->setJournal(0L);
+    }
+
+    // only the failed tile was handled again
+    REQUIRE((unsigned)handler->_count == numTiles + 1u);
+
+    ::remove(filename.c_str());
+}
+
+TEST_CASE( "MultithreadedTileVisitor handles every tile through a bounded queue" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<TileVisitorTest::CountingHandler> handler = new TileVisitorTest::CountingHandler();
+    osg::ref_ptr<MultithreadedTileVisitor> visitor = new MultithreadedTileVisitor(handler.get());
+    visitor->setNumThreads(4);
+    visitor->setMaxQueueSize(2);
+    visitor->setMinLevel(0);
+    visitor->setMaxLevel(3);
+    visitor->run(profile);
+
+    REQUIRE((unsigned)handler->_count == 2u + 8u + 32u + 128u);
+
+    std::vector<TileVisitor::LevelStats> stats;
+    visitor->getLevelStats(stats);
+    REQUIRE(stats.size() == 4u);
+    REQUIRE(stats[3].processed == 128u);
+}
+
+TEST_CASE( "TileVisitor traverses along a space-filling curve" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    SECTION("Hilbert order keeps consecutive tiles together") {
+        osg::ref_ptr<TileVisitorTest::RecordingHandler> depthFirst = new TileVisitorTest::RecordingHandler(TileKey::INVALID);
+        osg::ref_ptr<TileVisitor> visitor = new TileVisitor(depthFirst.get());
+        visitor->setMaxLevel(5);
+        visitor->run(profile);
+
+        osg::ref_ptr<TileVisitorTest::RecordingHandler> hilbert = new TileVisitorTest::RecordingHandler(TileKey::INVALID);
+        visitor->setTileHandler(hilbert.get());
+        visitor->setTraversalOrder(TileVisitor::ORDER_HILBERT);
+        visitor->setWorkingSetSize(256);
+        visitor->run(profile);
+
+        REQUIRE(depthFirst->_keys.size() == 2730u);
+        REQUIRE(hilbert->_keys.size() == 2730u);
+
+        // every tile on the bottom level is next to the one before it:
+        REQUIRE(TileVisitorTest::maxStep(hilbert->_keys, 5) == 1u);
+        REQUIRE(TileVisitorTest::maxStep(depthFirst->_keys, 5) > 1u);
+
+        // and the chunks are visited a level at a time:
+        REQUIRE(TileVisitorTest::levelSwitches(hilbert->_keys) * 4u < TileVisitorTest::levelSwitches(depthFirst->_keys));
+    }
+
+    SECTION("Tiles without data prune their children in every order") {
+        TileKey empty(2, 3, 1, profile);
+
+        osg::ref_ptr<TileVisitorTest::RecordingHandler> depthFirst = new TileVisitorTest::RecordingHandler(empty);
+        osg::ref_ptr<TileVisitor> visitor = new TileVisitor(depthFirst.get());
+        visitor->setMaxLevel(4);
+        visitor->run(profile);
+
+        osg::ref_ptr<TileVisitorTest::RecordingHandler> zorder = new TileVisitorTest::RecordingHandler(empty);
+        visitor->setTileHandler(zorder.get());
+        visitor->setTraversalOrder(TileVisitor::ORDER_Z);
+        visitor->setWorkingSetSize(16);
+        visitor->run(profile);
+
+        // 2 + 8 + 32 + 128 + 512, less the empty tile and its 4 + 16 descendants
+        REQUIRE(depthFirst->_keys.size() == 682u - 21u);
+        REQUIRE(zorder->_keys.size() == depthFirst->_keys.size());
+
+        std::set<TileKey> a(depthFirst->_keys.begin(), depthFirst->_keys.end());
+        std::set<TileKey> b(zorder->_keys.begin(), zorder->_keys.end());
+        REQUIRE(a == b);
+    }
+}